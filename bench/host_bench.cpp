@@ -0,0 +1,94 @@
+// Host benchmark of the hot paths, build with `make bench` (defines ADS7828_HOST)
+// The simulated DWT counts the bus time of every transfer at 72 MHz, the host time shows the CPU cost of the driver
+#include "ADS7828.hpp"
+
+#include <chrono>
+#include <stdio.h>
+
+// Iterations per measurement
+constexpr uint32_t BENCH_RUNS = 4096;
+
+I2C_HandleTypeDef hi2c1 = {};
+ADS7828_Pooled<> adc = ADS7828_Pooled<>(&hi2c1, 0x48);
+
+// Batch DMA reads complete from ADS7828_host_run
+static volatile bool batch_done = false;
+
+extern "C"
+{
+	void HAL_I2C_MasterTxCpltCallback(I2C_HandleTypeDef *hi2c) { adc.tx_complete_callback(hi2c); }
+	void HAL_I2C_MasterRxCpltCallback(I2C_HandleTypeDef *hi2c) { adc.rx_complete_callback(hi2c); }
+	void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c) { adc.error_callback(hi2c); }
+}
+
+static void on_batch(void *, HAL_StatusTypeDef, uint16_t *, size_t)
+{
+	batch_done = true;
+}
+
+/**
+ * @brief Reads a batch with DMA and runs the simulated bus until it completes
+ * @param channels Channels to read
+ * @param out Buffer for the 8 digits
+ */
+static void read_batch_dma(const ADS7828_CHANNEL *channels, uint16_t *out)
+{
+	batch_done = false;
+	if (adc.start_read_channels_dma(channels, 8, out, on_batch) != HAL_OK)
+	{
+		return;
+	}
+	while (!batch_done && ADS7828_host_run(1) != 0)
+	{
+	}
+}
+
+/**
+ * @brief Prints the simulated cycles and the host time per operation
+ * @param name Name of the measured operation
+ * @param per_run Operations per call of run, e.g. the channels of a batch
+ * @param run Measured operation
+ */
+template <typename F>
+static void measure(const char *name, uint32_t per_run, F run)
+{
+	auto host_start = std::chrono::steady_clock::now();
+	uint32_t start = ADS7828::get_cycles();
+	for (uint32_t i = 0; i < BENCH_RUNS; i++)
+	{
+		run();
+	}
+	uint32_t cycles = ADS7828::get_cycles() - start;
+	auto host_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - host_start).count();
+
+	uint32_t ops = BENCH_RUNS * per_run;
+	printf("%-24s %8lu cycles %8.1f ns host\n", name, (unsigned long)(cycles / ops), (double)host_ns / ops);
+}
+
+int main()
+{
+	hi2c1.Init.ClockSpeed = 400000;
+	HAL_I2C_Init(&hi2c1);
+	ADS7828_host_attach(0x48);
+	for (uint8_t channel = 0; channel < ADS7828_CHANNELS; channel++)
+	{
+		ADS7828_host_set_digit(0x48, channel, 500 + 400 * channel);
+	}
+	ADS7828_host_set_noise(2);
+	adc.set_averaging(CHANNEL_1_COM, 16);
+
+	printf("Per read at %lu Hz, DWT at %lu MHz\n", (unsigned long)hi2c1.Init.ClockSpeed, (unsigned long)(SystemCoreClock / 1000000));
+
+	volatile float sink = 0;
+	measure("read_digit", 1, [&] { sink = adc.read_digit(CHANNEL_0_COM); });
+	measure("read_voltage", 1, [&] { sink = adc.read_voltage(CHANNEL_0_COM); });
+	measure("read_digit averaged 16", 1, [&] { sink = adc.read_digit(CHANNEL_1_COM); });
+	measure("read_millivolts", 1, [&] { sink = (float)adc.read_millivolts(CHANNEL_0_COM); });
+
+	const ADS7828_CHANNEL channels[] = {CHANNEL_0_COM, CHANNEL_1_COM, CHANNEL_2_COM, CHANNEL_3_COM, CHANNEL_4_COM, CHANNEL_5_COM, CHANNEL_6_COM, CHANNEL_7_COM};
+	uint16_t out[ADS7828_CHANNELS];
+	measure("read_channels x8", 8, [&] { adc.read_channels(channels, 8, out); });
+	measure("read_channels_dma x8", 8, [&] { read_batch_dma(channels, out); });
+	(void)sink;
+	return 0;
+}
@@ -0,0 +1,118 @@
+// Host soak run of the scan engine with injected bus faults, build with `make soak` (defines ADS7828_HOST)
+// Usage: ./host_soak [seconds of simulated time, default 60]
+#include "ADS7828_soak.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Faults of a busy bus, injected into every transfer
+constexpr uint16_t SOAK_NACK_PERMILLE = 5;
+constexpr uint16_t SOAK_ARLO_PERMILLE = 2;
+constexpr uint32_t SOAK_STRETCH_US = 20;
+
+// Two devices, each on its own bus
+I2C_HandleTypeDef hi2c1 = {};
+I2C_HandleTypeDef hi2c2 = {};
+ADS7828 adc1 = ADS7828(&hi2c1, 0x48);
+ADS7828 adc2 = ADS7828(&hi2c2, 0x49);
+ADS7828_Scanner scanner1 = ADS7828_Scanner(&adc1);
+ADS7828_Scanner scanner2 = ADS7828_Scanner(&adc2);
+ADS7828_Soak soak;
+
+// Every driver ignores the callbacks of the other handle
+extern "C"
+{
+	void HAL_I2C_MasterTxCpltCallback(I2C_HandleTypeDef *hi2c)
+	{
+		adc1.tx_complete_callback(hi2c);
+		adc2.tx_complete_callback(hi2c);
+	}
+
+	void HAL_I2C_MasterRxCpltCallback(I2C_HandleTypeDef *hi2c)
+	{
+		adc1.rx_complete_callback(hi2c);
+		adc2.rx_complete_callback(hi2c);
+	}
+
+	void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c)
+	{
+		adc1.error_callback(hi2c);
+		adc2.error_callback(hi2c);
+	}
+}
+
+/**
+ * @brief Prints the report of the soak run
+ * @param report Report from ADS7828_Soak::get_report
+ */
+static void print_report(const ADS7828_soak_report_t &report)
+{
+	printf("elapsed      %lu ms\n", (unsigned long)report.elapsed_ms);
+	printf("frames       %lu\n", (unsigned long)report.frames);
+	printf("samples      %lu\n", (unsigned long)report.samples);
+	printf("dropped      %lu\n", (unsigned long)report.dropped);
+	printf("retried      %lu\n", (unsigned long)report.retried);
+	printf("restarts     %lu\n", (unsigned long)report.restarts);
+	printf("recoveries   %lu, mean %lu us, max %lu us\n", (unsigned long)report.recoveries, (unsigned long)report.recovery_mean_us, (unsigned long)report.recovery_max_us);
+	printf("interval max %lu us\n", (unsigned long)report.interval_max_us);
+	for (uint8_t i = 0; i < ADS7828_SOAK_BUCKETS; i++)
+	{
+		if (report.histogram[i] == 0)
+		{
+			continue;
+		}
+		if (i == ADS7828_SOAK_BUCKETS - 1)
+		{
+			printf("  >= %6lu us %lu\n", 1UL << (i - 1), (unsigned long)report.histogram[i]);
+		}
+		else
+		{
+			printf("  <  %6lu us %lu\n", 1UL << i, (unsigned long)report.histogram[i]);
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t seconds = (argc > 1) ? (uint32_t)strtoul(argv[1], nullptr, 10) : 60;
+
+	hi2c1.Init.ClockSpeed = 400000;
+	hi2c2.Init.ClockSpeed = 400000;
+	HAL_I2C_Init(&hi2c1);
+	HAL_I2C_Init(&hi2c2);
+	ADS7828_host_attach(0x48);
+	ADS7828_host_attach(0x49);
+	for (uint8_t channel = 0; channel < ADS7828_CHANNELS; channel++)
+	{
+		ADS7828_host_set_digit(0x48, channel, 100 + 500 * channel);
+		ADS7828_host_set_digit(0x49, channel, 4000 - 500 * channel);
+	}
+	ADS7828_host_set_noise(2);
+	ADS7828_host_set_faults(SOAK_NACK_PERMILLE, SOAK_ARLO_PERMILLE, SOAK_STRETCH_US);
+
+	soak.attach(&scanner1);
+	soak.attach(&scanner2);
+	if (soak.start() != HAL_OK)
+	{
+		printf("soak start failed\n");
+		return 1;
+	}
+
+	// HAL_GetTick follows the simulated bus time
+	uint32_t start = HAL_GetTick();
+	while (HAL_GetTick() - start < seconds * 1000)
+	{
+		if (ADS7828_host_run(1) == 0)
+		{
+			ADS7828_host_advance_us(100);
+		}
+		soak.poll();
+	}
+	soak.stop();
+	ADS7828_host_run(8);
+
+	ADS7828_soak_report_t report;
+	soak.get_report(report);
+	print_report(report);
+	return 0;
+}
@@ -26,11 +26,34 @@
 
 /* Private typedef -----------------------------------------------------------*/
 /* USER CODE BEGIN PTD */
-
+enum BENCH_MODE
+{
+	BENCH_BLOCKING,		  // read() with STOP between command and result
+	BENCH_REPEATED_START, // read() with a repeated start
+	BENCH_DMA,			  // start_read_dma(), chained from the callback
+	BENCH_BATCH_DMA,	  // start_read_channels_dma() over BENCH_BATCH channels
+	BENCH_STREAM,		  // stream_channel(), command only sent once
+	BENCH_MODES
+};
+
+struct bench_result_t
+{
+	uint32_t clock_hz;			 // I2C SCL frequency
+	uint32_t samples;			 // Digits read
+	uint32_t errors;			 // Reads that did not return HAL_OK
+	uint32_t cycles;			 // DWT cycles of the whole run
+	uint32_t cycles_per_sample;	 // DWT cycles per digit
+	uint32_t samples_per_s;		 // Sustained throughput
+	uint32_t cpu_load_permille; // Share of the run the CPU was not idle, 1000 for the blocking modes
+};
 /* USER CODE END PTD */
 
 /* Private define ------------------------------------------------------------*/
 /* USER CODE BEGIN PD */
+// Samples per benchmark run
+#define BENCH_SAMPLES 512
+// Channel configurations of one batch run
+#define BENCH_BATCH 8
 /* USER CODE END PD */
 
 /* Private macro -------------------------------------------------------------*/
@@ -40,22 +63,202 @@
 
 /* Private variables ---------------------------------------------------------*/
  I2C_HandleTypeDef hi2c1;
+DMA_HandleTypeDef hdma_i2c1_rx;
+DMA_HandleTypeDef hdma_i2c1_tx;
 
 /* USER CODE BEGIN PV */
-
+// I2C clocks of the benchmark
+static const ADS7828_BUS_SPEED bench_clocks[] = {BUS_STANDARD, BUS_FAST};
+#define BENCH_CLOCKS (sizeof(bench_clocks) / sizeof(bench_clocks[0]))
+
+// Results of the last benchmark pass, read them with the debugger (e.g. Live Expressions)
+volatile bench_result_t bench_results[BENCH_CLOCKS][BENCH_MODES];
+volatile uint32_t bench_passes = 0;
+
+static ADS7828 *bench_adc = nullptr;
+static uint16_t bench_buffer[BENCH_SAMPLES];
+static const ADS7828_CHANNEL bench_channels[BENCH_BATCH] = {CHANNEL_0_COM, CHANNEL_1_COM, CHANNEL_2_COM, CHANNEL_3_COM,
+															 CHANNEL_4_COM, CHANNEL_5_COM, CHANNEL_6_COM, CHANNEL_7_COM};
+static volatile bool bench_done;
+static volatile uint32_t bench_count;
+static volatile uint32_t bench_errors;
+// DWT cycles of one iteration of bench_idle
+static uint32_t bench_idle_cycles = 1;
 /* USER CODE END PV */
 
 /* Private function prototypes -----------------------------------------------*/
 void SystemClock_Config(void);
 static void MX_GPIO_Init(void);
+static void MX_DMA_Init(void);
 static void MX_I2C1_Init(void);
 /* USER CODE BEGIN PFP */
-
+static void bench_run(ADS7828_BUS_SPEED speed, volatile bench_result_t *results);
 /* USER CODE END PFP */
 
 /* Private user code ---------------------------------------------------------*/
 /* USER CODE BEGIN 0 */
+// The driver needs the HAL I2C callbacks for the DMA reads
+extern "C" void HAL_I2C_MasterTxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+	bench_adc->tx_complete_callback(hi2c);
+}
+
+extern "C" void HAL_I2C_MasterRxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+	bench_adc->rx_complete_callback(hi2c);
+}
+
+extern "C" void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c)
+{
+	bench_adc->error_callback(hi2c);
+}
+
+/**
+ * Counts loop iterations until the running asynchronous benchmark is done
+ *
+ * @param limit Maximum number of iterations
+ * @return Number of iterations
+ */
+static uint32_t bench_idle(uint32_t limit)
+{
+	uint32_t n = 0;
+	while (!bench_done && n < limit)
+	{
+		n++;
+	}
+	return n;
+}
+
+static void bench_dma_callback(void *context, ADS7828_CHANNEL channel, HAL_StatusTypeDef status, ADS7828_digit_t digit)
+{
+	(void)context;
+	(void)digit;
+
+	if (status != HAL_OK)
+	{
+		bench_errors = bench_errors + 1;
+	}
+
+	bench_count = bench_count + 1;
+	if (bench_count >= BENCH_SAMPLES || bench_adc->start_read_dma(channel, bench_dma_callback) != HAL_OK)
+	{
+		bench_done = true;
+	}
+}
+
+static void bench_batch_callback(void *context, HAL_StatusTypeDef status, uint16_t *out, size_t count)
+{
+	(void)context;
+	(void)count;
+
+	if (status != HAL_OK)
+	{
+		bench_errors = bench_errors + BENCH_BATCH;
+	}
+
+	bench_count = bench_count + BENCH_BATCH;
+	if (bench_count >= BENCH_SAMPLES || bench_adc->start_read_channels_dma(bench_channels, BENCH_BATCH, out, bench_batch_callback) != HAL_OK)
+	{
+		bench_done = true;
+	}
+}
+
+static void bench_stream_callback(void *context, ADS7828_CHANNEL channel, HAL_StatusTypeDef status, uint16_t *data, size_t count)
+{
+	(void)context;
+	(void)channel;
+	(void)status;
+	(void)data;
+
+	bench_count = count;
+	bench_errors = BENCH_SAMPLES - count;
+	bench_done = true;
+}
 
+/**
+ * Runs one benchmark mode and stores the throughput and CPU load
+ *
+ * @param mode The BENCH_MODE to run
+ * @param result Receives the measurement
+ */
+static void bench_mode(BENCH_MODE mode, volatile bench_result_t *result)
+{
+	bench_done = false;
+	bench_count = 0;
+	bench_errors = 0;
+	uint32_t idle = 0;
+	HAL_StatusTypeDef status = HAL_OK;
+
+	uint32_t start = ADS7828::get_cycles();
+	switch (mode)
+	{
+	case BENCH_BLOCKING:
+	case BENCH_REPEATED_START:
+		bench_adc->set_repeated_start(mode == BENCH_REPEATED_START);
+		for (uint32_t i = 0; i < BENCH_SAMPLES; i++)
+		{
+			if (bench_adc->read(CHANNEL_0_COM, bench_buffer[i]) != HAL_OK)
+			{
+				bench_errors = bench_errors + 1;
+			}
+		}
+		bench_count = BENCH_SAMPLES;
+		bench_adc->set_repeated_start(false);
+		break;
+	case BENCH_DMA:
+		status = bench_adc->start_read_dma(CHANNEL_0_COM, bench_dma_callback);
+		break;
+	case BENCH_BATCH_DMA:
+		status = bench_adc->start_read_channels_dma(bench_channels, BENCH_BATCH, bench_buffer, bench_batch_callback);
+		break;
+	case BENCH_STREAM:
+		status = bench_adc->stream_channel(CHANNEL_0_COM, bench_buffer, BENCH_SAMPLES, bench_stream_callback);
+		break;
+	default:
+		break;
+	}
+
+	if (mode >= BENCH_DMA)
+	{
+		if (status == HAL_OK)
+		{
+			idle = bench_idle(UINT32_MAX);
+		}
+		else
+		{
+			bench_errors = BENCH_SAMPLES;
+		}
+	}
+	uint32_t cycles = ADS7828::get_cycles() - start;
+
+	uint32_t idle_cycles = idle * bench_idle_cycles;
+	result->samples = bench_count;
+	result->errors = bench_errors;
+	result->cycles = cycles;
+	result->cycles_per_sample = bench_count ? cycles / bench_count : 0;
+	result->samples_per_s = cycles ? (uint32_t)((uint64_t)bench_count * SystemCoreClock / cycles) : 0;
+	result->cpu_load_permille = (cycles && idle_cycles < cycles) ? 1000 - (uint32_t)((uint64_t)idle_cycles * 1000 / cycles) : 0;
+}
+
+/**
+ * Reconfigures the I2C peripheral for a bus speed and runs all benchmark modes
+ *
+ * @param speed The ADS7828_BUS_SPEED to benchmark
+ * @param results Receives BENCH_MODES measurements
+ */
+static void bench_run(ADS7828_BUS_SPEED speed, volatile bench_result_t *results)
+{
+	if (bench_adc->set_bus_speed(speed) != HAL_OK)
+	{
+		Error_Handler();
+	}
+
+	for (uint8_t mode = 0; mode < BENCH_MODES; mode++)
+	{
+		results[mode].clock_hz = speed;
+		bench_mode((BENCH_MODE)mode, &results[mode]);
+	}
+}
 /* USER CODE END 0 */
 
 /**
@@ -86,10 +289,19 @@ int main(void)
 
   /* Initialize all configured peripherals */
   MX_GPIO_Init();
+  MX_DMA_Init();
   MX_I2C1_Init();
   /* USER CODE BEGIN 2 */
 
   ADS7828 adc = ADS7828(&hi2c1, 0x48);
+  bench_adc = &adc;
+  ADS7828::enable_cycle_counter();
+
+  // Cycles of one idle iteration, used to calculate the CPU load of the asynchronous modes
+  bench_done = false;
+  uint32_t start = ADS7828::get_cycles();
+  bench_idle(10000);
+  bench_idle_cycles = (ADS7828::get_cycles() - start) / 10000;
 
   /* USER CODE END 2 */
 
@@ -97,7 +309,11 @@ int main(void)
   /* USER CODE BEGIN WHILE */
   while (1)
   {
-	 float voltage = adc.read_voltage(CHANNEL_0_COM);
+	 for (uint8_t i = 0; i < BENCH_CLOCKS; i++)
+	 {
+		 bench_run(bench_clocks[i], bench_results[i]);
+	 }
+	 bench_passes = bench_passes + 1;
 
 	 HAL_Delay(1000);
 
@@ -181,6 +397,25 @@ static void MX_I2C1_Init(void)
 
 }
 
+/**
+  * Enable DMA controller clock
+  */
+static void MX_DMA_Init(void)
+{
+
+  /* DMA controller clock enable */
+  __HAL_RCC_DMA1_CLK_ENABLE();
+
+  /* DMA interrupt init */
+  /* DMA1_Channel6_IRQn interrupt configuration */
+  HAL_NVIC_SetPriority(DMA1_Channel6_IRQn, 0, 0);
+  HAL_NVIC_EnableIRQ(DMA1_Channel6_IRQn);
+  /* DMA1_Channel7_IRQn interrupt configuration */
+  HAL_NVIC_SetPriority(DMA1_Channel7_IRQn, 0, 0);
+  HAL_NVIC_EnableIRQ(DMA1_Channel7_IRQn);
+
+}
+
 /**
   * @brief GPIO Initialization Function
   * @param None
@@ -1,4 +1,42 @@
 #include "ADS7828.hpp"
+#include <string.h>
+
+// Command bytes of all channel configurations for every power down mode, generated at compile time
+static constexpr ADS7828_command_table_t command_tables[4] = {
+	ADS7828_make_command_table(POWER_DOWN),
+	ADS7828_make_command_table(REF_OFF),
+	ADS7828_make_command_table(REF_ON_AD_OFF),
+	ADS7828_make_command_table(REF_ON_AD_ON),
+};
+static_assert(command_tables[REF_ON_AD_ON].command[CHANNEL_7_COM] == 0xFC, "Command table does not match the datasheet");
+
+// (k * digit) >> 16 for the block conversion, the Cortex-M4/M7 DSP extension multiplies 32 x 16 bits in one cycle
+#if defined(__ARM_FEATURE_DSP) && __ARM_FEATURE_DSP
+static inline int32_t mul_q16_lo(int32_t k, uint32_t pair)
+{
+	int32_t result;
+	__asm("smulwb %0, %1, %2" : "=r"(result) : "r"(k), "r"(pair));
+	return result;
+}
+
+static inline int32_t mul_q16_hi(int32_t k, uint32_t pair)
+{
+	int32_t result;
+	__asm("smulwt %0, %1, %2" : "=r"(result) : "r"(k), "r"(pair));
+	return result;
+}
+#else
+static inline int32_t mul_q16(int32_t k, uint16_t digit)
+{
+	return (int32_t)(((int64_t)k * digit) >> 16);
+}
+#endif
+
+// value / divisor rounded half away from zero, for the fixed-point configuration
+static inline int64_t div_round(int64_t value, int64_t divisor)
+{
+	return ((value < 0) == (divisor < 0)) ? (value + divisor / 2) / divisor : (value - divisor / 2) / divisor;
+}
 
 /**
  * Constructor for ADS7828 object
@@ -6,7 +44,7 @@
  * @param hi2c Pointer to an initialized I2C_HandleTypeDef for the I2C commands
  * @param address I2C address of the device, default is 0x48 for AD0 = AD1 = 0
  */
-ADS7828::ADS7828(I2C_HandleTypeDef *hi2c, uint8_t address) : _hi2c(hi2c), _address(address)
+ADS7828::ADS7828(I2C_HandleTypeDef *hi2c, uint8_t address) : _address(address), _hi2c(hi2c), _bus(hi2c)
 {
 	init();
 
@@ -14,6 +52,7 @@ ADS7828::ADS7828(I2C_HandleTypeDef *hi2c, uint8_t address) : _hi2c(hi2c), _addre
 	set_power_mode(REF_ON_AD_ON);
 }
 
+#ifndef ADS7828_INTEGER_ONLY
 /**
  * Constructor for ADS7828 object for usage with external reference voltage.
  * Implicitly changes the power down mode to disable the internal voltage reference!
@@ -22,30 +61,115 @@ ADS7828::ADS7828(I2C_HandleTypeDef *hi2c, uint8_t address) : _hi2c(hi2c), _addre
  * @param address I2C address of the device, default is 0x48 for AD0 = AD1 = 0
  * @param external_ref_voltage The external reference voltage (in Volts) connected to the ADC, should be between 0.05V and 5V
  */
-ADS7828::ADS7828(I2C_HandleTypeDef *hi2c, uint8_t address, float external_ref_voltage) : _hi2c(hi2c), _address(address)
+ADS7828::ADS7828(I2C_HandleTypeDef *hi2c, uint8_t address, float external_ref_voltage) : _address(address), _hi2c(hi2c), _bus(hi2c)
 {
 	init();
 	set_ref_voltage_external(external_ref_voltage);
 }
+#endif
+
+#ifdef ADS7828_DYNAMIC_MEM
+/**
+ * Constructor for ADS7828 object with a pool for the averaging buffers, see ADS7828_Pooled for a driver that owns its pool
+ *
+ * @param hi2c Pointer to an initialized I2C_HandleTypeDef for the I2C commands
+ * @param address I2C address of the device, default is 0x48 for AD0 = AD1 = 0
+ * @param pool Storage the averaging buffers of all channels are carved from, has to live as long as the driver
+ * @param pool_size Number of values in the pool
+ */
+ADS7828::ADS7828(I2C_HandleTypeDef *hi2c, uint8_t address, uint16_t *pool, uint16_t pool_size) : ADS7828(hi2c, address)
+{
+	_avg_pool = pool;
+	_avg_pool_size = (pool != nullptr) ? pool_size : 0;
+}
+#endif
+
+/**
+ * Move constructor, e.g. to return a driver from a factory function or to place it into an array.
+ * The whole state is taken over without bus traffic, the averaging buffers stay in the pool given at construction.
+ * Scanners, buses and forwarded callbacks hold their pointer to the old object, so move a driver before handing it out
+ * and never while an asynchronous transfer is running.
+ *
+ * @param other Driver to take the state from, keeps a valid copy of its configuration
+ */
+ADS7828::ADS7828(ADS7828 &&other) : ADS7828(static_cast<const ADS7828 &>(other))
+{
+}
 
-ADS7828::~ADS7828()
+/**
+ * Move assignment, see the move constructor
+ *
+ * @param other Driver to take the state from, keeps a valid copy of its configuration
+ * @return This driver
+ */
+ADS7828 &ADS7828::operator=(ADS7828 &&other)
 {
+	if (this != &other)
+	{
+		*this = static_cast<const ADS7828 &>(other);
+	}
+
+	return *this;
+}
+
 #ifdef ADS7828_DYNAMIC_MEM
-	for (uint8_t c = 0; c < ADS7828_CHANNELS; c++)
+/**
+ * Copies the carved averaging buffers into another pool of the same size and points the buffers there,
+ * e.g. after the members were taken over from a driver with its own pool
+ *
+ * @param pool New storage of the pool, at least as large as the current one
+ */
+void ADS7828::move_pool(uint16_t *pool)
+{
+	for (uint16_t i = 0; i < _avg_pool_used; i++)
 	{
-		delete[] _buffers[c].data;
+		pool[i] = _avg_pool[i];
 	}
-#endif
+
+	for (uint8_t s = 0; s < ADS7828_SLOTS; s++)
+	{
+		if (_buffers[s].data != nullptr)
+		{
+			_buffers[s].data = pool + (_buffers[s].data - _avg_pool);
+		}
+	}
+
+	_avg_pool = pool;
 }
+#endif
 
 /**
  * ADC class initialisation
  */
 void ADS7828::init()
 {
-	reset_scaling();
+	memset(_slots, ADS7828_NO_SLOT, sizeof(_slots));
+	memset(_slot_channels, ADS7828_NO_SLOT, sizeof(_slot_channels));
+	memset(_conv_channels, ADS7828_NO_SLOT, sizeof(_conv_channels));
+	apply_power_mode(_pd_mode);
+	update_conversion();
+
+#if defined(ADS7828_I2C_V2)
+	// Estimate the clock from the timing register, assumes the I2C is clocked from PCLK1
+	if (_hi2c != nullptr && _hi2c->Init.Timing != 0)
+	{
+		uint32_t clock_hz = timing_to_clock(HAL_RCC_GetPCLK1Freq(), _hi2c->Init.Timing);
+		if (clock_hz != 0)
+		{
+			_bus_clock_hz = clock_hz;
+		}
+	}
+#else
+	// The I2C v1 peripheral is configured with the clock speed directly
+	if (_hi2c != nullptr && _hi2c->Init.ClockSpeed != 0)
+	{
+		_bus_clock_hz = _hi2c->Init.ClockSpeed;
+	}
+#endif
+	update_timeout();
 }
 
+#if !defined(ADS7828_ASYNC_ONLY) && !defined(ADS7828_INTEGER_ONLY)
 /**
  * Reads the voltage of a specified channel configuration.
  * Conversion from digits to voltage is done with the set reference voltage!
@@ -55,9 +179,47 @@ void ADS7828::init()
  */
 float ADS7828::read_voltage(ADS7828_CHANNEL channel)
 {
-	return (read_digit(channel) / 4095.0 * _ref_voltage * _scaling[channel]);
+	return digit_to_voltage(channel, read_digit(channel));
+}
+#endif
+
+#ifndef ADS7828_INTEGER_ONLY
+/**
+ * Converts a digit of a channel configuration to voltage with the set reference voltage and scaling,
+ * or looks it up in the conversion table of the channel (see set_lut)
+ *
+ * @param channel The ADS7828_CHANNEL configuration the digit belongs to
+ * @param digit The digit (0 - 4095), e.g. from an asynchronous read
+ * @return Voltage [V] of the digit
+ */
+float ADS7828::digit_to_voltage(ADS7828_CHANNEL channel, float digit)
+{
+	const ADS7828_conversion_t &conv = conversion(channel);
+
+	if (conv.lut != nullptr)
+	{
+		// Averaged and filtered digits are fractional, the table has one entry per integer digit
+		uint32_t index = (digit <= 0) ? 0 : (uint32_t)(digit + 0.5f);
+		return conv.lut->values[(index < ADS7828_LUT_SIZE) ? index : ADS7828_LUT_SIZE - 1];
+	}
+
+#ifndef ADS7828_SOFT_MATH
+	if (_ratio_channel == ADS7828_CHANNELS)
+	{
+		float gain = conv.scaling * (float)conv.cal_gain * (1.0f / (float)(1ULL << (ADS7828_SCALE_SHIFT + ADS7828_CAL_SHIFT)));
+		return (digit / 4095.0f * (_ref_uv * 1e-6f)) * gain + conv.cal_offset_uv * 1e-6f;
+	}
+#endif
+
+	// The fixed-point factor already holds reference, scaling, calibration and the ratiometric correction, the digit keeps its fraction
+	constexpr uint8_t shift = ADS7828_FIXED_SHIFT + ADS7828_AVG_FRAC_BITS;
+	int32_t value = (int32_t)(digit * (1 << ADS7828_AVG_FRAC_BITS) + ((digit < 0) ? -0.5f : 0.5f));
+	int64_t microvolts = ((int64_t)value * 1000 * conv.mv_factor + conv.mv_offset * (1000 << ADS7828_AVG_FRAC_BITS) + (1LL << (shift - 1))) >> shift;
+	return (int32_t)microvolts * 1e-6f;
 }
+#endif
 
+#if !defined(ADS7828_ASYNC_ONLY) && !defined(ADS7828_INTEGER_ONLY)
 /**
  * Reads the digit of a specified channel configuration.
  * ADS7828 has 12 Bit resolution, so values from 0 - 4095!
@@ -67,197 +229,3944 @@ float ADS7828::read_voltage(ADS7828_CHANNEL channel)
  */
 float ADS7828::read_digit(ADS7828_CHANNEL channel)
 {
-	uint8_t command = 0x00;
+	uint32_t start = stats_start();
+	uint16_t digit = 0;
+	transfer_digit(channel, digit);
 
-	command |= (((uint8_t)channel) << 4);
-	command |= (((uint8_t)_pd_mode) << 2);
+	float result = process_digit(channel, digit);
+	record_read(start);
+	record_latency(channel, start);
+	return result;
+}
+#endif
 
-	uint8_t data[2] = {0};
+#ifndef ADS7828_ASYNC_ONLY
+/**
+ * Reads the digit of a specified channel configuration and reports errors.
+ * On a timeout or stuck bus, the bus is recovered (if recovery pins are set) and the reading is repeated once.
+ * Failed readings do not update the averaging.
+ *
+ * @param channel The ADS7828_CHANNEL configuration you want the digit from
+ * @param out Receives the (rounded average) digit (0 - 4095), only written on success
+ * @return HAL_OK on success, otherwise the HAL status of the failed transfer
+ */
+HAL_StatusTypeDef ADS7828::read(ADS7828_CHANNEL channel, uint16_t &out)
+{
+	uint32_t start = stats_start();
+	uint16_t digit = 0;
+	HAL_StatusTypeDef status = transfer_digit(channel, digit);
+
+	// The recovery and the second attempt would exceed a latency budget
+	if ((status == HAL_TIMEOUT || status == HAL_BUSY) && !_busy && _scl_port != nullptr && _budget_us == 0)
+	{
+		if (recover_bus() == HAL_OK)
+		{
+			status = transfer_digit(channel, digit);
+			_last_quality = _last_quality | QUALITY_RETRIED;
+		}
+	}
 
-	HAL_I2C_Master_Transmit(_hi2c, (_address << 1), &command, 1, HAL_MAX_DELAY);
-	HAL_I2C_Master_Receive(_hi2c, (_address << 1), data, 2, HAL_MAX_DELAY);
+	if (status != HAL_OK)
+	{
+		return status;
+	}
 
-	uint16_t digit = (uint16_t)((data[0] << 8) + data[1]);
+	out = process_digit_int(channel, digit);
+	record_read(start);
+	record_latency(channel, start);
+	return HAL_OK;
+}
 
-	// No averaging
-	if (_buffers[channel].n <= 1)
+/**
+ * Reads the digit of a specified channel configuration with a timeout for this call only, see read(channel, out).
+ * E.g. a tight deadline for one critical channel on a fast bus, or a longer wait while another master loads the bus.
+ *
+ * @param channel The ADS7828_CHANNEL configuration you want the digit from
+ * @param out Receives the (rounded average) digit (0 - 4095), only written on success
+ * @param timeout_ms Timeout per HAL transfer of this reading in [ms], HAL_MAX_DELAY to wait forever
+ * @return HAL_OK on success, otherwise the HAL status of the failed transfer
+ */
+HAL_StatusTypeDef ADS7828::read(ADS7828_CHANNEL channel, uint16_t &out, uint32_t timeout_ms)
+{
+	uint32_t timeout = _timeout_ms;
+	_timeout_ms = timeout_ms;
+
+	HAL_StatusTypeDef status = read(channel, out);
+
+	_timeout_ms = timeout;
+	return status;
+}
+
+/**
+ * Reads the raw digit of a specified channel configuration without float conversion.
+ * Averaging is not applied and the averaging buffer is not updated!
+ *
+ * @param channel The ADS7828_CHANNEL configuration you want the digit from
+ * @param status Optional pointer that receives the HAL status of the transfer
+ * @return Measured ADC digit (0 - 4095), 0 if the transfer failed
+ */
+uint16_t ADS7828::read_raw(ADS7828_CHANNEL channel, HAL_StatusTypeDef *status)
+{
+	uint16_t digit = 0;
+	HAL_StatusTypeDef result = transfer_digit(channel, digit);
+
+	if (status != nullptr)
 	{
-		return digit;
+		*status = result;
 	}
 
-	// Update the buffer and calculate average
-	_buffers[channel].append(digit);
-	return _buffers[channel].average();
+	return digit;
 }
 
 /**
- * Set your external reference voltage for operation without the internal reference.
- * Implicitly switches the power down mode to turn the internal reference OFF!
+ * Reads the signed difference of a differential pair.
+ * A differential read clips at 0 when the voltage is reversed, so the pair is read in the polarity that
+ * worked last time and only read again in the other polarity if the result is 0.
+ * Each sign change costs one extra read, a steady input one read per call. Averaging is not applied.
  *
- * @param ref_voltage External reference voltage in [V]
+ * @param pair Any differential ADS7828_CHANNEL, e.g. CHANNEL_0_1 or CHANNEL_1_0 give the same result: Channel 0 - Channel 1
+ * @param out Receives the signed digit (-4095 - 4095), only written on success
+ * @return HAL_OK on success, HAL_ERROR for a single-ended channel, otherwise the HAL status of the failed transfer
  */
-void ADS7828::set_ref_voltage_external(float ref_voltage)
+HAL_StatusTypeDef ADS7828::read_signed(ADS7828_CHANNEL pair, int16_t &out)
 {
-	_ref_voltage = ref_voltage;
+	// Single-ended channels have the SD bit set
+	if (pair & 0b1000)
+	{
+		return HAL_ERROR;
+	}
+
+	// The normal polarity (CHANNEL_0_1 ...) has bit 2 cleared
+	ADS7828_CHANNEL normal = static_cast<ADS7828_CHANNEL>(pair & 0b0011);
+	uint8_t mask = 1U << normal;
+	bool reversed = _diff_reversed & mask;
 
-	if (_pd_mode == REF_OFF)
+	uint16_t digit = 0;
+	HAL_StatusTypeDef status = transfer_digit(reversed ? reverse_pair(normal) : normal, digit);
+
+	if (status == HAL_OK && digit == 0)
 	{
-		return;
+		reversed = !reversed;
+		status = transfer_digit(reversed ? reverse_pair(normal) : normal, digit);
 	}
 
-	// If you choose an external voltage reference we have to change the mode accordingly
-	set_power_mode(REF_OFF, true);
+	if (status != HAL_OK)
+	{
+		return status;
+	}
+
+	// Keep the polarity that gave a result, a 0 in both keeps the last one
+	if (digit != 0)
+	{
+		_diff_reversed = reversed ? (_diff_reversed | mask) : (_diff_reversed & ~mask);
+	}
+
+	out = reversed ? -(int16_t)digit : (int16_t)digit;
+	return HAL_OK;
 }
 
 /**
- * Set the reference voltage back to internal (2.5V).
- * Implicitly switches the power down mode to turn the internal reference ON!
+ * Reads the signed voltage of a differential pair in integer microvolts, see read_signed.
+ * The conversion (scaling, calibration) of the polarity that was read is used.
  *
- * @param ref_voltage External reference voltage in [V]
+ * @param pair Any differential ADS7828_CHANNEL, the result is the voltage of the first minus the second channel of CHANNEL_x_y with x < y
+ * @param status Optional pointer that receives the HAL status of the read
+ * @return Voltage [uV] of the pair, 0 if the read failed
  */
-void ADS7828::set_ref_voltage_internal()
+int32_t ADS7828::read_signed_microvolts(ADS7828_CHANNEL pair, HAL_StatusTypeDef *status)
 {
-	_ref_voltage = 2.5;
+	int16_t digit = 0;
+	HAL_StatusTypeDef result = read_signed(pair, digit);
 
-	// If you choose an internal voltage reference we have to change the mode accordingly
-	set_power_mode(REF_ON_AD_ON, true);
+	if (status != nullptr)
+	{
+		*status = result;
+	}
+
+	if (result != HAL_OK)
+	{
+		return 0;
+	}
+
+	ADS7828_CHANNEL normal = static_cast<ADS7828_CHANNEL>(pair & 0b0011);
+	if (digit < 0)
+	{
+		return -digit_to_microvolts(reverse_pair(normal), (uint16_t)-digit);
+	}
+
+	return digit_to_microvolts(normal, (uint16_t)digit);
 }
+#endif
 
 /**
- * Set the ADC power down mode (see datasheet for more info).
- * Implicitly switches the reference voltage to internal (2.5V) for modes with REF_ON_x
+ * Get the same differential pair with the opposite polarity, e.g. CHANNEL_1_0 for CHANNEL_0_1
  *
- * @param mode The mode you want to switch to
- * @param update_now If true, the mode is switched instantly by sending a command. Otherwise mode is changed with next read request!
+ * @param pair A differential ADS7828_CHANNEL
+ * @return The reversed pair, single-ended channels are returned unchanged
  */
-void ADS7828::set_power_mode(ADS7828_PD_MODE mode, bool update_now)
+ADS7828_CHANNEL ADS7828::reverse_pair(ADS7828_CHANNEL pair)
 {
-	_pd_mode = mode;
+	if (pair & 0b1000)
+	{
+		return pair;
+	}
 
-	// If you choose a mode with internal reference we have to set the voltage back
-	if (mode == REF_ON_AD_OFF || mode == REF_ON_AD_ON)
+	return static_cast<ADS7828_CHANNEL>(pair ^ 0b0100);
+}
+
+#ifndef ADS7828_ASYNC_ONLY
+/**
+ * Reads the averaged digit of a specified channel configuration as fixed-point value.
+ * The result has ADS7828_AVG_FRAC_BITS fractional bits, so the average keeps its precision in a uint16_t.
+ *
+ * @param channel The ADS7828_CHANNEL configuration you want the digit from
+ * @param status Optional pointer that receives the HAL status of the transfer
+ * @return Average of the last N digits (or the digit without averaging) * 2^ADS7828_AVG_FRAC_BITS, 0 if the transfer failed
+ */
+uint16_t ADS7828::read_average_fixed(ADS7828_CHANNEL channel, HAL_StatusTypeDef *status)
+{
+	uint16_t digit = 0;
+	HAL_StatusTypeDef result = transfer_digit(channel, digit);
+
+	if (status != nullptr)
 	{
-		set_ref_voltage_internal();
+		*status = result;
 	}
 
-	// To update the mode we have to transmit the command, so just do a random request
-	if (update_now)
+	// Failed readings must not end up in the average
+	if (result != HAL_OK)
+	{
+		return 0;
+	}
+
+	uint8_t slot = _slots[channel];
+
+	if (slot == ADS7828_NO_SLOT)
+	{
+		return (uint16_t)(digit << ADS7828_AVG_FRAC_BITS);
+	}
+
+	digit = reject_spikes(slot, digit);
+
+	if (_filters[slot].mode != FILTER_NONE)
+	{
+		constexpr uint8_t shift = ADS7828_FILTER_FRAC_BITS - ADS7828_AVG_FRAC_BITS;
+		return (uint16_t)((_filters[slot].update(digit) + (1 << (shift - 1))) >> shift);
+	}
+
+	ADS7828_circ_buf_t &buf = _buffers[slot];
+
+	if (buf.n <= 1)
 	{
-		read_digit(CHANNEL_0_COM);
+		return (uint16_t)(digit << ADS7828_AVG_FRAC_BITS);
 	}
+
+	buf.append(digit);
+	return (uint16_t)buf.divide(buf.sum << ADS7828_AVG_FRAC_BITS);
 }
 
 /**
- * Set the ADC power down mode (see datasheet for more info).
- * Implicitly switches the reference voltage to internal (2.5V) for modes with REF_ON_x
+ * Reads the voltage of a specified channel configuration in integer millivolts.
+ * Uses the precomputed fixed-point factor of the channel, so no float math is done per reading.
  *
- * @param mode The mode you want to switch to
+ * Failed readings do not update the averaging.
+ *
+ * @param channel The ADS7828_CHANNEL configuration you want the voltage from
+ * @param status Optional pointer that receives the HAL status of the transfer
+ * @return Measured ADC Voltage [mV] of given channel configuration, including scaling, 0 if the transfer failed
  */
-void ADS7828::set_power_mode(ADS7828_PD_MODE mode)
+int32_t ADS7828::read_millivolts(ADS7828_CHANNEL channel, HAL_StatusTypeDef *status)
 {
-	set_power_mode(mode, true);
+	uint16_t digit = 0;
+	HAL_StatusTypeDef result = transfer_digit(channel, digit);
+
+	if (status != nullptr)
+	{
+		*status = result;
+	}
+
+	// Failed readings must not end up in the average
+	if (result != HAL_OK)
+	{
+		return 0;
+	}
+
+	return digit_to_millivolts(channel, process_digit_int(channel, digit));
 }
 
 /**
- * Set the scaling for a channel voltage so that read_voltage returns voltage * scaling
+ * Reads the voltage of a specified channel configuration in integer microvolts.
+ * Uses the precomputed fixed-point factor of the channel, so no float math is done per reading.
  *
- * @param channel The Channel to set the scaling for
- * @param scaling Scaling Factor that will be multiplied with the voltage
+ * Failed readings do not update the averaging.
+ *
+ * @param channel The ADS7828_CHANNEL configuration you want the voltage from
+ * @param status Optional pointer that receives the HAL status of the transfer
+ * @return Measured ADC Voltage [uV] of given channel configuration, including scaling, 0 if the transfer failed
  */
-void ADS7828::set_scaling(ADS7828_CHANNEL channel, float scaling)
+int32_t ADS7828::read_microvolts(ADS7828_CHANNEL channel, HAL_StatusTypeDef *status)
 {
-	_scaling[channel] = scaling;
+	uint16_t digit = 0;
+	HAL_StatusTypeDef result = transfer_digit(channel, digit);
+
+	if (status != nullptr)
+	{
+		*status = result;
+	}
+
+	// Failed readings must not end up in the average
+	if (result != HAL_OK)
+	{
+		return 0;
+	}
+
+	return digit_to_microvolts(channel, process_digit_int(channel, digit));
 }
+#endif
 
 /**
- * Get the current voltage scaling for a channel
+ * Converts a digit of a channel configuration to millivolts with one multiply and shift
  *
- * @param channel The Channel to get the scaling for
- * @return The current scaling factor of the channel
+ * @param channel The ADS7828_CHANNEL configuration the digit belongs to
+ * @param digit The digit (0 - 4095)
+ * @return Voltage [mV] of the digit
  */
-float ADS7828::get_scaling(ADS7828_CHANNEL channel)
+int32_t ADS7828::digit_to_millivolts(ADS7828_CHANNEL channel, uint16_t digit)
 {
-	return _scaling[channel];
+	const ADS7828_conversion_t &conv = conversion(channel);
+	return (int32_t)(((int64_t)digit * conv.mv_factor + conv.mv_offset + (1 << (ADS7828_FIXED_SHIFT - 1))) >> ADS7828_FIXED_SHIFT);
 }
 
 /**
- * Reset the scaling for a channel voltage back to 1
+ * Converts a digit of a channel configuration to microvolts with one multiply and shift
  *
- * @param channel The Channel to reset the scaling for
+ * @param channel The ADS7828_CHANNEL configuration the digit belongs to
+ * @param digit The digit (0 - 4095)
+ * @return Voltage [uV] of the digit
  */
-void ADS7828::reset_scaling(ADS7828_CHANNEL channel)
+int32_t ADS7828::digit_to_microvolts(ADS7828_CHANNEL channel, uint16_t digit)
 {
-	set_scaling(channel, 1);
+	const ADS7828_conversion_t &conv = conversion(channel);
+	return (int32_t)(((int64_t)(digit * 1000) * conv.mv_factor + conv.mv_offset * 1000 + (1 << (ADS7828_FIXED_SHIFT - 1))) >> ADS7828_FIXED_SHIFT);
 }
 
+#ifndef ADS7828_ASYNC_ONLY
 /**
- * Reset the scaling for all channels back to 1
+ * Reads a channel configuration 4^extra_bits times and decimates the sum to 12 + extra_bits bits.
+ * The command byte is only sent once, the following digits are read back to back like a stream.
+ * Only adds resolution if the input carries at least about one digit of noise. Averaging and filters don't apply.
  *
+ * @param channel The ADS7828_CHANNEL configuration you want the value from
+ * @param extra_bits Additional bits of resolution (1 - ADS7828_OVERSAMPLE_MAX_BITS)
+ * @param status Optional pointer that receives the HAL status of the transfers
+ * @return Sum of the digits >> extra_bits (0 - 4095 * 2^extra_bits), 0 if a transfer failed
  */
-void ADS7828::reset_scaling()
+uint16_t ADS7828::read_oversampled(ADS7828_CHANNEL channel, uint8_t extra_bits, HAL_StatusTypeDef *status)
 {
-	for (uint8_t c = 0; c < ADS7828_CHANNELS; c++)
+	if (extra_bits > ADS7828_OVERSAMPLE_MAX_BITS)
 	{
-		reset_scaling(static_cast<ADS7828_CHANNEL>(c));
+		extra_bits = ADS7828_OVERSAMPLE_MAX_BITS;
+	}
+
+	uint16_t samples = 1U << (2 * extra_bits);
+	uint16_t digit = 0;
+	HAL_StatusTypeDef result = transfer_digit(channel, digit);
+	uint32_t sum = digit;
+
+	for (uint16_t i = 1; i < samples && result == HAL_OK; i++)
+	{
+		result = receive_digit(digit);
+		sum += digit;
+	}
+
+	if (status != nullptr)
+	{
+		*status = result;
 	}
+
+	return (result == HAL_OK) ? (uint16_t)(sum >> extra_bits) : 0;
 }
+#endif
 
 /**
- * Enables averaging for a certain channel.
- *	Whenever get_digit or get_voltage is called, the result will be the average of the last N values.
+ * Converts an oversampled value of a channel configuration to microvolts, keeping the extra resolution
  *
- * @param channel The channel to enable averaging fot
- * @param n Number of values to average
+ * @param channel The ADS7828_CHANNEL configuration the value belongs to
+ * @param value Value from read_oversampled or start_oversample_dma
+ * @param extra_bits The extra bits the value was read with
+ * @return Voltage [uV] of the value
  */
-void ADS7828::set_averaging(ADS7828_CHANNEL channel, uint8_t n)
+int32_t ADS7828::oversampled_to_microvolts(ADS7828_CHANNEL channel, uint16_t value, uint8_t extra_bits)
 {
-	// Averaging over 1 value is useless
-	if (n == 1)
+	const ADS7828_conversion_t &conv = conversion(channel);
+	uint8_t shift = ADS7828_FIXED_SHIFT + extra_bits;
+	return (int32_t)(((int64_t)value * 1000 * conv.mv_factor + conv.mv_offset * 1000 * (1LL << extra_bits) + (1LL << (shift - 1))) >> shift);
+}
+
+/**
+ * Converts a block of raw digits of one channel configuration to microvolts, e.g. a buffer from stream_channel.
+ * One multiply with a Q16 factor and an add per digit; on Cortex-M4/M7 two digits are loaded at once and
+ * multiplied with the DSP instructions, otherwise the loop is unrolled. Averaging and filters don't apply.
+ * The result is within 1 uV of digit_to_microvolts.
+ *
+ * @param digits Raw digits (0 - 4095)
+ * @param out Receives the voltages [uV], may not overlap digits
+ * @param n Number of digits
+ * @param channel The ADS7828_CHANNEL configuration the digits belong to
+ */
+void ADS7828::convert_block(const uint16_t *digits, int32_t *out, size_t n, ADS7828_CHANNEL channel)
+{
+	// Microvolts per digit with 16 fractional bits, too large factors (scaling > ~50) take the exact path
+	const ADS7828_conversion_t &conv = conversion(channel);
+	int64_t k64 = ((int64_t)conv.mv_factor * 1000) >> (ADS7828_FIXED_SHIFT - 16);
+	if (k64 > INT32_MAX || k64 < INT32_MIN)
 	{
+		for (size_t i = 0; i < n; i++)
+		{
+			out[i] = digit_to_microvolts(channel, digits[i]);
+		}
 		return;
 	}
 
-#ifdef ADS7828_DYNAMIC_MEM
-	// Reserve memory to store n last values
-	_buffers[channel].n = n;
-	_buffers[channel].data = new uint16_t[n]{0};
+	const int32_t k = (int32_t)k64;
+	// The multiply truncates, half a microvolt is added to the offset for rounding
+	const int32_t c = (int32_t)((conv.mv_offset * 1000 + (1LL << (ADS7828_FIXED_SHIFT - 1))) >> ADS7828_FIXED_SHIFT);
+	size_t i = 0;
+
+#if defined(__ARM_FEATURE_DSP) && __ARM_FEATURE_DSP
+	for (; i + 4 <= n; i += 4)
+	{
+		uint32_t pair0;
+		uint32_t pair1;
+		memcpy(&pair0, &digits[i], 4);
+		memcpy(&pair1, &digits[i + 2], 4);
+		out[i] = mul_q16_lo(k, pair0) + c;
+		out[i + 1] = mul_q16_hi(k, pair0) + c;
+		out[i + 2] = mul_q16_lo(k, pair1) + c;
+		out[i + 3] = mul_q16_hi(k, pair1) + c;
+	}
+
+	for (; i < n; i++)
+	{
+		out[i] = mul_q16_lo(k, digits[i]) + c;
+	}
 #else
-	_buffers[channel].n = (n > ADS7828_AVG_MAX) ? ADS7828_AVG_MAX : n;
-	clear_averaging(channel);
+	for (; i + 4 <= n; i += 4)
+	{
+		out[i] = mul_q16(k, digits[i]) + c;
+		out[i + 1] = mul_q16(k, digits[i + 1]) + c;
+		out[i + 2] = mul_q16(k, digits[i + 2]) + c;
+		out[i + 3] = mul_q16(k, digits[i + 3]) + c;
+	}
+
+	for (; i < n; i++)
+	{
+		out[i] = mul_q16(k, digits[i]) + c;
+	}
 #endif
 }
 
 /**
- * Clears all current values of the channel and sets them to 0
+ * Recomputes the fixed-point conversion factor of a conversion entry from the reference voltage, scaling and ratiometric correction.
+ * Staged in 64 bit integers, so no float math is needed.
  *
- * @param channel The channel to clear the old values for
+ * @param conversion The entry to update
  */
-void ADS7828::clear_averaging(ADS7828_CHANNEL channel)
+void ADS7828::update_conversion(ADS7828_conversion_t &conversion)
 {
-	for (uint8_t n = 0; n < _buffers[channel].n; n++)
-	{
-		_buffers[channel].data[n] = 0;
-	}
+	// Microvolts per digit with ADS7828_SCALE_SHIFT fractional bits, the gain adds ADS7828_CAL_SHIFT more
+	int64_t uv_per_digit = div_round((int64_t)_ref_uv * conversion.scaling, 4095);
+	int64_t factor = uv_per_digit * conversion.cal_gain;
+
+	// To millivolts with ADS7828_FIXED_SHIFT fractional bits
+	conversion.mv_base = (int32_t)div_round(factor, 1000LL << (ADS7828_SCALE_SHIFT + ADS7828_CAL_SHIFT - ADS7828_FIXED_SHIFT));
+	conversion.mv_factor = (int32_t)(((int64_t)conversion.mv_base * _ratio + (1L << (ADS7828_RATIO_SHIFT - 1))) >> ADS7828_RATIO_SHIFT);
+	conversion.mv_offset = ((int64_t)conversion.cal_offset_uv << ADS7828_FIXED_SHIFT) / 1000;
 }
 
 /**
- * Disables the averaging and deletes all stored values
- *
- * @param channel The channel to disable averaging for
+ * Recomputes the fixed-point conversion factors of all conversion entries
  */
-void ADS7828::disable_averaging(ADS7828_CHANNEL channel)
+void ADS7828::update_conversion()
 {
-	// Averaging is already disabled
-	if (_buffers[channel].n == 1)
+	for (uint8_t e = 0; e <= ADS7828_CONVERSIONS; e++)
 	{
-		return;
+		update_conversion(_conversions[e]);
 	}
+}
 
-	_buffers[channel].n = 1;
+#ifndef ADS7828_ASYNC_ONLY
+/**
+ * Transfers the command byte and receives the raw result
+ *
+ * @param channel The ADS7828_CHANNEL configuration you want the digit from
+ * @param digit Receives the raw ADC digit (0 - 4095), 0 if the transfer failed
+ * @return HAL status of the transfer
+ */
+HAL_StatusTypeDef ADS7828::transfer_digit(ADS7828_CHANNEL channel, uint16_t &digit)
+{
+	return transfer_command(build_command(channel), digit);
+}
 
-#ifdef ADS7828_DYNAMIC_MEM
-	delete[] _buffers[channel].data;
-#else
-	clear_averaging(channel);
+/**
+ * Transfers a prepared command byte and receives the raw result
+ *
+ * @param command Command byte from build_command
+ * @param digit Receives the raw ADC digit (0 - 4095), 0 if the transfer failed
+ * @return HAL status of the transfer
+ */
+HAL_StatusTypeDef ADS7828::transfer_command(uint8_t command, uint16_t &digit)
+{
+	uint8_t data[2] = {0};
+	uint32_t operation = budget_start();
+	uint32_t timeout_ms = budget_timeout(operation);
+	HAL_StatusTypeDef status = (timeout_ms == 0) ? HAL_BUSY : HAL_TIMEOUT;
+	bool aborted = (timeout_ms == 0);
+
+	if (aborted)
+	{
+		// Not started, the bus is busy or the budget is shorter than the shortest timeout
+	}
+	else if (_repeated_start)
+	{
+		uint32_t start = stats_start();
+		status = _bus.write_read(_address, command, data, 2, timeout_ms);
+		record_transfer(status, 5, start);
+	}
+	else
+	{
+		uint32_t start = stats_start();
+		status = _bus.write(_address, &command, 1, timeout_ms);
+		record_transfer(status, 2, start);
+
+		if (status == HAL_OK)
+		{
+			// The bus is still busy right after the STOP, only the remaining time counts
+			timeout_ms = budget_timeout(operation, false);
+			aborted = (timeout_ms == 0);
+			status = HAL_TIMEOUT;
+
+			if (!aborted)
+			{
+				start = stats_start();
+				status = _bus.read(_address, data, 2, timeout_ms);
+				record_transfer(status, 3, start);
+			}
+		}
+	}
+
+	_sample_cycles = get_cycles();
+	budget_end(operation, aborted);
+
+	digit = (status == HAL_OK) ? (uint16_t)((data[0] << 8) + data[1]) : 0;
+	_raw_digit = digit;
+	_last_quality = ADS7828_quality(digit, _last_settled) | ((status != HAL_OK) << 4);
+	return status;
+}
+
+/**
+ * Receives the next digit of the last selected channel without sending a command
+ *
+ * @param digit Receives the raw ADC digit (0 - 4095), 0 if the transfer failed
+ * @return HAL status of the transfer
+ */
+HAL_StatusTypeDef ADS7828::receive_digit(uint16_t &digit)
+{
+	uint8_t data[2] = {0};
+	uint32_t operation = budget_start();
+	uint32_t timeout_ms = budget_timeout(operation);
+	HAL_StatusTypeDef status = HAL_BUSY;
+
+	if (timeout_ms != 0)
+	{
+		uint32_t start = stats_start();
+		status = _bus.read(_address, data, 2, timeout_ms);
+		record_transfer(status, 3, start);
+	}
+
+	_sample_cycles = get_cycles();
+	budget_end(operation, timeout_ms == 0);
+
+	digit = (status == HAL_OK) ? (uint16_t)((data[0] << 8) + data[1]) : 0;
+	_raw_digit = digit;
+	_last_quality = ADS7828_quality(digit, _last_settled) | ((status != HAL_OK) << 4);
+	return status;
+}
+
+/**
+ * Reads several channel configurations at once.
+ * All command bytes are prepared first, the transfers run back to back and averaging is applied in one pass afterwards.
+ *
+ * @param channels List of ADS7828_CHANNEL configurations to read
+ * @param n Number of channels in the list (1 - 16)
+ * @param out Receives the (rounded average) digit of every channel in list order
+ * @param quality Optional list that receives the ADS7828_QUALITY bits of every channel in list order, only written on success
+ * @return HAL_OK on success, otherwise the status of the first failed transfer (the digits are not processed then)
+ */
+HAL_StatusTypeDef ADS7828::read_channels(const ADS7828_CHANNEL *channels, size_t n, uint16_t *out, uint8_t *quality)
+{
+	if (n == 0 || n > ADS7828_CHANNELS)
+	{
+		return HAL_ERROR;
+	}
+
+	uint8_t commands[ADS7828_CHANNELS];
+	uint16_t unsettled = 0;
+
+	for (size_t i = 0; i < n; i++)
+	{
+		commands[i] = build_command(channels[i]);
+		unsettled |= (uint16_t)(!_last_settled << i);
+	}
+
+	for (size_t i = 0; i < n; i++)
+	{
+		HAL_StatusTypeDef status = transfer_command(commands[i], out[i]);
+
+		if (status != HAL_OK)
+		{
+			return status;
+		}
+	}
+
+	if (quality != nullptr)
+	{
+		for (size_t i = 0; i < n; i++)
+		{
+			quality[i] = ADS7828_quality(out[i], !((unsettled >> i) & 1));
+		}
+	}
+
+	for (size_t i = 0; i < n; i++)
+	{
+		out[i] = process_digit_int(channels[i], out[i]);
+	}
+
+	return HAL_OK;
+}
+#endif
+
+#if !defined(ADS7828_ASYNC_ONLY) && !defined(ADS7828_INTEGER_ONLY)
+/**
+ * Reads the voltages of several channel configurations at once, see read_channels
+ *
+ * @param channels List of ADS7828_CHANNEL configurations to read
+ * @param n Number of channels in the list (1 - 16)
+ * @param out Receives the voltage [V] of every channel in list order
+ * @return HAL_OK on success, otherwise the status of the first failed transfer
+ */
+HAL_StatusTypeDef ADS7828::read_channels_voltage(const ADS7828_CHANNEL *channels, size_t n, float *out)
+{
+	uint16_t digits[ADS7828_CHANNELS];
+	HAL_StatusTypeDef status = read_channels(channels, n, digits);
+
+	if (status != HAL_OK)
+	{
+		return status;
+	}
+
+	for (size_t i = 0; i < n; i++)
+	{
+		out[i] = digit_to_voltage(channels[i], digits[i]);
+	}
+
+	return HAL_OK;
+}
+#endif
+
+/**
+ * Builds the command byte for a channel configuration with the current power down mode
+ *
+ * @param channel The ADS7828_CHANNEL configuration to select
+ * @return Command byte for the ADS7828 (Datasheet Table 1)
+ */
+uint8_t ADS7828::build_command(ADS7828_CHANNEL channel)
+{
+	return *prepare_command(channel);
+}
+
+/**
+ * Looks up the command byte for a channel configuration in the table of the current power down mode.
+ * Every command starts a conversion, so the reference and power tracking is updated here.
+ *
+ * @param channel The ADS7828_CHANNEL configuration to select
+ * @return Pointer to the command byte in flash, can be transmitted by DMA directly
+ */
+const uint8_t *ADS7828::prepare_command(ADS7828_CHANNEL channel)
+{
+	// The auto power policy schedules the next reference warm-up from here
+	if (_auto_power)
+	{
+		_last_conversion_tick = HAL_GetTick();
+		_ref_warm = false;
+	}
+
+	track_reference(_pd_mode);
+
+	return &_commands[channel];
+}
+
+/**
+ * Changes the power down mode that is sent with every command by switching to its command table
+ *
+ * @param mode The new power down mode
+ */
+void ADS7828::apply_power_mode(ADS7828_PD_MODE mode)
+{
+	_pd_mode = mode;
+	_commands = command_tables[mode].command;
+}
+
+/**
+ * Applies the median filter of a slot to a freshly received digit
+ *
+ * @param slot The slot of the channel the digit belongs to
+ * @param digit The raw digit received from the ADC
+ * @return Digit, or median of the last 3, 5 or 7 digits if the median is enabled
+ */
+uint16_t ADS7828::reject_spikes(uint8_t slot, uint16_t digit)
+{
+	if (_medians[slot].size == 0)
+	{
+		return digit;
+	}
+
+	return _medians[slot].update(digit);
+}
+
+#ifndef ADS7828_INTEGER_ONLY
+/**
+ * Applies the averaging of the channel to a freshly received digit
+ *
+ * @param channel The ADS7828_CHANNEL configuration the digit belongs to
+ * @param digit The raw digit received from the ADC
+ * @return Digit, filter output, or average of the last N digits if averaging is enabled
+ */
+float ADS7828::process_digit(ADS7828_CHANNEL channel, uint16_t digit)
+{
+	if (channel == _ratio_channel)
+	{
+		track_ratio(digit);
+	}
+
+#ifdef ADS7828_NO_AVERAGING
+	return digit;
+#else
+	uint8_t slot = _slots[channel];
+
+	// Plain channel, no filter state at all
+	if (slot == ADS7828_NO_SLOT)
+	{
+		return digit;
+	}
+
+	digit = reject_spikes(slot, digit);
+
+	if (_filters[slot].mode != FILTER_NONE)
+	{
+		return _filters[slot].update(digit) * (1.0f / (1 << ADS7828_FILTER_FRAC_BITS));
+	}
+
+	// No averaging
+	if (_buffers[slot].n <= 1)
+	{
+		return digit;
+	}
+
+	// Update the buffer and calculate average
+	_buffers[slot].append(digit);
+	return _buffers[slot].average();
+#endif
+}
+#endif
+
+/**
+ * Applies the averaging of the channel to a freshly received digit, staying in integer math
+ *
+ * @param channel The ADS7828_CHANNEL configuration the digit belongs to
+ * @param digit The raw digit received from the ADC
+ * @return Digit, rounded filter output, or rounded average of the last N digits if averaging is enabled
+ */
+uint16_t ADS7828::process_digit_int(ADS7828_CHANNEL channel, uint16_t digit)
+{
+	if (channel == _ratio_channel)
+	{
+		track_ratio(digit);
+	}
+
+#ifdef ADS7828_NO_AVERAGING
+	return digit;
+#else
+	uint8_t slot = _slots[channel];
+
+	// Plain channel, no filter state at all
+	if (slot == ADS7828_NO_SLOT)
+	{
+		return digit;
+	}
+
+	digit = reject_spikes(slot, digit);
+
+	if (_filters[slot].mode != FILTER_NONE)
+	{
+		return (uint16_t)((_filters[slot].update(digit) + (1 << (ADS7828_FILTER_FRAC_BITS - 1))) >> ADS7828_FILTER_FRAC_BITS);
+	}
+
+	// No averaging
+	if (_buffers[slot].n <= 1)
+	{
+		return digit;
+	}
+
+	_buffers[slot].append(digit);
+	return _buffers[slot].average_int();
+#endif
+}
+
+#ifndef ADS7828_INTEGER_ONLY
+/**
+ * Set your external reference voltage for operation without the internal reference, see set_ref_voltage_external_uv
+ *
+ * @param ref_voltage External reference voltage in [V]
+ */
+void ADS7828::set_ref_voltage_external(float ref_voltage)
+{
+	set_ref_voltage_external_uv((ref_voltage > 0) ? (uint32_t)(ref_voltage * 1e6f + 0.5f) : 0);
+}
+#endif
+
+/**
+ * Set your external reference voltage for operation without the internal reference.
+ * Implicitly switches the power down mode to turn the internal reference OFF!
+ * The new mode is sent with the next read, no extra bus traffic is generated.
+ *
+ * @param ref_uv External reference voltage in [uV]
+ */
+void ADS7828::set_ref_voltage_external_uv(uint32_t ref_uv)
+{
+	disable_ratiometric();
+	_ref_uv = ref_uv;
+	_internal_ref = false;
+	update_conversion();
+
+	// If you choose an external voltage reference we have to change the mode accordingly
+	if (uses_internal_ref(_pd_mode))
+	{
+		apply_power_mode(REF_OFF);
+	}
+
+	if (_auto_power)
+	{
+		apply_auto_power();
+	}
+}
+
+/**
+ * Set the reference voltage back to internal (2.5V).
+ * Implicitly switches the power down mode to turn the internal reference ON!
+ * The new mode is sent with the next read, no extra bus traffic is generated.
+ */
+void ADS7828::set_ref_voltage_internal()
+{
+	disable_ratiometric();
+	_ref_uv = 2500000;
+	_internal_ref = true;
+	update_conversion();
+
+	// If you choose an internal voltage reference we have to change the mode accordingly
+	if (!uses_internal_ref(_pd_mode))
+	{
+		apply_power_mode(REF_ON_AD_ON);
+	}
+
+	if (_auto_power)
+	{
+		apply_auto_power();
+	}
+}
+
+/**
+ * Enables the ratiometric mode: one channel measures a known voltage derived from the same source as the reference,
+ * e.g. a precise reference diode or a divider of the sensor supply, and every reading of it corrects the conversion
+ * factors of all channels for the actual reference voltage.
+ * The monitor digit is smoothed with an integer EMA and the factors are updated with one division and a multiplication
+ * per channel, the voltage conversions stay in fixed point, so there is no extra float math per sample.
+ * Readings of the monitor channel through read, read_digit, single asynchronous reads, batches and the scanner update
+ * the correction, streams, sequences and sweeps deliver raw digits and do not.
+ * Conversion tables (set_lut) are not corrected. Set the reference voltage first, changing it disables the mode.
+ *
+ * @param monitor The ADS7828_CHANNEL configuration measuring the known voltage
+ * @param known_uv Voltage [uV] at the ADC input of the monitor channel (before scaling)
+ * @param smoothing EMA shift of the monitor digit (0 - 8), 0 applies every reading directly
+ * @return HAL_OK if enabled, HAL_ERROR for an invalid channel, smoothing, or a voltage outside of the input range
+ */
+HAL_StatusTypeDef ADS7828::set_ratiometric_uv(ADS7828_CHANNEL monitor, uint32_t known_uv, uint8_t smoothing)
+{
+	if (_ref_uv == 0)
+	{
+		return HAL_ERROR;
+	}
+
+	uint64_t expected = (((uint64_t)known_uv * 4095 << ADS7828_AVG_FRAC_BITS) + _ref_uv / 2) / _ref_uv;
+
+	// The correction is only valid while the monitor is neither clipped nor close to zero
+	if (monitor >= ADS7828_CHANNELS || smoothing > 8 || expected < (16 << ADS7828_AVG_FRAC_BITS) || expected > (4080 << ADS7828_AVG_FRAC_BITS))
+	{
+		return HAL_ERROR;
+	}
+
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	_ratio_channel = monitor;
+	_ratio_smoothing = smoothing;
+	_ratio_expected = (uint32_t)expected;
+	_ratio_avg = 0;
+
+	__set_PRIMASK(primask);
+
+	return HAL_OK;
+}
+
+#ifndef ADS7828_INTEGER_ONLY
+/**
+ * Enables the ratiometric mode, see set_ratiometric_uv
+ *
+ * @param monitor The ADS7828_CHANNEL configuration measuring the known voltage
+ * @param known_voltage Voltage [V] at the ADC input of the monitor channel (before scaling)
+ * @param smoothing EMA shift of the monitor digit (0 - 8), 0 applies every reading directly
+ * @return HAL_OK if enabled, HAL_ERROR for an invalid channel, smoothing, or a voltage outside of the input range
+ */
+HAL_StatusTypeDef ADS7828::set_ratiometric(ADS7828_CHANNEL monitor, float known_voltage, uint8_t smoothing)
+{
+	return set_ratiometric_uv(monitor, (known_voltage > 0) ? (uint32_t)(known_voltage * 1e6f + 0.5f) : 0, smoothing);
+}
+#endif
+
+/**
+ * Disables the ratiometric mode, conversions use the set reference voltage again
+ */
+void ADS7828::disable_ratiometric()
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	_ratio_channel = ADS7828_CHANNELS;
+	_ratio = 1L << ADS7828_RATIO_SHIFT;
+	apply_ratio();
+
+	__set_PRIMASK(primask);
+}
+
+/**
+ * Check if the ratiometric mode is enabled
+ *
+ * @return True between set_ratiometric and disable_ratiometric
+ */
+bool ADS7828::is_ratiometric()
+{
+	return _ratio_channel != ADS7828_CHANNELS;
+}
+
+#ifndef ADS7828_INTEGER_ONLY
+/**
+ * Get the reference voltage the conversions currently use
+ *
+ * @return Set reference voltage [V], corrected by the monitor channel in ratiometric mode
+ */
+float ADS7828::get_ref_voltage()
+{
+	return _ref_uv * 1e-6f * (float)_ratio / (float)(1L << ADS7828_RATIO_SHIFT);
+}
+#endif
+
+/**
+ * Get the reference voltage the conversions currently use
+ *
+ * @return Set reference voltage [uV], corrected by the monitor channel in ratiometric mode
+ */
+uint32_t ADS7828::get_ref_voltage_uv()
+{
+	return (uint32_t)(((uint64_t)_ref_uv * _ratio + (1UL << (ADS7828_RATIO_SHIFT - 1))) >> ADS7828_RATIO_SHIFT);
+}
+
+/**
+ * Updates the ratiometric correction with a raw digit of the monitor channel.
+ * Called from process_digit, so it runs in the context of the reading, e.g. the I2C interrupt.
+ *
+ * @param digit The raw digit of the monitor channel
+ */
+void ADS7828::track_ratio(uint16_t digit)
+{
+	uint32_t value = (uint32_t)digit << ADS7828_AVG_FRAC_BITS;
+
+	// A clipped or collapsed monitor would turn the factors into garbage, keep the last correction
+	if (value * 2 < _ratio_expected || value > _ratio_expected * 2 || digit >= 4095)
+	{
+		return;
+	}
+
+	uint32_t avg = _ratio_avg;
+
+	if (avg == 0)
+	{
+		avg = value;
+	}
+	else
+	{
+		avg = (uint32_t)((int32_t)avg + (((int32_t)value - (int32_t)avg) >> _ratio_smoothing));
+	}
+
+	// The EMA settles quickly, most readings leave the average and all factors as they are
+	if (avg == _ratio_avg)
+	{
+		return;
+	}
+
+	_ratio_avg = avg;
+
+	// A lower monitor digit than expected means a higher reference voltage
+	_ratio = (int32_t)((((uint64_t)_ratio_expected << ADS7828_RATIO_SHIFT) + avg / 2) / avg);
+	apply_ratio();
+}
+
+/**
+ * Applies the ratiometric correction to the fixed-point conversion factors of all conversion entries
+ */
+void ADS7828::apply_ratio()
+{
+	int32_t ratio = _ratio;
+
+	for (uint8_t e = 0; e <= ADS7828_CONVERSIONS; e++)
+	{
+		_conversions[e].mv_factor = (int32_t)(((int64_t)_conversions[e].mv_base * ratio + (1L << (ADS7828_RATIO_SHIFT - 1))) >> ADS7828_RATIO_SHIFT);
+	}
+}
+
+/**
+ * Set the ADC power down mode (see datasheet for more info).
+ * Implicitly switches the reference voltage to internal (2.5V) for modes with REF_ON_x
+ * Disables the automatic power policy!
+ *
+ * @param mode The mode you want to switch to
+ * @param update_now If true, the mode is switched instantly by sending only the command byte. Otherwise mode is changed with next read request!
+ *                   Ignored with ADS7828_ASYNC_ONLY
+ */
+void ADS7828::set_power_mode(ADS7828_PD_MODE mode, bool update_now)
+{
+	apply_power_mode(mode);
+	_auto_power = false;
+
+	// If you choose a mode with internal reference we have to set the voltage back
+	if (uses_internal_ref(mode) && !_internal_ref)
+	{
+		disable_ratiometric();
+		_ref_uv = 2500000;
+		_internal_ref = true;
+		update_conversion();
+	}
+
+#ifdef ADS7828_ASYNC_ONLY
+	// Without blocking transfers the mode is always sent with the next read
+	(void)update_now;
+#else
+	// The mode is part of every command byte, a command without reading the result is enough to switch
+	if (update_now)
+	{
+		uint8_t command = build_command(CHANNEL_0_COM);
+		uint32_t start = stats_start();
+		HAL_StatusTypeDef status = _bus.write(_address, &command, 1, _timeout_ms);
+		record_transfer(status, 2, start);
+
+		if (status == HAL_OK)
+		{
+			track_reference(mode);
+		}
+	}
+#endif
+}
+
+/**
+ * Set the ADC power down mode (see datasheet for more info).
+ * Implicitly switches the reference voltage to internal (2.5V) for modes with REF_ON_x
+ * Disables the automatic power policy!
+ * The new mode is sent with the next read, no extra bus traffic is generated.
+ *
+ * @param mode The mode you want to switch to
+ */
+void ADS7828::set_power_mode(ADS7828_PD_MODE mode)
+{
+	set_power_mode(mode, false);
+}
+
+/**
+ * Get the current power down mode
+ *
+ * @return The mode that is sent with the next command
+ */
+ADS7828_PD_MODE ADS7828::get_power_mode()
+{
+	return _pd_mode;
+}
+
+/**
+ * Enables the automatic power policy for a sampling interval.
+ * With an external reference, the ADC is powered down between all conversions.
+ * With the internal reference, the reference stays powered for intervals shorter than ADS7828_AUTO_POWER_MIN_MS,
+ * otherwise everything is powered down and update_auto_power wakes the reference ADS7828_REF_SETTLE_MS ahead of the next sample.
+ *
+ * @param interval_ms Expected time between two conversions in [ms]
+ */
+void ADS7828::set_auto_power(uint32_t interval_ms)
+{
+	_auto_interval_ms = interval_ms;
+	_auto_power = true;
+	_last_conversion_tick = HAL_GetTick();
+	_ref_warm = false;
+
+	apply_auto_power();
+}
+
+/**
+ * Disables the automatic power policy, the default mode for the current reference is restored
+ */
+void ADS7828::disable_auto_power()
+{
+	_auto_power = false;
+	apply_power_mode(_internal_ref ? REF_ON_AD_ON : REF_OFF);
+}
+
+/**
+ * Has to be called periodically (at least every ADS7828_REF_SETTLE_MS) while the automatic power policy is enabled.
+ * Sends a single command byte that powers up the internal reference ahead of the next sample, so the sample is not delayed by the settling time.
+ * Does nothing with ADS7828_ASYNC_ONLY, the reference then powers up with the conversion.
+ */
+void ADS7828::update_auto_power()
+{
+	// Only needed if the internal reference is powered down between conversions
+	if (!_auto_power || !_internal_ref || _pd_mode != POWER_DOWN || _ref_warm || _busy)
+	{
+		return;
+	}
+
+	uint32_t elapsed = HAL_GetTick() - _last_conversion_tick;
+
+	if (elapsed + ADS7828_REF_SETTLE_MS < _auto_interval_ms)
+	{
+		return;
+	}
+
+#ifndef ADS7828_ASYNC_ONLY
+	uint8_t *command = (uint8_t *)&command_tables[REF_ON_AD_OFF].command[CHANNEL_0_COM];
+
+	uint32_t start = stats_start();
+	HAL_StatusTypeDef status = _bus.write(_address, command, 1, _timeout_ms);
+	record_transfer(status, 2, start);
+
+	if (status == HAL_OK)
+	{
+		track_reference(REF_ON_AD_OFF);
+		_ref_warm = true;
+	}
+#endif
+}
+
+/**
+ * Check if the reference has settled, i.e. a conversion started now would be accurate.
+ * The settling time starts when the internal reference is powered up or switched off for an external one.
+ *
+ * @return True if the reference for the current mode is stable
+ */
+bool ADS7828::is_ref_settled()
+{
+	// The internal reference is powered down after the last command
+	if (_internal_ref && !_ref_on)
+	{
+		return false;
+	}
+
+	// The tick resolution is 1ms, so one more tick has to pass to guarantee the full settling time
+	return (HAL_GetTick() - _ref_switch_tick) > ADS7828_REF_SETTLE_MS;
+}
+
+/**
+ * Check if the reference used for the conversions is powered, i.e. it is settled or settling
+ *
+ * @return False if the internal reference is used but powered down between conversions
+ */
+bool ADS7828::is_ref_powered()
+{
+	return !_internal_ref || _ref_on;
+}
+
+/**
+ * Check if the last conversion was done with a settled reference
+ *
+ * @return False if the last reading was taken during reference settling and might be inaccurate
+ */
+bool ADS7828::was_ref_settled()
+{
+	return _last_settled;
+}
+
+/**
+ * Get the quality of the last conversion, blocking or asynchronous.
+ * Clipping is checked on the raw digit, before averaging or filters.
+ *
+ * @return ADS7828_QUALITY bits, 0 for a clean sample
+ */
+uint8_t ADS7828::get_quality()
+{
+	return _last_quality;
+}
+
+/**
+ * Get the raw digit of the last conversion of a blocking or asynchronous single read, e.g. in the callback of start_read_dma
+ *
+ * @return Digit (0 - 4095) before averaging and filters, 0 if the transfer failed
+ */
+uint16_t ADS7828::get_raw_digit()
+{
+	return _raw_digit;
+}
+
+/**
+ * Starts the DWT cycle counter, which is used for the sample timestamps.
+ * Debuggers start it as well, call this once at startup to have timestamps without a debugger.
+ *
+ * @return False if the core has no cycle counter (Cortex-M0)
+ */
+bool ADS7828::enable_cycle_counter()
+{
+#ifdef ADS7828_HAS_CYCCNT
+	CoreDebug->DEMCR = CoreDebug->DEMCR | CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL = DWT->CTRL | DWT_CTRL_CYCCNTENA_Msk;
+	return true;
+#else
+	return false;
+#endif
+}
+
+/**
+ * Get the current value of the DWT cycle counter
+ *
+ * @return CPU cycles, wraps around every 2^32 cycles (about 60s at 72 MHz), 0 without cycle counter
+ */
+uint32_t ADS7828::get_cycles()
+{
+#ifdef ADS7828_HAS_CYCCNT
+	return DWT->CYCCNT;
+#else
+	return 0;
+#endif
+}
+
+/**
+ * Get the timestamp of the last result, taken when its last byte was received.
+ * For asynchronous reads it is taken at the start of the receive complete interrupt.
+ * Divide differences by SystemCoreClock for seconds.
+ *
+ * @return DWT cycle count of the last received result
+ */
+uint32_t ADS7828::get_sample_cycles()
+{
+	return _sample_cycles;
+}
+
+#ifdef ADS7828_STATS
+/**
+ * Get the instrumentation counters since construction or the last reset_stats
+ *
+ * @return Reference to the counters, updated by the driver
+ */
+const ADS7828_stats_t &ADS7828::get_stats()
+{
+	return _stats;
+}
+
+/**
+ * Get the average duration of the blocking reads
+ *
+ * @return Average DWT cycles per read_digit / read, 0 if nothing was read yet
+ */
+uint32_t ADS7828::get_read_cycles_avg()
+{
+	return (_stats.reads == 0) ? 0 : (uint32_t)(_stats.read_cycles_sum / _stats.reads);
+}
+
+/**
+ * Sets all instrumentation counters to 0
+ */
+void ADS7828::reset_stats()
+{
+	_stats = {};
+}
+#endif
+
+#ifdef ADS7828_LATENCY
+/**
+ * Get the latency histogram of a channel configuration.
+ * Blocking reads count from the call, asynchronous single reads from start_read_dma or from the submission to an ADS7828_Bus.
+ * Only successful reads are counted, streams, batches and sequences are not.
+ *
+ * @param channel The ADS7828_CHANNEL configuration
+ * @param latency Receives a consistent copy of the histogram
+ */
+void ADS7828::get_latency(ADS7828_CHANNEL channel, ADS7828_latency_t &latency)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	latency = _latency[channel];
+
+	__set_PRIMASK(primask);
+}
+
+/**
+ * Get the latency histogram of all channel configurations of the device combined
+ *
+ * @param latency Receives the sum of the histograms, max_cycles is the longest latency of all channels
+ */
+void ADS7828::get_device_latency(ADS7828_latency_t &latency)
+{
+	latency = {};
+
+	for (uint8_t c = 0; c < ADS7828_CHANNELS; c++)
+	{
+		ADS7828_latency_t channel;
+		get_latency((ADS7828_CHANNEL)c, channel);
+
+		for (uint8_t b = 0; b < ADS7828_LATENCY_BUCKETS; b++)
+		{
+			latency.buckets[b] += channel.buckets[b];
+		}
+
+		latency.count += channel.count;
+		latency.max_cycles = (channel.max_cycles > latency.max_cycles) ? channel.max_cycles : latency.max_cycles;
+	}
+}
+
+/**
+ * Clears the latency histograms of all channels
+ */
+void ADS7828::reset_latency()
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	for (uint8_t c = 0; c < ADS7828_CHANNELS; c++)
+	{
+		_latency[c] = {};
+	}
+
+	__set_PRIMASK(primask);
+}
+
+/**
+ * Sets the request time of the next start_read_dma, called by queues like ADS7828_Bus right before they start a queued read,
+ * so the time spent in the queue is part of the latency
+ *
+ * @param cycles DWT cycle count when the read was requested
+ */
+void ADS7828::set_request_cycles(uint32_t cycles)
+{
+	_request_origin = cycles;
+	_request_queued = true;
+}
+#endif
+
+/**
+ * Records a command with the given power down mode, called for every transmitted command.
+ * The conversion of a command still uses the reference state of the previous command,
+ * its power down bits only apply afterwards.
+ *
+ * @param mode The power down mode of the command
+ */
+void ADS7828::track_reference(ADS7828_PD_MODE mode)
+{
+	_last_settled = is_ref_settled();
+
+	bool ref_on = uses_internal_ref(mode);
+
+	if (ref_on != _ref_on)
+	{
+		_ref_on = ref_on;
+		_ref_switch_tick = HAL_GetTick();
+	}
+}
+
+/**
+ * Picks the power down mode that is sent with the conversions of the automatic power policy
+ */
+void ADS7828::apply_auto_power()
+{
+	if (_internal_ref && _auto_interval_ms < ADS7828_AUTO_POWER_MIN_MS)
+	{
+		// Waking the reference would take most of the interval, keep it powered
+		apply_power_mode(REF_ON_AD_OFF);
+	}
+	else
+	{
+		apply_power_mode(POWER_DOWN);
+	}
+}
+
+/**
+ * Check if a power down mode keeps the internal reference powered
+ *
+ * @param mode The mode to check
+ * @return True for the REF_ON_x modes
+ */
+bool ADS7828::uses_internal_ref(ADS7828_PD_MODE mode)
+{
+	return (mode == REF_ON_AD_OFF || mode == REF_ON_AD_ON);
+}
+
+/**
+ * Enables single-transaction reads for the blocking read functions.
+ * The command byte and the result are transferred with a repeated start instead of a STOP and a second START,
+ * saving one address phase per read.
+ *
+ * @param enable If true, read_digit and read_voltage use one repeated-start transaction
+ */
+void ADS7828::set_repeated_start(bool enable)
+{
+	_repeated_start = enable;
+}
+
+/**
+ * Set the I2C clock the timeouts are calculated from.
+ * Read from the handle for STM32F1/F2/F4, estimated from the timing register with PCLK1 for the I2C v2 families.
+ *
+ * @param clock_hz I2C SCL frequency in [Hz]
+ */
+void ADS7828::set_bus_clock(uint32_t clock_hz)
+{
+	if (clock_hz == 0)
+	{
+		return;
+	}
+
+	_bus_clock_hz = clock_hz;
+	update_timeout();
+}
+
+/**
+ * Reconfigures the I2C peripheral for a bus speed and updates the timeouts.
+ * The I2C v1 peripheral (STM32F1/F2/F4) gets the clock speed, the timing register of the I2C v2 peripheral
+ * (STM32F0/F3/F7/G4/L4/H7) is calculated from the I2C kernel clock. Other devices on the bus have to support the speed!
+ *
+ * @param speed The ADS7828_BUS_SPEED to use
+ * @param kernel_clock_hz Clock of the I2C v2 peripheral in [Hz], 0 for PCLK1. Ignored by the I2C v1 families
+ * @return HAL_OK if the peripheral was reconfigured, HAL_BUSY during an asynchronous transfer,
+ *         HAL_ERROR if the kernel clock is too slow for the speed, or the HAL error
+ */
+HAL_StatusTypeDef ADS7828::set_bus_speed(ADS7828_BUS_SPEED speed, uint32_t kernel_clock_hz)
+{
+	if (_busy)
+	{
+		return HAL_BUSY;
+	}
+
+#if defined(ADS7828_I2C_V2)
+	if (kernel_clock_hz == 0)
+	{
+		kernel_clock_hz = HAL_RCC_GetPCLK1Freq();
+	}
+
+	uint32_t timing = calc_timing(kernel_clock_hz, speed);
+	if (timing == 0)
+	{
+		return HAL_ERROR;
+	}
+	_hi2c->Init.Timing = timing;
+#else
+	(void)kernel_clock_hz;
+	_hi2c->Init.ClockSpeed = speed;
+	_hi2c->Init.DutyCycle = I2C_DUTYCYCLE_2;
+#endif
+
+	HAL_StatusTypeDef status = HAL_I2C_Init(_hi2c);
+	if (status == HAL_OK)
+	{
+		set_bus_clock(speed);
+	}
+
+	return status;
+}
+
+/**
+ * Get the I2C clock the timeouts are calculated from
+ *
+ * @return I2C SCL frequency in [Hz]
+ */
+uint32_t ADS7828::get_bus_clock()
+{
+	return _bus_clock_hz;
+}
+
+#ifdef ADS7828_I2C_V2
+/**
+ * Calculates the TIMINGR value of the I2C v2 peripheral for a bus speed.
+ * Uses the smallest prescaler that fits the SCL period, the minimum low and high times and
+ * the data setup and hold times of the I2C specification. Analog filter delays are neglected.
+ *
+ * @param kernel_clock_hz Clock of the I2C peripheral in [Hz]
+ * @param speed The ADS7828_BUS_SPEED to calculate the timing for
+ * @return Timing register value, 0 if the kernel clock is too slow
+ */
+uint32_t ADS7828::calc_timing(uint32_t kernel_clock_hz, ADS7828_BUS_SPEED speed)
+{
+	// I2C specification in [ns]: minimum SCL low and high time, data setup time, SDA rise and fall time
+	const bool fast = (speed == BUS_FAST);
+	const uint32_t t_low = fast ? 1300 : 4700;
+	const uint32_t t_high = fast ? 600 : 4000;
+	const uint32_t t_setup = fast ? 100 : 250;
+	const uint32_t t_rise = fast ? 300 : 1000;
+	const uint32_t t_fall = 300;
+
+	uint32_t period = kernel_clock_hz / speed; // Kernel clocks per SCL period
+
+	for (uint32_t presc = 0; presc < 16; presc++)
+	{
+		uint32_t ticks = period / (presc + 1);
+		if (ticks > 512)
+		{
+			continue;
+		}
+
+		// Kernel clocks per prescaled tick in [ns], rounded up to keep the minimum times
+		uint32_t tick_ns = (uint32_t)(((uint64_t)(presc + 1) * 1000000000 + kernel_clock_hz - 1) / kernel_clock_hz);
+		uint32_t low_min = (t_low + tick_ns - 1) / tick_ns;
+		uint32_t high_min = (t_high + tick_ns - 1) / tick_ns;
+		if (ticks < low_min + high_min)
+		{
+			return 0;
+		}
+
+		// The spare ticks are split in the ratio of the minimum times
+		uint32_t low = ticks * t_low / (t_low + t_high);
+		if (low < low_min)
+		{
+			low = low_min;
+		}
+		uint32_t high = ticks - low;
+		if (high < high_min)
+		{
+			high = high_min;
+			low = ticks - high;
+		}
+		if (low > 256 || high > 256)
+		{
+			continue;
+		}
+
+		// Data setup after the SDA rise and data hold after the SCL fall, both fields are 4 Bit
+		uint32_t scldel = (t_rise + t_setup + tick_ns - 1) / tick_ns;
+		uint32_t sdadel = (t_fall + tick_ns - 1) / tick_ns;
+		scldel = (scldel > 0) ? scldel - 1 : 0;
+		if (scldel > 15 || sdadel > 15)
+		{
+			continue;
+		}
+
+		return (presc << 28) | (scldel << 20) | (sdadel << 16) | ((high - 1) << 8) | (low - 1);
+	}
+
+	return 0;
+}
+
+/**
+ * Estimates the SCL frequency of a TIMINGR value
+ *
+ * @param kernel_clock_hz Clock of the I2C peripheral in [Hz]
+ * @param timing Timing register value
+ * @return I2C SCL frequency in [Hz]
+ */
+uint32_t ADS7828::timing_to_clock(uint32_t kernel_clock_hz, uint32_t timing)
+{
+	uint32_t presc = (timing >> 28) + 1;
+	uint32_t high = ((timing >> 8) & 0xFF) + 1;
+	uint32_t low = (timing & 0xFF) + 1;
+	return kernel_clock_hz / (presc * (high + low));
+}
+#endif
+
+/**
+ * Overrides the timeout of the blocking transfers
+ *
+ * @param timeout_ms Timeout per HAL transfer in [ms], HAL_MAX_DELAY to wait forever
+ */
+void ADS7828::set_timeout(uint32_t timeout_ms)
+{
+	_timeout_ms = timeout_ms;
+}
+
+/**
+ * Get the timeout of the blocking transfers
+ *
+ * @return Timeout per HAL transfer in [ms]
+ */
+uint32_t ADS7828::get_timeout()
+{
+	return _timeout_ms;
+}
+
+/**
+ * Set the margin added to the bus time of the calculated timeout, e.g. for clock stretching or a shared bus
+ * where transfers of other masters delay the own ones. Recalculates the timeout, overriding set_timeout.
+ *
+ * @param margin_ms Margin in [ms], default ADS7828_TIMEOUT_MARGIN_MS
+ */
+void ADS7828::set_timeout_margin(uint32_t margin_ms)
+{
+	_timeout_margin_ms = margin_ms;
+	update_timeout();
+}
+
+/**
+ * Get the margin of the calculated timeout
+ *
+ * @return Margin in [ms]
+ */
+uint32_t ADS7828::get_timeout_margin()
+{
+	return _timeout_margin_ms;
+}
+
+/**
+ * Set a latency budget for the blocking conversions, e.g. to stay inside the window of a watchdog.
+ * Every conversion (command and result) then finishes or aborts with HAL_TIMEOUT or HAL_BUSY within budget_us:
+ * the timeout of each transfer is cut to the remaining budget, a transfer is not started if the budget can't cover it,
+ * a busy bus is not waited for and read() does not recover the bus. HAL timeouts count in ticks, a timeout of T ms
+ * can last T + 1 ms, so the budget has to be at least 2ms plus the transfer time.
+ * Elapsed time is measured with the DWT cycle counter (see enable_cycle_counter), or in HAL ticks on Cortex-M0.
+ * Clears the deadline statistics.
+ *
+ * @param budget_us Longest time of one blocking conversion in [us], 0 to disable
+ */
+void ADS7828::set_latency_budget(uint32_t budget_us)
+{
+	_budget_us = budget_us;
+	_deadline_misses = 0;
+	_worst_latency_us = 0;
+}
+
+/**
+ * Get the latency budget of the blocking conversions
+ *
+ * @return Budget in [us], 0 if disabled
+ */
+uint32_t ADS7828::get_latency_budget()
+{
+	return _budget_us;
+}
+
+/**
+ * Get the number of conversions that missed the latency budget.
+ * Counts conversions that were aborted because the budget did not cover the next transfer or the bus was busy,
+ * and conversions that took longer than the budget, which only happens if the budget is too short for the tick resolution.
+ *
+ * @return Deadline misses since the budget was set
+ */
+uint32_t ADS7828::get_deadline_miss_count()
+{
+	return _deadline_misses;
+}
+
+/**
+ * Get the longest blocking conversion with a latency budget
+ *
+ * @return Worst measured latency in [us] since the budget was set
+ */
+uint32_t ADS7828::get_worst_latency_us()
+{
+	return _worst_latency_us;
+}
+
+/**
+ * Takes the start time of a blocking conversion for the latency budget
+ *
+ * @return DWT cycles, HAL ticks without cycle counter
+ */
+uint32_t ADS7828::budget_start()
+{
+#ifdef ADS7828_HAS_CYCCNT
+	return get_cycles();
+#else
+	return HAL_GetTick();
+#endif
+}
+
+/**
+ * Calculates the timeout of the next transfer of a conversion so it ends within the latency budget
+ *
+ * @param start Start of the conversion from budget_start
+ * @param check_bus Skip the transfer if the bus is busy, false for the second transfer of a conversion
+ * @return Timeout in [ms], 0 if the transfer must not be started
+ */
+uint32_t ADS7828::budget_timeout(uint32_t start, bool check_bus)
+{
+	if (_budget_us == 0)
+	{
+		return _timeout_ms;
+	}
+
+#ifdef ADS7828_HAS_CYCCNT
+	uint32_t elapsed_us = (get_cycles() - start) / (SystemCoreClock / 1000000);
+#else
+	// The current tick may already be almost over
+	uint32_t elapsed_us = (HAL_GetTick() - start + 1) * 1000;
+#endif
+
+	if (elapsed_us >= _budget_us || (check_bus && _bus.is_bus_busy()))
+	{
+		return 0;
+	}
+
+	// A timeout of T ticks lasts up to T + 1 ms
+	uint32_t timeout_ms = (_budget_us - elapsed_us) / 1000;
+	timeout_ms = (timeout_ms > 0) ? timeout_ms - 1 : 0;
+
+	return (timeout_ms < _timeout_ms) ? timeout_ms : _timeout_ms;
+}
+
+/**
+ * Records the latency of a blocking conversion with a budget
+ *
+ * @param start Start of the conversion from budget_start
+ * @param aborted True if a transfer was skipped to keep the budget
+ */
+void ADS7828::budget_end(uint32_t start, bool aborted)
+{
+	if (_budget_us == 0)
+	{
+		return;
+	}
+
+#ifdef ADS7828_HAS_CYCCNT
+	uint32_t elapsed_us = (get_cycles() - start) / (SystemCoreClock / 1000000);
+#else
+	uint32_t elapsed_us = (HAL_GetTick() - start) * 1000;
+#endif
+
+	if (elapsed_us > _worst_latency_us)
+	{
+		_worst_latency_us = elapsed_us;
+	}
+
+	if (aborted || elapsed_us > _budget_us)
+	{
+		_deadline_misses++;
+	}
+}
+
+/**
+ * Calculates the timeout from the bus clock: the longest blocking transfer, a repeated-start read of 5 bytes
+ * with ACK bits, plus the margin (see set_timeout_margin)
+ */
+void ADS7828::update_timeout()
+{
+	uint32_t bits = 5 * 9;
+	_timeout_ms = (bits * 1000 + _bus_clock_hz - 1) / _bus_clock_hz + _timeout_margin_ms;
+}
+
+/**
+ * Set the I2C pins, enables the automatic bus recovery of read
+ *
+ * @param scl_port GPIO port of SCL
+ * @param scl_pin GPIO pin of SCL, e.g. GPIO_PIN_6
+ * @param sda_port GPIO port of SDA
+ * @param sda_pin GPIO pin of SDA, e.g. GPIO_PIN_7
+ */
+void ADS7828::set_recovery_pins(GPIO_TypeDef *scl_port, uint16_t scl_pin, GPIO_TypeDef *sda_port, uint16_t sda_pin)
+{
+	_scl_port = scl_port;
+	_scl_pin = scl_pin;
+	_sda_port = sda_port;
+	_sda_pin = sda_pin;
+}
+
+/**
+ * Frees a stuck bus, e.g. after a slave was interrupted while pulling SDA low.
+ * The I2C peripheral is deinitialized, up to 9 clocks are generated on SCL until SDA is released,
+ * followed by a STOP condition, then the peripheral is initialized again with the handle settings.
+ *
+ * @return HAL_OK if SDA was released and the I2C was reinitialized, HAL_ERROR otherwise
+ */
+HAL_StatusTypeDef ADS7828::recover_bus()
+{
+	if (_scl_port == nullptr || _sda_port == nullptr)
+	{
+		return HAL_ERROR;
+	}
+
+	HAL_I2C_DeInit(_hi2c);
+
+	GPIO_InitTypeDef gpio = {};
+	gpio.Mode = GPIO_MODE_OUTPUT_OD;
+	gpio.Pull = GPIO_NOPULL;
+	gpio.Speed = GPIO_SPEED_FREQ_HIGH;
+
+	gpio.Pin = _scl_pin;
+	HAL_GPIO_WritePin(_scl_port, _scl_pin, GPIO_PIN_SET);
+	HAL_GPIO_Init(_scl_port, &gpio);
+
+	gpio.Pin = _sda_pin;
+	HAL_GPIO_WritePin(_sda_port, _sda_pin, GPIO_PIN_SET);
+	HAL_GPIO_Init(_sda_port, &gpio);
+
+	// Clock out the byte the slave is still sending
+	for (uint8_t i = 0; i < 9 && HAL_GPIO_ReadPin(_sda_port, _sda_pin) == GPIO_PIN_RESET; i++)
+	{
+		HAL_GPIO_WritePin(_scl_port, _scl_pin, GPIO_PIN_RESET);
+		delay_half_clock();
+		HAL_GPIO_WritePin(_scl_port, _scl_pin, GPIO_PIN_SET);
+		delay_half_clock();
+	}
+
+	// STOP condition: SDA rising while SCL is high
+	HAL_GPIO_WritePin(_sda_port, _sda_pin, GPIO_PIN_RESET);
+	delay_half_clock();
+	HAL_GPIO_WritePin(_sda_port, _sda_pin, GPIO_PIN_SET);
+	delay_half_clock();
+
+	bool released = (HAL_GPIO_ReadPin(_sda_port, _sda_pin) == GPIO_PIN_SET);
+
+	// Restores the alternate function of the pins via HAL_I2C_MspInit
+	if (HAL_I2C_Init(_hi2c) != HAL_OK || !released)
+	{
+		return HAL_ERROR;
+	}
+
+	return HAL_OK;
+}
+
+/**
+ * Busy waits for about half a period of a 100 kHz clock (5us)
+ */
+void ADS7828::delay_half_clock()
+{
+	// A loop iteration takes at least 4 cycles
+	volatile uint32_t i = SystemCoreClock / 800000;
+	while (i > 0)
+	{
+		i = i - 1;
+	}
+}
+
+/**
+ * Gives a channel its own conversion entry, starting with the defaults.
+ * The entry is filled before the channel is switched to it, so a read from an interrupt sees either the old or the new one.
+ *
+ * @param channel The channel that needs its own scaling, calibration, table or curve
+ * @return The entry of the channel, nullptr if all ADS7828_CONVERSIONS entries are used by other channels
+ */
+ADS7828_conversion_t *ADS7828::own_conversion(ADS7828_CHANNEL channel)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	uint8_t found = _conv[channel];
+
+	for (uint8_t e = 0; e < ADS7828_CONVERSIONS && found == 0; e++)
+	{
+		if (_conv_channels[e] == ADS7828_NO_SLOT)
+		{
+			_conv_channels[e] = channel;
+			_conversions[e + 1] = _conversions[0];
+			_conv[channel] = e + 1;
+			found = e + 1;
+		}
+	}
+
+	__set_PRIMASK(primask);
+	return (found != 0) ? &_conversions[found] : nullptr;
+}
+
+/**
+ * Gives the conversion entry of a channel back once it only holds the defaults again
+ *
+ * @param channel The channel to check
+ */
+void ADS7828::release_conversion(ADS7828_CHANNEL channel)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	uint8_t entry = _conv[channel];
+
+	if (entry != 0 && _conversions[entry].is_default())
+	{
+		_conv[channel] = 0;
+		_conv_channels[entry - 1] = ADS7828_NO_SLOT;
+	}
+
+	__set_PRIMASK(primask);
+}
+
+/**
+ * Stores scaling and calibration of a channel and recomputes its conversion factor.
+ * Channels that end up with the defaults share the default entry, so resetting never fails.
+ *
+ * @param channel The channel to set
+ * @param scaling Scaling Factor that will be multiplied with the voltage, fixed-point with ADS7828_SCALE_SHIFT fractional bits
+ * @param cal_gain Calibration gain, fixed-point with ADS7828_CAL_SHIFT fractional bits
+ * @param cal_offset_uv Calibration offset [uV]
+ * @return HAL_OK, HAL_ERROR if the channel needs its own entry and all ADS7828_CONVERSIONS are used by other channels
+ */
+HAL_StatusTypeDef ADS7828::store_conversion(ADS7828_CHANNEL channel, int32_t scaling, int32_t cal_gain, int32_t cal_offset_uv)
+{
+	if (_conv[channel] == 0 && scaling == (1L << ADS7828_SCALE_SHIFT) && cal_gain == (1L << ADS7828_CAL_SHIFT) && cal_offset_uv == 0)
+	{
+		return HAL_OK;
+	}
+
+	ADS7828_conversion_t *conv = own_conversion(channel);
+
+	if (conv == nullptr)
+	{
+		return HAL_ERROR;
+	}
+
+	conv->scaling = scaling;
+	conv->cal_gain = cal_gain;
+	conv->cal_offset_uv = cal_offset_uv;
+	update_conversion(*conv);
+	release_conversion(channel);
+	return HAL_OK;
+}
+
+/**
+ * Get the number of channels that can still get their own scaling, calibration, conversion table or sensor curve
+ *
+ * @return Free entries of the ADS7828_CONVERSIONS
+ */
+uint8_t ADS7828::get_free_conversions()
+{
+	uint8_t free = 0;
+
+	for (uint8_t e = 0; e < ADS7828_CONVERSIONS; e++)
+	{
+		free += (_conv_channels[e] == ADS7828_NO_SLOT) ? 1 : 0;
+	}
+
+	return free;
+}
+
+#ifndef ADS7828_INTEGER_ONLY
+/**
+ * Set the scaling for a channel voltage so that read_voltage returns voltage * scaling.
+ * Stored in fixed-point with ADS7828_SCALE_SHIFT fractional bits.
+ *
+ * @param channel The Channel to set the scaling for
+ * @param scaling Scaling Factor that will be multiplied with the voltage
+ * @return HAL_OK, HAL_ERROR if all ADS7828_CONVERSIONS are used by other channels
+ */
+HAL_StatusTypeDef ADS7828::set_scaling(ADS7828_CHANNEL channel, float scaling)
+{
+	float fixed = scaling * (float)(1L << ADS7828_SCALE_SHIFT);
+	const ADS7828_conversion_t &conv = conversion(channel);
+	return store_conversion(channel, (int32_t)((fixed >= 0) ? (fixed + 0.5f) : (fixed - 0.5f)), conv.cal_gain, conv.cal_offset_uv);
+}
+
+/**
+ * Get the current voltage scaling for a channel
+ *
+ * @param channel The Channel to get the scaling for
+ * @return The current scaling factor of the channel
+ */
+float ADS7828::get_scaling(ADS7828_CHANNEL channel)
+{
+	return conversion(channel).scaling / (float)(1L << ADS7828_SCALE_SHIFT);
+}
+#endif
+
+/**
+ * Set the scaling for a channel voltage as a ratio, e.g. 11 / 1 for a 100k / 10k divider, without float math
+ *
+ * @param channel The Channel to set the scaling for
+ * @param numerator Numerator of the scaling factor
+ * @param denominator Denominator of the scaling factor
+ * @return HAL_OK, HAL_ERROR if the denominator is 0, the factor doesn't fit ADS7828_SCALE_SHIFT or all ADS7828_CONVERSIONS are used by other channels
+ */
+HAL_StatusTypeDef ADS7828::set_scaling_ratio(ADS7828_CHANNEL channel, int32_t numerator, int32_t denominator)
+{
+	if (denominator == 0)
+	{
+		return HAL_ERROR;
+	}
+
+	int64_t fixed = div_round((int64_t)numerator << ADS7828_SCALE_SHIFT, denominator);
+
+	if (fixed > INT32_MAX || fixed < INT32_MIN)
+	{
+		return HAL_ERROR;
+	}
+
+	const ADS7828_conversion_t &conv = conversion(channel);
+	return store_conversion(channel, (int32_t)fixed, conv.cal_gain, conv.cal_offset_uv);
+}
+
+/**
+ * Get the current voltage scaling for a channel in fixed-point
+ *
+ * @param channel The Channel to get the scaling for
+ * @return The scaling factor with ADS7828_SCALE_SHIFT fractional bits
+ */
+int32_t ADS7828::get_scaling_fixed(ADS7828_CHANNEL channel)
+{
+	return conversion(channel).scaling;
+}
+
+/**
+ * Reset the scaling for a channel voltage back to 1
+ *
+ * @param channel The Channel to reset the scaling for
+ */
+void ADS7828::reset_scaling(ADS7828_CHANNEL channel)
+{
+	set_scaling_ratio(channel, 1, 1);
+}
+
+/**
+ * Reset the scaling for all channels back to 1
+ *
+ */
+void ADS7828::reset_scaling()
+{
+	for (uint8_t c = 0; c < ADS7828_CHANNELS; c++)
+	{
+		reset_scaling(static_cast<ADS7828_CHANNEL>(c));
+	}
+}
+
+#ifndef ADS7828_INTEGER_ONLY
+/**
+ * Set a conversion table for a channel, read_voltage and digit_to_voltage then return the entry of the digit.
+ * The table replaces reference, scaling and calibration of the voltage calculation, the millivolt
+ * and microvolt reads keep using them. Generate it at compile time with ADS7828_lut.hpp, so it is placed in flash.
+ *
+ * @param channel The Channel to set the table for
+ * @param lut Table with one entry per digit, has to stay valid while it is set, nullptr to calculate the voltage again
+ * @return HAL_OK, HAL_ERROR if all ADS7828_CONVERSIONS are used by other channels
+ */
+HAL_StatusTypeDef ADS7828::set_lut(ADS7828_CHANNEL channel, const ADS7828_lut_t *lut)
+{
+	if (_conv[channel] == 0 && lut == nullptr)
+	{
+		return HAL_OK;
+	}
+
+	ADS7828_conversion_t *conv = own_conversion(channel);
+
+	if (conv == nullptr)
+	{
+		return HAL_ERROR;
+	}
+
+	conv->lut = lut;
+	release_conversion(channel);
+	return HAL_OK;
+}
+
+/**
+ * Get the conversion table of a channel
+ *
+ * @param channel The Channel to get the table for
+ * @return The table set with set_lut, nullptr if the voltage is calculated
+ */
+const ADS7828_lut_t *ADS7828::get_lut(ADS7828_CHANNEL channel)
+{
+	return conversion(channel).lut;
+}
+#endif
+
+/**
+ * Set the sensor curve of a channel for the linearization, e.g. the temperature of an NTC over the digit.
+ * Between the points the result is interpolated linearly with integer math, outside it is clamped to the end points.
+ * The curve replaces calculations like Steinhart-Hart on the voltage, place it in flash as const table.
+ *
+ * @param channel The Channel to set the curve for
+ * @param points Curve points with ascending digits, has to stay valid while it is set
+ * @param n Number of points (2 - 255)
+ * @return HAL_OK, HAL_ERROR if there are less than 2 points, the digits are not ascending or all ADS7828_CONVERSIONS are used by other channels
+ */
+HAL_StatusTypeDef ADS7828::set_curve(ADS7828_CHANNEL channel, const ADS7828_curve_point_t *points, uint8_t n)
+{
+	if (points == nullptr || n < 2)
+	{
+		return HAL_ERROR;
+	}
+
+	for (uint8_t i = 1; i < n; i++)
+	{
+		if (points[i].digit <= points[i - 1].digit)
+		{
+			return HAL_ERROR;
+		}
+	}
+
+	ADS7828_conversion_t *conv = own_conversion(channel);
+
+	if (conv == nullptr)
+	{
+		return HAL_ERROR;
+	}
+
+	// The size first, a read from an interrupt never sees the new points with a shorter curve
+	conv->curve_size = n;
+	conv->curve = points;
+	return HAL_OK;
+}
+
+/**
+ * Removes the sensor curve of a channel, the linearization then returns the digit
+ *
+ * @param channel The Channel to remove the curve from
+ */
+void ADS7828::clear_curve(ADS7828_CHANNEL channel)
+{
+	if (_conv[channel] == 0)
+	{
+		return;
+	}
+
+	ADS7828_conversion_t &conv = _conversions[_conv[channel]];
+	conv.curve = nullptr;
+	conv.curve_size = 0;
+	release_conversion(channel);
+}
+
+#ifndef ADS7828_ASYNC_ONLY
+/**
+ * Reads a channel and converts the (rounded average) digit with the sensor curve of the channel
+ *
+ * @param channel The ADS7828_CHANNEL configuration you want the value from
+ * @param status Optional pointer that receives the HAL status of the read
+ * @return Value of the curve at the digit, 0 if the read failed
+ */
+int32_t ADS7828::read_linearized(ADS7828_CHANNEL channel, HAL_StatusTypeDef *status)
+{
+	uint16_t digit = 0;
+	HAL_StatusTypeDef result = read(channel, digit);
+
+	if (status != nullptr)
+	{
+		*status = result;
+	}
+
+	if (result != HAL_OK)
+	{
+		return 0;
+	}
+
+	return digit_to_linearized(channel, digit);
+}
+#endif
+
+/**
+ * Converts a digit with the sensor curve of a channel.
+ * Finds the segment by binary search and interpolates with one multiply and one divide, no float math is done.
+ *
+ * @param channel The ADS7828_CHANNEL configuration the digit belongs to
+ * @param digit The digit (0 - 4095)
+ * @return Value of the curve at the digit, rounded to the unit of the points, the digit if the channel has no curve
+ */
+int32_t ADS7828::digit_to_linearized(ADS7828_CHANNEL channel, uint16_t digit)
+{
+	const ADS7828_conversion_t &conv = conversion(channel);
+	const ADS7828_curve_point_t *points = conv.curve;
+	uint8_t n = conv.curve_size;
+
+	if (points == nullptr)
+	{
+		return digit;
+	}
+
+	if (digit <= points[0].digit)
+	{
+		return points[0].value;
+	}
+
+	if (digit >= points[n - 1].digit)
+	{
+		return points[n - 1].value;
+	}
+
+	// points[low].digit <= digit < points[high].digit
+	uint8_t low = 0;
+	uint8_t high = n - 1;
+
+	while (high - low > 1)
+	{
+		uint8_t mid = (low + high) / 2;
+
+		if (points[mid].digit <= digit)
+		{
+			low = mid;
+		}
+		else
+		{
+			high = mid;
+		}
+	}
+
+	int32_t span = points[high].digit - points[low].digit;
+	int32_t delta = (int32_t)(points[high].value - points[low].value) * (digit - points[low].digit);
+	delta += (delta < 0) ? -span / 2 : span / 2;
+
+	return points[low].value + delta / span;
+}
+
+#ifndef ADS7828_INTEGER_ONLY
+/**
+ * Calculates the two-point calibration of a channel from two readings of known voltages, see calibrate_fixed.
+ * The readings are taken with the current reference and scaling, e.g. with read_digit or read_oversampled / 4^k.
+ *
+ * @param channel The channel to calibrate
+ * @param known_low The lower applied voltage [V] (after scaling)
+ * @param digit_low The digit read with known_low applied
+ * @param known_high The higher applied voltage [V] (after scaling)
+ * @param digit_high The digit read with known_high applied
+ * @return HAL_OK, HAL_ERROR if both points read the same, the gain is out of range or all ADS7828_CONVERSIONS are used by other channels
+ */
+HAL_StatusTypeDef ADS7828::calibrate(ADS7828_CHANNEL channel, float known_low, float digit_low, float known_high, float digit_high)
+{
+	float low = known_low * 1e6f;
+	float high = known_high * 1e6f;
+	float fixed_low = digit_low * (1 << ADS7828_AVG_FRAC_BITS) + 0.5f;
+	float fixed_high = digit_high * (1 << ADS7828_AVG_FRAC_BITS) + 0.5f;
+
+	// Digits outside of the range are no valid readings
+	if (fixed_low < 0 || fixed_high < 0 || fixed_low > 65535.0f || fixed_high > 65535.0f)
+	{
+		return HAL_ERROR;
+	}
+
+	return calibrate_fixed(channel, (int32_t)((low >= 0) ? (low + 0.5f) : (low - 0.5f)), (uint16_t)fixed_low,
+						   (int32_t)((high >= 0) ? (high + 0.5f) : (high - 0.5f)), (uint16_t)fixed_high);
+}
+
+/**
+ * Sets the calibration of a channel directly, e.g. with coefficients stored from an earlier calibrate
+ *
+ * @param channel The channel to set the calibration for
+ * @param gain Factor applied to the scaled voltage
+ * @param offset Voltage [V] added after the gain
+ * @return HAL_OK, HAL_ERROR if all ADS7828_CONVERSIONS are used by other channels
+ */
+HAL_StatusTypeDef ADS7828::set_calibration(ADS7828_CHANNEL channel, float gain, float offset)
+{
+	float g = gain * (float)(1UL << ADS7828_CAL_SHIFT);
+	float o = offset * 1e6f;
+
+	return set_calibration_fixed(channel, (int32_t)((g >= 0) ? (g + 0.5f) : (g - 0.5f)), (int32_t)((o >= 0) ? (o + 0.5f) : (o - 0.5f)));
+}
+
+/**
+ * Get the calibration gain of a channel
+ *
+ * @param channel The channel to get the gain for
+ * @return The gain, 1 if not calibrated
+ */
+float ADS7828::get_calibration_gain(ADS7828_CHANNEL channel)
+{
+	return conversion(channel).cal_gain / (float)(1UL << ADS7828_CAL_SHIFT);
+}
+
+/**
+ * Get the calibration offset of a channel
+ *
+ * @param channel The channel to get the offset for
+ * @return The offset [V], 0 if not calibrated
+ */
+float ADS7828::get_calibration_offset(ADS7828_CHANNEL channel)
+{
+	return conversion(channel).cal_offset_uv * 1e-6f;
+}
+#endif
+
+/**
+ * Calculates the two-point calibration of a channel from two readings of known voltages, in integer math.
+ * The readings are taken with the current reference and scaling, e.g. with read_average_fixed or read_oversampled << (4 - k).
+ * Afterwards every voltage reading of the channel is corrected with gain * voltage + offset.
+ *
+ * @param channel The channel to calibrate
+ * @param known_low_uv The lower applied voltage [uV] (after scaling)
+ * @param digit_low The digit read with known_low_uv applied, with ADS7828_AVG_FRAC_BITS fractional bits
+ * @param known_high_uv The higher applied voltage [uV] (after scaling)
+ * @param digit_high The digit read with known_high_uv applied, with ADS7828_AVG_FRAC_BITS fractional bits
+ * @return HAL_OK, HAL_ERROR if both points read the same, the gain is out of range or all ADS7828_CONVERSIONS are used by other channels
+ */
+HAL_StatusTypeDef ADS7828::calibrate_fixed(ADS7828_CHANNEL channel, int32_t known_low_uv, uint16_t digit_low, int32_t known_high_uv, uint16_t digit_high)
+{
+	// Microvolts per digit with ADS7828_SCALE_SHIFT fractional bits
+	int64_t lsb = div_round((int64_t)get_ref_voltage_uv() * conversion(channel).scaling, 4095);
+	int64_t span = ((int64_t)digit_high - digit_low) * lsb >> ADS7828_AVG_FRAC_BITS;
+
+	// Both points read the same, no slope
+	if (span == 0)
+	{
+		return HAL_ERROR;
+	}
+
+	// The difference keeps 32 fractional bits below, more than +-1 kV doesn't fit
+	int64_t delta = (int64_t)known_high_uv - known_low_uv;
+
+	if (delta >= (1LL << 30) || delta <= -(1LL << 30))
+	{
+		return HAL_ERROR;
+	}
+
+	int64_t gain = div_round(delta * (1LL << (ADS7828_SCALE_SHIFT + ADS7828_CAL_SHIFT)), span);
+
+	if (gain > INT32_MAX || gain < INT32_MIN)
+	{
+		return HAL_ERROR;
+	}
+
+	int64_t low_uv = div_round((int64_t)digit_low * lsb, 1LL << (ADS7828_AVG_FRAC_BITS + ADS7828_SCALE_SHIFT));
+	int64_t offset = known_low_uv - div_round(gain * low_uv, 1LL << ADS7828_CAL_SHIFT);
+
+	if (offset > INT32_MAX || offset < INT32_MIN)
+	{
+		return HAL_ERROR;
+	}
+
+	return set_calibration_fixed(channel, (int32_t)gain, (int32_t)offset);
+}
+
+/**
+ * Sets the calibration of a channel directly in fixed-point, e.g. with coefficients stored from an earlier calibrate
+ *
+ * @param channel The channel to set the calibration for
+ * @param gain Factor applied to the scaled voltage, with ADS7828_CAL_SHIFT fractional bits
+ * @param offset_uv Voltage [uV] added after the gain
+ * @return HAL_OK, HAL_ERROR if all ADS7828_CONVERSIONS are used by other channels
+ */
+HAL_StatusTypeDef ADS7828::set_calibration_fixed(ADS7828_CHANNEL channel, int32_t gain, int32_t offset_uv)
+{
+	return store_conversion(channel, conversion(channel).scaling, gain, offset_uv);
+}
+
+/**
+ * Get the calibration gain of a channel in fixed-point
+ *
+ * @param channel The channel to get the gain for
+ * @return The gain with ADS7828_CAL_SHIFT fractional bits, 1 << ADS7828_CAL_SHIFT if not calibrated
+ */
+int32_t ADS7828::get_calibration_gain_fixed(ADS7828_CHANNEL channel)
+{
+	return conversion(channel).cal_gain;
+}
+
+/**
+ * Get the calibration offset of a channel
+ *
+ * @param channel The channel to get the offset for
+ * @return The offset [uV], 0 if not calibrated
+ */
+int32_t ADS7828::get_calibration_offset_uv(ADS7828_CHANNEL channel)
+{
+	return conversion(channel).cal_offset_uv;
+}
+
+/**
+ * Reset the calibration of a channel to gain 1 and offset 0
+ *
+ * @param channel The channel to reset the calibration for
+ */
+void ADS7828::reset_calibration(ADS7828_CHANNEL channel)
+{
+	// Back to the defaults, so this never needs a new entry
+	store_conversion(channel, conversion(channel).scaling, 1L << ADS7828_CAL_SHIFT, 0);
+}
+
+/**
+ * Reset the calibration of all channels
+ */
+void ADS7828::reset_calibration()
+{
+	for (uint8_t c = 0; c < ADS7828_CHANNELS; c++)
+	{
+		reset_calibration(static_cast<ADS7828_CHANNEL>(c));
+	}
+}
+
+/**
+ * CRC-32 (IEEE 802.3) of a block of data, nibble-wise with a small table
+ *
+ * @param data Start of the data
+ * @param length Number of bytes
+ * @return CRC of the data
+ */
+uint32_t ADS7828_crc32(const void *data, size_t length)
+{
+	static const uint32_t table[16] = {
+		0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+		0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C};
+
+	const uint8_t *bytes = (const uint8_t *)data;
+	uint32_t crc = 0xFFFFFFFF;
+
+	for (size_t i = 0; i < length; i++)
+	{
+		crc = table[(crc ^ bytes[i]) & 0x0F] ^ (crc >> 4);
+		crc = table[(crc ^ (bytes[i] >> 4)) & 0x0F] ^ (crc >> 4);
+	}
+
+	return ~crc;
+}
+
+/**
+ * Serializes the reference, power, scaling, calibration and filter settings of all channels
+ *
+ * @param config Receives the configuration including its CRC
+ */
+void ADS7828::get_config(ADS7828_config_t &config)
+{
+	config = {};
+	config.magic = ADS7828_CONFIG_MAGIC;
+	config.version = ADS7828_CONFIG_VERSION;
+	config.size = sizeof(ADS7828_config_t);
+	config.ref_uv = _ref_uv;
+	config.auto_interval_ms = _auto_power ? _auto_interval_ms : 0;
+	config.internal_ref = _internal_ref;
+	config.pd_mode = _pd_mode;
+	config.repeated_start = _repeated_start;
+
+	for (uint8_t c = 0; c < ADS7828_CHANNELS; c++)
+	{
+		const ADS7828_conversion_t &conv = conversion(static_cast<ADS7828_CHANNEL>(c));
+		config.scaling[c] = conv.scaling;
+		config.cal_gain[c] = conv.cal_gain;
+		config.cal_offset_uv[c] = conv.cal_offset_uv;
+		uint8_t slot = _slots[c];
+
+		if (slot != ADS7828_NO_SLOT)
+		{
+			config.filter_coeff[c] = _filters[slot].coeff;
+			config.filter_mode[c] = _filters[slot].mode;
+			config.averaging[c] = (_buffers[slot].n > 1) ? _buffers[slot].n : 1;
+			config.median[c] = _medians[slot].size;
+		}
+		else
+		{
+			config.filter_mode[c] = FILTER_NONE;
+			config.averaging[c] = 1;
+		}
+	}
+
+	config.crc = ADS7828_crc32(&config, offsetof(ADS7828_config_t, crc));
+}
+
+/**
+ * Restores a configuration from get_config, e.g. after loading it from flash.
+ * Nothing is changed if the configuration is invalid or its filters don't fit. Stored averages and filter states start over.
+ *
+ * @param config The configuration to apply
+ * @return HAL_OK if applied, HAL_ERROR if the magic, version, size or CRC don't match, or the filters need more slots or averaging values
+ *         or the scaling and calibration more ADS7828_CONVERSIONS than the driver has
+ */
+HAL_StatusTypeDef ADS7828::set_config(const ADS7828_config_t &config)
+{
+	if (config.magic != ADS7828_CONFIG_MAGIC || config.version != ADS7828_CONFIG_VERSION || config.size != sizeof(ADS7828_config_t))
+	{
+		return HAL_ERROR;
+	}
+
+	if (config.crc != ADS7828_crc32(&config, offsetof(ADS7828_config_t, crc)) || config.pd_mode > REF_ON_AD_ON)
+	{
+		return HAL_ERROR;
+	}
+
+	uint8_t slots = 0;
+	uint32_t depths = 0;
+	uint8_t conversions = 0;
+
+	for (uint8_t c = 0; c < ADS7828_CHANNELS; c++)
+	{
+		// Tables and curves are not part of the configuration, their channels keep their entries
+		ADS7828_conversion_t kept = conversion(static_cast<ADS7828_CHANNEL>(c));
+		kept.scaling = config.scaling[c];
+		kept.cal_gain = config.cal_gain[c];
+		kept.cal_offset_uv = config.cal_offset_uv[c];
+		conversions += kept.is_default() ? 0 : 1;
+
+		slots += (config.filter_mode[c] != FILTER_NONE || config.averaging[c] > 1 || config.median[c] > 1) ? 1 : 0;
+		// Averaging only applies to channels without a recursive filter
+		depths += (config.filter_mode[c] == FILTER_NONE && config.averaging[c] > 1) ? config.averaging[c] : 0;
+	}
+
+#ifdef ADS7828_NO_AVERAGING
+	// Averaging, filters and the median are compiled out, their setters fail
+	if (slots != 0)
+	{
+		return HAL_ERROR;
+	}
+#endif
+
+	if (slots > ADS7828_SLOTS || conversions > ADS7828_CONVERSIONS)
+	{
+		return HAL_ERROR;
+	}
+
+#ifdef ADS7828_DYNAMIC_MEM
+	// Disabling all channels below empties the pool, so the whole pool is available
+	if (depths > _avg_pool_size)
+	{
+		return HAL_ERROR;
+	}
+#else
+	(void)depths;
+#endif
+
+	// Free all slots and conversion entries first, so every channel of the configuration finds one
+	for (uint8_t c = 0; c < ADS7828_CHANNELS; c++)
+	{
+		ADS7828_CHANNEL channel = static_cast<ADS7828_CHANNEL>(c);
+		disable_filter(channel);
+		disable_averaging(channel);
+		disable_median(channel);
+		store_conversion(channel, 1L << ADS7828_SCALE_SHIFT, 1L << ADS7828_CAL_SHIFT, 0);
+	}
+
+	HAL_StatusTypeDef status = HAL_OK;
+
+	for (uint8_t c = 0; c < ADS7828_CHANNELS; c++)
+	{
+		ADS7828_CHANNEL channel = static_cast<ADS7828_CHANNEL>(c);
+		HAL_StatusTypeDef result = HAL_OK;
+
+		if (config.filter_mode[c] == FILTER_EMA)
+		{
+			result = set_filter_ema(channel, (uint8_t)config.filter_coeff[c]);
+		}
+		else if (config.filter_mode[c] == FILTER_IIR)
+		{
+			result = set_filter_iir_fixed(channel, config.filter_coeff[c]);
+		}
+		else if (config.averaging[c] > 1)
+		{
+			result = set_averaging(channel, config.averaging[c]);
+		}
+
+		if (result == HAL_OK)
+		{
+			result = set_median(channel, config.median[c]);
+		}
+
+		HAL_StatusTypeDef stored = store_conversion(channel, config.scaling[c], config.cal_gain[c], config.cal_offset_uv[c]);
+		result = (result == HAL_OK) ? stored : result;
+
+		// Checked above, keep the first failure if a setter fails anyway
+		status = (status == HAL_OK) ? result : status;
+	}
+
+	// Also updates the conversion factors of all channels
+	if (config.internal_ref)
+	{
+		set_ref_voltage_internal();
+	}
+	else
+	{
+		set_ref_voltage_external_uv(config.ref_uv);
+	}
+
+	_repeated_start = config.repeated_start;
+
+	if (config.auto_interval_ms != 0)
+	{
+		set_auto_power(config.auto_interval_ms);
+	}
+	else
+	{
+		_auto_power = false;
+		apply_power_mode(static_cast<ADS7828_PD_MODE>(config.pd_mode));
+	}
+
+	return status;
+}
+
+/**
+ * Assigns a slot for the filter state to a channel, a channel keeps its slot until averaging, filter and median are disabled.
+ * The slot map is changed with interrupts disabled, the scanner changes the averaging from the I2C interrupt (see ADS7828_Scanner::reconfigure).
+ *
+ * @param channel The channel that needs filter state
+ * @return Slot of the channel, ADS7828_NO_SLOT if all ADS7828_SLOTS are taken
+ */
+uint8_t ADS7828::acquire_slot(ADS7828_CHANNEL channel)
+{
+#ifdef ADS7828_NO_AVERAGING
+	// Averaging, filters and the median are compiled out, every setter fails
+	(void)channel;
+	return ADS7828_NO_SLOT;
+#else
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	uint8_t found = _slots[channel];
+
+	for (uint8_t slot = 0; slot < ADS7828_SLOTS && found == ADS7828_NO_SLOT; slot++)
+	{
+		if (_slot_channels[slot] == ADS7828_NO_SLOT)
+		{
+			_slot_channels[slot] = channel;
+			_slots[channel] = slot;
+			found = slot;
+		}
+	}
+
+	__set_PRIMASK(primask);
+	return found;
+#endif
+}
+
+/**
+ * Frees the slot of a channel once it has neither averaging, filter nor median.
+ * The averaging buffer carved from the pool stays with the slot and is reused by the next channel.
+ *
+ * @param channel The channel to check
+ */
+void ADS7828::release_slot(ADS7828_CHANNEL channel)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	uint8_t slot = _slots[channel];
+
+	if (slot != ADS7828_NO_SLOT && _buffers[slot].n <= 1 && _filters[slot].mode == FILTER_NONE && _medians[slot].size == 0)
+	{
+		_slot_channels[slot] = ADS7828_NO_SLOT;
+		_slots[channel] = ADS7828_NO_SLOT;
+	}
+
+	__set_PRIMASK(primask);
+}
+
+/**
+ * Enables averaging for a certain channel.
+ *	Whenever get_digit or get_voltage is called, the result will be the average of the last N values.
+ *	With a power of two N the average of the filled buffer is a shift instead of a division.
+ *
+ * @param channel The channel to enable averaging fot
+ * @param n Number of values to average (up to 65535), limited by ADS7828_AVG_MAX or the free space in the averaging pool
+ * @return HAL_OK if enabled, HAL_ERROR if all ADS7828_SLOTS are used by other channels or no values are left in the pool,
+ *         always for a driver constructed without a pool
+ */
+HAL_StatusTypeDef ADS7828::set_averaging(ADS7828_CHANNEL channel, uint16_t n)
+{
+	// Averaging over 1 value is useless
+	if (n <= 1)
+	{
+		return HAL_OK;
+	}
+
+	// Only one filter per channel
+	disable_filter(channel);
+
+	uint8_t slot = acquire_slot(channel);
+
+	if (slot == ADS7828_NO_SLOT)
+	{
+		return HAL_ERROR;
+	}
+
+#ifdef ADS7828_DYNAMIC_MEM
+	ADS7828_circ_buf_t &buf = _buffers[slot];
+
+	// The pool is shared by all slots, carving is atomic against the scanner interrupt
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	uint16_t available = _avg_pool_size - _avg_pool_used;
+
+	if (n > buf.cap)
+	{
+		if (buf.data != nullptr && buf.data + buf.cap == _avg_pool + _avg_pool_used)
+		{
+			// Last carved buffer, grow it in place
+			uint16_t grow = (n - buf.cap > available) ? available : n - buf.cap;
+			_avg_pool_used += grow;
+			buf.cap += grow;
+		}
+		else if (available > buf.cap)
+		{
+			// Carve a new buffer, the old one stays unused in the pool
+			buf.cap = (n > available) ? available : n;
+			buf.data = _avg_pool + _avg_pool_used;
+			_avg_pool_used += buf.cap;
+		}
+	}
+
+	// Pool exhausted, use what is there
+	if (n > buf.cap)
+	{
+		n = buf.cap;
+	}
+
+	// The depth marks the buffer as used before another slot can reset the pool
+	if (n > 1)
+	{
+		buf.set_depth(n);
+	}
+
+	__set_PRIMASK(primask);
+
+	if (n <= 1)
+	{
+		release_slot(channel);
+		return HAL_ERROR;
+	}
+
+	clear_averaging(channel);
+#else
+	_buffers[slot].set_depth((n > ADS7828_AVG_MAX) ? ADS7828_AVG_MAX : n);
+	clear_averaging(channel);
+#endif
+	return HAL_OK;
+}
+
+/**
+ * Clears all current values of the channel.
+ * The average restarts with the next reading and only covers the readings taken since.
+ *
+ * @param channel The channel to clear the old values for
+ */
+void ADS7828::clear_averaging(ADS7828_CHANNEL channel)
+{
+	uint8_t slot = _slots[channel];
+
+	if (slot == ADS7828_NO_SLOT)
+	{
+		return;
+	}
+
+	ADS7828_circ_buf_t &buf = _buffers[slot];
+
+	for (uint16_t n = 0; n < buf.n; n++)
+	{
+		buf.data[n] = 0;
+	}
+
+	buf.w_index = 0;
+	buf.fill = 0;
+	buf.sum = 0;
+}
+
+/**
+ * Disables the averaging and deletes all stored values
+ *
+ * @param channel The channel to disable averaging for
+ */
+void ADS7828::disable_averaging(ADS7828_CHANNEL channel)
+{
+	uint8_t slot = _slots[channel];
+
+	// Averaging is already disabled
+	if (slot == ADS7828_NO_SLOT || _buffers[slot].n <= 1)
+	{
+		return;
+	}
+
+	ADS7828_circ_buf_t &buf = _buffers[slot];
+	buf.set_depth(1);
+	buf.fill = 0;
+
+#ifdef ADS7828_DYNAMIC_MEM
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	// The last carved buffer goes back to the pool, others are kept for reuse
+	if (buf.data != nullptr && buf.data + buf.cap == _avg_pool + _avg_pool_used)
+	{
+		_avg_pool_used -= buf.cap;
+		buf.cap = 0;
+		buf.data = nullptr;
+	}
+
+	// No averaging left at all, start over with an empty pool
+	bool in_use = false;
+	for (uint8_t s = 0; s < ADS7828_SLOTS; s++)
+	{
+		in_use |= _buffers[s].n > 1;
+	}
+
+	if (!in_use)
+	{
+		for (uint8_t s = 0; s < ADS7828_SLOTS; s++)
+		{
+			_buffers[s].cap = 0;
+			_buffers[s].data = nullptr;
+		}
+		_avg_pool_used = 0;
+	}
+
+	__set_PRIMASK(primask);
+#else
+	buf.w_index = 0;
+	buf.sum = 0;
+
+	for (uint8_t n = 0; n < ADS7828_AVG_MAX; n++)
+	{
+		buf.data[n] = 0;
+	}
+#endif
+	release_slot(channel);
+}
+
+/**
+ * Enables an exponential moving average for a certain channel: y += (x - y) / 2^shift.
+ * Only needs one accumulator word and no multiplication, replaces the moving average of the channel.
+ *
+ * @param channel The channel to enable the filter for
+ * @param shift Smoothing, alpha = 2^-shift (1 - 15), roughly averages the last 2^(shift+1) values
+ * @return HAL_OK if enabled, HAL_ERROR if all ADS7828_SLOTS are used by other channels
+ */
+HAL_StatusTypeDef ADS7828::set_filter_ema(ADS7828_CHANNEL channel, uint8_t shift)
+{
+	if (shift == 0)
+	{
+		disable_filter(channel);
+		return HAL_OK;
+	}
+
+	disable_averaging(channel);
+
+	uint8_t slot = acquire_slot(channel);
+
+	if (slot == ADS7828_NO_SLOT)
+	{
+		return HAL_ERROR;
+	}
+
+	_filters[slot].mode = FILTER_EMA;
+	_filters[slot].coeff = (shift > 15) ? 15 : shift;
+	clear_filter(channel);
+	return HAL_OK;
+}
+
+#ifndef ADS7828_INTEGER_ONLY
+/**
+ * Enables a first-order IIR low pass for a certain channel: y += alpha * (x - y).
+ * The coefficient is converted to fixed-point once, see set_filter_iir_fixed.
+ *
+ * @param channel The channel to enable the filter for
+ * @param alpha Weight of a new value, between 0 (no change) and 1 (no filtering)
+ * @return HAL_OK if enabled, HAL_ERROR if all ADS7828_SLOTS are used by other channels
+ */
+HAL_StatusTypeDef ADS7828::set_filter_iir(ADS7828_CHANNEL channel, float alpha)
+{
+	uint32_t coeff = (alpha > 0) ? (uint32_t)(alpha * 65536.0f + 0.5f) : 0;
+
+	// No filtering for alpha = 1
+	return set_filter_iir_fixed(channel, (coeff >= 65536) ? 0 : (uint16_t)coeff);
+}
+#endif
+
+/**
+ * Enables a first-order IIR low pass for a certain channel: y += alpha * (x - y), replaces the moving average of the channel
+ *
+ * @param channel The channel to enable the filter for
+ * @param alpha Weight of a new value with 16 fractional bits (1 - 65535), 0 disables the filter
+ * @return HAL_OK if enabled, HAL_ERROR if all ADS7828_SLOTS are used by other channels
+ */
+HAL_StatusTypeDef ADS7828::set_filter_iir_fixed(ADS7828_CHANNEL channel, uint16_t alpha)
+{
+	// No output at all for alpha = 0
+	if (alpha == 0)
+	{
+		disable_filter(channel);
+		return HAL_OK;
+	}
+
+	disable_averaging(channel);
+
+	uint8_t slot = acquire_slot(channel);
+
+	if (slot == ADS7828_NO_SLOT)
+	{
+		return HAL_ERROR;
+	}
+
+	_filters[slot].mode = FILTER_IIR;
+	_filters[slot].coeff = alpha;
+	clear_filter(channel);
+	return HAL_OK;
+}
+
+/**
+ * Restarts the filter of a channel, the next value is taken as is
+ *
+ * @param channel The channel to clear the filter for
+ */
+void ADS7828::clear_filter(ADS7828_CHANNEL channel)
+{
+	uint8_t slot = _slots[channel];
+
+	if (slot == ADS7828_NO_SLOT)
+	{
+		return;
+	}
+
+	_filters[slot].state = 0;
+	_filters[slot].primed = false;
+}
+
+/**
+ * Disables the recursive filter of a channel
+ *
+ * @param channel The channel to disable the filter for
+ */
+void ADS7828::disable_filter(ADS7828_CHANNEL channel)
+{
+	uint8_t slot = _slots[channel];
+
+	if (slot == ADS7828_NO_SLOT)
+	{
+		return;
+	}
+
+	_filters[slot].mode = FILTER_NONE;
+	_filters[slot].coeff = 0;
+	clear_filter(channel);
+	release_slot(channel);
+}
+
+/**
+ * Get the recursive filter mode of a channel
+ *
+ * @param channel The channel to get the mode for
+ * @return FILTER_NONE, FILTER_EMA or FILTER_IIR
+ */
+ADS7828_FILTER_MODE ADS7828::get_filter_mode(ADS7828_CHANNEL channel)
+{
+	uint8_t slot = _slots[channel];
+	return (slot == ADS7828_NO_SLOT) ? FILTER_NONE : static_cast<ADS7828_FILTER_MODE>(_filters[slot].mode);
+}
+
+/**
+ * Enables a median filter for a certain channel that rejects single spikes.
+ * The median is taken before the moving average or recursive filter, so both can be combined.
+ *
+ * @param channel The channel to enable the median for
+ * @param size Window size 3, 5 or 7, even sizes are rounded up, 0 or 1 disables the median
+ * @return HAL_OK if enabled, HAL_ERROR if all ADS7828_SLOTS are used by other channels
+ */
+HAL_StatusTypeDef ADS7828::set_median(ADS7828_CHANNEL channel, uint8_t size)
+{
+	if (size <= 1)
+	{
+		disable_median(channel);
+		return HAL_OK;
+	}
+
+	uint8_t slot = acquire_slot(channel);
+
+	if (slot == ADS7828_NO_SLOT)
+	{
+		return HAL_ERROR;
+	}
+
+	size |= 1;
+	_medians[slot].size = (size > ADS7828_MEDIAN_MAX) ? ADS7828_MEDIAN_MAX : size;
+	_medians[slot].w_index = 0;
+	_medians[slot].primed = false;
+	return HAL_OK;
+}
+
+/**
+ * Disables the median filter of a channel
+ *
+ * @param channel The channel to disable the median for
+ */
+void ADS7828::disable_median(ADS7828_CHANNEL channel)
+{
+	uint8_t slot = _slots[channel];
+
+	if (slot == ADS7828_NO_SLOT)
+	{
+		return;
+	}
+
+	_medians[slot].size = 0;
+	_medians[slot].w_index = 0;
+	_medians[slot].primed = false;
+	release_slot(channel);
+}
+
+/**
+ * Get the number of slots left for channels with averaging, a filter or a median
+ *
+ * @return Free slots out of ADS7828_SLOTS
+ */
+uint8_t ADS7828::get_free_slots()
+{
+	uint8_t free = 0;
+
+	for (uint8_t slot = 0; slot < ADS7828_SLOTS; slot++)
+	{
+		free += (_slot_channels[slot] == ADS7828_NO_SLOT) ? 1 : 0;
+	}
+
+	return free;
+}
+
+/**
+ * Get the sum of the last N values of a channel with averaging enabled.
+ * Dividing by get_averaging_count() gives the same result as the averaged digit, but lets you stay in integer math.
+ *
+ * @param channel The channel to get the sum for
+ * @return Sum of the stored digits, 0 if averaging is disabled
+ */
+uint32_t ADS7828::get_averaging_sum(ADS7828_CHANNEL channel)
+{
+	uint8_t slot = _slots[channel];
+
+	if (slot == ADS7828_NO_SLOT || _buffers[slot].n <= 1)
+	{
+		return 0;
+	}
+
+	return _buffers[slot].sum;
+}
+
+/**
+ * Get the number of values currently covered by the average of a channel.
+ * Grows from 0 up to N after enabling or clearing the averaging.
+ *
+ * @param channel The channel to get the count for
+ * @return Number of valid stored digits, 0 if averaging is disabled
+ */
+uint16_t ADS7828::get_averaging_count(ADS7828_CHANNEL channel)
+{
+	uint8_t slot = _slots[channel];
+
+	if (slot == ADS7828_NO_SLOT || _buffers[slot].n <= 1)
+	{
+		return 0;
+	}
+
+	return _buffers[slot].fill;
+}
+
+#ifdef ADS7828_DYNAMIC_MEM
+/**
+ * Get the number of values left in the averaging pool
+ *
+ * @return Values that can still be carved for new or deeper averaging buffers
+ */
+uint16_t ADS7828::get_averaging_pool_free()
+{
+	return _avg_pool_size - _avg_pool_used;
+}
+#endif
+
+/**
+ * Starts a non-blocking read of a channel configuration using DMA.
+ * The command byte is sent with I2C_FIRST_FRAME and the result is received with a repeated start,
+ * the callback is called from the I2C interrupt once the digit is available.
+ * Requires tx_complete_callback, rx_complete_callback and error_callback to be called from the HAL I2C callbacks!
+ *
+ * @param channel The ADS7828_CHANNEL configuration you want the digit from
+ * @param callback Function that receives the digit (same value as read_digit) or the error status
+ * @param context User pointer that is passed to the callback
+ * @return HAL_OK if the transfer was started, HAL_BUSY if a read is already running, or the HAL error
+ */
+HAL_StatusTypeDef ADS7828::start_read_dma(ADS7828_CHANNEL channel, ADS7828_callback_t callback, void *context)
+{
+#ifdef ADS7828_LATENCY
+	// A queued request counts from its submission, a direct one from now
+	uint32_t requested = _request_queued ? _request_origin : get_cycles();
+	_request_queued = false;
+#endif
+
+	if (_busy)
+	{
+		return HAL_BUSY;
+	}
+
+#ifdef ADS7828_LATENCY
+	_request_cycles = requested;
+#endif
+
+	_async_mode = ASYNC_SINGLE;
+	_async_callback = callback;
+	_async_context = context;
+
+	return start_async(channel, I2C_FIRST_FRAME);
+}
+
+/**
+ * Defers the averaging and filters of single DMA reads to the callback, e.g. to start the next read first,
+ * so the processing runs while the command byte of the next read is on the bus (see ADS7828_Scanner::set_read_ahead).
+ * While enabled, the callback of start_read_dma gets the raw digit and calls process_result for the processed one.
+ *
+ * @param defer True to pass raw digits, false to process them before the callback
+ */
+void ADS7828::set_deferred_processing(bool defer)
+{
+	_defer_processing = defer;
+}
+
+/**
+ * Applies averaging, filters and the ratiometric tracking of the channel to a raw digit, like a completed read does
+ *
+ * @param channel The ADS7828_CHANNEL configuration the digit belongs to
+ * @param digit The raw digit, e.g. passed to the callback of a deferred start_read_dma
+ * @return Digit, filter output, or average like read_digit (rounded with ADS7828_INTEGER_ONLY)
+ */
+ADS7828_digit_t ADS7828::process_result(ADS7828_CHANNEL channel, uint16_t digit)
+{
+#ifdef ADS7828_INTEGER_ONLY
+	return process_digit_int(channel, digit);
+#else
+	return process_digit(channel, digit);
+#endif
+}
+
+/**
+ * Streams raw digits of a single channel configuration into a buffer using DMA.
+ * The command byte is only sent once, afterwards the ADS7828 keeps converting the selected channel
+ * on every read, so each digit only costs the address byte and the two result bytes on the bus.
+ * Averaging is not applied to streamed digits!
+ *
+ * @param channel The ADS7828_CHANNEL configuration to stream
+ * @param dst Buffer for count digits (0 - 4095), has to stay valid until the callback is called
+ * @param count Number of digits to read
+ * @param callback Function that is called from the I2C interrupt once the buffer is filled or an error occurred
+ * @param context User pointer that is passed to the callback
+ * @return HAL_OK if the stream was started, HAL_BUSY if a transfer is already running, or the HAL error
+ */
+HAL_StatusTypeDef ADS7828::stream_channel(ADS7828_CHANNEL channel, uint16_t *dst, size_t count, ADS7828_stream_callback_t callback, void *context)
+{
+	if (_busy)
+	{
+		return HAL_BUSY;
+	}
+
+	if (count == 0)
+	{
+		return HAL_ERROR;
+	}
+
+	_async_mode = ASYNC_STREAM;
+	_stream_callback = callback;
+	_async_context = context;
+	_stream_dst = dst;
+	_stream_count = count;
+	_stream_index = 0;
+
+	// The command is terminated with a STOP, every digit is read in its own receive
+	return start_async(channel, I2C_FIRST_AND_LAST_FRAME);
+}
+
+/**
+ * Starts a non-blocking oversampled read of a channel configuration using DMA.
+ * Works like stream_channel, but the 4^extra_bits digits are summed up in the interrupt,
+ * so no buffer is needed. The callback receives the sum >> extra_bits like read_oversampled returns it.
+ *
+ * @param channel The ADS7828_CHANNEL configuration you want the value from
+ * @param extra_bits Additional bits of resolution (1 - ADS7828_OVERSAMPLE_MAX_BITS)
+ * @param callback Function that is called from the I2C interrupt with the value or the error status
+ * @param context User pointer that is passed to the callback
+ * @return HAL_OK if the read was started, HAL_BUSY if a transfer is already running, or the HAL error
+ */
+HAL_StatusTypeDef ADS7828::start_oversample_dma(ADS7828_CHANNEL channel, uint8_t extra_bits, ADS7828_oversample_callback_t callback, void *context)
+{
+	if (_busy)
+	{
+		return HAL_BUSY;
+	}
+
+	if (extra_bits > ADS7828_OVERSAMPLE_MAX_BITS)
+	{
+		extra_bits = ADS7828_OVERSAMPLE_MAX_BITS;
+	}
+
+	_async_mode = ASYNC_OVERSAMPLE;
+	_oversample_callback = callback;
+	_async_context = context;
+	_oversample.bits = extra_bits;
+	_oversample.sum = 0;
+	_stream_count = 1U << (2 * extra_bits);
+	_stream_index = 0;
+
+	return start_async(channel, I2C_FIRST_AND_LAST_FRAME);
+}
+
+/**
+ * Starts a capture of a single channel configuration with pre-trigger history.
+ * Like stream_channel, the command byte is only sent once and the digits are received with DMA,
+ * but they fill the buffer circularly until a trigger. After the trigger, size - pre more digits are received,
+ * so the window holds pre digits before the trigger, the trigger and the following digits.
+ * The interrupt only stores the digit and checks the trigger, the callback is called once for the whole window.
+ * abort() stops a capture without calling the callback.
+ *
+ * @param channel The ADS7828_CHANNEL configuration to capture
+ * @param buffer Circular buffer for size raw digits, has to stay valid until the callback is called
+ * @param size Number of digits in the buffer and length of the window
+ * @param pre Digits before the trigger (0 - size - 1)
+ * @param callback Function that is called from the I2C interrupt once the window is complete or an error occurred
+ * @param context User pointer that is passed to the callback
+ * @return HAL_OK if the capture was started, HAL_BUSY if a transfer is already running, HAL_ERROR for invalid sizes or the HAL error
+ */
+HAL_StatusTypeDef ADS7828::start_capture(ADS7828_CHANNEL channel, uint16_t *buffer, size_t size, size_t pre, ADS7828_capture_callback_t callback, void *context)
+{
+	if (_busy)
+	{
+		return HAL_BUSY;
+	}
+
+	if (size == 0 || pre >= size)
+	{
+		return HAL_ERROR;
+	}
+
+	_async_mode = ASYNC_CAPTURE;
+	_capture_callback = callback;
+	_async_context = context;
+	_stream_dst = buffer;
+	_stream_count = size;
+	_stream_index = 0;
+	_capture.pre = pre;
+	_capture.filled = 0;
+	_capture.first = 0;
+	_capture.window_pre = 0;
+	_capture_request = false;
+	_capture_triggered = false;
+
+	return start_async(channel, I2C_FIRST_AND_LAST_FRAME);
+}
+
+/**
+ * Set the automatic trigger of the captures, checked on every raw digit in the interrupt
+ *
+ * @param trigger Condition of the trigger, TRIGGER_SOFTWARE to only use trigger_capture
+ * @param level Trigger level as raw digit (0 - 4095)
+ */
+void ADS7828::set_capture_trigger(ADS7828_TRIGGER trigger, uint16_t level)
+{
+	_capture_mode = trigger;
+	_capture_level = level;
+}
+
+/**
+ * Triggers the running capture, the next received digit becomes the trigger of the window.
+ * Can be called from any context, e.g. an EXTI interrupt.
+ */
+void ADS7828::trigger_capture()
+{
+	_capture_request = true;
+}
+
+/**
+ * Check if the running capture has triggered and only receives the post-trigger digits
+ *
+ * @return True after the trigger until the callback
+ */
+bool ADS7828::is_capture_triggered()
+{
+	return _capture_triggered;
+}
+
+/**
+ * Reads several channel configurations in one chained I2C transaction using DMA.
+ * All command bytes are prepared first, each command and result are joined with repeated starts and
+ * only the last result is followed by a STOP. Averaging is applied in one pass before the callback.
+ *
+ * @param channels List of ADS7828_CHANNEL configurations to read
+ * @param n Number of channels in the list (1 - 16)
+ * @param out Receives the (rounded average) digit of every channel in list order, has to stay valid until the callback
+ * @param callback Function that is called from the I2C interrupt when all channels are read or an error occurred
+ * @param context User pointer that is passed to the callback
+ * @param quality Optional list that receives the ADS7828_QUALITY bits of every channel in list order, has to stay valid until the callback
+ * @return HAL_OK if the transfer was started, HAL_BUSY if a transfer is already running, or the HAL error
+ */
+HAL_StatusTypeDef ADS7828::start_read_channels_dma(const ADS7828_CHANNEL *channels, size_t n, uint16_t *out, ADS7828_batch_callback_t callback, void *context, uint8_t *quality)
+{
+	if (_busy)
+	{
+		return HAL_BUSY;
+	}
+
+	if (n == 0 || n > ADS7828_CHANNELS)
+	{
+		return HAL_ERROR;
+	}
+
+	_batch.unsettled = 0;
+
+	for (size_t i = 0; i < n; i++)
+	{
+		_batch.channels[i] = channels[i];
+		_batch.commands[i] = build_command(channels[i]);
+		_batch.unsettled |= (uint16_t)(!_last_settled << i);
+	}
+
+	_batch.quality = quality;
+
+	_async_mode = ASYNC_BATCH;
+	_batch_callback = callback;
+	_async_context = context;
+	_async_channel = channels[0];
+	_stream_dst = out;
+	_stream_count = n;
+	_stream_index = 0;
+	_busy = true;
+
+	HAL_StatusTypeDef status = HAL_I2C_Master_Seq_Transmit_DMA(_hi2c, (_address << 1), &_batch.commands[0], 1, I2C_FIRST_FRAME);
+	record_transfer(status, 2);
+
+	if (status != HAL_OK)
+	{
+		_busy = false;
+	}
+
+	return status;
+}
+
+/**
+ * Transmits the command of the next channel of a running batch with a repeated start
+ */
+void ADS7828::batch_next()
+{
+	HAL_StatusTypeDef status = HAL_I2C_Master_Seq_Transmit_DMA(_hi2c, (_address << 1), &_batch.commands[_stream_index], 1, I2C_NEXT_FRAME);
+	record_transfer(status, 2);
+
+	if (status != HAL_OK)
+	{
+		finish_async(status, 0);
+	}
+}
+
+/**
+ * Reads a channel sequence endlessly into a circular buffer using DMA, the layout is interleaved:
+ * buffer[i] holds a digit of channels[i % n]. The command bytes of the sequence are prepared once,
+ * every digit is one DMA command transmit and one DMA receive straight into the buffer, which the driver chains from the interrupt.
+ * The callback is called for every filled half while the other half is being filled, like the half and full transfer
+ * callbacks of a circular DMA. Process or copy the half before the sequence wraps around to it.
+ * A sequence of one channel sends its command once and then only reads, like stream_channel.
+ * Raw digits, averaging and filters do not apply. Runs until abort() or an error.
+ *
+ * @param channels List of ADS7828_CHANNEL configurations to read in this order
+ * @param n Number of channels in the list (1 - 16)
+ * @param buffer Circular buffer for the digits, has to stay valid until the sequence is aborted
+ * @param size Number of digits in the buffer, a multiple of 2 * n so every half starts with the first channel
+ * @param callback Function that is called from the I2C interrupt for every filled half or an error
+ * @param context User pointer that is passed to the callback
+ * @return HAL_OK if the sequence was started, HAL_BUSY if a transfer is already running, HAL_ERROR for an invalid size, or the HAL error
+ */
+HAL_StatusTypeDef ADS7828::start_sequence(const ADS7828_CHANNEL *channels, size_t n, uint16_t *buffer, size_t size, ADS7828_sequence_callback_t callback, void *context)
+{
+	if (_busy)
+	{
+		return HAL_BUSY;
+	}
+
+	if (n == 0 || n > ADS7828_CHANNELS || size == 0 || size % (2 * n) != 0)
+	{
+		return HAL_ERROR;
+	}
+
+	for (size_t i = 0; i < n; i++)
+	{
+		_batch.commands[i] = build_command(channels[i]);
+	}
+
+	_async_mode = ASYNC_SEQUENCE;
+	_sequence_callback = callback;
+	_async_context = context;
+	_async_channel = channels[0];
+	_stream_dst = buffer;
+	_stream_count = size;
+	_stream_index = 0;
+	_batch.sequence_n = (uint8_t)n;
+	_batch.sequence_pos = 0;
+	_sequence_halves = 0;
+	_busy = true;
+
+	HAL_StatusTypeDef status = HAL_I2C_Master_Seq_Transmit_DMA(_hi2c, (_address << 1), &_batch.commands[0], 1, I2C_FIRST_FRAME);
+	record_transfer(status, 2);
+
+	if (status != HAL_OK)
+	{
+		_busy = false;
+	}
+
+	return status;
+}
+
+/**
+ * Get the number of buffer halves the running or last sequence has completed
+ *
+ * @return Completed halves, one callback each
+ */
+uint32_t ADS7828::get_sequence_count()
+{
+	return _sequence_halves;
+}
+
+/**
+ * Starts the transfers of the next digit of a running sequence, the first command is sent by start_sequence
+ */
+void ADS7828::sequence_next()
+{
+	HAL_StatusTypeDef status;
+
+	if (_batch.sequence_n == 1)
+	{
+		// The ADS7828 keeps converting the selected channel, only the first digit needs the command
+		status = HAL_I2C_Master_Seq_Receive_DMA(_hi2c, (_address << 1), (uint8_t *)&_stream_dst[_stream_index], 2, I2C_FIRST_AND_LAST_FRAME);
+		record_transfer(status, 3);
+	}
+	else
+	{
+		status = HAL_I2C_Master_Seq_Transmit_DMA(_hi2c, (_address << 1), &_batch.commands[_batch.sequence_pos], 1, I2C_FIRST_FRAME);
+		record_transfer(status, 2);
+	}
+
+	if (status != HAL_OK)
+	{
+		finish_async(status, 0);
+	}
+}
+
+/**
+ * Stores the received digit of a running capture, checks the trigger and requests the next digit
+ */
+void ADS7828::capture_next()
+{
+	size_t size = _stream_count;
+	uint16_t digit = swap_digit(_stream_dst[_stream_index]);
+	_stream_dst[_stream_index] = digit;
+
+	if (!_capture_triggered)
+	{
+		// The edges need a previous digit
+		uint16_t previous = _stream_dst[(_stream_index == 0) ? size - 1 : _stream_index - 1];
+		bool valid = _capture.filled > 0;
+		bool hit = _capture_request;
+
+		switch (_capture_mode)
+		{
+		case TRIGGER_RISING:
+			hit |= valid && previous < _capture_level && digit >= _capture_level;
+			break;
+		case TRIGGER_FALLING:
+			hit |= valid && previous >= _capture_level && digit < _capture_level;
+			break;
+		case TRIGGER_ABOVE:
+			hit |= digit >= _capture_level;
+			break;
+		default:
+			break;
+		}
+
+		if (hit)
+		{
+			// A trigger right after the start has less history than requested
+			size_t pre = (_capture.filled < _capture.pre) ? _capture.filled : _capture.pre;
+			_capture.post = size - _capture.pre;
+			_capture.window_pre = pre;
+			_capture.count = pre + _capture.post;
+			_capture.first = (_stream_index + size - pre) % size;
+			_capture_request = false;
+			_capture_triggered = true;
+		}
+	}
+
+	if (_capture.filled < size)
+	{
+		_capture.filled++;
+	}
+
+	if (++_stream_index == size)
+	{
+		_stream_index = 0;
+	}
+
+	if (_capture_triggered && --_capture.post == 0)
+	{
+		finish_async(HAL_OK, 0);
+		return;
+	}
+
+	stream_next();
+}
+
+/**
+ * Reads several channel configurations with one memory read DMA transfer each, e.g. all 16 for a full sweep.
+ * The command byte is sent like a register address, the peripheral adds the repeated start and the STOP,
+ * and clock stretching is handled by the hardware. Every result takes one interrupt instead of two, which starts the
+ * next transfer before it stores the digit, so the bus only idles for the interrupt latency between the channels.
+ * Raw digits, averaging and filters do not apply. Forward HAL_I2C_MemRxCpltCallback to rx_complete_callback.
+ *
+ * @param channels List of ADS7828_CHANNEL configurations to read, nullptr for all 16 in the order of their command bytes
+ * @param n Number of channels in the list (1 - 16), ignored for nullptr
+ * @param out Receives the raw digit (0 - 4095) of every channel in list order, has to stay valid until the callback
+ * @param callback Function that is called from the I2C interrupt when all channels are read or an error occurred
+ * @param context User pointer that is passed to the callback
+ * @return HAL_OK if the sweep was started, HAL_BUSY if a transfer is already running, HAL_ERROR for an invalid list, or the HAL error
+ */
+HAL_StatusTypeDef ADS7828::start_sweep_dma(const ADS7828_CHANNEL *channels, size_t n, uint16_t *out, ADS7828_batch_callback_t callback, void *context)
+{
+	if (_busy)
+	{
+		return HAL_BUSY;
+	}
+
+	if (channels == nullptr)
+	{
+		n = ADS7828_CHANNELS;
+	}
+
+	if (n == 0 || n > ADS7828_CHANNELS)
+	{
+		return HAL_ERROR;
+	}
+
+	// All commands are prepared, so the interrupt only starts the next transfer
+	for (size_t i = 0; i < n; i++)
+	{
+		ADS7828_CHANNEL channel = (channels != nullptr) ? channels[i] : (ADS7828_CHANNEL)i;
+		_batch.channels[i] = channel;
+		_batch.commands[i] = build_command(channel);
+	}
+
+	_async_mode = ASYNC_SWEEP;
+	_batch_callback = callback;
+	_async_context = context;
+	_async_channel = static_cast<ADS7828_CHANNEL>(_batch.channels[0]);
+	_stream_dst = out;
+	_stream_count = n;
+	_stream_index = 0;
+	_busy = true;
+
+	HAL_StatusTypeDef status = HAL_I2C_Mem_Read_DMA(_hi2c, (_address << 1), _batch.commands[0], I2C_MEMADD_SIZE_8BIT, (uint8_t *)&_stream_dst[0], 2);
+	record_transfer(status, 5);
+
+	if (status != HAL_OK)
+	{
+		_busy = false;
+	}
+
+	return status;
+}
+
+/**
+ * Starts the memory read of the next channel of a running sweep
+ *
+ * @return HAL status of the started transfer
+ */
+HAL_StatusTypeDef ADS7828::sweep_next()
+{
+	HAL_StatusTypeDef status = HAL_I2C_Mem_Read_DMA(_hi2c, (_address << 1), _batch.commands[_stream_index], I2C_MEMADD_SIZE_8BIT, (uint8_t *)&_stream_dst[_stream_index], 2);
+	record_transfer(status, 5);
+	return status;
+}
+
+/**
+ * Claims the driver and transmits the command byte of an asynchronous transfer
+ *
+ * @param channel The ADS7828_CHANNEL configuration to select
+ * @param xfer_options HAL sequential transfer option of the command byte
+ * @return HAL_OK if the transfer was started, or the HAL error
+ */
+HAL_StatusTypeDef ADS7828::start_async(ADS7828_CHANNEL channel, uint32_t xfer_options)
+{
+	_busy = true;
+	_async_channel = channel;
+	// The DMA transmits the command straight out of the table
+	uint8_t *command = (uint8_t *)prepare_command(channel);
+
+	HAL_StatusTypeDef status = HAL_I2C_Master_Seq_Transmit_DMA(_hi2c, (_address << 1), command, 1, xfer_options);
+	record_transfer(status, 2);
+
+	if (status != HAL_OK)
+	{
+		_busy = false;
+	}
+
+	return status;
+}
+
+/**
+ * Converts a digit received MSB first by DMA into the MCU byte order
+ *
+ * @param raw The two received bytes as stored in memory
+ * @return The digit (0 - 4095)
+ */
+uint16_t ADS7828::swap_digit(uint16_t raw)
+{
+	uint8_t *bytes = (uint8_t *)&raw;
+	return (uint16_t)((bytes[0] << 8) + bytes[1]);
+}
+
+/**
+ * Receives the next digit of a running stream directly into the destination buffer
+ */
+void ADS7828::stream_next()
+{
+	// Oversampled digits are summed up right away and need no buffer
+	uint8_t *dst = (_async_mode == ASYNC_OVERSAMPLE) ? _async_data : (uint8_t *)&_stream_dst[_stream_index];
+	HAL_StatusTypeDef status = HAL_I2C_Master_Receive_DMA(_hi2c, (_address << 1), dst, 2);
+	record_transfer(status, 3);
+
+	if (status != HAL_OK)
+	{
+		finish_async(status, 0);
+	}
+}
+
+/**
+ * Check if an asynchronous read is currently running
+ *
+ * @return True while a read started with start_read_dma has not completed yet
+ */
+bool ADS7828::is_busy()
+{
+	return _busy;
+}
+
+/**
+ * Aborts a running asynchronous transfer without calling its callback, e.g. after a timeout
+ */
+void ADS7828::abort()
+{
+	if (!_busy)
+	{
+		return;
+	}
+
+	_busy = false;
+	HAL_I2C_Master_Abort_IT(_hi2c, (_address << 1));
+}
+
+/**
+ * Get the I2C handle the device is connected to
+ *
+ * @return Pointer to the I2C handle passed to the constructor
+ */
+I2C_HandleTypeDef *ADS7828::get_handle()
+{
+	return _hi2c;
+}
+
+/**
+ * Get the transport of the blocking transfers, e.g. to set the pins of the bit-bang transport
+ *
+ * @return The ADS7828_transport_t of the device
+ */
+ADS7828_transport_t &ADS7828::get_transport()
+{
+	return _bus;
+}
+
+/**
+ * Get the I2C address of the device
+ *
+ * @return 7 Bit I2C address passed to the constructor
+ */
+uint8_t ADS7828::get_address()
+{
+	return _address;
+}
+
+/**
+ * Has to be called from HAL_I2C_MasterTxCpltCallback.
+ * Continues a running asynchronous read by receiving the result.
+ *
+ * @param hi2c The I2C handle passed to the HAL callback
+ */
+void ADS7828::tx_complete_callback(I2C_HandleTypeDef *hi2c)
+{
+	if (hi2c != _hi2c || !_busy)
+	{
+		return;
+	}
+
+	if (_async_mode == ASYNC_STREAM || _async_mode == ASYNC_OVERSAMPLE || _async_mode == ASYNC_CAPTURE)
+	{
+		stream_next();
+		return;
+	}
+
+	if (_async_mode == ASYNC_SEQUENCE)
+	{
+		HAL_StatusTypeDef status = HAL_I2C_Master_Seq_Receive_DMA(_hi2c, (_address << 1), (uint8_t *)&_stream_dst[_stream_index], 2, I2C_LAST_FRAME);
+		record_transfer(status, 3);
+
+		if (status != HAL_OK)
+		{
+			finish_async(status, 0);
+		}
+		return;
+	}
+
+	if (_async_mode == ASYNC_BATCH)
+	{
+		// Only the result of the last channel ends the transaction
+		uint32_t options = (_stream_index + 1 < _stream_count) ? I2C_NEXT_FRAME : I2C_LAST_FRAME;
+		HAL_StatusTypeDef status = HAL_I2C_Master_Seq_Receive_DMA(_hi2c, (_address << 1), (uint8_t *)&_stream_dst[_stream_index], 2, options);
+		record_transfer(status, 3);
+
+		if (status != HAL_OK)
+		{
+			finish_async(status, 0);
+		}
+		return;
+	}
+
+	HAL_StatusTypeDef status = HAL_I2C_Master_Seq_Receive_DMA(_hi2c, (_address << 1), _async_data, 2, I2C_LAST_FRAME);
+	record_transfer(status, 3);
+
+	if (status != HAL_OK)
+	{
+		finish_async(status, 0);
+	}
+}
+
+/**
+ * Has to be called from HAL_I2C_MasterRxCpltCallback.
+ * Finishes a running asynchronous read and passes the digit to the callback.
+ * For streams, the next digit is requested until the buffer is filled.
+ *
+ * @param hi2c The I2C handle passed to the HAL callback
+ */
+void ADS7828::rx_complete_callback(I2C_HandleTypeDef *hi2c)
+{
+	if (hi2c != _hi2c || !_busy)
+	{
+		return;
+	}
+
+	_sample_cycles = get_cycles();
+
+	if (_async_mode == ASYNC_STREAM)
+	{
+		// The digit was received MSB first, swap it to the MCU byte order in place
+		_stream_dst[_stream_index] = swap_digit(_stream_dst[_stream_index]);
+
+		if (++_stream_index < _stream_count)
+		{
+			stream_next();
+			return;
+		}
+
+		finish_async(HAL_OK, 0);
+		return;
+	}
+
+	if (_async_mode == ASYNC_CAPTURE)
+	{
+		capture_next();
+		return;
+	}
+
+	if (_async_mode == ASYNC_SEQUENCE)
+	{
+		_stream_dst[_stream_index] = swap_digit(_stream_dst[_stream_index]);
+		size_t half = _stream_count / 2;
+		uint16_t *filled = nullptr;
+
+		if (++_batch.sequence_pos == _batch.sequence_n)
+		{
+			_batch.sequence_pos = 0;
+		}
+
+		if (++_stream_index == half)
+		{
+			filled = _stream_dst;
+		}
+		else if (_stream_index == _stream_count)
+		{
+			filled = _stream_dst + half;
+			_stream_index = 0;
+		}
+
+		// The bus keeps running while the application processes the half
+		sequence_next();
+
+		if (filled != nullptr && _busy)
+		{
+			_sequence_halves = _sequence_halves + 1;
+
+			if (_sequence_callback != nullptr)
+			{
+				_sequence_callback(_async_context, HAL_OK, filled, half);
+			}
+		}
+		return;
+	}
+
+	if (_async_mode == ASYNC_OVERSAMPLE)
+	{
+		_oversample.sum += (uint16_t)((_async_data[0] << 8) + _async_data[1]);
+
+		if (++_stream_index < _stream_count)
+		{
+			stream_next();
+			return;
+		}
+
+		finish_async(HAL_OK, 0);
+		return;
+	}
+
+	if (_async_mode == ASYNC_SWEEP)
+	{
+		size_t done = _stream_index++;
+
+		// The next channel is already on the bus while the digit is stored
+		HAL_StatusTypeDef status = (_stream_index < _stream_count) ? sweep_next() : HAL_OK;
+		_stream_dst[done] = swap_digit(_stream_dst[done]);
+
+		if (status != HAL_OK || _stream_index >= _stream_count)
+		{
+			finish_async(status, 0);
+		}
+		return;
+	}
+
+	if (_async_mode == ASYNC_BATCH)
+	{
+		_stream_dst[_stream_index] = swap_digit(_stream_dst[_stream_index]);
+
+		if (++_stream_index < _stream_count)
+		{
+			batch_next();
+			return;
+		}
+
+		if (_batch.quality != nullptr)
+		{
+			for (size_t i = 0; i < _stream_count; i++)
+			{
+				_batch.quality[i] = ADS7828_quality(_stream_dst[i], !((_batch.unsettled >> i) & 1));
+			}
+		}
+
+		// Post-processing of all channels in one pass
+		for (size_t i = 0; i < _stream_count; i++)
+		{
+			_stream_dst[i] = process_digit_int(static_cast<ADS7828_CHANNEL>(_batch.channels[i]), _stream_dst[i]);
+		}
+
+		finish_async(HAL_OK, 0);
+		return;
+	}
+
+	uint16_t digit = (uint16_t)((_async_data[0] << 8) + _async_data[1]);
+	_raw_digit = digit;
+	_last_quality = ADS7828_quality(digit, _last_settled);
+	finish_async(HAL_OK, _defer_processing ? digit : process_result(_async_channel, digit));
+}
+
+/**
+ * Has to be called from HAL_I2C_ErrorCallback.
+ * Aborts a running asynchronous read and reports HAL_ERROR to the callback.
+ *
+ * @param hi2c The I2C handle passed to the HAL callback
+ */
+void ADS7828::error_callback(I2C_HandleTypeDef *hi2c)
+{
+	if (hi2c != _hi2c || !_busy)
+	{
+		return;
+	}
+
+#ifdef ADS7828_STATS
+	// The transfer itself was already counted when it was started
+	if (HAL_I2C_GetError(_hi2c) & HAL_I2C_ERROR_AF)
+	{
+		_stats.nacks++;
+	}
+	else
+	{
+		_stats.bus_errors++;
+	}
+#endif
+
+	finish_async(HAL_ERROR, 0);
+}
+
+/**
+ * Ends the running asynchronous transfer and notifies the user.
+ * The driver is released before the callback, so the callback can start the next read right away.
+ *
+ * @param status Result of the transfer
+ * @param digit The processed digit of a single read, only valid if status is HAL_OK
+ */
+void ADS7828::finish_async(HAL_StatusTypeDef status, ADS7828_digit_t digit)
+{
+	_busy = false;
+
+	if (status != HAL_OK)
+	{
+		_last_quality = QUALITY_FAILED;
+	}
+
+	if (_async_mode == ASYNC_STREAM)
+	{
+		if (_stream_callback != nullptr)
+		{
+			_stream_callback(_async_context, _async_channel, status, _stream_dst, _stream_index);
+		}
+		return;
+	}
+
+	if (_async_mode == ASYNC_OVERSAMPLE)
+	{
+		if (_oversample_callback != nullptr)
+		{
+			uint16_t value = (status == HAL_OK) ? (uint16_t)(_oversample.sum >> _oversample.bits) : 0;
+			_oversample_callback(_async_context, _async_channel, status, value, _oversample.bits);
+		}
+		return;
+	}
+
+	if (_async_mode == ASYNC_CAPTURE)
+	{
+		_capture_triggered = false;
+
+		if (_capture_callback != nullptr)
+		{
+			size_t count = (status == HAL_OK) ? _capture.count : 0;
+			_capture_callback(_async_context, _async_channel, status, _stream_dst, _capture.first, _capture.window_pre, count);
+		}
+		return;
+	}
+
+	if (_async_mode == ASYNC_SEQUENCE)
+	{
+		if (_sequence_callback != nullptr)
+		{
+			_sequence_callback(_async_context, status, _stream_dst, 0);
+		}
+		return;
+	}
+
+	if (_async_mode == ASYNC_BATCH || _async_mode == ASYNC_SWEEP)
+	{
+		if (_batch_callback != nullptr)
+		{
+			_batch_callback(_async_context, status, _stream_dst, (status == HAL_OK) ? _stream_count : 0);
+		}
+		return;
+	}
+
+#ifdef ADS7828_LATENCY
+	if (status == HAL_OK)
+	{
+		record_latency(_async_channel, _request_cycles);
+	}
 #endif
+
+	if (_async_callback != nullptr)
+	{
+		_async_callback(_async_context, _async_channel, status, digit);
+	}
 }
@@ -15,54 +15,238 @@
 #include "stm32f4xx_hal.h"
 #elif defined(STM32F7)
 #include "stm32f7xx_hal.h"
+#elif defined(STM32G4)
+#include "stm32g4xx_hal.h"
+#elif defined(STM32L4)
+#include "stm32l4xx_hal.h"
+#elif defined(STM32H7)
+#include "stm32h7xx_hal.h"
+#elif defined(ADS7828_HOST)
+#include "ADS7828_host.hpp"
+#elif defined(ADS7828_HAL_HEADER)
+// Any other HAL with the same I2C API, e.g. -D ADS7828_HAL_HEADER='"stm32g0xx_hal.h"'
+// Also define ADS7828_I2C_V2 if its I2C is configured with a timing register
+#include ADS7828_HAL_HEADER
 #else
 #error "Unsupported STM32 microcontroller. Make sure you build with -STM32F1 for example!"
 #endif
 #include <stdint.h>
+#include <stddef.h>
 // Number of ADS7828 channel combinations
 constexpr uint8_t ADS7828_CHANNELS = 16;
+// Fractional bits of the fixed-point millivolt conversion factors
+constexpr uint8_t ADS7828_FIXED_SHIFT = 22;
+// Fractional bits of fixed-point averaged digits, 12 Bit digits still fit into uint16_t
+constexpr uint8_t ADS7828_AVG_FRAC_BITS = 4;
+// Fractional bits of the calibration gain
+constexpr uint8_t ADS7828_CAL_SHIFT = 16;
+// Fractional bits of the reference correction of the ratiometric mode
+constexpr uint8_t ADS7828_RATIO_SHIFT = 20;
+// Fractional bits of the channel voltage scaling
+constexpr uint8_t ADS7828_SCALE_SHIFT = 16;
+// Maximum extra resolution of oversampled reads, 4^4 samples give a 16 Bit result
+constexpr uint8_t ADS7828_OVERSAMPLE_MAX_BITS = 4;
 
-// If defined, dynamic memory allocation with new/delete is done for averaging
+// Feature switches for small flash budgets, e.g. beside an application on the 64 KB of an STM32F103C8.
+// Define to drop all float math, voltages are read with read_millivolts and read_microvolts and the driver is only
+// configured with the integer setters (e.g. set_ref_voltage_external_uv, set_scaling_ratio, set_calibration_fixed)
+// #define ADS7828_INTEGER_ONLY
+
+// Define to drop averaging, EMA / IIR filters and the median, every reading is the plain digit
+// #define ADS7828_NO_AVERAGING
+
+// Define to drop the blocking reads, only the DMA reads and the modules built on them remain
+// #define ADS7828_ASYNC_ONLY
+
+#ifdef ADS7828_NO_AVERAGING
+// Arrays can't be empty, one unused slot with one value remains
+#ifndef ADS7828_SLOTS
+#define ADS7828_SLOTS 1
+#endif
+#ifndef ADS7828_AVG_POOL
+#define ADS7828_AVG_POOL 1
+#endif
+#ifndef ADS7828_AVG_MAX
+#define ADS7828_AVG_MAX 1
+#endif
+#endif
+
+// If defined, averaging buffers of any depth are carved from a fixed pool given to the driver, no heap is used
 #define ADS7828_DYNAMIC_MEM
+// Default number of values in the averaging pool of ADS7828_Pooled, shared by all channels of one driver
+#ifndef ADS7828_AVG_POOL
+#define ADS7828_AVG_POOL 128
+#endif
 #ifndef ADS7828_DYNAMIC_MEM
 // Number of values stored for every active channel for averaging
+#ifndef ADS7828_AVG_MAX
 #define ADS7828_AVG_MAX 20
 #endif
+#endif
+
+// Number of channels that can use averaging, a recursive filter or a median at the same time.
+// The filter state only exists for these, plain channels only keep their conversion factors (up to ADS7828_CHANNELS)
+#ifndef ADS7828_SLOTS
+#define ADS7828_SLOTS 4
+#endif
+// Slot index of a channel without averaging, filter and median
+constexpr uint8_t ADS7828_NO_SLOT = 0xFF;
+
+// Number of channels with their own scaling, calibration, conversion table or sensor curve at the same time.
+// All other channels share one default conversion (up to ADS7828_CHANNELS)
+#ifndef ADS7828_CONVERSIONS
+#define ADS7828_CONVERSIONS 4
+#endif
+
+// Settling time of the internal reference after power up in [ms]
+#ifndef ADS7828_REF_SETTLE_MS
+#define ADS7828_REF_SETTLE_MS 1
+#endif
+// Sampling intervals below this keep the internal reference powered with the automatic power policy
+#ifndef ADS7828_AUTO_POWER_MIN_MS
+#define ADS7828_AUTO_POWER_MIN_MS 10
+#endif
+
+// Margin added to the calculated transfer time for the blocking timeouts in [ms]
+#ifndef ADS7828_TIMEOUT_MARGIN_MS
+#define ADS7828_TIMEOUT_MARGIN_MS 2
+#endif
+
+// These families have the I2C v2 peripheral, which is configured with the TIMINGR register instead of the clock speed
+#if defined(STM32F0) || defined(STM32F3) || defined(STM32F7) || defined(STM32G4) || defined(STM32L4) || defined(STM32H7)
+#define ADS7828_I2C_V2
+#endif
+
+// The DWT cycle counter is only available on Cortex-M3 and up, timestamps are 0 otherwise
+#ifdef DWT_CTRL_CYCCNTENA_Msk
+#define ADS7828_HAS_CYCCNT
+#endif
 
+// Cortex-M0/M0+ (STM32F0) has neither a hardware divider nor an FPU, both are emulated in software.
+// If defined, averages divide with a reciprocal multiply and voltages are converted in fixed-point
+#if !defined(ADS7828_SOFT_MATH) && (defined(STM32F0) || defined(__ARM_ARCH_6M__))
+#define ADS7828_SOFT_MATH
+#endif
+
+#include "ADS7828_transport.hpp"
+
+// Same value as the HAL, a timeout of HAL_MAX_DELAY waits forever. The driver's own timeouts come from the bus clock
 #ifndef HAL_MAX_DELAY
-#define HAL_MAX_DELAY 100
+#define HAL_MAX_DELAY 0xFFFFFFFFU
+#endif
+
+#ifdef ADS7828_SOFT_MATH
+/**
+ * Divides with a precomputed reciprocal, exact for all values.
+ * The estimate from the upper half of the product is at most 2 too small and is corrected with one multiply each.
+ *
+ * @param value Dividend
+ * @param divisor Divisor, at least 2
+ * @param recip 0xFFFFFFFF / divisor
+ * @return value / divisor, rounded down
+ */
+inline uint32_t ADS7828_divide(uint32_t value, uint32_t divisor, uint32_t recip)
+{
+	uint32_t q = (uint32_t)(((uint64_t)value * recip) >> 32);
+
+	while (value - q * divisor >= divisor)
+	{
+		q++;
+	}
+
+	return q;
+}
 #endif
 
 struct ADS7828_circ_buf_t
 {
-	uint8_t w_index = 0; // Write index
-	uint8_t n = 0;		 // Number of elements
+	uint16_t w_index = 0; // Write index
+	uint16_t n = 0;		  // Number of elements
+	uint16_t fill = 0;	  // Number of valid elements, grows up to n after a clear
+	uint8_t shift = 0;	  // log2(n) if n is a power of two, 0 otherwise
+#ifdef ADS7828_SOFT_MATH
+	uint32_t recip = 0; // 0xFFFFFFFF / n, replaces the division once the buffer is full
+#endif
+	uint32_t sum = 0;	  // Running sum of all valid elements, 4095 * 65535 still fits
 #ifdef ADS7828_DYNAMIC_MEM
-	uint16_t *data; // Buffer data
+	uint16_t cap = 0;		  // Number of values carved from the pool
+	uint16_t *data = nullptr; // Buffer data, points into the pool
 #else
 	uint16_t data[ADS7828_AVG_MAX] = {0}; // Buffer data
 #endif
-	// Calculate the average of the last n elements
-	float average()
+	// Set the depth and remember whether the average of a full buffer can shift instead of divide
+	void set_depth(uint16_t depth)
 	{
-		float sum = 0;
+		n = depth;
+		shift = 0;
+#ifdef ADS7828_SOFT_MATH
+		// The only division, the warm-up after a clear still divides by the growing fill
+		recip = (depth > 1) ? 0xFFFFFFFFu / depth : 0;
+#endif
+
+		if ((depth & (depth - 1)) == 0)
+		{
+			while ((1u << shift) < depth)
+			{
+				shift++;
+			}
+		}
+	}
 
-		for (uint8_t i = 0; i < n; i++)
+	// Rounded value / fill, a shift once a power of two buffer is full
+	uint32_t divide(uint32_t value)
+	{
+		if (shift != 0 && fill == n)
 		{
+			return (value + (1u << (shift - 1))) >> shift;
+		}
+#ifdef ADS7828_SOFT_MATH
+		if (fill == n)
+		{
+			return ADS7828_divide(value + n / 2, n, recip);
+		}
+#endif
+		return (value + fill / 2) / fill;
+	}
 
-			sum += data[i];
+#ifndef ADS7828_INTEGER_ONLY
+	// Calculate the average of the valid elements, so a fresh buffer isn't biased toward zero
+	float average()
+	{
+#ifdef ADS7828_SOFT_MATH
+		// Integer division and a multiply by a power of two instead of the emulated float division
+		return (float)divide(sum << ADS7828_AVG_FRAC_BITS) * (1.0f / (1 << ADS7828_AVG_FRAC_BITS));
+#else
+		if (shift != 0 && fill == n)
+		{
+			return (float)sum * (1.0f / (1u << shift));
 		}
 
-		sum /= n;
+		return (float)sum / fill;
+#endif
+	}
+#endif
 
-		return sum;
+	// Rounded integer average of the valid elements
+	uint16_t average_int()
+	{
+		return (uint16_t)divide(sum);
 	}
 
 	// Replace the oldest value in the circular buffer
 	void append(uint16_t value)
 	{
+		// Keep the sum up to date instead of summing up all elements for every average
+		sum -= data[w_index];
+		sum += value;
 		data[w_index++] = value;
 
+		// Warm-up, the buffer isn't completely filled yet
+		if (fill < n)
+		{
+			fill++;
+		}
+
 		// Circ buffer rollover
 		if (w_index >= n)
 		{
@@ -72,6 +256,223 @@ struct ADS7828_circ_buf_t
 
 } typedef ADS7828_circ_buf_t;
 
+// Largest window of the median filter
+constexpr uint8_t ADS7828_MEDIAN_MAX = 7;
+
+// Median of the last 3, 5 or 7 values, rejects single spikes before averaging
+struct ADS7828_median_t
+{
+	uint16_t data[ADS7828_MEDIAN_MAX]; // Last values
+	uint8_t size = 0;				   // Window size, 0 disables the median
+	uint8_t w_index = 0;			   // Write index
+	bool primed = false;			   // Window holds values, the first value fills the whole window
+
+	// Compare and swap of a sorting network, compiles to conditional moves
+	static void sort2(uint16_t &a, uint16_t &b)
+	{
+		uint16_t lo = (a < b) ? a : b;
+		uint16_t hi = (a < b) ? b : a;
+		a = lo;
+		b = hi;
+	}
+
+	// Replace the oldest value and return the median of the window in constant time
+	uint16_t update(uint16_t value)
+	{
+		if (!primed)
+		{
+			for (uint8_t i = 0; i < size; i++)
+			{
+				data[i] = value;
+			}
+			primed = true;
+		}
+
+		data[w_index++] = value;
+
+		// Circ buffer rollover
+		if (w_index >= size)
+		{
+			w_index = 0;
+		}
+
+		uint16_t p[ADS7828_MEDIAN_MAX];
+		for (uint8_t i = 0; i < size; i++)
+		{
+			p[i] = data[i];
+		}
+
+		// Minimal sorting networks that only place the middle element
+		if (size == 3)
+		{
+			sort2(p[0], p[1]);
+			sort2(p[1], p[2]);
+			sort2(p[0], p[1]);
+			return p[1];
+		}
+
+		if (size == 5)
+		{
+			sort2(p[0], p[1]);
+			sort2(p[3], p[4]);
+			sort2(p[0], p[3]);
+			sort2(p[1], p[4]);
+			sort2(p[1], p[2]);
+			sort2(p[2], p[3]);
+			sort2(p[1], p[2]);
+			return p[2];
+		}
+
+		sort2(p[0], p[5]);
+		sort2(p[0], p[3]);
+		sort2(p[1], p[6]);
+		sort2(p[2], p[4]);
+		sort2(p[0], p[1]);
+		sort2(p[3], p[5]);
+		sort2(p[2], p[6]);
+		sort2(p[2], p[3]);
+		sort2(p[3], p[6]);
+		sort2(p[4], p[5]);
+		sort2(p[1], p[4]);
+		sort2(p[1], p[3]);
+		sort2(p[3], p[4]);
+		return p[3];
+	}
+};
+
+// Recursive filters that only need one accumulator word per channel
+enum ADS7828_FILTER_MODE
+{
+	FILTER_NONE, // No recursive filter, the moving average applies if enabled
+	FILTER_EMA,	 // Exponential moving average with alpha = 2^-shift, no multiplication
+	FILTER_IIR	 // First-order IIR with any alpha, one multiplication per value
+};
+
+// Fractional bits of the recursive filter state
+constexpr uint8_t ADS7828_FILTER_FRAC_BITS = 16;
+
+struct ADS7828_filter_t
+{
+	int32_t state = 0;			 // Filter output, fixed-point with ADS7828_FILTER_FRAC_BITS fractional bits
+	uint16_t coeff = 0;			 // EMA shift, or IIR alpha with 16 fractional bits
+	uint8_t mode = FILTER_NONE;	 // ADS7828_FILTER_MODE of the channel
+	bool primed = false;		 // State holds a value, the first value is taken as is
+
+	// Feed a new value and return the filter output in fixed-point
+	int32_t update(uint16_t value)
+	{
+		int32_t x = (int32_t)value << ADS7828_FILTER_FRAC_BITS;
+
+		if (!primed)
+		{
+			state = x;
+			primed = true;
+		}
+		else if (mode == FILTER_EMA)
+		{
+			state += (x - state) >> coeff;
+		}
+		else
+		{
+			state += (int32_t)(((int64_t)(x - state) * coeff) >> 16);
+		}
+
+		return state;
+	}
+};
+
+// Quality of a sample, combined as bit mask, 0 for a clean sample
+enum ADS7828_QUALITY
+{
+	QUALITY_CLIPPED_LOW = 0b00001,	// Raw digit is 0, the input may be below the range
+	QUALITY_CLIPPED_HIGH = 0b00010, // Raw digit is 4095, the input may be above the range
+	QUALITY_UNSETTLED = 0b00100,	// Converted while the reference was settling
+	QUALITY_RETRIED = 0b01000,		// Needed a bus recovery or a repeated read
+	QUALITY_FAILED = 0b10000,		// The transfer failed, the value is stale or 0
+};
+
+// Quality bits of a raw digit without branches, the comparisons are combined as bits
+inline uint8_t ADS7828_quality(uint16_t raw, bool settled)
+{
+	return (uint8_t)((raw == 0) | ((raw >= 4095) << 1) | ((!settled) << 2));
+}
+
+// Single sample record for handing results from interrupts to the application
+struct ADS7828_sample_t
+{
+	uint32_t timestamp; // Time of the sample, unit depends on the producer
+	uint16_t digit;		// Raw digit (0 - 4095)
+	uint8_t channel;	// ADS7828_CHANNEL of the sample
+	uint8_t device;		// Index of the device, e.g. for multiple devices on one bus
+};
+
+// Lock-free single-producer/single-consumer ring buffer, N has to be a power of two
+// The producer (e.g. an I2C callback) only writes head, the consumer (main loop or task) only writes tail
+template <uint16_t N>
+struct ADS7828_sample_ring_t
+{
+	static_assert(N > 0 && (N & (N - 1)) == 0, "Ring size has to be a power of two");
+
+	ADS7828_sample_t data[N];	   // Buffer data
+	volatile uint32_t head = 0;	   // Number of pushed elements
+	volatile uint32_t tail = 0;	   // Number of popped elements
+	volatile uint32_t dropped = 0; // Elements rejected because the ring was full
+
+	// Add an element, called by the producer only
+	bool push(const ADS7828_sample_t &sample)
+	{
+		uint32_t h = head;
+
+		if (h - tail >= N)
+		{
+			dropped = dropped + 1;
+			return false;
+		}
+
+		data[h & (N - 1)] = sample;
+
+		// The element has to be written before it is published
+		__DMB();
+		head = h + 1;
+
+		return true;
+	}
+
+	// Take the oldest element, called by the consumer only
+	bool pop(ADS7828_sample_t &sample)
+	{
+		return pop_n(&sample, 1) == 1;
+	}
+
+	// Take up to max elements at once, called by the consumer only
+	size_t pop_n(ADS7828_sample_t *dst, size_t max)
+	{
+		uint32_t t = tail;
+		uint32_t available = head - t;
+		size_t n = (available < max) ? available : max;
+
+		// Read the elements only after reading head
+		__DMB();
+
+		for (size_t i = 0; i < n; i++)
+		{
+			dst[i] = data[(t + i) & (N - 1)];
+		}
+
+		// The elements have to be read before the slots are released
+		__DMB();
+		tail = t + n;
+
+		return n;
+	}
+
+	// Number of elements ready to pop
+	size_t size()
+	{
+		return head - tail;
+	}
+};
+
 // Defines the command bits for every possible channel selection (Datasheet Table 2)
 // Choice between "Differential" for voltage between two channels or "Single Ended" for voltage to COM
 enum ADS7828_CHANNEL
@@ -104,41 +505,862 @@ enum ADS7828_PD_MODE
 	REF_ON_AD_ON = 0b11	  // Internal Reference ON and A/D Converter ON
 };
 
+// I2C bus speeds of the ADS7828 (Datasheet: standard, fast and high-speed mode)
+// High-speed mode needs the master code and repeated starts without STOP, which no STM32 I2C peripheral generates
+enum ADS7828_BUS_SPEED
+{
+	BUS_STANDARD = 100000, // Standard mode, 100 kHz
+	BUS_FAST = 400000,	   // Fast mode, 400 kHz
+};
+
+// Command bytes of all channel configurations for one power down mode, indexed by ADS7828_CHANNEL
+struct ADS7828_command_table_t
+{
+	uint8_t command[ADS7828_CHANNELS];
+};
+
+// Command byte of a channel configuration and power down mode (Datasheet Table 1): SD C2 C1 C0 PD1 PD0 X X
+constexpr uint8_t ADS7828_command(ADS7828_CHANNEL channel, ADS7828_PD_MODE mode)
+{
+	return (uint8_t)((channel << 4) | (mode << 2));
+}
+
+// Generates the command table of a power down mode
+constexpr ADS7828_command_table_t ADS7828_make_command_table(ADS7828_PD_MODE mode)
+{
+	ADS7828_command_table_t table = {};
+
+	for (uint8_t c = 0; c < ADS7828_CHANNELS; c++)
+	{
+		table.command[c] = ADS7828_command((ADS7828_CHANNEL)c, mode);
+	}
+
+	return table;
+}
+
+// Define to count transfers, errors and cycles of the driver, compiled out otherwise
+// #define ADS7828_STATS
+
+#ifdef ADS7828_STATS
+// Instrumentation counters, cycles are DWT cycles (see ADS7828::enable_cycle_counter)
+struct ADS7828_stats_t
+{
+	uint32_t transactions;		// I2C transfers started (address + data)
+	uint32_t bytes;				// Bytes on the bus including the address bytes
+	uint32_t nacks;				// Transfers that were not acknowledged
+	uint32_t timeouts;			// Blocking transfers that timed out
+	uint32_t bus_errors;		// Bus errors, arbitration losses and other HAL errors
+	uint32_t busy;				// Transfers rejected because the peripheral was busy
+	uint32_t reads;				// Blocking read_digit / read calls
+	uint32_t read_cycles_min;	// Fastest read
+	uint32_t read_cycles_max;	// Slowest read
+	uint64_t read_cycles_sum;	// Sum of all reads, divide by reads for the average
+	uint64_t busy_wait_cycles;	// Cycles spent waiting in blocking HAL transfers
+};
+#endif
+
+// Define to collect a latency histogram per channel, compiled out otherwise
+// #define ADS7828_LATENCY
+
+#ifdef ADS7828_LATENCY
+// Bucket 0 counts latencies below 2^ADS7828_LATENCY_SHIFT cycles, bucket i latencies below 2^(ADS7828_LATENCY_SHIFT + i),
+// the last bucket all longer ones (from 116ms at 72 MHz)
+constexpr uint8_t ADS7828_LATENCY_BUCKETS = 16;
+constexpr uint8_t ADS7828_LATENCY_SHIFT = 8;
+
+// Histogram of the DWT cycles from the request of a read to its result
+struct ADS7828_latency_t
+{
+	uint32_t buckets[ADS7828_LATENCY_BUCKETS]; // Results per log2 latency range
+	uint32_t count;							   // Results in all buckets
+	uint32_t max_cycles;					   // Longest latency
+};
+#endif
+
+// Identifies a stored ADS7828_config_t, the version changes with the layout
+constexpr uint32_t ADS7828_CONFIG_MAGIC = 0x41443738; // "AD78"
+constexpr uint16_t ADS7828_CONFIG_VERSION = 3;
+
+// Serialized driver configuration, e.g. to keep the calibration in flash
+struct ADS7828_config_t
+{
+	uint32_t magic;								// ADS7828_CONFIG_MAGIC
+	uint16_t version;							// ADS7828_CONFIG_VERSION
+	uint16_t size;								// sizeof(ADS7828_config_t)
+	uint32_t ref_uv;							// Reference voltage [uV]
+	uint32_t auto_interval_ms;					// Interval of the automatic power policy, 0 if disabled
+	uint8_t internal_ref;						// Internal reference is used
+	uint8_t pd_mode;							// ADS7828_PD_MODE
+	uint8_t repeated_start;						// Command and result in one transaction
+	uint8_t reserved;							// Padding, always 0
+	int32_t scaling[ADS7828_CHANNELS];			// Voltage scaling with ADS7828_SCALE_SHIFT fractional bits
+	int32_t cal_gain[ADS7828_CHANNELS];			// Calibration gain with ADS7828_CAL_SHIFT fractional bits
+	int32_t cal_offset_uv[ADS7828_CHANNELS];	// Calibration offset [uV]
+	uint16_t filter_coeff[ADS7828_CHANNELS];	// EMA shift or IIR coefficient
+	uint8_t filter_mode[ADS7828_CHANNELS];		// ADS7828_FILTER_MODE
+	uint16_t averaging[ADS7828_CHANNELS];		// Moving average depth, 1 if disabled
+	uint8_t median[ADS7828_CHANNELS];			// Median window, 0 if disabled
+	uint32_t crc;								// CRC-32 of all bytes before
+};
+
+uint32_t ADS7828_crc32(const void *data, size_t length);
+
+// Entries of a conversion table, one per digit
+constexpr uint16_t ADS7828_LUT_SIZE = 4096;
+
+// Conversion table from the digit to the unit returned by read_voltage, generated at compile time with ADS7828_lut.hpp
+struct ADS7828_lut_t
+{
+	float values[ADS7828_LUT_SIZE];
+};
+
+// Point of a sensor curve for the linearization, e.g. a temperature in tenths of a degree at a digit
+struct ADS7828_curve_point_t
+{
+	uint16_t digit; // Digit of the point, ascending within a curve
+	int16_t value;	// Result at the digit, fixed-point in the unit of the application
+};
+
+/**
+ * Digit of a resistive sensor in a divider on the reference, sensor on the low side (e.g. an NTC with a pull-up).
+ * Turns the resistance table of a datasheet into curve points at compile time.
+ *
+ * @param r_sensor Resistance of the sensor at the point
+ * @param r_fixed Resistance of the fixed resistor between reference and input
+ * @return Digit of the divider voltage (0 - 4095)
+ */
+constexpr uint16_t ADS7828_divider_digit(float r_sensor, float r_fixed)
+{
+	return (uint16_t)(4095.0f * r_sensor / (r_sensor + r_fixed) + 0.5f);
+}
+
+// Conversion of a channel from the digit to its voltage, shared by all channels that keep the defaults
+struct ADS7828_conversion_t
+{
+	int64_t mv_offset = 0;						// Calibration offset in millivolts, fixed-point with ADS7828_FIXED_SHIFT fractional bits
+	int32_t mv_factor = 0;						// Millivolts per digit incl. scaling and gain, fixed-point with ADS7828_FIXED_SHIFT fractional bits
+	int32_t mv_base = 0;						// mv_factor at the nominal reference voltage, before the ratiometric correction
+	int32_t cal_gain = 1L << ADS7828_CAL_SHIFT; // Calibration gain, fixed-point with ADS7828_CAL_SHIFT fractional bits
+	int32_t cal_offset_uv = 0;					// Calibration offset [uV]
+	int32_t scaling = 1L << ADS7828_SCALE_SHIFT; // Channel Voltage Scaling, fixed-point with ADS7828_SCALE_SHIFT fractional bits
+#ifndef ADS7828_INTEGER_ONLY
+	const ADS7828_lut_t *lut = nullptr;			// Conversion table replacing the voltage calculation, nullptr if unused
+#endif
+	const ADS7828_curve_point_t *curve = nullptr; // Sensor curve of the linearization, nullptr if unused
+	uint8_t curve_size = 0;						// Number of points of the curve
+
+	// Scaling and calibration are neutral and neither table nor curve is set
+	bool is_default() const
+	{
+#ifndef ADS7828_INTEGER_ONLY
+		if (lut != nullptr)
+		{
+			return false;
+		}
+#endif
+		return scaling == (1L << ADS7828_SCALE_SHIFT) && cal_gain == (1L << ADS7828_CAL_SHIFT) && cal_offset_uv == 0 && curve == nullptr;
+	}
+};
+
+#ifdef ADS7828_INTEGER_ONLY
+// Processed digit of the callbacks and result tables, the rounded average without float math
+typedef uint16_t ADS7828_digit_t;
+#else
+// Processed digit of the callbacks and result tables, averages and filter outputs keep their fraction
+typedef float ADS7828_digit_t;
+#endif
+
+/**
+ * Rounds a processed digit into the 12 bit range of the raw digits, e.g. for logs and streams
+ *
+ * @param digit Processed digit, calibrated results can leave 0 - 4095
+ * @return Digit in 0 - 4095
+ */
+inline uint16_t ADS7828_round_digit(ADS7828_digit_t digit)
+{
+#ifdef ADS7828_INTEGER_ONLY
+	return (digit > 4095) ? 4095 : digit;
+#else
+	// The cast is only defined inside the range of uint16_t
+	float rounded = digit + 0.5f;
+	return (rounded <= 0.0f) ? 0 : ((rounded >= 4095.0f) ? 4095 : (uint16_t)rounded);
+#endif
+}
+
+// Completion callback of an asynchronous read, digit is the same value read_digit would have returned
+typedef void (*ADS7828_callback_t)(void *context, ADS7828_CHANNEL channel, HAL_StatusTypeDef status, ADS7828_digit_t digit);
+
+// Completion callback of a stream, count is the number of raw digits written to data
+typedef void (*ADS7828_stream_callback_t)(void *context, ADS7828_CHANNEL channel, HAL_StatusTypeDef status, uint16_t *data, size_t count);
+
+// Completion callback of a batch read, count is the number of digits written to out
+typedef void (*ADS7828_batch_callback_t)(void *context, HAL_StatusTypeDef status, uint16_t *out, size_t count);
+
+// Completion callback of an oversampled read, value has 12 + extra_bits bits
+typedef void (*ADS7828_oversample_callback_t)(void *context, ADS7828_CHANNEL channel, HAL_StatusTypeDef status, uint16_t value, uint8_t extra_bits);
+
+// Completion callback of a capture, the window has count digits starting at data[first] and wraps at the end of the buffer.
+// The trigger is the digit at position pre of the window.
+typedef void (*ADS7828_capture_callback_t)(void *context, ADS7828_CHANNEL channel, HAL_StatusTypeDef status, uint16_t *data, size_t first, size_t pre, size_t count);
+
+// Called for every filled half of a sequence buffer, data holds count interleaved raw digits starting with the first channel.
+// On an error the sequence stops and count is 0.
+typedef void (*ADS7828_sequence_callback_t)(void *context, HAL_StatusTypeDef status, uint16_t *data, size_t count);
+
+// Automatic trigger of a capture, trigger_capture always works in addition
+enum ADS7828_TRIGGER
+{
+	TRIGGER_SOFTWARE, // Only trigger_capture
+	TRIGGER_RISING,	  // A digit reaches the level after one below it
+	TRIGGER_FALLING,  // A digit drops below the level after one at or above it
+	TRIGGER_ABOVE	  // Any digit at or above the level
+};
+
+// Type of the running asynchronous transfer
+enum ADS7828_ASYNC_MODE
+{
+	ASYNC_SINGLE,	 // Single read started with start_read_dma
+	ASYNC_STREAM,	 // Burst of reads started with stream_channel
+	ASYNC_BATCH,	 // Chained reads of several channels started with start_read_channels_dma
+	ASYNC_OVERSAMPLE, // Burst of reads summed up by the driver, started with start_oversample_dma
+	ASYNC_CAPTURE,	  // Endless stream into a circular buffer until a trigger, started with start_capture
+	ASYNC_SEQUENCE,	  // Endless reads of a channel sequence into a circular buffer, started with start_sequence
+	ASYNC_SWEEP		  // Memory reads of several channels, one DMA transfer each, started with start_sweep_dma
+};
+
+#if __cplusplus >= 202002L
+// Awaitable of read_async, defined in ADS7828_coro.hpp
+class ADS7828_read_awaitable;
+#endif
+
 class ADS7828
 {
 public:
 	ADS7828(I2C_HandleTypeDef *hi2c, uint8_t address);
+#ifndef ADS7828_INTEGER_ONLY
 	ADS7828(I2C_HandleTypeDef *hi2c, uint8_t address, float external_ref_voltage);
-	~ADS7828();
+#endif
+#ifdef ADS7828_DYNAMIC_MEM
+	ADS7828(I2C_HandleTypeDef *hi2c, uint8_t address, uint16_t *pool, uint16_t pool_size);
+#endif
+	ADS7828(ADS7828 &&other);
+	ADS7828 &operator=(ADS7828 &&other);
+	~ADS7828() = default;
 
+#ifndef ADS7828_ASYNC_ONLY
+#ifndef ADS7828_INTEGER_ONLY
 	float read_voltage(ADS7828_CHANNEL channel);
 	float read_digit(ADS7828_CHANNEL channel);
+#endif
+	HAL_StatusTypeDef read(ADS7828_CHANNEL channel, uint16_t &out);
+	HAL_StatusTypeDef read(ADS7828_CHANNEL channel, uint16_t &out, uint32_t timeout_ms);
+	uint16_t read_raw(ADS7828_CHANNEL channel, HAL_StatusTypeDef *status = nullptr);
+	uint16_t read_average_fixed(ADS7828_CHANNEL channel, HAL_StatusTypeDef *status = nullptr);
+
+	// Inline fast path for a channel known at compile time, defined below the class
+	template <ADS7828_CHANNEL Channel>
+	HAL_StatusTypeDef read(uint16_t &out);
+	template <ADS7828_CHANNEL Channel>
+	int32_t read_millivolts(HAL_StatusTypeDef *status = nullptr);
+#ifndef ADS7828_INTEGER_ONLY
+	template <ADS7828_CHANNEL Channel>
+	float read_voltage(HAL_StatusTypeDef *status = nullptr);
+#endif
+
+	HAL_StatusTypeDef read_channels(const ADS7828_CHANNEL *channels, size_t n, uint16_t *out, uint8_t *quality = nullptr);
+#ifndef ADS7828_INTEGER_ONLY
+	HAL_StatusTypeDef read_channels_voltage(const ADS7828_CHANNEL *channels, size_t n, float *out);
+#endif
 
+	int32_t read_millivolts(ADS7828_CHANNEL channel, HAL_StatusTypeDef *status = nullptr);
+	int32_t read_microvolts(ADS7828_CHANNEL channel, HAL_StatusTypeDef *status = nullptr);
+	uint16_t read_oversampled(ADS7828_CHANNEL channel, uint8_t extra_bits, HAL_StatusTypeDef *status = nullptr);
+	HAL_StatusTypeDef read_signed(ADS7828_CHANNEL pair, int16_t &out);
+	int32_t read_signed_microvolts(ADS7828_CHANNEL pair, HAL_StatusTypeDef *status = nullptr);
+#endif
+
+#ifndef ADS7828_INTEGER_ONLY
+	float digit_to_voltage(ADS7828_CHANNEL channel, float digit);
+#endif
+	int32_t digit_to_millivolts(ADS7828_CHANNEL channel, uint16_t digit);
+	int32_t digit_to_microvolts(ADS7828_CHANNEL channel, uint16_t digit);
+	int32_t oversampled_to_microvolts(ADS7828_CHANNEL channel, uint16_t value, uint8_t extra_bits);
+	void convert_block(const uint16_t *digits, int32_t *out, size_t n, ADS7828_CHANNEL channel);
+	static ADS7828_CHANNEL reverse_pair(ADS7828_CHANNEL pair);
+
+#ifndef ADS7828_INTEGER_ONLY
 	void set_ref_voltage_external(float ref_voltage);
+	HAL_StatusTypeDef set_ratiometric(ADS7828_CHANNEL monitor, float known_voltage, uint8_t smoothing = 4);
+	float get_ref_voltage();
+#endif
+	void set_ref_voltage_external_uv(uint32_t ref_uv);
 	void set_ref_voltage_internal();
+	HAL_StatusTypeDef set_ratiometric_uv(ADS7828_CHANNEL monitor, uint32_t known_uv, uint8_t smoothing = 4);
+	void disable_ratiometric();
+	bool is_ratiometric();
+	uint32_t get_ref_voltage_uv();
 
 	void set_power_mode(ADS7828_PD_MODE mode);
 	void set_power_mode(ADS7828_PD_MODE mode, bool update_now);
+	ADS7828_PD_MODE get_power_mode();
+
+	void set_auto_power(uint32_t interval_ms);
+	void disable_auto_power();
+	void update_auto_power();
+
+	bool is_ref_settled();
+	bool is_ref_powered();
+	bool was_ref_settled();
+	uint8_t get_quality();
+	uint16_t get_raw_digit();
+
+	static bool enable_cycle_counter();
+	static uint32_t get_cycles();
+	uint32_t get_sample_cycles();
+
+#ifdef ADS7828_STATS
+	const ADS7828_stats_t &get_stats();
+	uint32_t get_read_cycles_avg();
+	void reset_stats();
+#endif
+
+#ifdef ADS7828_LATENCY
+	void get_latency(ADS7828_CHANNEL channel, ADS7828_latency_t &latency);
+	void get_device_latency(ADS7828_latency_t &latency);
+	void reset_latency();
+	void set_request_cycles(uint32_t cycles);
+#endif
+
+	void set_repeated_start(bool enable);
+
+	void set_bus_clock(uint32_t clock_hz);
+	HAL_StatusTypeDef set_bus_speed(ADS7828_BUS_SPEED speed, uint32_t kernel_clock_hz = 0);
+	uint32_t get_bus_clock();
+	void set_timeout(uint32_t timeout_ms);
+	uint32_t get_timeout();
+	void set_timeout_margin(uint32_t margin_ms);
+	uint32_t get_timeout_margin();
+	void set_latency_budget(uint32_t budget_us);
+	uint32_t get_latency_budget();
+	uint32_t get_deadline_miss_count();
+	uint32_t get_worst_latency_us();
+	void set_recovery_pins(GPIO_TypeDef *scl_port, uint16_t scl_pin, GPIO_TypeDef *sda_port, uint16_t sda_pin);
+	HAL_StatusTypeDef recover_bus();
 
-	void set_scaling(ADS7828_CHANNEL channel, float scaling);
+#ifndef ADS7828_INTEGER_ONLY
+	HAL_StatusTypeDef set_scaling(ADS7828_CHANNEL channel, float scaling);
 	float get_scaling(ADS7828_CHANNEL channel);
+#endif
+	HAL_StatusTypeDef set_scaling_ratio(ADS7828_CHANNEL channel, int32_t numerator, int32_t denominator);
+	int32_t get_scaling_fixed(ADS7828_CHANNEL channel);
 	void reset_scaling(ADS7828_CHANNEL channel);
 	void reset_scaling();
+	uint8_t get_free_conversions();
+#ifndef ADS7828_INTEGER_ONLY
+	HAL_StatusTypeDef set_lut(ADS7828_CHANNEL channel, const ADS7828_lut_t *lut);
+	const ADS7828_lut_t *get_lut(ADS7828_CHANNEL channel);
+#endif
+	HAL_StatusTypeDef set_curve(ADS7828_CHANNEL channel, const ADS7828_curve_point_t *points, uint8_t n);
+	void clear_curve(ADS7828_CHANNEL channel);
+#ifndef ADS7828_ASYNC_ONLY
+	int32_t read_linearized(ADS7828_CHANNEL channel, HAL_StatusTypeDef *status = nullptr);
+#endif
+	int32_t digit_to_linearized(ADS7828_CHANNEL channel, uint16_t digit);
 
-	void set_averaging(ADS7828_CHANNEL channel, uint8_t n);
+#ifndef ADS7828_INTEGER_ONLY
+	HAL_StatusTypeDef calibrate(ADS7828_CHANNEL channel, float known_low, float digit_low, float known_high, float digit_high);
+	HAL_StatusTypeDef set_calibration(ADS7828_CHANNEL channel, float gain, float offset);
+	float get_calibration_gain(ADS7828_CHANNEL channel);
+	float get_calibration_offset(ADS7828_CHANNEL channel);
+#endif
+	HAL_StatusTypeDef calibrate_fixed(ADS7828_CHANNEL channel, int32_t known_low_uv, uint16_t digit_low, int32_t known_high_uv, uint16_t digit_high);
+	HAL_StatusTypeDef set_calibration_fixed(ADS7828_CHANNEL channel, int32_t gain, int32_t offset_uv);
+	int32_t get_calibration_gain_fixed(ADS7828_CHANNEL channel);
+	int32_t get_calibration_offset_uv(ADS7828_CHANNEL channel);
+	void reset_calibration(ADS7828_CHANNEL channel);
+	void reset_calibration();
+
+	void get_config(ADS7828_config_t &config);
+	HAL_StatusTypeDef set_config(const ADS7828_config_t &config);
+
+	HAL_StatusTypeDef set_averaging(ADS7828_CHANNEL channel, uint16_t n);
 	void clear_averaging(ADS7828_CHANNEL channel);
 	void disable_averaging(ADS7828_CHANNEL channel);
+	HAL_StatusTypeDef set_filter_ema(ADS7828_CHANNEL channel, uint8_t shift);
+#ifndef ADS7828_INTEGER_ONLY
+	HAL_StatusTypeDef set_filter_iir(ADS7828_CHANNEL channel, float alpha);
+#endif
+	HAL_StatusTypeDef set_filter_iir_fixed(ADS7828_CHANNEL channel, uint16_t alpha);
+	void clear_filter(ADS7828_CHANNEL channel);
+	void disable_filter(ADS7828_CHANNEL channel);
+	ADS7828_FILTER_MODE get_filter_mode(ADS7828_CHANNEL channel);
+
+	HAL_StatusTypeDef set_median(ADS7828_CHANNEL channel, uint8_t size);
+	void disable_median(ADS7828_CHANNEL channel);
+	uint8_t get_free_slots();
+
+	uint32_t get_averaging_sum(ADS7828_CHANNEL channel);
+	uint16_t get_averaging_count(ADS7828_CHANNEL channel);
+#ifdef ADS7828_DYNAMIC_MEM
+	uint16_t get_averaging_pool_free();
+#endif
+
+	HAL_StatusTypeDef start_read_dma(ADS7828_CHANNEL channel, ADS7828_callback_t callback, void *context = nullptr);
+	void set_deferred_processing(bool defer);
+	ADS7828_digit_t process_result(ADS7828_CHANNEL channel, uint16_t digit);
+	HAL_StatusTypeDef start_read_channels_dma(const ADS7828_CHANNEL *channels, size_t n, uint16_t *out, ADS7828_batch_callback_t callback, void *context = nullptr, uint8_t *quality = nullptr);
+	HAL_StatusTypeDef stream_channel(ADS7828_CHANNEL channel, uint16_t *dst, size_t count, ADS7828_stream_callback_t callback, void *context = nullptr);
+	HAL_StatusTypeDef start_oversample_dma(ADS7828_CHANNEL channel, uint8_t extra_bits, ADS7828_oversample_callback_t callback, void *context = nullptr);
+	HAL_StatusTypeDef start_capture(ADS7828_CHANNEL channel, uint16_t *buffer, size_t size, size_t pre, ADS7828_capture_callback_t callback, void *context = nullptr);
+	void set_capture_trigger(ADS7828_TRIGGER trigger, uint16_t level = 0);
+	void trigger_capture();
+	bool is_capture_triggered();
+	HAL_StatusTypeDef start_sequence(const ADS7828_CHANNEL *channels, size_t n, uint16_t *buffer, size_t size, ADS7828_sequence_callback_t callback, void *context = nullptr);
+	uint32_t get_sequence_count();
+	HAL_StatusTypeDef start_sweep_dma(const ADS7828_CHANNEL *channels, size_t n, uint16_t *out, ADS7828_batch_callback_t callback, void *context = nullptr);
+#if __cplusplus >= 202002L
+	ADS7828_read_awaitable read_async(ADS7828_CHANNEL channel);
+#endif
+	bool is_busy();
+	void abort();
+
+	I2C_HandleTypeDef *get_handle();
+	ADS7828_transport_t &get_transport();
+	uint8_t get_address();
+
+	// Forward the HAL I2C callbacks to these when using the asynchronous reads, HAL_I2C_MemRxCpltCallback to rx_complete_callback for sweeps
+	void tx_complete_callback(I2C_HandleTypeDef *hi2c);
+	void rx_complete_callback(I2C_HandleTypeDef *hi2c);
+	void error_callback(I2C_HandleTypeDef *hi2c);
+
+protected:
+#ifdef ADS7828_DYNAMIC_MEM
+	void move_pool(uint16_t *pool);
+#endif
 
 private:
+	// Only used by the move operations, copies would share the callbacks and listeners of a device
+	ADS7828(const ADS7828 &other) = default;
+	ADS7828 &operator=(const ADS7828 &other) = default;
+
 	void init();
+	static bool uses_internal_ref(ADS7828_PD_MODE mode);
+	void apply_auto_power();
+	void track_reference(ADS7828_PD_MODE mode);
+	void update_timeout();
+	static void delay_half_clock();
+#ifdef ADS7828_I2C_V2
+	static uint32_t calc_timing(uint32_t kernel_clock_hz, ADS7828_BUS_SPEED speed);
+	static uint32_t timing_to_clock(uint32_t kernel_clock_hz, uint32_t timing);
+#endif
+	uint8_t build_command(ADS7828_CHANNEL channel);
+	const uint8_t *prepare_command(ADS7828_CHANNEL channel);
+	void apply_power_mode(ADS7828_PD_MODE mode);
+#ifndef ADS7828_ASYNC_ONLY
+	HAL_StatusTypeDef transfer_digit(ADS7828_CHANNEL channel, uint16_t &digit);
+	HAL_StatusTypeDef transfer_command(uint8_t command, uint16_t &digit);
+	HAL_StatusTypeDef receive_digit(uint16_t &digit);
+#endif
+	static uint16_t swap_digit(uint16_t raw);
+	uint8_t acquire_slot(ADS7828_CHANNEL channel);
+	void release_slot(ADS7828_CHANNEL channel);
+	uint16_t reject_spikes(uint8_t slot, uint16_t digit);
+#ifndef ADS7828_INTEGER_ONLY
+	float process_digit(ADS7828_CHANNEL channel, uint16_t digit);
+#endif
+	uint16_t process_digit_int(ADS7828_CHANNEL channel, uint16_t digit);
+	// Conversion of a channel, the shared default entry if the channel has none of its own
+	const ADS7828_conversion_t &conversion(ADS7828_CHANNEL channel) const
+	{
+		return _conversions[_conv[channel]];
+	}
+	ADS7828_conversion_t *own_conversion(ADS7828_CHANNEL channel);
+	void release_conversion(ADS7828_CHANNEL channel);
+	HAL_StatusTypeDef store_conversion(ADS7828_CHANNEL channel, int32_t scaling, int32_t cal_gain, int32_t cal_offset_uv);
+	void update_conversion(ADS7828_conversion_t &conversion);
+	void update_conversion();
+	void track_ratio(uint16_t digit);
+	void apply_ratio();
+
+	// Statistics helpers, empty without ADS7828_STATS and ADS7828_LATENCY so the compiler drops them
+	uint32_t stats_start()
+	{
+#if defined(ADS7828_STATS) || defined(ADS7828_LATENCY)
+		return get_cycles();
+#else
+		return 0;
+#endif
+	}
+	uint32_t budget_start();
+	uint32_t budget_timeout(uint32_t start, bool check_bus = true);
+	void budget_end(uint32_t start, bool aborted);
+	void record_transfer(HAL_StatusTypeDef status, uint16_t bytes, uint32_t start = 0);
+	void record_read(uint32_t start);
+	void record_latency(ADS7828_CHANNEL channel, uint32_t start);
+	HAL_StatusTypeDef start_async(ADS7828_CHANNEL channel, uint32_t xfer_options);
+	void stream_next();
+	void batch_next();
+	void capture_next();
+	void sequence_next();
+	HAL_StatusTypeDef sweep_next();
+	void finish_async(HAL_StatusTypeDef status, ADS7828_digit_t digit);
+
+	ADS7828_conversion_t _conversions[ADS7828_CONVERSIONS + 1]; // Entry 0 holds the defaults, the others belong to one channel each
+	uint8_t _conv[ADS7828_CHANNELS] = {};		   // Conversion entry of every channel, 0 for channels with the defaults
+	uint8_t _conv_channels[ADS7828_CONVERSIONS];   // Channel owning entry i + 1, ADS7828_NO_SLOT if free
+	uint8_t _slots[ADS7828_CHANNELS];			   // Slot of the filter state of every channel, ADS7828_NO_SLOT for plain channels
+	uint8_t _slot_channels[ADS7828_SLOTS];		   // Channel owning a slot, ADS7828_NO_SLOT if free
+	ADS7828_circ_buf_t _buffers[ADS7828_SLOTS];	   // Circular buffers to store last values when averaging is enabled, indexed by slot
+	ADS7828_filter_t _filters[ADS7828_SLOTS];	   // Recursive filters, indexed by slot
+	ADS7828_median_t _medians[ADS7828_SLOTS];	   // Spike rejection in front of the averaging, indexed by slot
+#ifdef ADS7828_DYNAMIC_MEM
+	uint16_t *_avg_pool = nullptr;				   // Storage the averaging buffers are carved from, nullptr without a pool
+	uint16_t _avg_pool_size = 0;				   // Number of values in the pool
+	uint16_t _avg_pool_used = 0;				   // Values carved from the start of the pool
+#endif
+	uint32_t _ref_uv = 2500000;					   // Reference voltage [uV], the internal 2.5V reference by default
+	ADS7828_PD_MODE _pd_mode = REF_ON_AD_ON;	   // Current Power Down Mode, sent with every command
+	const uint8_t *_commands;					   // Command table of the current Power Down Mode
+	bool _repeated_start = false;				   // Command and result in one transaction
+	uint8_t _diff_reversed = 0;					   // Differential pairs last read in reverse polarity, bit per pair (0-1, 2-3, 4-5, 6-7)
+	bool _internal_ref = true;					   // Internal 2.5V reference is used
+	uint8_t _ratio_channel = ADS7828_CHANNELS;	   // Monitor channel of the ratiometric mode, ADS7828_CHANNELS if disabled
+	uint8_t _ratio_smoothing = 0;				   // EMA shift of the monitor digit
+	uint32_t _ratio_expected = 0;				   // Monitor digit at the nominal reference, with ADS7828_AVG_FRAC_BITS fractional bits
+	uint32_t _ratio_avg = 0;					   // Smoothed monitor digit with ADS7828_AVG_FRAC_BITS fractional bits, 0 before the first reading
+	volatile int32_t _ratio = 1L << ADS7828_RATIO_SHIFT; // Actual / nominal reference voltage, fixed-point with ADS7828_RATIO_SHIFT fractional bits
 
-	float _scaling[ADS7828_CHANNELS];			   // Channel Voltage Scaling
-	float _ref_voltage = 2.5;					   // Using the internal 2.5V reference voltage by default
-	ADS7828_PD_MODE _pd_mode;					   // Current Power Down Mode
-	ADS7828_circ_buf_t _buffers[ADS7828_CHANNELS]; // Circular buffers to store last values when averaging is enabled
+	bool _auto_power = false;					   // Automatic power policy enabled
+	uint32_t _auto_interval_ms = 0;				   // Expected time between conversions
+	volatile uint32_t _last_conversion_tick = 0;   // HAL tick of the last command
+	volatile bool _ref_warm = false;			   // Reference was woken up for the next conversion
+
+	bool _ref_on = false;						   // Internal reference powered after the last command
+	uint32_t _ref_switch_tick = 0;				   // HAL tick of the last reference power change
+	bool _last_settled = false;					   // Last conversion was done with a settled reference
+	volatile uint8_t _last_quality = 0;			   // ADS7828_QUALITY bits of the last conversion
+	volatile uint16_t _raw_digit = 0;			   // Digit of the last conversion before averaging and filters
+	volatile uint32_t _sample_cycles = 0;		   // DWT cycle count when the last result was received
+#ifdef ADS7828_STATS
+	ADS7828_stats_t _stats = {};				   // Instrumentation counters
+#endif
+
+#ifdef ADS7828_LATENCY
+	ADS7828_latency_t _latency[ADS7828_CHANNELS] = {}; // Latency histograms, indexed by ADS7828_CHANNEL
+	uint32_t _request_cycles = 0;					   // DWT cycle count of the request of the running async read
+	uint32_t _request_origin = 0;					   // Request time of the next async read, set by a queue
+	bool _request_queued = false;					   // _request_origin is valid
+#endif
 
 	uint8_t _address;		  // I2C Address
 	I2C_HandleTypeDef *_hi2c; // I2C Handle
+	ADS7828_transport_t _bus; // Blocking transfers, HAL or register level (ADS7828_LL)
+
+	uint32_t _bus_clock_hz = 100000;	  // I2C clock used for the timeout calculation
+	uint32_t _timeout_ms = 1 + ADS7828_TIMEOUT_MARGIN_MS; // Timeout of the blocking transfers, calculated by update_timeout
+	uint32_t _timeout_margin_ms = ADS7828_TIMEOUT_MARGIN_MS; // Added to the bus time of the timeout
+	uint32_t _budget_us = 0;			  // Latency budget of every blocking conversion, 0 if disabled
+	uint32_t _deadline_misses = 0;		  // Conversions aborted to keep the budget or finished late
+	uint32_t _worst_latency_us = 0;		  // Longest blocking conversion since the budget was set
+	GPIO_TypeDef *_scl_port = nullptr;	  // SCL pin for bus recovery
+	uint16_t _scl_pin = 0;
+	GPIO_TypeDef *_sda_port = nullptr;	  // SDA pin for bus recovery
+	uint16_t _sda_pin = 0;
+
+	volatile bool _busy = false;						 // Asynchronous read in progress
+	ADS7828_ASYNC_MODE _async_mode;						 // Type of the running asynchronous transfer
+	ADS7828_CHANNEL _async_channel;						 // Channel of the running asynchronous read
+	volatile bool _defer_processing = false;			 // Single reads pass the raw digit, the callback calls process_result
+	uint8_t _async_data[2];								 // DMA receive buffer
+	// Completion callback of the running transfer, only the one of _async_mode is valid
+	union
+	{
+		ADS7828_callback_t _async_callback = nullptr;	 // Completion callback of the running read
+		ADS7828_stream_callback_t _stream_callback;		 // Completion callback of the running stream
+		ADS7828_batch_callback_t _batch_callback;		 // Completion callback of the running batch or sweep
+		ADS7828_oversample_callback_t _oversample_callback; // Completion callback of the running oversampled read
+		ADS7828_capture_callback_t _capture_callback;	 // Completion callback of the running capture
+		ADS7828_sequence_callback_t _sequence_callback;	 // Half buffer callback of the running sequence
+	};
+	void *_async_context = nullptr;						 // User context passed to the callback
+
+	uint16_t *_stream_dst;	// Destination of the running stream or batch
+	size_t _stream_count;	// Number of digits requested
+	size_t _stream_index;	// Number of digits received
+
+	ADS7828_TRIGGER _capture_mode = TRIGGER_SOFTWARE; // Automatic trigger of the captures
+	uint16_t _capture_level = 0;					  // Trigger level of the automatic trigger
+	volatile bool _capture_request = false;			  // trigger_capture was called, the next digit is the trigger
+	volatile bool _capture_triggered = false;		  // The running capture only fills the post-trigger part
+	volatile uint32_t _sequence_halves = 0;			  // Buffer halves completed by the running sequence
+
+	// State of the running transfer, only one mode runs at a time so the modes share the memory
+	union
+	{
+		struct
+		{
+			uint32_t sum; // Sum of the digits of the running oversampled read
+			uint8_t bits; // Extra bits of the running oversampled read
+		} _oversample;
+
+		struct
+		{
+			size_t pre;		   // Requested digits before the trigger
+			size_t post;	   // Digits still to receive after the trigger
+			size_t filled;	   // Valid digits in the buffer, up to its size
+			size_t first;	   // Buffer index of the first digit of the window
+			size_t window_pre; // Digits before the trigger in the window, less than requested for an early trigger
+			size_t count;	   // Length of the window
+		} _capture;
+
+		struct
+		{
+			uint8_t channels[ADS7828_CHANNELS]; // ADS7828_CHANNEL of every entry of the running batch or sweep
+			uint8_t commands[ADS7828_CHANNELS]; // Precomputed command bytes of the running batch, sweep or sequence
+			uint16_t unsettled;					// Entries of the running batch prepared during reference settling, bit per entry
+			uint8_t *quality;					// Receives the ADS7828_QUALITY bits of the running batch, nullptr if not wanted
+			uint8_t sequence_n;					// Channels in the running sequence
+			uint8_t sequence_pos;				// Position of the next command in the sequence
+		} _batch;
+	};
+};
+
+/**
+ * ADS7828 that owns its averaging pool of PoolSize values, e.g. ADS7828_Pooled<64> for 64 averaged values over all channels.
+ * A plain ADS7828 only averages with a pool given to its constructor, so drivers without averaging (e.g. inside ADS7828T) carry none.
+ * Without ADS7828_DYNAMIC_MEM the buffers are part of every driver and PoolSize is ignored.
+ */
+template <uint16_t PoolSize = ADS7828_AVG_POOL>
+class ADS7828_Pooled : public ADS7828
+{
+public:
+#ifdef ADS7828_DYNAMIC_MEM
+	ADS7828_Pooled(I2C_HandleTypeDef *hi2c, uint8_t address) : ADS7828(hi2c, address, _pool, PoolSize) {}
+#ifndef ADS7828_INTEGER_ONLY
+	ADS7828_Pooled(I2C_HandleTypeDef *hi2c, uint8_t address, float external_ref_voltage) : ADS7828(hi2c, address, _pool, PoolSize)
+	{
+		set_ref_voltage_external(external_ref_voltage);
+	}
+#endif
+
+	// The buffers are copied into the own pool, a plain move would leave them pointing into the old driver
+	ADS7828_Pooled(ADS7828_Pooled &&other) : ADS7828(static_cast<ADS7828 &&>(other)) { move_pool(_pool); }
+	ADS7828_Pooled &operator=(ADS7828_Pooled &&other)
+	{
+		if (this != &other)
+		{
+			ADS7828::operator=(static_cast<ADS7828 &&>(other));
+			move_pool(_pool);
+		}
+
+		return *this;
+	}
+
+private:
+	static_assert(PoolSize > 0, "The pool needs at least one value");
+
+	uint16_t _pool[PoolSize]; // Storage of the averaging buffers
+#else
+	ADS7828_Pooled(I2C_HandleTypeDef *hi2c, uint8_t address) : ADS7828(hi2c, address) {}
+#ifndef ADS7828_INTEGER_ONLY
+	ADS7828_Pooled(I2C_HandleTypeDef *hi2c, uint8_t address, float external_ref_voltage) : ADS7828(hi2c, address, external_ref_voltage) {}
+#endif
+#endif
 };
 
+/**
+ * Counts a started transfer and classifies its errors
+ *
+ * @param status Status returned by the HAL
+ * @param bytes Bytes on the bus including the address bytes
+ * @param start Cycle count before a blocking transfer from stats_start, 0 for non-blocking transfers
+ */
+inline void ADS7828::record_transfer(HAL_StatusTypeDef status, uint16_t bytes, uint32_t start)
+{
+#ifdef ADS7828_STATS
+	if (start != 0)
+	{
+		_stats.busy_wait_cycles += get_cycles() - start;
+	}
+
+	if (status == HAL_BUSY)
+	{
+		_stats.busy++;
+		return;
+	}
+
+	_stats.transactions++;
+	_stats.bytes += bytes;
+
+	if (status == HAL_TIMEOUT)
+	{
+		_stats.timeouts++;
+	}
+	else if (status != HAL_OK)
+	{
+		if (HAL_I2C_GetError(_hi2c) & HAL_I2C_ERROR_AF)
+		{
+			_stats.nacks++;
+		}
+		else
+		{
+			_stats.bus_errors++;
+		}
+	}
+#else
+	(void)status;
+	(void)bytes;
+	(void)start;
+#endif
+}
+
+/**
+ * Records the duration of a blocking read
+ *
+ * @param start Cycle count at the start of the read from stats_start
+ */
+inline void ADS7828::record_read(uint32_t start)
+{
+#ifdef ADS7828_STATS
+	uint32_t cycles = get_cycles() - start;
+
+	if (_stats.reads == 0 || cycles < _stats.read_cycles_min)
+	{
+		_stats.read_cycles_min = cycles;
+	}
+	if (cycles > _stats.read_cycles_max)
+	{
+		_stats.read_cycles_max = cycles;
+	}
+
+	_stats.reads++;
+	_stats.read_cycles_sum += cycles;
+#else
+	(void)start;
+#endif
+}
+
+/**
+ * Adds the latency of a result to the histogram of its channel
+ *
+ * @param channel The ADS7828_CHANNEL configuration of the result
+ * @param start Cycle count of the request
+ */
+inline void ADS7828::record_latency(ADS7828_CHANNEL channel, uint32_t start)
+{
+#ifdef ADS7828_LATENCY
+	uint32_t cycles = get_cycles() - start;
+	uint32_t rest = cycles >> ADS7828_LATENCY_SHIFT;
+	uint8_t bucket = 0;
+
+	while (rest != 0 && bucket < ADS7828_LATENCY_BUCKETS - 1)
+	{
+		rest >>= 1;
+		bucket++;
+	}
+
+	ADS7828_latency_t &latency = _latency[channel];
+	latency.buckets[bucket]++;
+	latency.count++;
+	latency.max_cycles = (cycles > latency.max_cycles) ? cycles : latency.max_cycles;
+#else
+	(void)channel;
+	(void)start;
+#endif
+}
+
+#ifndef ADS7828_ASYNC_ONLY
+/**
+ * Reads the digit of a channel configuration that is known at compile time.
+ * Table offsets of the channel fold into constants and plain channels skip the filter processing inline.
+ * Unlike read(channel, out), the bus is not recovered on timeouts and no read statistics are recorded.
+ *
+ * @tparam Channel The ADS7828_CHANNEL configuration you want the digit from
+ * @param out Receives the (rounded average) digit (0 - 4095), only written on success
+ * @return HAL_OK on success, otherwise the HAL status of the failed transfer
+ */
+template <ADS7828_CHANNEL Channel>
+inline HAL_StatusTypeDef ADS7828::read(uint16_t &out)
+{
+	static_assert(Channel < ADS7828_CHANNELS, "Invalid channel configuration");
+
+	uint16_t digit = 0;
+	HAL_StatusTypeDef status = transfer_command(*prepare_command(Channel), digit);
+
+	if (status != HAL_OK)
+	{
+		return status;
+	}
+
+	// The monitor of the ratiometric mode is tracked in process_digit_int
+	out = (_slots[Channel] == ADS7828_NO_SLOT && Channel != _ratio_channel) ? digit : process_digit_int(Channel, digit);
+	return HAL_OK;
+}
+
+/**
+ * Reads the voltage of a channel configuration that is known at compile time in integer millivolts, see read<Channel>
+ *
+ * @tparam Channel The ADS7828_CHANNEL configuration you want the voltage from
+ * @param status Optional pointer that receives the HAL status of the transfer
+ * @return Voltage [mV] including scaling and calibration, 0 if the transfer failed
+ */
+template <ADS7828_CHANNEL Channel>
+inline int32_t ADS7828::read_millivolts(HAL_StatusTypeDef *status)
+{
+	uint16_t digit = 0;
+	HAL_StatusTypeDef result = read<Channel>(digit);
+
+	if (status != nullptr)
+	{
+		*status = result;
+	}
+
+	if (result != HAL_OK)
+	{
+		return 0;
+	}
+
+	const ADS7828_conversion_t &conv = conversion(Channel);
+	return (int32_t)(((int64_t)digit * conv.mv_factor + conv.mv_offset + (1 << (ADS7828_FIXED_SHIFT - 1))) >> ADS7828_FIXED_SHIFT);
+}
+
+#ifndef ADS7828_INTEGER_ONLY
+/**
+ * Reads the voltage of a channel configuration that is known at compile time, see read<Channel>.
+ * Uses the fixed-point factor of the channel or its conversion table, so the only float operation is the final scaling.
+ *
+ * @tparam Channel The ADS7828_CHANNEL configuration you want the voltage from
+ * @param status Optional pointer that receives the HAL status of the transfer
+ * @return Voltage [V] including scaling and calibration, 0 if the transfer failed
+ */
+template <ADS7828_CHANNEL Channel>
+inline float ADS7828::read_voltage(HAL_StatusTypeDef *status)
+{
+	uint16_t digit = 0;
+	HAL_StatusTypeDef result = read<Channel>(digit);
+
+	if (status != nullptr)
+	{
+		*status = result;
+	}
+
+	if (result != HAL_OK)
+	{
+		return 0.0f;
+	}
+
+	const ADS7828_conversion_t &conv = conversion(Channel);
+
+	if (conv.lut != nullptr)
+	{
+		return conv.lut->values[digit];
+	}
+
+	// Microvolts keep the resolution of the 12 bit digit for references up to 2^31 uV
+	int64_t microvolts = ((int64_t)digit * 1000 * conv.mv_factor + conv.mv_offset * 1000 + (1 << (ADS7828_FIXED_SHIFT - 1))) >> ADS7828_FIXED_SHIFT;
+	return (int32_t)microvolts * 1e-6f;
+}
+#endif // ADS7828_INTEGER_ONLY
+#endif // ADS7828_ASYNC_ONLY
+
 #endif // ADS7828_HPP
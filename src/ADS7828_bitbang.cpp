@@ -0,0 +1,376 @@
+#include "ADS7828.hpp"
+
+#if defined(ADS7828_BITBANG)
+
+/**
+ * Sets the pins and configures them as open-drain outputs, both lines are released.
+ * External pull-ups are needed like for the hardware I2C. Call set_clock afterwards.
+ *
+ * @param scl_port GPIO port of SCL
+ * @param scl_pin GPIO pin of SCL, e.g. GPIO_PIN_6
+ * @param sda_port GPIO port of SDA
+ * @param sda_pin GPIO pin of SDA, e.g. GPIO_PIN_7
+ */
+void ADS7828_BitBangTransport::set_pins(GPIO_TypeDef *scl_port, uint16_t scl_pin, GPIO_TypeDef *sda_port, uint16_t sda_pin)
+{
+	_scl_port = scl_port;
+	_scl_pin = scl_pin;
+	_sda_port = sda_port;
+	_sda_pin = sda_pin;
+
+	GPIO_InitTypeDef gpio = {0};
+	gpio.Mode = GPIO_MODE_OUTPUT_OD;
+	gpio.Pull = GPIO_NOPULL;
+	gpio.Speed = GPIO_SPEED_FREQ_HIGH;
+
+	scl_release();
+	sda_release();
+
+	gpio.Pin = scl_pin;
+	HAL_GPIO_Init(scl_port, &gpio);
+	gpio.Pin = sda_pin;
+	HAL_GPIO_Init(sda_port, &gpio);
+
+	if (_half_cycles == 0)
+	{
+		set_clock(100000);
+	}
+}
+
+/**
+ * Sets the SCL frequency from SystemCoreClock, e.g. 400000 for fast mode.
+ * With the DWT cycle counter the frequency is met closely, on Cortex-M0 the delay loop is estimated with
+ * ADS7828_BITBANG_LOOP_CYCLES and ADS7828_BITBANG_OVERHEAD_CYCLES, fine tune with set_half_period if needed.
+ *
+ * @param clock_hz SCL frequency [Hz]
+ */
+void ADS7828_BitBangTransport::set_clock(uint32_t clock_hz)
+{
+	if (clock_hz == 0)
+	{
+		return;
+	}
+
+	ADS7828::enable_cycle_counter();
+	set_half_period((SystemCoreClock + clock_hz) / (2 * clock_hz));
+}
+
+/**
+ * Sets half an SCL period directly
+ *
+ * @param cycles CPU cycles between two clock edges, e.g. 90 for 400 kHz at 72 MHz
+ */
+void ADS7828_BitBangTransport::set_half_period(uint32_t cycles)
+{
+	_half_cycles = (cycles == 0) ? 1 : cycles;
+}
+
+/**
+ * Get half an SCL period
+ *
+ * @return CPU cycles between two clock edges
+ */
+uint32_t ADS7828_BitBangTransport::get_half_period()
+{
+	return _half_cycles;
+}
+
+/**
+ * Writes bytes to a device and ends with a STOP
+ *
+ * @param address 7 Bit I2C address
+ * @param data Bytes to send
+ * @param size Number of bytes
+ * @param timeout_ms Timeout for clock stretching in [ms]
+ * @return HAL_OK, HAL_BUSY if a line is held low, HAL_ERROR on a NACK, HAL_TIMEOUT
+ */
+HAL_StatusTypeDef ADS7828_BitBangTransport::write(uint8_t address, uint8_t *data, uint16_t size, uint32_t timeout_ms)
+{
+	_timeout_ms = timeout_ms;
+	HAL_StatusTypeDef status = start((address << 1));
+
+	for (uint16_t i = 0; i < size && status == HAL_OK; i++)
+	{
+		status = write_byte(data[i]);
+	}
+
+	stop();
+	return status;
+}
+
+/**
+ * Reads bytes from a device and ends with a STOP
+ *
+ * @param address 7 Bit I2C address
+ * @param data Receives the bytes
+ * @param size Number of bytes
+ * @param timeout_ms Timeout for clock stretching in [ms]
+ * @return HAL_OK, HAL_BUSY if a line is held low, HAL_ERROR on a NACK, HAL_TIMEOUT
+ */
+HAL_StatusTypeDef ADS7828_BitBangTransport::read(uint8_t address, uint8_t *data, uint16_t size, uint32_t timeout_ms)
+{
+	_timeout_ms = timeout_ms;
+	HAL_StatusTypeDef status = start((address << 1) | 1);
+
+	// The last byte is not acknowledged, so the slave releases SDA for the STOP
+	for (uint16_t i = 0; i < size && status == HAL_OK; i++)
+	{
+		status = read_byte(data[i], i + 1 < size);
+	}
+
+	stop();
+	return status;
+}
+
+/**
+ * Writes one byte and reads the answer after a repeated start
+ *
+ * @param address 7 Bit I2C address
+ * @param command Byte to send, e.g. the command byte
+ * @param data Receives the bytes
+ * @param size Number of bytes
+ * @param timeout_ms Timeout for clock stretching in [ms]
+ * @return HAL_OK, HAL_BUSY if a line is held low, HAL_ERROR on a NACK, HAL_TIMEOUT
+ */
+HAL_StatusTypeDef ADS7828_BitBangTransport::write_read(uint8_t address, uint8_t command, uint8_t *data, uint16_t size, uint32_t timeout_ms)
+{
+	_timeout_ms = timeout_ms;
+	HAL_StatusTypeDef status = start((address << 1));
+
+	if (status == HAL_OK)
+	{
+		status = write_byte(command);
+	}
+
+	// Repeated start, SCL is low after the acknowledge
+	if (status == HAL_OK)
+	{
+		status = start((address << 1) | 1);
+	}
+
+	for (uint16_t i = 0; i < size && status == HAL_OK; i++)
+	{
+		status = read_byte(data[i], i + 1 < size);
+	}
+
+	stop();
+	return status;
+}
+
+/**
+ * Sets the time base of the next clock edge to now
+ */
+void ADS7828_BitBangTransport::begin()
+{
+	_tick = HAL_GetTick();
+	_deadline = ADS7828::get_cycles();
+}
+
+/**
+ * Waits until half a period after the last edge.
+ * If the deadline has already passed, e.g. after an interrupt, the next half period starts now, so no phase is too short.
+ */
+void ADS7828_BitBangTransport::half_delay()
+{
+#ifdef ADS7828_HAS_CYCCNT
+	_deadline += _half_cycles;
+	uint32_t now;
+
+	while ((int32_t)((now = DWT->CYCCNT) - _deadline) < 0)
+	{
+	}
+
+	if ((int32_t)(now - _deadline) > 0)
+	{
+		_deadline = now;
+	}
+#else
+	uint32_t loops = (_half_cycles > ADS7828_BITBANG_OVERHEAD_CYCLES) ? (_half_cycles - ADS7828_BITBANG_OVERHEAD_CYCLES) / ADS7828_BITBANG_LOOP_CYCLES : 0;
+
+	for (volatile uint32_t i = loops; i > 0; i = i - 1)
+	{
+	}
+#endif
+}
+
+/**
+ * Releases SCL and waits until it is high, a slave may hold it low (clock stretching)
+ *
+ * @return HAL_OK, HAL_TIMEOUT if SCL stays low
+ */
+HAL_StatusTypeDef ADS7828_BitBangTransport::clock_high()
+{
+	scl_release();
+
+	while (!scl_is_high())
+	{
+		if ((HAL_GetTick() - _tick) > _timeout_ms)
+		{
+			return fail(HAL_TIMEOUT, HAL_I2C_ERROR_TIMEOUT);
+		}
+	}
+
+	return HAL_OK;
+}
+
+/**
+ * Generates a START or, if the bus is already owned, a repeated START and sends the address byte
+ *
+ * @param address_byte Address shifted left with the R/W bit
+ * @return HAL_OK if the address was acknowledged
+ */
+HAL_StatusTypeDef ADS7828_BitBangTransport::start(uint8_t address_byte)
+{
+	bool repeated = !scl_is_high();
+
+	if (!repeated)
+	{
+		begin();
+
+		// Another master or a stuck slave holds a line
+		if (!sda_is_high())
+		{
+			return fail(HAL_BUSY, HAL_I2C_ERROR_BERR);
+		}
+
+		_hi2c->ErrorCode = HAL_I2C_ERROR_NONE;
+	}
+	else
+	{
+		// SCL is low after the last acknowledge, release SDA before the clock goes high
+		sda_release();
+		half_delay();
+
+		HAL_StatusTypeDef status = clock_high();
+		if (status != HAL_OK)
+		{
+			return status;
+		}
+		half_delay();
+	}
+
+	// SDA falling while SCL is high
+	sda_low();
+	half_delay();
+	scl_low();
+
+	return write_byte(address_byte);
+}
+
+/**
+ * Sends a byte MSB first and checks the acknowledge, SCL is low before and after
+ *
+ * @param byte Byte to send
+ * @return HAL_OK if acknowledged, HAL_ERROR on a NACK
+ */
+HAL_StatusTypeDef ADS7828_BitBangTransport::write_byte(uint8_t byte)
+{
+	for (uint8_t mask = 0x80; mask != 0; mask >>= 1)
+	{
+		if (byte & mask)
+		{
+			sda_release();
+		}
+		else
+		{
+			sda_low();
+		}
+
+		half_delay();
+		HAL_StatusTypeDef status = clock_high();
+		if (status != HAL_OK)
+		{
+			return status;
+		}
+		half_delay();
+		scl_low();
+	}
+
+	// The slave pulls SDA low during the ninth clock
+	sda_release();
+	half_delay();
+	HAL_StatusTypeDef status = clock_high();
+	if (status != HAL_OK)
+	{
+		return status;
+	}
+	half_delay();
+	bool ack = !sda_is_high();
+	scl_low();
+
+	return ack ? HAL_OK : fail(HAL_ERROR, HAL_I2C_ERROR_AF);
+}
+
+/**
+ * Receives a byte MSB first and sends the acknowledge, SCL is low before and after
+ *
+ * @param byte Receives the byte
+ * @param ack True to acknowledge, false for the last byte
+ * @return HAL_OK, HAL_TIMEOUT if SCL is stretched too long
+ */
+HAL_StatusTypeDef ADS7828_BitBangTransport::read_byte(uint8_t &byte, bool ack)
+{
+	uint8_t value = 0;
+	sda_release();
+
+	for (uint8_t i = 0; i < 8; i++)
+	{
+		half_delay();
+		HAL_StatusTypeDef status = clock_high();
+		if (status != HAL_OK)
+		{
+			return status;
+		}
+		half_delay();
+
+		// Sampled at the end of the high phase
+		value = (uint8_t)((value << 1) | (sda_is_high() ? 1 : 0));
+		scl_low();
+	}
+
+	if (ack)
+	{
+		sda_low();
+	}
+
+	half_delay();
+	HAL_StatusTypeDef status = clock_high();
+	if (status != HAL_OK)
+	{
+		return status;
+	}
+	half_delay();
+	scl_low();
+	sda_release();
+
+	byte = value;
+	return HAL_OK;
+}
+
+/**
+ * Generates a STOP: SDA rising while SCL is high
+ */
+void ADS7828_BitBangTransport::stop()
+{
+	sda_low();
+	half_delay();
+
+	// A stretching slave gets the timeout once more, the lines are released anyway
+	clock_high();
+	half_delay();
+	sda_release();
+	half_delay();
+}
+
+/**
+ * Stores the error code like the HAL does
+ *
+ * @return The status
+ */
+HAL_StatusTypeDef ADS7828_BitBangTransport::fail(HAL_StatusTypeDef status, uint32_t error_code)
+{
+	_hi2c->ErrorCode = error_code;
+	return status;
+}
+
+#endif // ADS7828_BITBANG
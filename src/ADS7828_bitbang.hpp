@@ -0,0 +1,88 @@
+// GPIO bit-bang transport for boards without a free I2C peripheral
+#ifndef ADS7828_BITBANG_HPP
+#define ADS7828_BITBANG_HPP
+
+#if defined(ADS7828_HOST)
+#error "The ADS7828_BITBANG transport needs the GPIO registers of an STM32"
+#endif
+
+// Cycles one delay loop iteration takes without the DWT cycle counter (Cortex-M0)
+#ifndef ADS7828_BITBANG_LOOP_CYCLES
+#define ADS7828_BITBANG_LOOP_CYCLES 4
+#endif
+// Cycles of the GPIO access around a delay, subtracted from the loop delay without the cycle counter
+#ifndef ADS7828_BITBANG_OVERHEAD_CYCLES
+#define ADS7828_BITBANG_OVERHEAD_CYCLES 12
+#endif
+
+// Blocking transfers on two open-drain GPIOs through BSRR and IDR.
+// Every clock edge waits for a deadline on the DWT cycle counter, so the time spent on the GPIO access
+// is part of the half period and the clock stays close to the set frequency. The I2C handle is not initialized,
+// only its ErrorCode is used to report NACKs and timeouts like the HAL does. Asynchronous reads need a hardware I2C.
+class ADS7828_BitBangTransport : public ADS7828_Transport<ADS7828_BitBangTransport>
+{
+public:
+	ADS7828_BitBangTransport(I2C_HandleTypeDef *hi2c) : _hi2c(hi2c) {}
+
+	void set_pins(GPIO_TypeDef *scl_port, uint16_t scl_pin, GPIO_TypeDef *sda_port, uint16_t sda_pin);
+	void set_clock(uint32_t clock_hz);
+	void set_half_period(uint32_t cycles);
+	uint32_t get_half_period();
+
+	HAL_StatusTypeDef write(uint8_t address, uint8_t *data, uint16_t size, uint32_t timeout_ms);
+	HAL_StatusTypeDef read(uint8_t address, uint8_t *data, uint16_t size, uint32_t timeout_ms);
+	HAL_StatusTypeDef write_read(uint8_t address, uint8_t command, uint8_t *data, uint16_t size, uint32_t timeout_ms);
+
+private:
+	// Open-drain: writing 1 releases the line, the pull-up takes it high
+	void scl_release()
+	{
+		_scl_port->BSRR = _scl_pin;
+	}
+
+	void scl_low()
+	{
+		_scl_port->BSRR = (uint32_t)_scl_pin << 16;
+	}
+
+	void sda_release()
+	{
+		_sda_port->BSRR = _sda_pin;
+	}
+
+	void sda_low()
+	{
+		_sda_port->BSRR = (uint32_t)_sda_pin << 16;
+	}
+
+	bool scl_is_high()
+	{
+		return (_scl_port->IDR & _scl_pin) != 0;
+	}
+
+	bool sda_is_high()
+	{
+		return (_sda_port->IDR & _sda_pin) != 0;
+	}
+
+	void begin();
+	void half_delay();
+	HAL_StatusTypeDef clock_high();
+	HAL_StatusTypeDef start(uint8_t address_byte);
+	HAL_StatusTypeDef write_byte(uint8_t byte);
+	HAL_StatusTypeDef read_byte(uint8_t &byte, bool ack);
+	void stop();
+	HAL_StatusTypeDef fail(HAL_StatusTypeDef status, uint32_t error_code);
+
+	I2C_HandleTypeDef *_hi2c;			// Handle for the error code, the peripheral is not used
+	GPIO_TypeDef *_scl_port = nullptr;	// SCL port
+	GPIO_TypeDef *_sda_port = nullptr;	// SDA port
+	uint16_t _scl_pin = 0;				// SCL pin mask, e.g. GPIO_PIN_6
+	uint16_t _sda_pin = 0;				// SDA pin mask
+	uint32_t _half_cycles = 0;			// CPU cycles of half an SCL period
+	uint32_t _deadline = 0;				// Cycle count of the next clock edge
+	uint32_t _tick = 0;					// HAL tick at the start of the transfer
+	uint32_t _timeout_ms = 0;			// Timeout of the running transfer
+};
+
+#endif // ADS7828_BITBANG_HPP
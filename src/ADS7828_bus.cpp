@@ -0,0 +1,470 @@
+#include "ADS7828_bus.hpp"
+
+static_assert((ADS7828_BUS_QUEUE & (ADS7828_BUS_QUEUE - 1)) == 0, "ADS7828_BUS_QUEUE has to be a power of two");
+
+/**
+ * Time base of the hold time
+ *
+ * @return DWT cycles, HAL ticks without the cycle counter
+ */
+static uint32_t hold_now()
+{
+#ifdef ADS7828_HAS_CYCCNT
+	return ADS7828::get_cycles();
+#else
+	return HAL_GetTick();
+#endif
+}
+
+/**
+ * Constructor for a bus manager that arbitrates the reads of several ADS7828 on one I2C bus
+ *
+ * @param hi2c Pointer to the initialized I2C_HandleTypeDef all devices are connected to
+ */
+ADS7828_Bus::ADS7828_Bus(I2C_HandleTypeDef *hi2c) : _hi2c(hi2c)
+{
+}
+
+/**
+ * Checks which of the four addresses 0x48 - 0x4B answer, with one address-only transfer each.
+ * Much faster at boot than a read with the full timeout for every possible device.
+ *
+ * @param hi2c Pointer to the initialized I2C_HandleTypeDef of the bus
+ * @param timeout_ms Timeout of every probe in [ms]
+ * @return Bit mask with bit i set if a device answered at 0x48 + i
+ */
+uint8_t ADS7828_Bus::probe(I2C_HandleTypeDef *hi2c, uint32_t timeout_ms)
+{
+	uint8_t present = 0;
+
+	for (uint8_t i = 0; i < ADS7828_BUS_DEVICES; i++)
+	{
+		if (HAL_I2C_IsDeviceReady(hi2c, (ADS7828_BUS_BASE_ADDRESS + i) << 1, 1, timeout_ms) == HAL_OK)
+		{
+			present |= (1U << i);
+		}
+	}
+
+	return present;
+}
+
+/**
+ * Adds a device to the bus, all its asynchronous reads have to go through submit afterwards
+ *
+ * @param adc Pointer to an ADS7828 constructed with the same I2C handle
+ * @return HAL_OK if the device was added, HAL_ERROR for a wrong handle or too many devices
+ */
+HAL_StatusTypeDef ADS7828_Bus::attach(ADS7828 *adc)
+{
+	if (adc->get_handle() != _hi2c || _n_devices >= ADS7828_BUS_DEVICES)
+	{
+		return HAL_ERROR;
+	}
+
+	_devices[_n_devices++] = adc;
+	return HAL_OK;
+}
+
+/**
+ * Adds the driver of another device on the bus, e.g. an EEPROM or an RTC.
+ * The client has to claim the bus before each of its transactions and release it afterwards.
+ *
+ * @param client Client owned by the application, set priority, grant and context before, both flags to false
+ * @return HAL_OK if the client was added, HAL_ERROR if ADS7828_BUS_CLIENTS are already added
+ */
+HAL_StatusTypeDef ADS7828_Bus::add_client(ADS7828_bus_client_t *client)
+{
+	if (_n_clients >= ADS7828_BUS_CLIENTS)
+	{
+		return HAL_ERROR;
+	}
+
+	client->waiting = false;
+	client->granted = false;
+	_clients[_n_clients++] = client;
+	return HAL_OK;
+}
+
+/**
+ * Set the priority of the ADS7828 reads against the clients (0 by default).
+ * A waiting client with at least this priority gets the bus as soon as the running read completes,
+ * clients with a lower priority wait until the read queue is empty or the hold time has expired.
+ *
+ * @param priority Priority of the reads
+ */
+void ADS7828_Bus::set_priority(uint8_t priority)
+{
+	_priority = priority;
+}
+
+/**
+ * Set the longest time the ADS7828 reads keep the bus from a waiting client of lower priority.
+ * Reads are never interrupted, the client gets the bus after the read that crosses the hold time.
+ *
+ * @param hold_us Hold time in [us], 0 to let lower priority clients wait for an empty read queue
+ */
+void ADS7828_Bus::set_max_hold(uint32_t hold_us)
+{
+	_max_hold_us = hold_us;
+}
+
+/**
+ * Requests the bus for a transaction of a client. It is granted right away if the bus is idle,
+ * otherwise after the running read or the transaction of another client, depending on the priorities.
+ * grant is called once the bus is granted, or poll client->granted, e.g. before blocking HAL transfers.
+ *
+ * @param client Added client
+ * @return HAL_OK if the bus was granted or the client is waiting, HAL_ERROR if the client was not added
+ */
+HAL_StatusTypeDef ADS7828_Bus::claim(ADS7828_bus_client_t *client)
+{
+	bool added = false;
+
+	for (uint8_t i = 0; i < _n_clients; i++)
+	{
+		added |= (_clients[i] == client);
+	}
+
+	if (!added)
+	{
+		return HAL_ERROR;
+	}
+
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	if (client->granted || client->waiting)
+	{
+		__set_PRIMASK(primask);
+		return HAL_OK;
+	}
+
+	bool idle = (_active == nullptr && _owner == nullptr);
+
+	if (idle)
+	{
+		_owner = client;
+		client->granted = true;
+	}
+	else
+	{
+		client->waiting = true;
+	}
+
+	__set_PRIMASK(primask);
+
+	if (idle && client->grant != nullptr)
+	{
+		client->grant(client->context);
+	}
+
+	return HAL_OK;
+}
+
+/**
+ * Ends the transaction of a client and hands the bus to the next waiting client or the queued reads.
+ * Also withdraws a claim that was not granted yet.
+ *
+ * @param client Client that claimed the bus
+ */
+void ADS7828_Bus::release(ADS7828_bus_client_t *client)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	client->waiting = false;
+
+	if (_owner != client)
+	{
+		__set_PRIMASK(primask);
+		return;
+	}
+
+	client->granted = false;
+	_owner = nullptr;
+	__set_PRIMASK(primask);
+
+	dispatch();
+}
+
+/**
+ * Queues an asynchronous read, see ADS7828::start_read_dma.
+ * Requests are executed in order, the next one is started from the completion interrupt of the previous one.
+ *
+ * @param adc Attached device to read from
+ * @param channel The ADS7828_CHANNEL configuration you want the digit from
+ * @param callback Function that receives the digit or the error status
+ * @param context User pointer that is passed to the callback
+ * @return HAL_OK if the request was queued, HAL_BUSY if the queue is full, HAL_ERROR if the device is not attached
+ */
+HAL_StatusTypeDef ADS7828_Bus::submit(ADS7828 *adc, ADS7828_CHANNEL channel, ADS7828_callback_t callback, void *context)
+{
+	if (!is_attached(adc))
+	{
+		return HAL_ERROR;
+	}
+
+	// The completion interrupt modifies the queue as well
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	if ((uint8_t)(_tail - _head) >= ADS7828_BUS_QUEUE)
+	{
+		__set_PRIMASK(primask);
+		return HAL_BUSY;
+	}
+
+	ADS7828_request_t &request = _queue[_tail & (ADS7828_BUS_QUEUE - 1)];
+	request.adc = adc;
+	request.channel = channel;
+	request.callback = callback;
+	request.context = context;
+#ifdef ADS7828_LATENCY
+	request.requested = ADS7828::get_cycles();
+#endif
+	_tail = _tail + 1;
+
+	// Claim the bus while the interrupts are still disabled
+	bool idle = (_active == nullptr && _owner == nullptr);
+	if (idle)
+	{
+		_active = adc;
+		_hold_start = hold_now();
+	}
+	__set_PRIMASK(primask);
+
+	if (idle)
+	{
+		start_next();
+	}
+
+	return HAL_OK;
+}
+
+/**
+ * Check if a device was added with attach
+ *
+ * @param adc Pointer to the device
+ * @return True if the device is attached to the bus
+ */
+bool ADS7828_Bus::is_attached(ADS7828 *adc)
+{
+	for (uint8_t i = 0; i < _n_devices; i++)
+	{
+		if (_devices[i] == adc)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * Get the number of queued requests including the running one
+ *
+ * @return Number of requests that have not completed yet
+ */
+uint8_t ADS7828_Bus::get_pending()
+{
+	return (uint8_t)(_tail - _head);
+}
+
+/**
+ * Check if the bus is idle
+ *
+ * @return True if no request is running or queued and no client holds the bus
+ */
+bool ADS7828_Bus::is_idle()
+{
+	return _head == _tail && _owner == nullptr;
+}
+
+/**
+ * Has to be called from HAL_I2C_MasterTxCpltCallback
+ *
+ * @param hi2c The I2C handle passed to the HAL callback
+ */
+void ADS7828_Bus::tx_complete_callback(I2C_HandleTypeDef *hi2c)
+{
+	if (hi2c == _hi2c && _active != nullptr)
+	{
+		_active->tx_complete_callback(hi2c);
+	}
+}
+
+/**
+ * Has to be called from HAL_I2C_MasterRxCpltCallback
+ *
+ * @param hi2c The I2C handle passed to the HAL callback
+ */
+void ADS7828_Bus::rx_complete_callback(I2C_HandleTypeDef *hi2c)
+{
+	if (hi2c == _hi2c && _active != nullptr)
+	{
+		_active->rx_complete_callback(hi2c);
+	}
+}
+
+/**
+ * Has to be called from HAL_I2C_ErrorCallback
+ *
+ * @param hi2c The I2C handle passed to the HAL callback
+ */
+void ADS7828_Bus::error_callback(I2C_HandleTypeDef *hi2c)
+{
+	if (hi2c == _hi2c && _active != nullptr)
+	{
+		_active->error_callback(hi2c);
+	}
+}
+
+/**
+ * Starts the request at the head of the queue, failed starts are reported and skipped
+ */
+void ADS7828_Bus::start_next()
+{
+	while (_head != _tail)
+	{
+		ADS7828_request_t &request = _queue[_head & (ADS7828_BUS_QUEUE - 1)];
+		_active = request.adc;
+
+#ifdef ADS7828_LATENCY
+		request.adc->set_request_cycles(request.requested);
+#endif
+		HAL_StatusTypeDef status = request.adc->start_read_dma(request.channel, on_digit, this);
+
+		if (status == HAL_OK)
+		{
+			return;
+		}
+
+		// Report the failed request and continue with the next one
+		ADS7828_request_t failed = request;
+		_head = _head + 1;
+
+		if (failed.callback != nullptr)
+		{
+			failed.callback(failed.context, failed.channel, status, 0);
+		}
+	}
+
+	_active = nullptr;
+
+	// The queue ran empty, a waiting client gets the bus
+	if (next_client() != nullptr)
+	{
+		dispatch();
+	}
+}
+
+/**
+ * Hands the bus to the most urgent waiting client or to the next queued read, called whenever the bus becomes free
+ */
+void ADS7828_Bus::dispatch()
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	ADS7828_bus_client_t *client = next_client();
+	bool reads = (_head != _tail);
+
+	if (client != nullptr && (!reads || client->priority >= _priority || hold_expired()))
+	{
+		_active = nullptr;
+		_owner = client;
+		client->waiting = false;
+		client->granted = true;
+		__set_PRIMASK(primask);
+
+		if (client->grant != nullptr)
+		{
+			client->grant(client->context);
+		}
+		return;
+	}
+
+	// The hold time starts when the reads take the bus from a client or an idle bus
+	if (reads && _active == nullptr)
+	{
+		_hold_start = hold_now();
+	}
+
+	_active = reads ? _queue[_head & (ADS7828_BUS_QUEUE - 1)].adc : nullptr;
+	__set_PRIMASK(primask);
+
+	if (reads)
+	{
+		start_next();
+	}
+}
+
+/**
+ * Finds the waiting client with the highest priority, the first added one on equal priorities
+ *
+ * @return The client, nullptr if none is waiting
+ */
+ADS7828_bus_client_t *ADS7828_Bus::next_client()
+{
+	ADS7828_bus_client_t *best = nullptr;
+
+	for (uint8_t i = 0; i < _n_clients; i++)
+	{
+		if (_clients[i]->waiting && (best == nullptr || _clients[i]->priority > best->priority))
+		{
+			best = _clients[i];
+		}
+	}
+
+	return best;
+}
+
+/**
+ * Check if the reads have kept the bus for the maximum hold time
+ *
+ * @return True if a waiting client of lower priority is due
+ */
+bool ADS7828_Bus::hold_expired()
+{
+	if (_max_hold_us == 0)
+	{
+		return false;
+	}
+
+#ifdef ADS7828_HAS_CYCCNT
+	uint32_t elapsed_us = (ADS7828::get_cycles() - _hold_start) / (SystemCoreClock / 1000000);
+#else
+	uint32_t elapsed_us = (HAL_GetTick() - _hold_start) * 1000;
+#endif
+
+	return elapsed_us >= _max_hold_us;
+}
+
+/**
+ * Completion callback of the running request, starts the next request before notifying the user
+ */
+void ADS7828_Bus::on_digit(void *context, ADS7828_CHANNEL channel, HAL_StatusTypeDef status, ADS7828_digit_t digit)
+{
+	ADS7828_Bus *bus = static_cast<ADS7828_Bus *>(context);
+
+	ADS7828_request_t done = bus->_queue[bus->_head & (ADS7828_BUS_QUEUE - 1)];
+	bus->_head = bus->_head + 1;
+
+	// With a client waiting, a read chained from the callback (e.g. by a scanner) has to be queued before the arbitration
+	bool chained = (bus->_head == bus->_tail && bus->next_client() != nullptr);
+
+	// Keep the bus busy, the user callback runs while the next transfer is on the wire
+	if (!chained)
+	{
+		bus->dispatch();
+	}
+
+	if (done.callback != nullptr)
+	{
+		done.callback(done.context, channel, status, digit);
+	}
+
+	if (chained)
+	{
+		bus->dispatch();
+	}
+}
@@ -0,0 +1,187 @@
+// Arbitration of several ADS7828 on one I2C bus
+#ifndef ADS7828_BUS_HPP
+#define ADS7828_BUS_HPP
+
+#include "ADS7828.hpp"
+
+#include <new>
+#include <type_traits>
+
+// Maximum number of devices on one bus, A0/A1 allow the addresses 0x48 - 0x4B
+constexpr uint8_t ADS7828_BUS_DEVICES = 4;
+// Address of the device with A0 and A1 low
+constexpr uint8_t ADS7828_BUS_BASE_ADDRESS = 0x48;
+// Maximum number of queued read requests, has to be a power of two
+constexpr uint8_t ADS7828_BUS_QUEUE = 16;
+// Maximum number of drivers of other devices sharing the bus, e.g. an EEPROM or an RTC
+constexpr uint8_t ADS7828_BUS_CLIENTS = 4;
+
+// Called when the bus is granted to a client, from claim or from the interrupt that ends the previous transfer
+typedef void (*ADS7828_grant_callback_t)(void *context);
+
+// Driver of another device on the bus, owned by the application
+struct ADS7828_bus_client_t
+{
+	uint8_t priority;				// Clients with a priority of at least set_priority take the bus after the running read
+	ADS7828_grant_callback_t grant; // Called when the bus is granted, nullptr to poll granted
+	void *context;					// User context passed to grant
+	volatile bool waiting;			// claim was called, the bus is not granted yet
+	volatile bool granted;			// The client may use the bus until release
+};
+
+// Queued read request
+struct ADS7828_request_t
+{
+	ADS7828 *adc;				 // Device to read from
+	ADS7828_CHANNEL channel;	 // Channel configuration to read
+	ADS7828_callback_t callback; // Completion callback
+	void *context;				 // User context passed to the callback
+#ifdef ADS7828_LATENCY
+	uint32_t requested; // DWT cycle count of the submission
+#endif
+};
+
+class ADS7828_Bus
+{
+public:
+	ADS7828_Bus(I2C_HandleTypeDef *hi2c);
+
+	static uint8_t probe(I2C_HandleTypeDef *hi2c, uint32_t timeout_ms = 1);
+
+	HAL_StatusTypeDef attach(ADS7828 *adc);
+	HAL_StatusTypeDef add_client(ADS7828_bus_client_t *client);
+	HAL_StatusTypeDef submit(ADS7828 *adc, ADS7828_CHANNEL channel, ADS7828_callback_t callback, void *context = nullptr);
+	bool is_attached(ADS7828 *adc);
+	uint8_t get_pending();
+	bool is_idle();
+
+	void set_priority(uint8_t priority);
+	void set_max_hold(uint32_t hold_us);
+	HAL_StatusTypeDef claim(ADS7828_bus_client_t *client);
+	void release(ADS7828_bus_client_t *client);
+
+	// Forward the HAL I2C callbacks to these instead of the single devices
+	void tx_complete_callback(I2C_HandleTypeDef *hi2c);
+	void rx_complete_callback(I2C_HandleTypeDef *hi2c);
+	void error_callback(I2C_HandleTypeDef *hi2c);
+
+private:
+	static void on_digit(void *context, ADS7828_CHANNEL channel, HAL_StatusTypeDef status, ADS7828_digit_t digit);
+	void start_next();
+	void dispatch();
+	ADS7828_bus_client_t *next_client();
+	bool hold_expired();
+
+	I2C_HandleTypeDef *_hi2c;					 // I2C Handle shared by all devices
+	ADS7828 *_devices[ADS7828_BUS_DEVICES] = {}; // Attached devices
+	uint8_t _n_devices = 0;						 // Number of attached devices
+
+	ADS7828_request_t _queue[ADS7828_BUS_QUEUE]; // Request FIFO, the head is the running request
+	volatile uint8_t _head = 0;					 // Index of the oldest request
+	volatile uint8_t _tail = 0;					 // Index of the next free slot
+	ADS7828 *_active = nullptr;					 // Device with the running transfer
+
+	ADS7828_bus_client_t *_clients[ADS7828_BUS_CLIENTS] = {}; // Drivers of other devices, in the order they were added
+	uint8_t _n_clients = 0;									   // Number of added clients
+	ADS7828_bus_client_t *_owner = nullptr;					   // Client holding the bus
+	uint8_t _priority = 0;									   // Priority of the ADS7828 reads against waiting clients
+	uint32_t _max_hold_us = 0;								   // Longest time the reads keep the bus from a waiting client, 0 for no limit
+	uint32_t _hold_start = 0;								   // DWT cycles (HAL tick on Cortex-M0) when the reads took the bus
+};
+
+/**
+ * Drivers for the devices found on a bus, constructed in place only for the present addresses.
+ * Reserve storage for the most devices a board can carry, absent devices cost neither a driver nor a boot-time read.
+ * Every driver gets an averaging pool of PoolSize values, 0 for plain drivers without averaging.
+ */
+template <uint8_t N = ADS7828_BUS_DEVICES, uint16_t PoolSize = ADS7828_AVG_POOL>
+class ADS7828_Discovery
+{
+	using driver_t = typename std::conditional<PoolSize == 0, ADS7828, ADS7828_Pooled<PoolSize>>::type;
+
+	// The drivers constructed in place are never destroyed
+	static_assert(std::is_trivially_destructible<driver_t>::value, "Discovered drivers have to be trivially destructible");
+
+public:
+	/**
+	 * Probes the bus and constructs a driver for each answering address, lowest address first
+	 *
+	 * @param hi2c Pointer to the initialized I2C_HandleTypeDef of the bus
+	 * @param timeout_ms Timeout of every probe in [ms]
+	 * @return Number of constructed drivers, at most N
+	 */
+	uint8_t discover(I2C_HandleTypeDef *hi2c, uint32_t timeout_ms = 1)
+	{
+		// The drivers are trivially destructible (see above), but may be in use, so they are only created once
+		if (_n > 0)
+		{
+			return _n;
+		}
+
+		uint8_t present = ADS7828_Bus::probe(hi2c, timeout_ms);
+
+		for (uint8_t i = 0; i < ADS7828_BUS_DEVICES && _n < N; i++)
+		{
+			if (present & (1U << i))
+			{
+				_devices[_n] = new (&_storage[_n]) driver_t(hi2c, ADS7828_BUS_BASE_ADDRESS + i);
+				_n++;
+			}
+		}
+
+		return _n;
+	}
+
+	/**
+	 * Get a constructed driver
+	 *
+	 * @param index Position in the order of the addresses (0 - size() - 1)
+	 * @return Pointer to the driver, nullptr for an invalid index
+	 */
+	ADS7828 *get(uint8_t index)
+	{
+		return (index < _n) ? _devices[index] : nullptr;
+	}
+
+	/**
+	 * Get the driver of an address
+	 *
+	 * @param address 7 Bit I2C address (0x48 - 0x4B)
+	 * @return Pointer to the driver, nullptr if no device answered at the address
+	 */
+	ADS7828 *find(uint8_t address)
+	{
+		for (uint8_t i = 0; i < _n; i++)
+		{
+			if (_devices[i]->get_address() == address)
+			{
+				return _devices[i];
+			}
+		}
+
+		return nullptr;
+	}
+
+	/**
+	 * Get the number of constructed drivers
+	 *
+	 * @return Devices found by discover, at most N
+	 */
+	uint8_t size()
+	{
+		return _n;
+	}
+
+private:
+	// Raw storage, so absent devices are never constructed
+	struct alignas(driver_t) storage_t
+	{
+		uint8_t bytes[sizeof(driver_t)];
+	};
+
+	storage_t _storage[N];		  // Space for the drivers
+	ADS7828 *_devices[N] = {};	  // Constructed drivers in address order
+	uint8_t _n = 0;				  // Number of constructed drivers
+};
+
+#endif // ADS7828_BUS_HPP
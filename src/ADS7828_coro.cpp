@@ -0,0 +1,119 @@
+#include "ADS7828_coro.hpp"
+
+#if __cplusplus >= 202002L
+
+// Coroutine frames, one block per running coroutine
+alignas(8) static uint8_t frames[ADS7828_CORO_FRAMES][ADS7828_CORO_FRAME_SIZE];
+static bool frame_used[ADS7828_CORO_FRAMES] = {false};
+
+// Coroutines whose read has finished, written from the I2C interrupts and emptied by ADS7828_coro_run
+// One entry more than frames, so a full queue is not mistaken for an empty one
+static std::coroutine_handle<> ready[ADS7828_CORO_FRAMES + 1];
+static volatile uint8_t ready_head = 0;
+static volatile uint8_t ready_tail = 0;
+
+/**
+ * Takes a frame from the pool, called by the compiler when an ADS7828_Task is started
+ *
+ * @param size Size of the frame the compiler needs
+ * @return Pointer to the frame, nullptr if it is too large or no frame is free
+ */
+void *ADS7828_coro_alloc(size_t size)
+{
+	if (size > ADS7828_CORO_FRAME_SIZE)
+	{
+		return nullptr;
+	}
+
+	// Coroutines can be started from interrupts as well
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	for (uint8_t i = 0; i < ADS7828_CORO_FRAMES; i++)
+	{
+		if (!frame_used[i])
+		{
+			frame_used[i] = true;
+			__set_PRIMASK(primask);
+			return frames[i];
+		}
+	}
+
+	__set_PRIMASK(primask);
+	return nullptr;
+}
+
+/**
+ * Returns a frame to the pool when its coroutine has finished
+ *
+ * @param frame Pointer from ADS7828_coro_alloc
+ */
+void ADS7828_coro_free(void *frame)
+{
+	for (uint8_t i = 0; i < ADS7828_CORO_FRAMES; i++)
+	{
+		if (frame == frames[i])
+		{
+			frame_used[i] = false;
+			return;
+		}
+	}
+}
+
+/**
+ * Queues a coroutine to be continued by ADS7828_coro_run, called from the completion interrupt
+ *
+ * @param handle The suspended coroutine
+ */
+void ADS7828_coro_ready(std::coroutine_handle<> handle)
+{
+	// Several I2C interrupts can complete reads
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	// Every coroutine waits for one read at most, so the queue cannot overflow
+	ready[ready_tail] = handle;
+	ready_tail = (ready_tail + 1) % (ADS7828_CORO_FRAMES + 1);
+
+	__set_PRIMASK(primask);
+}
+
+/**
+ * Continues all coroutines whose reads have finished, call it from the main loop.
+ * The coroutines run until their next co_await or their end.
+ *
+ * @return Number of continued coroutines
+ */
+uint8_t ADS7828_coro_run()
+{
+	uint8_t resumed = 0;
+
+	while (ready_head != ready_tail)
+	{
+		std::coroutine_handle<> handle = ready[ready_head];
+		ready_head = (ready_head + 1) % (ADS7828_CORO_FRAMES + 1);
+		handle.resume();
+		resumed++;
+	}
+
+	return resumed;
+}
+
+/**
+ * Get the number of frames left in the pool
+ *
+ * @return Coroutines that can still be started
+ */
+uint8_t ADS7828_coro_free_frames()
+{
+	uint8_t free = 0;
+
+	for (uint8_t i = 0; i < ADS7828_CORO_FRAMES; i++)
+	{
+		free += frame_used[i] ? 0 : 1;
+	}
+
+	return free;
+}
+
+#endif // __cplusplus >= 202002L
@@ -0,0 +1,160 @@
+// C++20 coroutine interface of the DMA reads, frames come from a static pool and no heap is used
+#ifndef ADS7828_CORO_HPP
+#define ADS7828_CORO_HPP
+
+#include "ADS7828.hpp"
+
+#if __cplusplus >= 202002L
+
+#include <coroutine>
+
+// Number of coroutines that can run at the same time
+#ifndef ADS7828_CORO_FRAMES
+#define ADS7828_CORO_FRAMES 4
+#endif
+// Size of one coroutine frame in bytes, holds the locals that live across co_await
+#ifndef ADS7828_CORO_FRAME_SIZE
+#define ADS7828_CORO_FRAME_SIZE 256
+#endif
+
+// Result of a co_await on read_async
+struct ADS7828_read_result_t
+{
+	HAL_StatusTypeDef status; // HAL_OK, or the error of the transfer
+	ADS7828_digit_t digit;			  // Processed digit like read_digit, 0 on errors
+};
+
+void *ADS7828_coro_alloc(size_t size);
+void ADS7828_coro_free(void *frame);
+void ADS7828_coro_ready(std::coroutine_handle<> handle);
+uint8_t ADS7828_coro_run();
+uint8_t ADS7828_coro_free_frames();
+
+/**
+ * Return type of a coroutine that uses co_await on the ADS7828, e.g.
+ *
+ *   ADS7828_Task measure(ADS7828 &adc) { auto result = co_await adc.read_async(CHANNEL_0_COM); ... }
+ *
+ * The coroutine starts right away when called and runs up to its first co_await,
+ * its frame is taken from the static pool and returned when it finishes.
+ */
+class ADS7828_Task
+{
+public:
+	struct promise_type
+	{
+		static void *operator new(size_t size) noexcept
+		{
+			return ADS7828_coro_alloc(size);
+		}
+
+		static void operator delete(void *frame)
+		{
+			ADS7828_coro_free(frame);
+		}
+
+		// Called instead of throwing when the pool is empty
+		static ADS7828_Task get_return_object_on_allocation_failure()
+		{
+			return ADS7828_Task(false);
+		}
+
+		ADS7828_Task get_return_object()
+		{
+			return ADS7828_Task(true);
+		}
+
+		std::suspend_never initial_suspend() noexcept
+		{
+			return {};
+		}
+
+		// The frame is freed as soon as the coroutine returns
+		std::suspend_never final_suspend() noexcept
+		{
+			return {};
+		}
+
+		void return_void()
+		{
+		}
+
+		void unhandled_exception()
+		{
+		}
+	};
+
+	/**
+	 * Check if the coroutine was started
+	 *
+	 * @return False if no frame was left in the pool and the coroutine did not run
+	 */
+	bool started() const
+	{
+		return _started;
+	}
+
+private:
+	explicit ADS7828_Task(bool started) : _started(started) {}
+
+	bool _started;
+};
+
+// Starts a DMA read on co_await and continues the coroutine from ADS7828_coro_run once the result is there
+class ADS7828_read_awaitable
+{
+public:
+	ADS7828_read_awaitable(ADS7828 *adc, ADS7828_CHANNEL channel) : _adc(adc), _channel(channel) {}
+
+	bool await_ready()
+	{
+		return false;
+	}
+
+	// Resumes right away if the read could not be started
+	bool await_suspend(std::coroutine_handle<> handle)
+	{
+		_handle = handle;
+		_status = _adc->start_read_dma(_channel, on_digit, this);
+		return (_status == HAL_OK);
+	}
+
+	ADS7828_read_result_t await_resume()
+	{
+		return {_status, (_status == HAL_OK) ? _digit : (ADS7828_digit_t)0};
+	}
+
+private:
+	static void on_digit(void *context, ADS7828_CHANNEL channel, HAL_StatusTypeDef status, ADS7828_digit_t digit)
+	{
+		ADS7828_read_awaitable *awaitable = static_cast<ADS7828_read_awaitable *>(context);
+		awaitable->_status = status;
+		awaitable->_digit = digit;
+		(void)channel;
+
+		// Continued from the main loop, not from the interrupt
+		ADS7828_coro_ready(awaitable->_handle);
+	}
+
+	ADS7828 *_adc;					   // Driver used for the read
+	ADS7828_CHANNEL _channel;		   // Channel configuration to read
+	std::coroutine_handle<> _handle;   // Coroutine waiting for the result
+	HAL_StatusTypeDef _status = HAL_OK; // Status of the read
+	ADS7828_digit_t _digit = 0;				   // Result of the read
+};
+
+/**
+ * Starts a DMA read that can be awaited in an ADS7828_Task, see start_read_dma.
+ * The coroutine is suspended until the result is there, the CPU is free in the meantime.
+ *
+ * @param channel The ADS7828_CHANNEL configuration you want the digit from
+ * @return Awaitable that gives an ADS7828_read_result_t
+ */
+inline ADS7828_read_awaitable ADS7828::read_async(ADS7828_CHANNEL channel)
+{
+	return ADS7828_read_awaitable(this, channel);
+}
+
+#endif // __cplusplus >= 202002L
+
+#endif // ADS7828_CORO_HPP
@@ -0,0 +1,159 @@
+#include "ADS7828_flash.hpp"
+#include <string.h>
+
+#ifdef HAL_FLASH_MODULE_ENABLED
+
+/**
+ * Constructor for a configuration store in a reserved flash area.
+ * The area is erased on every save, so it must not hold code or other data.
+ *
+ * @param address Start of the reserved page or sector, e.g. from the linker script
+ * @param sector Number of the sector at address (in its bank), only needed for STM32F2/F4/F7/H7
+ */
+ADS7828_Flash::ADS7828_Flash(uint32_t address, uint32_t sector) : _address(address), _sector(sector)
+{
+}
+
+/**
+ * Stores the current configuration of a driver. The flash area is erased first.
+ * The CPU stalls while the flash is busy, don't call this while timing critical interrupts run.
+ *
+ * @param adc The driver to store the configuration of
+ * @return HAL_OK if stored and verified, otherwise the status of the failed flash operation
+ */
+HAL_StatusTypeDef ADS7828_Flash::save(ADS7828 &adc)
+{
+	ADS7828_config_t config;
+	adc.get_config(config);
+
+	HAL_StatusTypeDef status = HAL_FLASH_Unlock();
+
+	if (status == HAL_OK)
+	{
+		status = erase();
+	}
+
+#if defined(STM32F2) || defined(STM32F4) || defined(STM32F7)
+	// Programmed word by word, the size of the config is a multiple of 4
+	const uint32_t *words = (const uint32_t *)&config;
+
+	for (uint32_t i = 0; i < sizeof(config) / 4 && status == HAL_OK; i++)
+	{
+		status = HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, _address + i * 4, words[i]);
+	}
+#elif defined(STM32G4) || defined(STM32L4)
+	// Programmed in double-words, the size of the config is a multiple of 8
+	static_assert(sizeof(ADS7828_config_t) % 8 == 0, "The config has to fill whole double-words");
+	const uint64_t *doublewords = (const uint64_t *)&config;
+
+	for (uint32_t i = 0; i < sizeof(config) / 8 && status == HAL_OK; i++)
+	{
+		status = HAL_FLASH_Program(FLASH_TYPEPROGRAM_DOUBLEWORD, _address + i * 8, doublewords[i]);
+	}
+#elif defined(STM32H7)
+	// Programmed in flash words of 256 (or 128) bits, the last one is padded with erased bytes
+	const uint32_t flash_word = FLASH_NB_32BITWORD_IN_FLASHWORD * 4;
+	const uint8_t *bytes = (const uint8_t *)&config;
+
+	for (uint32_t offset = 0; offset < sizeof(config) && status == HAL_OK; offset += flash_word)
+	{
+		uint32_t buffer[FLASH_NB_32BITWORD_IN_FLASHWORD];
+		memset(buffer, 0xFF, sizeof(buffer));
+		memcpy(buffer, bytes + offset, (sizeof(config) - offset < flash_word) ? sizeof(config) - offset : flash_word);
+		status = HAL_FLASH_Program(FLASH_TYPEPROGRAM_FLASHWORD, _address + offset, (uint32_t)buffer);
+	}
+#else
+	// F0/F1/F3 only program half-words
+	const uint16_t *halfwords = (const uint16_t *)&config;
+
+	for (uint32_t i = 0; i < sizeof(config) / 2 && status == HAL_OK; i++)
+	{
+		status = HAL_FLASH_Program(FLASH_TYPEPROGRAM_HALFWORD, _address + i * 2, halfwords[i]);
+	}
+#endif
+
+	HAL_FLASH_Lock();
+
+	if (status == HAL_OK && !is_valid())
+	{
+		return HAL_ERROR;
+	}
+
+	return status;
+}
+
+/**
+ * Applies the stored configuration to a driver. Reads the flash directly, so it takes only microseconds.
+ *
+ * @param adc The driver to configure
+ * @return HAL_OK if applied, HAL_ERROR if nothing valid is stored (the driver keeps its settings then)
+ */
+HAL_StatusTypeDef ADS7828_Flash::load(ADS7828 &adc)
+{
+	return adc.set_config(*(const ADS7828_config_t *)_address);
+}
+
+/**
+ * Check if the flash area holds a configuration of the current layout with a valid CRC
+ *
+ * @return True if load would succeed
+ */
+bool ADS7828_Flash::is_valid()
+{
+	const ADS7828_config_t *config = (const ADS7828_config_t *)_address;
+
+	return config->magic == ADS7828_CONFIG_MAGIC && config->version == ADS7828_CONFIG_VERSION &&
+		   config->size == sizeof(ADS7828_config_t) && config->crc == ADS7828_crc32(config, offsetof(ADS7828_config_t, crc));
+}
+
+/**
+ * Erases the reserved page or sector, the flash has to be unlocked
+ *
+ * @return Status of the erase
+ */
+HAL_StatusTypeDef ADS7828_Flash::erase()
+{
+	FLASH_EraseInitTypeDef erase = {};
+	uint32_t error = 0;
+
+#if defined(STM32F2) || defined(STM32F4) || defined(STM32F7)
+	erase.TypeErase = FLASH_TYPEERASE_SECTORS;
+	erase.Sector = _sector;
+	erase.NbSectors = 1;
+	erase.VoltageRange = FLASH_VOLTAGE_RANGE_3;
+#elif defined(STM32G4) || defined(STM32L4)
+	// Pages are numbered within their bank
+	uint32_t offset = _address - FLASH_BASE;
+	erase.TypeErase = FLASH_TYPEERASE_PAGES;
+	erase.Banks = FLASH_BANK_1;
+#ifdef FLASH_BANK_2
+	if (offset >= FLASH_BANK_SIZE)
+	{
+		erase.Banks = FLASH_BANK_2;
+		offset -= FLASH_BANK_SIZE;
+	}
+#endif
+	erase.Page = offset / FLASH_PAGE_SIZE;
+	erase.NbPages = 1;
+#elif defined(STM32H7)
+	erase.TypeErase = FLASH_TYPEERASE_SECTORS;
+	erase.Banks = FLASH_BANK_1;
+#ifdef FLASH_BANK2_BASE
+	if (_address >= FLASH_BANK2_BASE)
+	{
+		erase.Banks = FLASH_BANK_2;
+	}
+#endif
+	erase.Sector = _sector;
+	erase.NbSectors = 1;
+	erase.VoltageRange = FLASH_VOLTAGE_RANGE_3;
+#else
+	erase.TypeErase = FLASH_TYPEERASE_PAGES;
+	erase.PageAddress = _address;
+	erase.NbPages = 1;
+#endif
+
+	return HAL_FLASHEx_Erase(&erase, &error);
+}
+
+#endif // HAL_FLASH_MODULE_ENABLED
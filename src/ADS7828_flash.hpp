@@ -0,0 +1,27 @@
+// Keeps the ADS7828 configuration in a reserved flash page or sector
+#ifndef ADS7828_FLASH_HPP
+#define ADS7828_FLASH_HPP
+
+#include "ADS7828.hpp"
+
+#ifdef HAL_FLASH_MODULE_ENABLED
+
+class ADS7828_Flash
+{
+public:
+	ADS7828_Flash(uint32_t address, uint32_t sector = 0);
+
+	HAL_StatusTypeDef save(ADS7828 &adc);
+	HAL_StatusTypeDef load(ADS7828 &adc);
+	bool is_valid();
+
+private:
+	HAL_StatusTypeDef erase();
+
+	uint32_t _address; // Start of the reserved flash area, has to be the start of a page or sector
+	uint32_t _sector;  // Sector of the area, only used by families with sector erase (F2/F4/F7/H7)
+};
+
+#endif // HAL_FLASH_MODULE_ENABLED
+
+#endif // ADS7828_FLASH_HPP
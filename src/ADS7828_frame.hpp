@@ -0,0 +1,82 @@
+// Compact binary frames of raw samples for streaming to a PC
+#ifndef ADS7828_FRAME_HPP
+#define ADS7828_FRAME_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Samples per frame, has to be even. 30 samples give 64 byte frames, one USB full-speed packet
+#ifndef ADS7828_FRAME_SAMPLES
+#define ADS7828_FRAME_SAMPLES 30
+#endif
+
+static_assert(ADS7828_FRAME_SAMPLES % 2 == 0 && ADS7828_FRAME_SAMPLES <= 62, "Frame samples have to be even and fit into 6 bits");
+
+// First byte of every frame
+constexpr uint8_t ADS7828_FRAME_SYNC = 0xA5;
+// Header: sync, sequence number, sample count | device << 6, XOR checksum of bytes 1, 2 and the payload
+constexpr size_t ADS7828_FRAME_HEADER = 4;
+// Largest frame, every two samples take 4 bytes: tags of both, then both 12 Bit digits packed into 3 bytes
+constexpr size_t ADS7828_FRAME_SIZE = ADS7828_FRAME_HEADER + ADS7828_FRAME_SAMPLES * 2;
+
+// Packs raw 12 Bit digits with a 4 Bit tag (e.g. the ADS7828_CHANNEL) each
+// Pair layout: tag_a | tag_b << 4, a[7:0], a[11:8] | b[3:0] << 4, b[11:4]
+struct ADS7828_frame_t
+{
+	uint8_t data[ADS7828_FRAME_SIZE]; // Frame bytes, header first
+	uint8_t count = 0;				  // Number of packed samples
+
+	// Add a sample, returns true if the frame is full afterwards
+	bool add(uint8_t tag, uint16_t digit)
+	{
+		uint8_t *pair = &data[ADS7828_FRAME_HEADER + (count / 2) * 4];
+
+		if ((count & 1) == 0)
+		{
+			pair[0] = tag & 0x0F;
+			pair[1] = (uint8_t)digit;
+			pair[2] = (digit >> 8) & 0x0F;
+			pair[3] = 0;
+		}
+		else
+		{
+			pair[0] |= (uint8_t)(tag << 4);
+			pair[2] |= (uint8_t)(digit << 4);
+			pair[3] = (uint8_t)(digit >> 4);
+		}
+
+		return ++count >= ADS7828_FRAME_SAMPLES;
+	}
+
+	bool is_full()
+	{
+		return count >= ADS7828_FRAME_SAMPLES;
+	}
+
+	// Write the header and return the number of bytes to send, device is the index of the ADC (0 - 3)
+	size_t finish(uint8_t sequence, uint8_t device = 0)
+	{
+		size_t length = ADS7828_FRAME_HEADER + ((count + 1) / 2) * 4;
+		uint8_t info = (uint8_t)(count | (device << 6));
+		uint8_t checksum = sequence ^ info;
+
+		for (size_t i = ADS7828_FRAME_HEADER; i < length; i++)
+		{
+			checksum ^= data[i];
+		}
+
+		data[0] = ADS7828_FRAME_SYNC;
+		data[1] = sequence;
+		data[2] = info;
+		data[3] = checksum;
+
+		return length;
+	}
+
+	void clear()
+	{
+		count = 0;
+	}
+};
+
+#endif // ADS7828_FRAME_HPP
@@ -0,0 +1,471 @@
+#include "ADS7828.hpp"
+
+#ifdef ADS7828_HOST
+
+// Number of simulated devices, A0/A1 allow the addresses 0x48 - 0x4B
+constexpr uint8_t HOST_DEVICES = 4;
+// Number of I2C handles with their own DMA transfer, every handle is a separate bus
+constexpr uint8_t HOST_BUSES = 4;
+
+// Simulated ADS7828
+struct host_device_t
+{
+	uint8_t address = 0;					 // 7 Bit address, 0 if unused
+	uint8_t command = 0;					 // Last received command byte
+	uint16_t digits[ADS7828_CHANNELS] = {0}; // Input of every channel configuration
+};
+
+// Completion of a simulated DMA transfer
+enum host_event_t
+{
+	EVENT_NONE,
+	EVENT_TX,
+	EVENT_RX,
+	EVENT_MEM_RX,
+	EVENT_ERROR
+};
+
+// Running DMA transfer of one bus
+struct host_bus_t
+{
+	I2C_HandleTypeDef *handle = nullptr; // Handle of the bus, nullptr if unused
+	host_event_t pending = EVENT_NONE;	 // Completion to deliver
+};
+
+ADS7828_host_dwt_t ADS7828_host_dwt = {};
+ADS7828_host_debug_t ADS7828_host_debug = {};
+uint32_t SystemCoreClock = 72000000;
+
+static host_device_t devices[HOST_DEVICES];
+static uint16_t noise = 0;
+static uint32_t noise_state = 1;
+static HAL_StatusTypeDef fail_status = HAL_OK;
+static uint32_t fail_error = HAL_I2C_ERROR_NONE;
+static uint16_t fault_nack = 0;
+static uint16_t fault_arlo = 0;
+static uint32_t fault_stretch_us = 0;
+static uint32_t fault_state = 1;
+static host_bus_t buses[HOST_BUSES];
+static uint8_t next_bus = 0;
+
+/**
+ * Gets the transfer state of a handle, the first use of a handle assigns it a free entry
+ */
+static host_bus_t &find_bus(I2C_HandleTypeDef *hi2c)
+{
+	for (uint8_t i = 0; i < HOST_BUSES; i++)
+	{
+		if (buses[i].handle == hi2c || buses[i].handle == nullptr)
+		{
+			buses[i].handle = hi2c;
+			return buses[i];
+		}
+	}
+
+	// More handles than simulated buses share the last one
+	return buses[HOST_BUSES - 1];
+}
+
+static bool is_busy(I2C_HandleTypeDef *hi2c)
+{
+	return find_bus(hi2c).pending != EVENT_NONE;
+}
+
+/**
+ * Advances the simulated cycle counter by the time a number of bits take on the bus
+ */
+static void advance_bits(I2C_HandleTypeDef *hi2c, uint32_t bits)
+{
+	uint32_t clock = (hi2c->Init.ClockSpeed != 0) ? hi2c->Init.ClockSpeed : 100000;
+	ADS7828_host_dwt.CYCCNT = ADS7828_host_dwt.CYCCNT + (uint32_t)((uint64_t)bits * SystemCoreClock / clock);
+}
+
+// Next value of the random fault generator (0 - 32767), separate from the noise so both sequences are reproducible
+static uint32_t fault_random()
+{
+	fault_state = fault_state * 1103515245 + 12345;
+	return (fault_state >> 16) & 0x7FFF;
+}
+
+static host_device_t *find_device(uint16_t dev_address)
+{
+	for (uint8_t i = 0; i < HOST_DEVICES; i++)
+	{
+		if (devices[i].address != 0 && devices[i].address == (dev_address >> 1))
+		{
+			return &devices[i];
+		}
+	}
+
+	return nullptr;
+}
+
+/**
+ * Consumes an injected error or a NACK of an unknown address
+ */
+static HAL_StatusTypeDef check_transfer(I2C_HandleTypeDef *hi2c, host_device_t *device)
+{
+	// Start + address + ACK
+	advance_bits(hi2c, 10);
+
+	if (fail_status != HAL_OK)
+	{
+		HAL_StatusTypeDef status = fail_status;
+		hi2c->ErrorCode = fail_error;
+		fail_status = HAL_OK;
+		return status;
+	}
+
+	if (fault_stretch_us != 0)
+	{
+		ADS7828_host_advance_us(fault_random() % (fault_stretch_us + 1));
+	}
+
+	if (fault_nack != 0 || fault_arlo != 0)
+	{
+		uint32_t roll = fault_random() % 1000;
+
+		if (roll < fault_nack)
+		{
+			hi2c->ErrorCode = HAL_I2C_ERROR_AF;
+			return HAL_ERROR;
+		}
+
+		if (roll < (uint32_t)fault_nack + fault_arlo)
+		{
+			hi2c->ErrorCode = HAL_I2C_ERROR_ARLO;
+			return HAL_ERROR;
+		}
+	}
+
+	if (device == nullptr)
+	{
+		hi2c->ErrorCode = HAL_I2C_ERROR_AF;
+		return HAL_ERROR;
+	}
+
+	hi2c->ErrorCode = HAL_I2C_ERROR_NONE;
+	return HAL_OK;
+}
+
+// A new conversion of the selected channel, MSB first like on the bus
+static void convert(host_device_t *device, uint8_t *data, uint16_t size)
+{
+	int32_t digit = device->digits[device->command >> 4];
+
+	if (noise != 0)
+	{
+		noise_state = noise_state * 1103515245 + 12345;
+		digit += (int32_t)((noise_state >> 16) % (2 * noise + 1)) - noise;
+		digit = (digit < 0) ? 0 : (digit > 4095) ? 4095 : digit;
+	}
+
+	for (uint16_t i = 0; i + 1 < size; i += 2)
+	{
+		data[i] = (uint8_t)(digit >> 8);
+		data[i + 1] = (uint8_t)digit;
+	}
+}
+
+static HAL_StatusTypeDef transmit(I2C_HandleTypeDef *hi2c, uint16_t dev_address, uint8_t *data, uint16_t size)
+{
+	host_device_t *device = find_device(dev_address);
+	HAL_StatusTypeDef status = check_transfer(hi2c, device);
+
+	if (status == HAL_OK && size > 0)
+	{
+		device->command = data[size - 1];
+		advance_bits(hi2c, 9 * size);
+	}
+
+	return status;
+}
+
+static HAL_StatusTypeDef receive(I2C_HandleTypeDef *hi2c, uint16_t dev_address, uint8_t *data, uint16_t size)
+{
+	host_device_t *device = find_device(dev_address);
+	HAL_StatusTypeDef status = check_transfer(hi2c, device);
+
+	if (status == HAL_OK)
+	{
+		convert(device, data, size);
+		// Data bytes + ACK, then the STOP
+		advance_bits(hi2c, 9 * size + 1);
+	}
+
+	return status;
+}
+
+static HAL_StatusTypeDef start_dma(I2C_HandleTypeDef *hi2c, HAL_StatusTypeDef status, host_event_t event)
+{
+	if (status == HAL_BUSY)
+	{
+		return status;
+	}
+
+	// Failing DMA transfers report their error through the callback like the real peripheral
+	find_bus(hi2c).pending = (status == HAL_OK) ? event : EVENT_ERROR;
+	return HAL_OK;
+}
+
+extern "C"
+{
+	uint32_t HAL_GetTick(void)
+	{
+		return (uint32_t)(((uint64_t)ADS7828_host_dwt.CYCCNT * 1000) / SystemCoreClock);
+	}
+
+	HAL_StatusTypeDef HAL_I2C_Init(I2C_HandleTypeDef *hi2c)
+	{
+		hi2c->ErrorCode = HAL_I2C_ERROR_NONE;
+		find_bus(hi2c).pending = EVENT_NONE;
+		return HAL_OK;
+	}
+
+	HAL_StatusTypeDef HAL_I2C_DeInit(I2C_HandleTypeDef *)
+	{
+		return HAL_OK;
+	}
+
+	uint32_t HAL_I2C_GetError(I2C_HandleTypeDef *hi2c)
+	{
+		return hi2c->ErrorCode;
+	}
+
+	HAL_StatusTypeDef HAL_I2C_Master_Transmit(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint8_t *pData, uint16_t Size, uint32_t)
+	{
+		return is_busy(hi2c) ? HAL_BUSY : transmit(hi2c, DevAddress, pData, Size);
+	}
+
+	HAL_StatusTypeDef HAL_I2C_Master_Receive(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint8_t *pData, uint16_t Size, uint32_t)
+	{
+		return is_busy(hi2c) ? HAL_BUSY : receive(hi2c, DevAddress, pData, Size);
+	}
+
+	HAL_StatusTypeDef HAL_I2C_IsDeviceReady(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint32_t Trials, uint32_t)
+	{
+		if (is_busy(hi2c))
+		{
+			return HAL_BUSY;
+		}
+
+		for (uint32_t i = 0; i < Trials; i++)
+		{
+			if (transmit(hi2c, DevAddress, nullptr, 0) == HAL_OK)
+			{
+				return HAL_OK;
+			}
+		}
+
+		return HAL_ERROR;
+	}
+
+	HAL_StatusTypeDef HAL_I2C_Mem_Read(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress, uint16_t, uint8_t *pData, uint16_t Size, uint32_t)
+	{
+		if (is_busy(hi2c))
+		{
+			return HAL_BUSY;
+		}
+
+		uint8_t command = (uint8_t)MemAddress;
+		HAL_StatusTypeDef status = transmit(hi2c, DevAddress, &command, 1);
+		return (status == HAL_OK) ? receive(hi2c, DevAddress, pData, Size) : status;
+	}
+
+	HAL_StatusTypeDef HAL_I2C_Mem_Read_DMA(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress, uint16_t, uint8_t *pData, uint16_t Size)
+	{
+		if (is_busy(hi2c))
+		{
+			return HAL_BUSY;
+		}
+
+		uint8_t command = (uint8_t)MemAddress;
+		HAL_StatusTypeDef status = transmit(hi2c, DevAddress, &command, 1);
+		return start_dma(hi2c, (status == HAL_OK) ? receive(hi2c, DevAddress, pData, Size) : status, EVENT_MEM_RX);
+	}
+
+	HAL_StatusTypeDef HAL_I2C_Master_Seq_Transmit_DMA(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint8_t *pData, uint16_t Size, uint32_t)
+	{
+		return is_busy(hi2c) ? HAL_BUSY : start_dma(hi2c, transmit(hi2c, DevAddress, pData, Size), EVENT_TX);
+	}
+
+	HAL_StatusTypeDef HAL_I2C_Master_Seq_Receive_DMA(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint8_t *pData, uint16_t Size, uint32_t)
+	{
+		return is_busy(hi2c) ? HAL_BUSY : start_dma(hi2c, receive(hi2c, DevAddress, pData, Size), EVENT_RX);
+	}
+
+	HAL_StatusTypeDef HAL_I2C_Master_Receive_DMA(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint8_t *pData, uint16_t Size)
+	{
+		return is_busy(hi2c) ? HAL_BUSY : start_dma(hi2c, receive(hi2c, DevAddress, pData, Size), EVENT_RX);
+	}
+
+	HAL_StatusTypeDef HAL_I2C_Master_Abort_IT(I2C_HandleTypeDef *hi2c, uint16_t)
+	{
+		find_bus(hi2c).pending = EVENT_NONE;
+		return HAL_OK;
+	}
+
+	// Weak defaults like in the HAL, the application forwards them to the driver
+	__attribute__((weak)) void HAL_I2C_MasterTxCpltCallback(I2C_HandleTypeDef *)
+	{
+	}
+
+	__attribute__((weak)) void HAL_I2C_MasterRxCpltCallback(I2C_HandleTypeDef *)
+	{
+	}
+
+	__attribute__((weak)) void HAL_I2C_MemRxCpltCallback(I2C_HandleTypeDef *)
+	{
+	}
+
+	__attribute__((weak)) void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *)
+	{
+	}
+
+	void HAL_GPIO_Init(GPIO_TypeDef *, GPIO_InitTypeDef *)
+	{
+	}
+
+	void HAL_GPIO_WritePin(GPIO_TypeDef *, uint16_t, GPIO_PinState)
+	{
+	}
+
+	GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *, uint16_t)
+	{
+		// The simulated bus is never stuck
+		return GPIO_PIN_SET;
+	}
+}
+
+/**
+ * Adds a simulated ADS7828 to the bus, reads from other addresses are not acknowledged
+ *
+ * @param address 7 Bit address of the device
+ */
+void ADS7828_host_attach(uint8_t address)
+{
+	for (uint8_t i = 0; i < HOST_DEVICES; i++)
+	{
+		if (devices[i].address == 0 || devices[i].address == address)
+		{
+			devices[i].address = address;
+			return;
+		}
+	}
+}
+
+/**
+ * Sets the digit a simulated device converts for a channel configuration
+ *
+ * @param address 7 Bit address of the device
+ * @param channel The ADS7828_CHANNEL configuration
+ * @param digit The digit (0 - 4095)
+ */
+void ADS7828_host_set_digit(uint8_t address, uint8_t channel, uint16_t digit)
+{
+	host_device_t *device = find_device(address << 1);
+
+	if (device != nullptr && channel < ADS7828_CHANNELS)
+	{
+		device->digits[channel] = digit;
+	}
+}
+
+/**
+ * Adds uniform noise to every conversion, e.g. for oversampling and filter tests
+ *
+ * @param amplitude Maximum deviation in digits, 0 for exact results
+ */
+void ADS7828_host_set_noise(uint16_t amplitude)
+{
+	noise = amplitude;
+}
+
+/**
+ * Lets the next transfer fail
+ *
+ * @param status Status returned by the HAL, e.g. HAL_TIMEOUT
+ * @param error_code Error code reported by HAL_I2C_GetError, e.g. HAL_I2C_ERROR_AF
+ */
+void ADS7828_host_fail_next(HAL_StatusTypeDef status, uint32_t error_code)
+{
+	fail_status = status;
+	fail_error = error_code;
+}
+
+/**
+ * Injects random faults into all following transfers, e.g. for soak runs.
+ * The faults repeat with every run, the generator starts from the same seed.
+ *
+ * @param nack_permille Transfers per 1000 that are not acknowledged
+ * @param arlo_permille Transfers per 1000 that lose the arbitration to another master
+ * @param stretch_us Maximum time a device stretches the clock before every transfer [us], 0 to disable
+ */
+void ADS7828_host_set_faults(uint16_t nack_permille, uint16_t arlo_permille, uint32_t stretch_us)
+{
+	fault_nack = nack_permille;
+	fault_arlo = arlo_permille;
+	fault_stretch_us = stretch_us;
+}
+
+/**
+ * Advances the simulated time, e.g. to let the reference settle
+ *
+ * @param us Time [us]
+ */
+void ADS7828_host_advance_us(uint32_t us)
+{
+	ADS7828_host_dwt.CYCCNT = ADS7828_host_dwt.CYCCNT + (uint32_t)((uint64_t)us * SystemCoreClock / 1000000);
+}
+
+/**
+ * Delivers the completions of the simulated DMA transfers by calling the HAL I2C callbacks.
+ * Transfers started from a callback are completed in the same call, several buses take turns.
+ *
+ * @param max_events Maximum number of completions to deliver
+ * @return Number of delivered completions
+ */
+size_t ADS7828_host_run(size_t max_events)
+{
+	size_t events = 0;
+
+	uint8_t idle = 0;
+
+	while (idle < HOST_BUSES && events < max_events)
+	{
+		host_bus_t &bus = buses[next_bus];
+		next_bus = (next_bus + 1) % HOST_BUSES;
+
+		if (bus.pending == EVENT_NONE)
+		{
+			idle++;
+			continue;
+		}
+
+		host_event_t event = bus.pending;
+		bus.pending = EVENT_NONE;
+		events++;
+		idle = 0;
+
+		if (event == EVENT_TX)
+		{
+			HAL_I2C_MasterTxCpltCallback(bus.handle);
+		}
+		else if (event == EVENT_RX)
+		{
+			HAL_I2C_MasterRxCpltCallback(bus.handle);
+		}
+		else if (event == EVENT_MEM_RX)
+		{
+			HAL_I2C_MemRxCpltCallback(bus.handle);
+		}
+		else
+		{
+			HAL_I2C_ErrorCallback(bus.handle);
+		}
+	}
+
+	return events;
+}
+
+#endif // ADS7828_HOST
@@ -0,0 +1,147 @@
+// Host build of the driver without the STM32 HAL, e.g. for benchmarks on a PC
+// Provides the used HAL types and functions and simulates ADS7828 devices on a virtual I2C bus
+#ifndef ADS7828_HOST_HPP
+#define ADS7828_HOST_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef enum
+{
+	HAL_OK = 0x00U,
+	HAL_ERROR = 0x01U,
+	HAL_BUSY = 0x02U,
+	HAL_TIMEOUT = 0x03U
+} HAL_StatusTypeDef;
+
+#define HAL_MAX_DELAY 0xFFFFFFFFU
+
+#define HAL_I2C_ERROR_NONE 0x00U
+#define HAL_I2C_ERROR_BERR 0x01U
+#define HAL_I2C_ERROR_ARLO 0x02U
+#define HAL_I2C_ERROR_AF 0x04U
+
+#define I2C_MEMADD_SIZE_8BIT 0x01U
+#define I2C_FIRST_FRAME 0x01U
+#define I2C_NEXT_FRAME 0x02U
+#define I2C_FIRST_AND_LAST_FRAME 0x08U
+#define I2C_LAST_FRAME 0x20U
+#define I2C_DUTYCYCLE_2 0x00000000U
+
+typedef struct
+{
+	uint32_t ClockSpeed; // SCL frequency [Hz] of the simulated bus
+	uint32_t DutyCycle;
+	uint32_t Timing;
+} I2C_InitTypeDef;
+
+typedef struct
+{
+	I2C_InitTypeDef Init;
+	volatile uint32_t ErrorCode;
+} I2C_HandleTypeDef;
+
+typedef struct
+{
+	uint32_t ODR;
+} GPIO_TypeDef;
+
+typedef struct
+{
+	uint32_t Pin;
+	uint32_t Mode;
+	uint32_t Pull;
+	uint32_t Speed;
+} GPIO_InitTypeDef;
+
+typedef enum
+{
+	GPIO_PIN_RESET = 0,
+	GPIO_PIN_SET
+} GPIO_PinState;
+
+#define GPIO_PIN_6 ((uint16_t)0x0040)
+#define GPIO_PIN_7 ((uint16_t)0x0080)
+#define GPIO_MODE_OUTPUT_OD 0x00000011U
+#define GPIO_NOPULL 0x00000000U
+#define GPIO_SPEED_FREQ_HIGH 0x00000003U
+
+// Simulated cycle counter, advanced by the bus time of every transfer
+typedef struct
+{
+	volatile uint32_t CTRL;
+	volatile uint32_t CYCCNT;
+} ADS7828_host_dwt_t;
+
+typedef struct
+{
+	volatile uint32_t DEMCR;
+} ADS7828_host_debug_t;
+
+#define DWT_CTRL_CYCCNTENA_Msk (0x1UL)
+#define CoreDebug_DEMCR_TRCENA_Msk (1UL << 24)
+
+extern ADS7828_host_dwt_t ADS7828_host_dwt;
+extern ADS7828_host_debug_t ADS7828_host_debug;
+#define DWT (&ADS7828_host_dwt)
+#define CoreDebug (&ADS7828_host_debug)
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+	extern uint32_t SystemCoreClock;
+
+	uint32_t HAL_GetTick(void);
+
+	HAL_StatusTypeDef HAL_I2C_Init(I2C_HandleTypeDef *hi2c);
+	HAL_StatusTypeDef HAL_I2C_DeInit(I2C_HandleTypeDef *hi2c);
+	uint32_t HAL_I2C_GetError(I2C_HandleTypeDef *hi2c);
+	HAL_StatusTypeDef HAL_I2C_Master_Transmit(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint8_t *pData, uint16_t Size, uint32_t Timeout);
+	HAL_StatusTypeDef HAL_I2C_Master_Receive(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint8_t *pData, uint16_t Size, uint32_t Timeout);
+	HAL_StatusTypeDef HAL_I2C_IsDeviceReady(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint32_t Trials, uint32_t Timeout);
+	HAL_StatusTypeDef HAL_I2C_Mem_Read(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress, uint16_t MemAddSize, uint8_t *pData, uint16_t Size, uint32_t Timeout);
+	HAL_StatusTypeDef HAL_I2C_Mem_Read_DMA(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress, uint16_t MemAddSize, uint8_t *pData, uint16_t Size);
+	HAL_StatusTypeDef HAL_I2C_Master_Seq_Transmit_DMA(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint8_t *pData, uint16_t Size, uint32_t XferOptions);
+	HAL_StatusTypeDef HAL_I2C_Master_Seq_Receive_DMA(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint8_t *pData, uint16_t Size, uint32_t XferOptions);
+	HAL_StatusTypeDef HAL_I2C_Master_Receive_DMA(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint8_t *pData, uint16_t Size);
+	HAL_StatusTypeDef HAL_I2C_Master_Abort_IT(I2C_HandleTypeDef *hi2c, uint16_t DevAddress);
+	void HAL_I2C_MasterTxCpltCallback(I2C_HandleTypeDef *hi2c);
+	void HAL_I2C_MasterRxCpltCallback(I2C_HandleTypeDef *hi2c);
+	void HAL_I2C_MemRxCpltCallback(I2C_HandleTypeDef *hi2c);
+	void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c);
+
+	void HAL_GPIO_Init(GPIO_TypeDef *GPIOx, GPIO_InitTypeDef *GPIO_Init);
+	void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState);
+	GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin);
+
+#ifdef __cplusplus
+}
+#endif
+
+// Interrupts don't exist on the host, the simulated completions run from ADS7828_host_run
+inline uint32_t __get_PRIMASK() { return 0; }
+inline void __set_PRIMASK(uint32_t) {}
+inline void __disable_irq() {}
+inline void __DMB() { __atomic_thread_fence(__ATOMIC_SEQ_CST); }
+
+// Control of the simulation
+void ADS7828_host_attach(uint8_t address);
+void ADS7828_host_set_digit(uint8_t address, uint8_t channel, uint16_t digit);
+void ADS7828_host_set_noise(uint16_t amplitude);
+void ADS7828_host_fail_next(HAL_StatusTypeDef status, uint32_t error_code);
+void ADS7828_host_set_faults(uint16_t nack_permille, uint16_t arlo_permille, uint32_t stretch_us);
+void ADS7828_host_advance_us(uint32_t us);
+size_t ADS7828_host_run(size_t max_events = SIZE_MAX);
+
+// Sleeping ends with the next simulated completion, or with the next SysTick if no transfer is running
+inline void __WFI()
+{
+	if (ADS7828_host_run(1) == 0)
+	{
+		ADS7828_host_advance_us(1000);
+	}
+}
+
+#endif // ADS7828_HOST_HPP
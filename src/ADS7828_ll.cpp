@@ -0,0 +1,539 @@
+#include "ADS7828.hpp"
+
+#if defined(ADS7828_LL) && defined(ADS7828_I2C_V2)
+// I2C v2: the peripheral sends address, bytes and STOP (AUTOEND) on its own, the CPU only moves the data bytes
+
+/**
+ * Writes bytes to a device and ends with a STOP
+ *
+ * @param address 7 Bit I2C address
+ * @param data Bytes to send
+ * @param size Number of bytes
+ * @param timeout_ms Timeout of the whole transfer in [ms]
+ * @return HAL_OK, HAL_BUSY if the bus did not get free, HAL_ERROR on a NACK or bus error, HAL_TIMEOUT
+ */
+HAL_StatusTypeDef ADS7828_LlTransport::write(uint8_t address, uint8_t *data, uint16_t size, uint32_t timeout_ms)
+{
+	uint32_t tick = HAL_GetTick();
+	HAL_StatusTypeDef status = wait_idle(tick, timeout_ms);
+
+	if (status != HAL_OK)
+	{
+		return status;
+	}
+
+	return transfer((address << 1), data, size, true, tick, timeout_ms);
+}
+
+/**
+ * Reads bytes from a device and ends with a STOP
+ *
+ * @param address 7 Bit I2C address
+ * @param data Receives the bytes
+ * @param size Number of bytes
+ * @param timeout_ms Timeout of the whole transfer in [ms]
+ * @return HAL_OK, HAL_BUSY if the bus did not get free, HAL_ERROR on a NACK or bus error, HAL_TIMEOUT
+ */
+HAL_StatusTypeDef ADS7828_LlTransport::read(uint8_t address, uint8_t *data, uint16_t size, uint32_t timeout_ms)
+{
+	uint32_t tick = HAL_GetTick();
+	HAL_StatusTypeDef status = wait_idle(tick, timeout_ms);
+
+	if (status != HAL_OK)
+	{
+		return status;
+	}
+
+	return transfer((address << 1) | 1, data, size, true, tick, timeout_ms);
+}
+
+/**
+ * Writes one byte and reads the answer after a repeated start
+ *
+ * @param address 7 Bit I2C address
+ * @param command Byte to send, e.g. the command byte
+ * @param data Receives the bytes
+ * @param size Number of bytes
+ * @param timeout_ms Timeout of the whole transfer in [ms]
+ * @return HAL_OK, HAL_BUSY if the bus did not get free, HAL_ERROR on a NACK or bus error, HAL_TIMEOUT
+ */
+HAL_StatusTypeDef ADS7828_LlTransport::write_read(uint8_t address, uint8_t command, uint8_t *data, uint16_t size, uint32_t timeout_ms)
+{
+	uint32_t tick = HAL_GetTick();
+	HAL_StatusTypeDef status = wait_idle(tick, timeout_ms);
+
+	if (status == HAL_OK)
+	{
+		status = transfer((address << 1), &command, 1, false, tick, timeout_ms);
+	}
+
+	if (status != HAL_OK)
+	{
+		return status;
+	}
+
+	// START while TC is set generates the repeated start
+	return transfer((address << 1) | 1, data, size, true, tick, timeout_ms);
+}
+
+/**
+ * Waits until no other master or stuck transfer occupies the bus
+ *
+ * @param tick HAL tick at the start of the transfer
+ * @param timeout_ms Timeout of the whole transfer in [ms]
+ * @return HAL_OK, HAL_BUSY after the timeout
+ */
+HAL_StatusTypeDef ADS7828_LlTransport::wait_idle(uint32_t tick, uint32_t timeout_ms)
+{
+	while (_hi2c->Instance->ISR & I2C_ISR_BUSY)
+	{
+		if ((HAL_GetTick() - tick) > timeout_ms)
+		{
+			_hi2c->ErrorCode = HAL_I2C_ERROR_TIMEOUT;
+			return HAL_BUSY;
+		}
+	}
+
+	// A late STOP of an aborted transfer must not end the next one
+	_hi2c->Instance->ICR = I2C_ICR_STOPCF | I2C_ICR_NACKCF;
+	_hi2c->ErrorCode = HAL_I2C_ERROR_NONE;
+	return HAL_OK;
+}
+
+/**
+ * Runs one transaction from the START to the STOP or, without autoend, to the transfer complete flag.
+ * Transfers of more than 255 bytes are split with RELOAD, the bus is not released in between.
+ *
+ * @param address_byte Address shifted left with the R/W bit
+ * @param data Bytes to send or receive
+ * @param size Number of bytes
+ * @param autoend If true the peripheral generates the STOP, otherwise the bus is kept for a repeated start
+ * @param tick HAL tick at the start of the transfer
+ * @param timeout_ms Timeout of the whole transfer in [ms]
+ * @return HAL_OK once the STOP or the transfer complete flag was seen
+ */
+HAL_StatusTypeDef ADS7828_LlTransport::transfer(uint8_t address_byte, uint8_t *data, uint16_t size, bool autoend, uint32_t tick, uint32_t timeout_ms)
+{
+	I2C_TypeDef *i2c = _hi2c->Instance;
+	const bool reading = (address_byte & 1);
+	const uint32_t end = autoend ? I2C_CR2_AUTOEND : 0;
+
+	uint32_t chunk = (size > 255) ? 255 : size;
+	uint32_t cr2 = (address_byte & 0xFE) | (reading ? I2C_CR2_RD_WRN : 0) | (chunk << I2C_CR2_NBYTES_Pos);
+	i2c->CR2 = cr2 | ((size > 255) ? I2C_CR2_RELOAD : end) | I2C_CR2_START;
+
+	for (uint16_t i = 0; i < size; i++)
+	{
+		if (i != 0 && i % 255 == 0)
+		{
+			// Next chunk of the same transaction
+			HAL_StatusTypeDef status = wait(I2C_ISR_TCR, tick, timeout_ms);
+			if (status != HAL_OK)
+			{
+				return status;
+			}
+
+			uint32_t remaining = size - i;
+			chunk = (remaining > 255) ? 255 : remaining;
+			i2c->CR2 = (i2c->CR2 & ~(I2C_CR2_NBYTES | I2C_CR2_RELOAD | I2C_CR2_AUTOEND)) | (chunk << I2C_CR2_NBYTES_Pos) |
+					   ((remaining > 255) ? I2C_CR2_RELOAD : end);
+		}
+
+		HAL_StatusTypeDef status = wait(reading ? I2C_ISR_RXNE : I2C_ISR_TXIS, tick, timeout_ms);
+		if (status != HAL_OK)
+		{
+			return status;
+		}
+
+		if (reading)
+		{
+			data[i] = (uint8_t)i2c->RXDR;
+		}
+		else
+		{
+			i2c->TXDR = data[i];
+		}
+	}
+
+	if (!autoend)
+	{
+		return wait(I2C_ISR_TC, tick, timeout_ms);
+	}
+
+	HAL_StatusTypeDef status = wait(I2C_ISR_STOPF, tick, timeout_ms);
+	i2c->ICR = I2C_ICR_STOPCF;
+	return status;
+}
+
+/**
+ * Polls an ISR flag and checks for NACK, bus errors and the timeout
+ *
+ * @param flag I2C_ISR_x flag to wait for
+ * @param tick HAL tick at the start of the transfer
+ * @param timeout_ms Timeout of the whole transfer in [ms]
+ * @return HAL_OK once the flag is set, HAL_ERROR on a NACK or bus error, HAL_TIMEOUT
+ */
+HAL_StatusTypeDef ADS7828_LlTransport::wait(uint32_t flag, uint32_t tick, uint32_t timeout_ms)
+{
+	I2C_TypeDef *i2c = _hi2c->Instance;
+
+	while (true)
+	{
+		uint32_t isr = i2c->ISR;
+
+		if (isr & flag)
+		{
+			return HAL_OK;
+		}
+
+		if (isr & (I2C_ISR_NACKF | I2C_ISR_BERR | I2C_ISR_ARLO))
+		{
+			_hi2c->ErrorCode = (isr & I2C_ISR_NACKF) ? HAL_I2C_ERROR_AF : ((isr & I2C_ISR_ARLO) ? HAL_I2C_ERROR_ARLO : HAL_I2C_ERROR_BERR);
+			return fail(HAL_ERROR);
+		}
+
+		if ((HAL_GetTick() - tick) > timeout_ms)
+		{
+			_hi2c->ErrorCode = HAL_I2C_ERROR_TIMEOUT;
+			return fail(HAL_TIMEOUT);
+		}
+	}
+}
+
+/**
+ * Releases the bus after an error and clears the error flags
+ *
+ * @param status The error status
+ * @return status
+ */
+HAL_StatusTypeDef ADS7828_LlTransport::fail(HAL_StatusTypeDef status)
+{
+	I2C_TypeDef *i2c = _hi2c->Instance;
+
+	// Without AUTOEND the STOP is up to software
+	if (!(i2c->CR2 & I2C_CR2_AUTOEND) && !(i2c->ISR & I2C_ISR_STOPF))
+	{
+		i2c->CR2 |= I2C_CR2_STOP;
+	}
+
+	i2c->ICR = I2C_ICR_NACKCF | I2C_ICR_BERRCF | I2C_ICR_ARLOCF | I2C_ICR_STOPCF;
+	i2c->CR2 &= ~(I2C_CR2_RELOAD | I2C_CR2_AUTOEND);
+	return status;
+}
+
+#elif defined(ADS7828_LL)
+// I2C v1: every event of the transfer is handled by polling SR1
+
+/**
+ * Writes bytes to a device and ends with a STOP
+ *
+ * @param address 7 Bit I2C address
+ * @param data Bytes to send
+ * @param size Number of bytes
+ * @param timeout_ms Timeout of the whole transfer in [ms]
+ * @return HAL_OK, HAL_BUSY if the bus did not get free, HAL_ERROR on a NACK or bus error, HAL_TIMEOUT
+ */
+HAL_StatusTypeDef ADS7828_LlTransport::write(uint8_t address, uint8_t *data, uint16_t size, uint32_t timeout_ms)
+{
+	uint32_t tick = HAL_GetTick();
+	HAL_StatusTypeDef status = send((address << 1), data, size, tick, timeout_ms);
+
+	if (status == HAL_OK)
+	{
+		_hi2c->Instance->CR1 |= I2C_CR1_STOP;
+	}
+
+	return status;
+}
+
+/**
+ * Reads bytes from a device and ends with a STOP
+ *
+ * @param address 7 Bit I2C address
+ * @param data Receives the bytes
+ * @param size Number of bytes
+ * @param timeout_ms Timeout of the whole transfer in [ms]
+ * @return HAL_OK, HAL_BUSY if the bus did not get free, HAL_ERROR on a NACK or bus error, HAL_TIMEOUT
+ */
+HAL_StatusTypeDef ADS7828_LlTransport::read(uint8_t address, uint8_t *data, uint16_t size, uint32_t timeout_ms)
+{
+	uint32_t tick = HAL_GetTick();
+	HAL_StatusTypeDef status = wait_idle(tick, timeout_ms);
+
+	if (status != HAL_OK)
+	{
+		return status;
+	}
+
+	return receive((address << 1) | 1, data, size, tick, timeout_ms);
+}
+
+/**
+ * Writes one byte and reads the answer after a repeated start
+ *
+ * @param address 7 Bit I2C address
+ * @param command Byte to send, e.g. the command byte
+ * @param data Receives the bytes
+ * @param size Number of bytes
+ * @param timeout_ms Timeout of the whole transfer in [ms]
+ * @return HAL_OK, HAL_BUSY if the bus did not get free, HAL_ERROR on a NACK or bus error, HAL_TIMEOUT
+ */
+HAL_StatusTypeDef ADS7828_LlTransport::write_read(uint8_t address, uint8_t command, uint8_t *data, uint16_t size, uint32_t timeout_ms)
+{
+	uint32_t tick = HAL_GetTick();
+	HAL_StatusTypeDef status = send((address << 1), &command, 1, tick, timeout_ms);
+
+	if (status != HAL_OK)
+	{
+		return status;
+	}
+
+	// The START after the last byte is a repeated start
+	return receive((address << 1) | 1, data, size, tick, timeout_ms);
+}
+
+/**
+ * Waits until no other master or stuck transfer occupies the bus
+ *
+ * @param tick HAL tick at the start of the transfer
+ * @param timeout_ms Timeout of the whole transfer in [ms]
+ * @return HAL_OK, HAL_BUSY after the timeout
+ */
+HAL_StatusTypeDef ADS7828_LlTransport::wait_idle(uint32_t tick, uint32_t timeout_ms)
+{
+	while (_hi2c->Instance->SR2 & I2C_SR2_BUSY)
+	{
+		if ((HAL_GetTick() - tick) > timeout_ms)
+		{
+			_hi2c->ErrorCode = HAL_I2C_ERROR_TIMEOUT;
+			return HAL_BUSY;
+		}
+	}
+
+	_hi2c->ErrorCode = HAL_I2C_ERROR_NONE;
+	return HAL_OK;
+}
+
+/**
+ * Generates a START (or repeated start) and sends the address byte
+ *
+ * @param address_byte Address shifted left with the R/W bit
+ * @param tick HAL tick at the start of the transfer
+ * @param timeout_ms Timeout of the whole transfer in [ms]
+ * @return HAL_OK once the address was acknowledged, ADDR is still set
+ */
+HAL_StatusTypeDef ADS7828_LlTransport::start(uint8_t address_byte, uint32_t tick, uint32_t timeout_ms)
+{
+	I2C_TypeDef *i2c = _hi2c->Instance;
+	i2c->CR1 |= I2C_CR1_START;
+
+	HAL_StatusTypeDef status = wait(I2C_SR1_SB, tick, timeout_ms);
+	if (status != HAL_OK)
+	{
+		return status;
+	}
+
+	i2c->DR = address_byte;
+	return wait(I2C_SR1_ADDR, tick, timeout_ms);
+}
+
+/**
+ * Addresses the device for writing and sends the bytes, the bus is kept for a STOP or a repeated start
+ *
+ * @param address_byte Address shifted left with the R/W bit cleared
+ * @param data Bytes to send
+ * @param size Number of bytes
+ * @param tick HAL tick at the start of the transfer
+ * @param timeout_ms Timeout of the whole transfer in [ms]
+ * @return HAL_OK once the last byte was sent
+ */
+HAL_StatusTypeDef ADS7828_LlTransport::send(uint8_t address_byte, uint8_t *data, uint16_t size, uint32_t tick, uint32_t timeout_ms)
+{
+	I2C_TypeDef *i2c = _hi2c->Instance;
+
+	HAL_StatusTypeDef status = wait_idle(tick, timeout_ms);
+	if (status != HAL_OK)
+	{
+		return status;
+	}
+
+	i2c->CR1 &= ~I2C_CR1_POS;
+	status = start(address_byte, tick, timeout_ms);
+	if (status != HAL_OK)
+	{
+		return status;
+	}
+	clear_addr();
+
+	for (uint16_t i = 0; i < size; i++)
+	{
+		status = wait(I2C_SR1_TXE, tick, timeout_ms);
+		if (status != HAL_OK)
+		{
+			return status;
+		}
+		i2c->DR = data[i];
+	}
+
+	return wait(I2C_SR1_BTF, tick, timeout_ms);
+}
+
+/**
+ * Addresses the device for reading and receives the bytes, ends with a STOP.
+ * Follows the reception procedures of the reference manual for 1, 2 and more bytes,
+ * the steps between clearing ADDR and the STOP must not be interrupted.
+ *
+ * @param address_byte Address shifted left with the R/W bit set
+ * @param data Receives the bytes
+ * @param size Number of bytes
+ * @param tick HAL tick at the start of the transfer
+ * @param timeout_ms Timeout of the whole transfer in [ms]
+ * @return HAL_OK once all bytes were received
+ */
+HAL_StatusTypeDef ADS7828_LlTransport::receive(uint8_t address_byte, uint8_t *data, uint16_t size, uint32_t tick, uint32_t timeout_ms)
+{
+	I2C_TypeDef *i2c = _hi2c->Instance;
+
+	// For two bytes the NACK is prepared for the second byte with POS
+	i2c->CR1 = (size == 2) ? (i2c->CR1 | I2C_CR1_ACK | I2C_CR1_POS) : ((i2c->CR1 | I2C_CR1_ACK) & ~I2C_CR1_POS);
+
+	HAL_StatusTypeDef status = start(address_byte, tick, timeout_ms);
+	if (status != HAL_OK)
+	{
+		return status;
+	}
+
+	uint32_t primask = __get_PRIMASK();
+
+	if (size == 1)
+	{
+		i2c->CR1 &= ~I2C_CR1_ACK;
+		__disable_irq();
+		clear_addr();
+		i2c->CR1 |= I2C_CR1_STOP;
+		__set_PRIMASK(primask);
+
+		status = wait(I2C_SR1_RXNE, tick, timeout_ms);
+		if (status != HAL_OK)
+		{
+			return status;
+		}
+		data[0] = (uint8_t)i2c->DR;
+		return HAL_OK;
+	}
+
+	if (size == 2)
+	{
+		__disable_irq();
+		clear_addr();
+		i2c->CR1 &= ~I2C_CR1_ACK;
+		__set_PRIMASK(primask);
+
+		// Both bytes are in DR and the shift register once BTF is set
+		status = wait(I2C_SR1_BTF, tick, timeout_ms);
+		if (status != HAL_OK)
+		{
+			return status;
+		}
+
+		__disable_irq();
+		i2c->CR1 |= I2C_CR1_STOP;
+		data[0] = (uint8_t)i2c->DR;
+		__set_PRIMASK(primask);
+		data[1] = (uint8_t)i2c->DR;
+		i2c->CR1 &= ~I2C_CR1_POS;
+		return HAL_OK;
+	}
+
+	clear_addr();
+
+	for (uint16_t i = 0; i < size; i++)
+	{
+		if (size - i == 3)
+		{
+			// The last three bytes: NACK and STOP are set while the last byte is received
+			status = wait(I2C_SR1_BTF, tick, timeout_ms);
+			if (status != HAL_OK)
+			{
+				return status;
+			}
+
+			i2c->CR1 &= ~I2C_CR1_ACK;
+			__disable_irq();
+			data[i++] = (uint8_t)i2c->DR;
+			i2c->CR1 |= I2C_CR1_STOP;
+			data[i++] = (uint8_t)i2c->DR;
+			__set_PRIMASK(primask);
+		}
+
+		status = wait(I2C_SR1_RXNE, tick, timeout_ms);
+		if (status != HAL_OK)
+		{
+			return status;
+		}
+		data[i] = (uint8_t)i2c->DR;
+	}
+
+	return HAL_OK;
+}
+
+/**
+ * Polls an SR1 flag and checks for NACK, bus errors and the timeout
+ *
+ * @param flag I2C_SR1_x flag to wait for
+ * @param tick HAL tick at the start of the transfer
+ * @param timeout_ms Timeout of the whole transfer in [ms]
+ * @return HAL_OK once the flag is set, HAL_ERROR on a NACK or bus error, HAL_TIMEOUT
+ */
+HAL_StatusTypeDef ADS7828_LlTransport::wait(uint32_t flag, uint32_t tick, uint32_t timeout_ms)
+{
+	I2C_TypeDef *i2c = _hi2c->Instance;
+
+	while (true)
+	{
+		uint32_t sr1 = i2c->SR1;
+
+		if (sr1 & flag)
+		{
+			return HAL_OK;
+		}
+
+		if (sr1 & (I2C_SR1_AF | I2C_SR1_BERR | I2C_SR1_ARLO))
+		{
+			_hi2c->ErrorCode = (sr1 & I2C_SR1_AF) ? HAL_I2C_ERROR_AF : ((sr1 & I2C_SR1_ARLO) ? HAL_I2C_ERROR_ARLO : HAL_I2C_ERROR_BERR);
+			i2c->SR1 = (uint32_t)~(I2C_SR1_AF | I2C_SR1_BERR | I2C_SR1_ARLO);
+			return fail(HAL_ERROR);
+		}
+
+		if ((HAL_GetTick() - tick) > timeout_ms)
+		{
+			_hi2c->ErrorCode = HAL_I2C_ERROR_TIMEOUT;
+			return fail(HAL_TIMEOUT);
+		}
+	}
+}
+
+/**
+ * Releases the bus after an error
+ *
+ * @param status The error status
+ * @return status
+ */
+HAL_StatusTypeDef ADS7828_LlTransport::fail(HAL_StatusTypeDef status)
+{
+	I2C_TypeDef *i2c = _hi2c->Instance;
+	i2c->CR1 = (i2c->CR1 | I2C_CR1_STOP) & ~(I2C_CR1_ACK | I2C_CR1_POS);
+	return status;
+}
+
+/**
+ * Clears the ADDR flag by reading SR1 and SR2
+ */
+void ADS7828_LlTransport::clear_addr()
+{
+	volatile uint32_t sr = _hi2c->Instance->SR1;
+	sr = _hi2c->Instance->SR2;
+	(void)sr;
+}
+
+#endif
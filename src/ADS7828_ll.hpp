@@ -0,0 +1,36 @@
+// Register level transport for the I2C v1 (STM32F1/F2/F4) and I2C v2 peripheral (STM32F0/F3/F7/G4/L4/H7)
+#ifndef ADS7828_LL_HPP
+#define ADS7828_LL_HPP
+
+#if defined(ADS7828_HOST)
+#error "The ADS7828_LL transport needs the I2C registers of an STM32"
+#endif
+
+// Blocking transfers that drive the I2C registers directly instead of the HAL state machine.
+// The peripheral still has to be initialized with HAL_I2C_Init, the asynchronous reads keep using the HAL.
+class ADS7828_LlTransport : public ADS7828_Transport<ADS7828_LlTransport>
+{
+public:
+	ADS7828_LlTransport(I2C_HandleTypeDef *hi2c) : _hi2c(hi2c) {}
+
+	HAL_StatusTypeDef write(uint8_t address, uint8_t *data, uint16_t size, uint32_t timeout_ms);
+	HAL_StatusTypeDef read(uint8_t address, uint8_t *data, uint16_t size, uint32_t timeout_ms);
+	HAL_StatusTypeDef write_read(uint8_t address, uint8_t command, uint8_t *data, uint16_t size, uint32_t timeout_ms);
+
+private:
+	HAL_StatusTypeDef wait_idle(uint32_t tick, uint32_t timeout_ms);
+	HAL_StatusTypeDef wait(uint32_t flag, uint32_t tick, uint32_t timeout_ms);
+	HAL_StatusTypeDef fail(HAL_StatusTypeDef status);
+#ifdef ADS7828_I2C_V2
+	HAL_StatusTypeDef transfer(uint8_t address_byte, uint8_t *data, uint16_t size, bool autoend, uint32_t tick, uint32_t timeout_ms);
+#else
+	HAL_StatusTypeDef start(uint8_t address_byte, uint32_t tick, uint32_t timeout_ms);
+	HAL_StatusTypeDef send(uint8_t address_byte, uint8_t *data, uint16_t size, uint32_t tick, uint32_t timeout_ms);
+	HAL_StatusTypeDef receive(uint8_t address_byte, uint8_t *data, uint16_t size, uint32_t tick, uint32_t timeout_ms);
+	void clear_addr();
+#endif
+
+	I2C_HandleTypeDef *_hi2c; // I2C Handle, only the register block and the error code are used
+};
+
+#endif // ADS7828_LL_HPP
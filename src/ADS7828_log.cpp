@@ -0,0 +1,498 @@
+#include "ADS7828_log.hpp"
+
+// Bits of the largest code, used to check if a record still fits into the block
+constexpr uint32_t LOG_MAX_CODE_BITS = 16;
+
+/**
+ * Constructor for an encoder without channels, call set_channels or push_frame before the first record
+ */
+ADS7828_LogEncoder::ADS7828_LogEncoder()
+{
+}
+
+/**
+ * Sets the channel list of the records. A running block is finished first, the new list starts with a keyframe.
+ *
+ * @param channels List of ADS7828_CHANNEL configurations, the digits of push are in this order
+ * @param n Number of channels in the list (1 - 16)
+ * @return HAL_OK, HAL_ERROR for an invalid list
+ */
+HAL_StatusTypeDef ADS7828_LogEncoder::set_channels(const ADS7828_CHANNEL *channels, uint8_t n)
+{
+	if (n == 0 || n > ADS7828_CHANNELS)
+	{
+		return HAL_ERROR;
+	}
+
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	if (_records > 0)
+	{
+		finish_block();
+	}
+
+	for (uint8_t i = 0; i < n; i++)
+	{
+		_channels[i] = channels[i];
+	}
+
+	_n = n;
+
+	__set_PRIMASK(primask);
+	return HAL_OK;
+}
+
+/**
+ * Adds one record with a digit for every channel of the list
+ *
+ * @param digits Raw digits (0 - 4095) in the order of the channel list
+ * @return False if the record was dropped because both blocks wait for take_block, or no channels are set
+ */
+bool ADS7828_LogEncoder::push(const uint16_t *digits)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	bool added = encode(digits);
+
+	__set_PRIMASK(primask);
+	return added;
+}
+
+/**
+ * Adds the results of a scanner frame as one record. A different channel list starts a new block.
+ *
+ * @param results Result table indexed by ADS7828_CHANNEL
+ * @param channels Channel list of the frame
+ * @param n Number of channels in the list
+ * @return False if the record was dropped
+ */
+bool ADS7828_LogEncoder::push_frame(const ADS7828_digit_t *results, const ADS7828_CHANNEL *channels, uint8_t n)
+{
+	if (n == 0 || n > ADS7828_CHANNELS)
+	{
+		return false;
+	}
+
+	bool same = (n == _n);
+
+	for (uint8_t i = 0; i < n && same; i++)
+	{
+		same = (channels[i] == _channels[i]);
+	}
+
+	if (!same)
+	{
+		set_channels(channels, n);
+	}
+
+	uint16_t digits[ADS7828_CHANNELS];
+
+	for (uint8_t i = 0; i < n; i++)
+	{
+		digits[i] = ADS7828_round_digit(results[channels[i]]);
+	}
+
+	return push(digits);
+}
+
+/**
+ * Finishes the partly filled block, e.g. before a power down, so take_block returns it
+ */
+void ADS7828_LogEncoder::flush()
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	if (_records > 0)
+	{
+		finish_block();
+	}
+
+	__set_PRIMASK(primask);
+}
+
+/**
+ * Get the oldest finished block. It stays valid and is returned again until release_block is called.
+ *
+ * @return Pointer to ADS7828_LOG_BLOCK bytes, nullptr if no block is finished
+ */
+const uint8_t *ADS7828_LogEncoder::take_block()
+{
+	return _full[_take] ? _blocks[_take] : nullptr;
+}
+
+/**
+ * Releases the block of take_block after it was written, so it can be filled again
+ */
+void ADS7828_LogEncoder::release_block()
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	if (_full[_take])
+	{
+		_full[_take] = false;
+		_take = _take ^ 1;
+	}
+
+	__set_PRIMASK(primask);
+}
+
+/**
+ * Get the number of finished blocks
+ *
+ * @return Blocks since construction
+ */
+uint32_t ADS7828_LogEncoder::get_block_count()
+{
+	return _blocks_done;
+}
+
+/**
+ * Get the number of encoded records
+ *
+ * @return Records since construction, including the ones in the filled block
+ */
+uint32_t ADS7828_LogEncoder::get_record_count()
+{
+	return _records_done;
+}
+
+/**
+ * Get the number of dropped records
+ *
+ * @return Records lost because both blocks waited for take_block
+ */
+uint32_t ADS7828_LogEncoder::get_dropped_count()
+{
+	return _dropped;
+}
+
+/**
+ * Frame callback for ADS7828_Scanner, logs every completed frame as one record
+ */
+void ADS7828_LogEncoder::on_scan_frame(void *context, const ADS7828_digit_t *results, const ADS7828_CHANNEL *channels, uint8_t n)
+{
+	static_cast<ADS7828_LogEncoder *>(context)->push_frame(results, channels, n);
+}
+
+/**
+ * Encodes a record into the filled block, interrupts have to be disabled
+ *
+ * @return False if the record was dropped
+ */
+bool ADS7828_LogEncoder::encode(const uint16_t *digits)
+{
+	if (_n == 0)
+	{
+		return false;
+	}
+
+	// A record is only started if it fits with the largest codes
+	if (_records > 0 && _bit + _n * LOG_MAX_CODE_BITS > ADS7828_LOG_BLOCK * 8)
+	{
+		finish_block();
+	}
+
+	if (_full[_fill])
+	{
+		_dropped = _dropped + 1;
+		return false;
+	}
+
+	if (_records == 0)
+	{
+		start_block();
+
+		// Keyframe
+		for (uint8_t i = 0; i < _n; i++)
+		{
+			_previous[i] = digits[i] & 0x0FFF;
+			put(_previous[i], 12);
+		}
+	}
+	else
+	{
+		for (uint8_t i = 0; i < _n; i++)
+		{
+			uint16_t digit = digits[i] & 0x0FFF;
+			int32_t delta = (int32_t)digit - _previous[i];
+			uint32_t zigzag = (delta < 0) ? (uint32_t)(-2 * delta - 1) : (uint32_t)(2 * delta);
+
+			if (zigzag == 0)
+			{
+				put(0b0, 1);
+			}
+			else if (zigzag <= 4)
+			{
+				put((0b10 << 2) | (zigzag - 1), 4);
+			}
+			else if (zigzag <= 20)
+			{
+				put((0b110 << 4) | (zigzag - 5), 7);
+			}
+			else if (zigzag <= 148)
+			{
+				put((0b1110 << 7) | (zigzag - 21), 11);
+			}
+			else
+			{
+				put((0b1111 << 12) | digit, 16);
+			}
+
+			_previous[i] = digit;
+		}
+	}
+
+	_records++;
+	_records_done = _records_done + 1;
+	return true;
+}
+
+/**
+ * Clears the filled block and writes the channel list, the header is completed by finish_block
+ */
+void ADS7828_LogEncoder::start_block()
+{
+	uint8_t *block = _blocks[_fill];
+
+	for (size_t i = 0; i < ADS7828_LOG_BLOCK; i++)
+	{
+		block[i] = 0;
+	}
+
+	block[5] = _n;
+
+	for (uint8_t i = 0; i < _n; i++)
+	{
+		block[ADS7828_LOG_HEADER + i / 2] |= (uint8_t)((_channels[i] & 0x0F) << ((i & 1) ? 4 : 0));
+	}
+
+	_bit = (ADS7828_LOG_HEADER + (_n + 1) / 2) * 8;
+}
+
+/**
+ * Writes the header of the filled block and hands it to take_block, interrupts have to be disabled
+ */
+void ADS7828_LogEncoder::finish_block()
+{
+	uint8_t *block = _blocks[_fill];
+
+	for (size_t i = (_bit + 7) / 8; i < ADS7828_LOG_BLOCK; i++)
+	{
+		block[i] = 0xFF;
+	}
+
+	block[0] = ADS7828_LOG_SYNC;
+	block[1] = (uint8_t)_sequence;
+	block[2] = (uint8_t)(_sequence >> 8);
+	block[3] = (uint8_t)_records;
+	block[4] = (uint8_t)(_records >> 8);
+	block[6] = 0;
+
+	uint8_t checksum = 0;
+
+	for (size_t i = 1; i < ADS7828_LOG_BLOCK; i++)
+	{
+		checksum ^= block[i];
+	}
+
+	block[6] = checksum;
+
+	_full[_fill] = true;
+	_fill ^= 1;
+	_records = 0;
+	_sequence++;
+	_blocks_done = _blocks_done + 1;
+}
+
+/**
+ * Appends the lowest bits of a value, MSB first
+ */
+void ADS7828_LogEncoder::put(uint32_t value, uint8_t bits)
+{
+	uint8_t *block = _blocks[_fill];
+
+	while (bits > 0)
+	{
+		uint8_t free = 8 - (_bit & 7);
+		uint8_t take = (bits < free) ? bits : free;
+		uint8_t chunk = (uint8_t)((value >> (bits - take)) & ((1U << take) - 1));
+
+		block[_bit >> 3] |= (uint8_t)(chunk << (free - take));
+		_bit += take;
+		bits -= take;
+	}
+}
+
+/**
+ * Checks a block and prepares reading its records
+ *
+ * @param block Block bytes, e.g. read back from flash
+ * @param size Size of the block, ADS7828_LOG_BLOCK of the encoder
+ * @return HAL_OK, HAL_ERROR for an erased or corrupted block
+ */
+HAL_StatusTypeDef ADS7828_LogDecoder::open(const uint8_t *block, size_t size)
+{
+	_block = nullptr;
+
+	if (size < ADS7828_LOG_HEADER || block[0] != ADS7828_LOG_SYNC)
+	{
+		return HAL_ERROR;
+	}
+
+	uint8_t checksum = 0;
+
+	for (size_t i = 1; i < size; i++)
+	{
+		checksum ^= block[i];
+	}
+
+	// The checksum byte makes the XOR of all bytes after the sync 0
+	if (checksum != 0)
+	{
+		return HAL_ERROR;
+	}
+
+	uint8_t n = block[5];
+
+	if (n == 0 || n > ADS7828_CHANNELS || size < ADS7828_LOG_HEADER + (n + 1) / 2)
+	{
+		return HAL_ERROR;
+	}
+
+	for (uint8_t i = 0; i < n; i++)
+	{
+		_channels[i] = (ADS7828_CHANNEL)((block[ADS7828_LOG_HEADER + i / 2] >> ((i & 1) ? 4 : 0)) & 0x0F);
+	}
+
+	_block = block;
+	_size_bits = size * 8;
+	_bit = (ADS7828_LOG_HEADER + (n + 1) / 2) * 8;
+	_sequence = (uint16_t)(block[1] | (block[2] << 8));
+	_records = (uint16_t)(block[3] | (block[4] << 8));
+	_index = 0;
+	_n = n;
+
+	return HAL_OK;
+}
+
+/**
+ * Decodes the next record of the opened block
+ *
+ * @param digits Receives one digit per channel, in the order of get_channels
+ * @return False after the last record or if the block is truncated
+ */
+bool ADS7828_LogDecoder::next(uint16_t *digits)
+{
+	if (_block == nullptr || _index >= _records)
+	{
+		return false;
+	}
+
+	for (uint8_t i = 0; i < _n; i++)
+	{
+		if (_index == 0)
+		{
+			_previous[i] = (uint16_t)get(12);
+		}
+		else if (get(1) == 0)
+		{
+			// No change
+		}
+		else
+		{
+			uint32_t zigzag;
+
+			if (get(1) == 0)
+			{
+				zigzag = get(2) + 1;
+			}
+			else if (get(1) == 0)
+			{
+				zigzag = get(4) + 5;
+			}
+			else if (get(1) == 0)
+			{
+				zigzag = get(7) + 21;
+			}
+			else
+			{
+				zigzag = 0;
+				_previous[i] = (uint16_t)get(12);
+			}
+
+			if (zigzag != 0)
+			{
+				int32_t delta = (zigzag & 1) ? -(int32_t)((zigzag + 1) / 2) : (int32_t)(zigzag / 2);
+				_previous[i] = (uint16_t)((_previous[i] + delta) & 0x0FFF);
+			}
+		}
+
+		if (_bit > _size_bits)
+		{
+			_block = nullptr;
+			return false;
+		}
+
+		digits[i] = _previous[i];
+	}
+
+	_index++;
+	return true;
+}
+
+/**
+ * Get the sequence number of the opened block, consecutive blocks of an encoder count up
+ *
+ * @return Sequence number, wraps after 65535
+ */
+uint16_t ADS7828_LogDecoder::get_sequence()
+{
+	return _sequence;
+}
+
+/**
+ * Get the number of records of the opened block
+ *
+ * @return Records, 0 if no block is open
+ */
+uint16_t ADS7828_LogDecoder::get_record_count()
+{
+	return (_block != nullptr) ? _records : 0;
+}
+
+/**
+ * Get the channel list of the opened block
+ *
+ * @param channels Receives up to 16 ADS7828_CHANNEL configurations
+ * @return Number of channels of every record
+ */
+uint8_t ADS7828_LogDecoder::get_channels(ADS7828_CHANNEL *channels)
+{
+	for (uint8_t i = 0; i < _n; i++)
+	{
+		channels[i] = _channels[i];
+	}
+
+	return _n;
+}
+
+/**
+ * Reads the next bits, MSB first. Reads past the end return 1 bits like erased flash
+ */
+uint32_t ADS7828_LogDecoder::get(uint8_t bits)
+{
+	uint32_t value = 0;
+
+	for (uint8_t b = 0; b < bits; b++)
+	{
+		uint32_t bit = (_bit < _size_bits) ? ((_block[_bit >> 3] >> (7 - (_bit & 7))) & 1) : 1;
+		value = (value << 1) | bit;
+		_bit++;
+	}
+
+	return value;
+}
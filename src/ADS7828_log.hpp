@@ -0,0 +1,101 @@
+// Compressed sample log for flash storage: delta-encoded records in self-contained blocks
+#ifndef ADS7828_LOG_HPP
+#define ADS7828_LOG_HPP
+
+#include "ADS7828.hpp"
+
+// Bytes per block, e.g. one SPI flash page. Every block starts with a keyframe and decodes on its own
+#ifndef ADS7828_LOG_BLOCK
+#define ADS7828_LOG_BLOCK 256
+#endif
+
+static_assert(ADS7828_LOG_BLOCK >= 64 && ADS7828_LOG_BLOCK <= 8192, "Log blocks have to hold at least one record of 16 channels");
+
+// First byte of every block
+constexpr uint8_t ADS7828_LOG_SYNC = 0x5A;
+// Header: sync, sequence number (2 bytes), record count (2 bytes), channel count, XOR checksum of the block, then 4 Bit channels
+constexpr size_t ADS7828_LOG_HEADER = 7;
+
+/**
+ * Encodes records of a channel list into blocks of ADS7828_LOG_BLOCK bytes.
+ * The first record of a block stores the 12 Bit digits, all others the difference to the previous digit of the channel,
+ * MSB first with the codes
+ *
+ *   0                 no change
+ *   10   + 2 Bit      +-1, +-2
+ *   110  + 4 Bit      +-3 ... +-10
+ *   1110 + 7 Bit      +-11 ... +-74
+ *   1111 + 12 Bit     digit
+ *
+ * The differences are zigzag coded (0, -1, 1, -2, 2, ...). Unused bytes at the end of a block stay 0xFF like erased flash.
+ * Records are pushed from the interrupt, finished blocks are taken in the main loop, e.g. to write them to flash.
+ */
+class ADS7828_LogEncoder
+{
+public:
+	ADS7828_LogEncoder();
+
+	HAL_StatusTypeDef set_channels(const ADS7828_CHANNEL *channels, uint8_t n);
+	bool push(const uint16_t *digits);
+	bool push_frame(const ADS7828_digit_t *results, const ADS7828_CHANNEL *channels, uint8_t n);
+	void flush();
+
+	const uint8_t *take_block();
+	void release_block();
+
+	uint32_t get_block_count();
+	uint32_t get_record_count();
+	uint32_t get_dropped_count();
+
+	// Frame callback for ADS7828_Scanner, the context has to point to the encoder
+	static void on_scan_frame(void *context, const ADS7828_digit_t *results, const ADS7828_CHANNEL *channels, uint8_t n);
+
+private:
+	bool encode(const uint16_t *digits);
+	void start_block();
+	void finish_block();
+	void put(uint32_t value, uint8_t bits);
+
+	ADS7828_CHANNEL _channels[ADS7828_CHANNELS]; // Channel list of the records
+	uint8_t _n = 0;								 // Number of channels in the list
+	uint16_t _previous[ADS7828_CHANNELS] = {0};	 // Last digit of every list entry in the running block
+
+	uint8_t _blocks[2][ADS7828_LOG_BLOCK];	 // One block is filled while the other one waits to be written
+	volatile bool _full[2] = {false, false}; // Block is finished and not released yet
+	uint8_t _fill = 0;						 // Index of the block being filled
+	volatile uint8_t _take = 0;				 // Index of the oldest finished block
+	uint32_t _bit = 0;						 // Write position in the filled block in bits
+	uint16_t _records = 0;					 // Records in the filled block
+	uint16_t _sequence = 0;					 // Sequence number of the next block
+
+	volatile uint32_t _blocks_done = 0; // Finished blocks
+	volatile uint32_t _records_done = 0; // Encoded records
+	volatile uint32_t _dropped = 0;		 // Records lost because both blocks were waiting
+};
+
+// Reads the records of one block
+class ADS7828_LogDecoder
+{
+public:
+	HAL_StatusTypeDef open(const uint8_t *block, size_t size = ADS7828_LOG_BLOCK);
+	bool next(uint16_t *digits);
+
+	uint16_t get_sequence();
+	uint16_t get_record_count();
+	uint8_t get_channels(ADS7828_CHANNEL *channels);
+
+private:
+	uint32_t get(uint8_t bits);
+
+	const uint8_t *_block = nullptr;			 // Opened block
+	uint32_t _size_bits = 0;					 // Size of the block in bits
+	uint32_t _bit = 0;							 // Read position in bits
+	uint16_t _records = 0;						 // Records in the block
+	uint16_t _index = 0;						 // Next record
+	uint16_t _sequence = 0;						 // Sequence number of the block
+	uint8_t _n = 0;								 // Number of channels of the records
+	ADS7828_CHANNEL _channels[ADS7828_CHANNELS]; // Channel list of the records
+	uint16_t _previous[ADS7828_CHANNELS] = {0};	 // Last digit of every list entry
+};
+
+#endif // ADS7828_LOG_HPP
@@ -0,0 +1,231 @@
+#include "ADS7828_lowpower.hpp"
+
+/**
+ * Constructor for periodic acquisition with sleep phases.
+ * Takes the current power mode of the driver as the mode of the scans.
+ *
+ * @param adc Pointer to the ADS7828 used for the reads, its HAL I2C callbacks have to be forwarded
+ */
+ADS7828_LowPower::ADS7828_LowPower(ADS7828 *adc) : _adc(adc)
+{
+	_active_mode = adc->get_power_mode();
+}
+
+/**
+ * Set the time between the starts of two scans of acquire
+ *
+ * @param interval_ms Scan interval in [ms]
+ * @return HAL_OK, HAL_ERROR for an interval of 0
+ */
+HAL_StatusTypeDef ADS7828_LowPower::set_interval(uint32_t interval_ms)
+{
+	if (interval_ms == 0)
+	{
+		return HAL_ERROR;
+	}
+
+	_interval_ms = interval_ms;
+	return HAL_OK;
+}
+
+/**
+ * Enable or disable the POWER_DOWN command after every scan of acquire (enabled by default).
+ * With the internal reference the next scan waits in sleep until the reference has settled again.
+ *
+ * @param enable True to power the ADS7828 down between the scans
+ */
+void ADS7828_LowPower::set_power_down(bool enable)
+{
+	_power_down = enable;
+}
+
+/**
+ * Enter the STOP mode instead of sleeping for waits of at least min_ms.
+ * The HAL tick does not run in STOP mode, so the wake-up source armed by the callback defines the schedule.
+ * Any other wake-up interrupt starts the next scan early.
+ *
+ * @param arm Function that arms a wake-up source after the given time, nullptr to disable the STOP mode
+ * @param resume Function that restores the system clock after the wake-up, e.g. calls SystemClock_Config
+ * @param context User pointer that is passed to both functions
+ * @param min_ms Shorter waits only sleep with __WFI
+ */
+void ADS7828_LowPower::set_stop_mode(ADS7828_wakeup_callback_t arm, ADS7828_resume_callback_t resume, void *context, uint32_t min_ms)
+{
+	_arm = arm;
+	_resume = resume;
+	_stop_context = context;
+	_stop_min_ms = min_ms;
+}
+
+/**
+ * Reads a list of channels with DMA and sleeps with __WFI until the batch has completed.
+ * The I2C interrupts wake the MCU, the CPU only runs for the DMA setup of every channel.
+ *
+ * @param channels List of ADS7828_CHANNEL configurations to read
+ * @param n Number of channels in the list (1 - 16)
+ * @param out Receives the raw digit of every channel
+ * @return Status of the batch, HAL_BUSY if the driver is busy with another async read
+ */
+HAL_StatusTypeDef ADS7828_LowPower::read_channels(const ADS7828_CHANNEL *channels, size_t n, uint16_t *out)
+{
+	_done = false;
+
+	HAL_StatusTypeDef status = _adc->start_read_channels_dma(channels, n, out, on_batch, this);
+
+	if (status != HAL_OK)
+	{
+		return status;
+	}
+
+	// A completion between the check and __WFI stays pending and ends the sleep right away
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	while (!_done)
+	{
+		sleep();
+		__set_PRIMASK(primask);
+		__disable_irq();
+	}
+
+	__set_PRIMASK(primask);
+
+	return _status;
+}
+
+/**
+ * Waits for the next scan interval, reads the channels and powers the ADS7828 down again.
+ * The first call scans right away. Call it from the main loop, the MCU sleeps (or stops) during all waits:
+ *
+ *   while (1) { lp.acquire(channels, n, out); process(out); }
+ *
+ * Sends single command bytes to switch the power mode, which disables the automatic power policy of the driver.
+ *
+ * @param channels List of ADS7828_CHANNEL configurations to read
+ * @param n Number of channels in the list (1 - 16)
+ * @param out Receives the raw digit of every channel
+ * @return Status of the batch
+ */
+HAL_StatusTypeDef ADS7828_LowPower::acquire(const ADS7828_CHANNEL *channels, size_t n, uint16_t *out)
+{
+	if (_started)
+	{
+		sleep_until(_next_tick);
+	}
+	else
+	{
+		_next_tick = HAL_GetTick();
+		_started = true;
+	}
+
+	// Keep the phase of the schedule, unless a whole interval was missed
+	_next_tick += _interval_ms;
+
+	if ((int32_t)(HAL_GetTick() - _next_tick) >= 0)
+	{
+		_next_tick = HAL_GetTick() + _interval_ms;
+	}
+
+	if (_power_down && _active_mode != POWER_DOWN)
+	{
+		_adc->set_power_mode(_active_mode, true);
+
+		while (!_adc->is_ref_settled())
+		{
+			sleep();
+		}
+	}
+
+	HAL_StatusTypeDef status = read_channels(channels, n, out);
+
+	if (_power_down && _active_mode != POWER_DOWN)
+	{
+		_adc->set_power_mode(POWER_DOWN, true);
+	}
+
+	return status;
+}
+
+/**
+ * Get the number of __WFI sleeps, every interrupt ends one
+ *
+ * @return Sleeps since construction
+ */
+uint32_t ADS7828_LowPower::get_sleep_count()
+{
+	return _sleeps;
+}
+
+/**
+ * Get the number of STOP mode entries
+ *
+ * @return STOP phases since construction
+ */
+uint32_t ADS7828_LowPower::get_stop_count()
+{
+	return _stops;
+}
+
+/**
+ * Batch callback, called from the I2C interrupt once all channels are read
+ */
+void ADS7828_LowPower::on_batch(void *context, HAL_StatusTypeDef status, uint16_t *out, size_t count)
+{
+	(void)out;
+	(void)count;
+
+	ADS7828_LowPower *self = (ADS7828_LowPower *)context;
+	self->_status = status;
+	self->_done = true;
+}
+
+/**
+ * Sleeps until the next interrupt (SysTick, I2C or DMA)
+ */
+void ADS7828_LowPower::sleep()
+{
+	_sleeps++;
+	__WFI();
+}
+
+/**
+ * Sleeps until the HAL tick reaches the given value, or enters the STOP mode for long waits
+ *
+ * @param tick HAL tick to wait for
+ */
+void ADS7828_LowPower::sleep_until(uint32_t tick)
+{
+	int32_t remaining = (int32_t)(tick - HAL_GetTick());
+
+	if (remaining <= 0)
+	{
+		return;
+	}
+
+#if defined(HAL_PWR_MODULE_ENABLED) && !defined(ADS7828_HOST)
+	if (_arm != nullptr && (uint32_t)remaining >= _stop_min_ms)
+	{
+		_arm(_stop_context, remaining);
+		_stops++;
+
+		HAL_SuspendTick();
+		HAL_PWR_EnterSTOPMode(PWR_LOWPOWERREGULATOR_ON, PWR_STOPENTRY_WFI);
+
+		if (_resume != nullptr)
+		{
+			_resume(_stop_context);
+		}
+
+		HAL_ResumeTick();
+
+		// The tick stood still, the wake-up marks the scheduled time
+		_next_tick = HAL_GetTick();
+		return;
+	}
+#endif
+
+	while ((int32_t)(tick - HAL_GetTick()) > 0)
+	{
+		sleep();
+	}
+}
@@ -0,0 +1,54 @@
+// Periodic acquisition for battery powered nodes, the MCU sleeps while the DMA reads run and between the scans
+#ifndef ADS7828_LOWPOWER_HPP
+#define ADS7828_LOWPOWER_HPP
+
+#include "ADS7828.hpp"
+
+// Arms a wake-up source (e.g. the RTC wake-up timer) that ends the STOP mode after sleep_ms
+typedef void (*ADS7828_wakeup_callback_t)(void *context, uint32_t sleep_ms);
+
+// Called after the STOP mode, has to restore the system clock (e.g. SystemClock_Config)
+typedef void (*ADS7828_resume_callback_t)(void *context);
+
+class ADS7828_LowPower
+{
+public:
+	ADS7828_LowPower(ADS7828 *adc);
+
+	HAL_StatusTypeDef set_interval(uint32_t interval_ms);
+	void set_power_down(bool enable);
+	void set_stop_mode(ADS7828_wakeup_callback_t arm, ADS7828_resume_callback_t resume, void *context = nullptr, uint32_t min_ms = 10);
+
+	HAL_StatusTypeDef read_channels(const ADS7828_CHANNEL *channels, size_t n, uint16_t *out);
+	HAL_StatusTypeDef acquire(const ADS7828_CHANNEL *channels, size_t n, uint16_t *out);
+
+	uint32_t get_sleep_count();
+	uint32_t get_stop_count();
+
+private:
+	static void on_batch(void *context, HAL_StatusTypeDef status, uint16_t *out, size_t count);
+	void sleep();
+	void sleep_until(uint32_t tick);
+
+	ADS7828 *_adc; // Driver used for the reads, its HAL I2C callbacks have to be forwarded
+
+	uint32_t _interval_ms = 1000; // Time between the starts of two scans
+	uint32_t _next_tick = 0;	  // HAL tick of the next scan
+	bool _started = false;		  // The first scan of acquire has run, the following ones wait for _next_tick
+
+	bool _power_down = true;					 // Power the ADS7828 down between the scans
+	ADS7828_PD_MODE _active_mode = REF_ON_AD_ON; // Mode restored for the scans if _power_down is set
+
+	ADS7828_wakeup_callback_t _arm = nullptr;		// Arms the wake-up source for the STOP mode, nullptr to only sleep
+	ADS7828_resume_callback_t _resume = nullptr;	// Restores the clocks after the STOP mode
+	void *_stop_context = nullptr;					// User context passed to both
+	uint32_t _stop_min_ms = 10;						// Shorter waits sleep instead of entering STOP
+
+	volatile bool _done = false;					// The running batch has completed
+	volatile HAL_StatusTypeDef _status = HAL_OK; // Result of the running batch
+
+	uint32_t _sleeps = 0; // Number of __WFI sleeps
+	uint32_t _stops = 0;  // Number of STOP mode entries
+};
+
+#endif // ADS7828_LOWPOWER_HPP
@@ -0,0 +1,51 @@
+// Compile-time generated conversion tables for channels with a fixed reference and scaling
+#ifndef ADS7828_LUT_HPP
+#define ADS7828_LUT_HPP
+
+#include "ADS7828.hpp"
+
+/**
+ * Generates the table of a linear conversion, the same as digit_to_voltage calculates without calibration
+ *
+ *   static constexpr ADS7828_lut_t divider = ADS7828_linear_lut(2.5f, 11.0f);
+ *
+ * @param ref_voltage Reference voltage [V]
+ * @param scaling Factor multiplied with the voltage, e.g. of a voltage divider
+ * @param offset Added after the scaling, in the unit of the result
+ * @return Table with one entry per digit
+ */
+constexpr ADS7828_lut_t ADS7828_linear_lut(float ref_voltage, float scaling, float offset = 0)
+{
+	ADS7828_lut_t lut = {};
+
+	for (uint16_t digit = 0; digit < ADS7828_LUT_SIZE; digit++)
+	{
+		lut.values[digit] = (float)(digit / 4095.0 * ref_voltage * scaling) + offset;
+	}
+
+	return lut;
+}
+
+/**
+ * Generates the table of any constexpr conversion of the digit, e.g. a sensor curve in engineering units
+ *
+ *   constexpr float to_pressure(uint16_t digit) { return (digit - 410) * 0.0305f; }
+ *   static constexpr ADS7828_lut_t pressure = ADS7828_make_lut<to_pressure>();
+ *
+ * @tparam Convert constexpr function from the digit (0 - 4095) to the result
+ * @return Table with one entry per digit
+ */
+template <float (*Convert)(uint16_t)>
+constexpr ADS7828_lut_t ADS7828_make_lut()
+{
+	ADS7828_lut_t lut = {};
+
+	for (uint16_t digit = 0; digit < ADS7828_LUT_SIZE; digit++)
+	{
+		lut.values[digit] = Convert(digit);
+	}
+
+	return lut;
+}
+
+#endif // ADS7828_LUT_HPP
@@ -0,0 +1,339 @@
+#include "ADS7828_multi.hpp"
+
+/**
+ * Constructor for a coordinator that scans ADS7828 on several I2C buses at the same time
+ */
+ADS7828_MultiBus::ADS7828_MultiBus()
+{
+}
+
+/**
+ * Adds the scanner of one bus. Its frame callback is used by the coordinator, each bus needs its own I2C peripheral.
+ * Several devices on one bus are read with separate scanners one after the other, see ADS7828_Bus.
+ *
+ * @param scanner Scanner of an ADS7828 whose HAL I2C callbacks are forwarded
+ * @param channels List of ADS7828_CHANNEL configurations to read on this bus
+ * @param n Number of channels in the list (1 - 16)
+ * @return HAL_OK if the bus was added, HAL_BUSY while running, HAL_ERROR for an invalid list, a shared I2C handle or too many buses
+ */
+HAL_StatusTypeDef ADS7828_MultiBus::attach(ADS7828_Scanner *scanner, const ADS7828_CHANNEL *channels, uint8_t n)
+{
+	if (_running)
+	{
+		return HAL_BUSY;
+	}
+
+	if (_buses >= ADS7828_MULTI_BUSES || n == 0 || n > ADS7828_CHANNELS)
+	{
+		return HAL_ERROR;
+	}
+
+	for (uint8_t b = 0; b < _buses; b++)
+	{
+		if (_scanners[b]->get_adc()->get_handle() == scanner->get_adc()->get_handle())
+		{
+			return HAL_ERROR;
+		}
+	}
+
+	for (uint8_t i = 0; i < n; i++)
+	{
+		_channels[_buses][i] = channels[i];
+	}
+
+	_scanners[_buses] = scanner;
+	_n[_buses] = n;
+	_links[_buses] = {this, _buses};
+	_buses++;
+
+	return HAL_OK;
+}
+
+/**
+ * Starts scanning all buses. Every frame is started on all buses at the same moment, each bus reads its whole list
+ * as one chained DMA batch, and the merged frame is published when the last bus has finished.
+ * The frame rate is set by the slowest bus, the throughput grows with the number of buses.
+ *
+ * @param tick_hz 0 to start the next frame as soon as all buses are done,
+ *                otherwise the rate [Hz] at which tick() is called from a timer to start the frames
+ * @return HAL_OK if all buses were started, HAL_BUSY if already running, HAL_ERROR if no bus is attached,
+ *         other status of the first scanner that did not start
+ */
+HAL_StatusTypeDef ADS7828_MultiBus::start(uint32_t tick_hz)
+{
+	if (_running)
+	{
+		return HAL_BUSY;
+	}
+
+	if (_buses == 0)
+	{
+		return HAL_ERROR;
+	}
+
+	// Every entry is read on every tick, in free-running mode the tick is given by the last bus
+	uint32_t rate_hz = (tick_hz == 0) ? 1 : tick_hz;
+	uint32_t rates[ADS7828_CHANNELS];
+
+	for (uint8_t i = 0; i < ADS7828_CHANNELS; i++)
+	{
+		rates[i] = rate_hz;
+	}
+
+	for (uint8_t b = 0; b < _buses; b++)
+	{
+		_scanners[b]->set_frame_callback(on_frame, &_links[b]);
+		HAL_StatusTypeDef status = _scanners[b]->start_scheduled(_channels[b], rates, _n[b], rate_hz);
+
+		if (status != HAL_OK)
+		{
+			for (uint8_t s = 0; s < b; s++)
+			{
+				_scanners[s]->stop();
+			}
+			return status;
+		}
+	}
+
+	_pending = 0;
+	_frame_id = 0;
+	_missed = 0;
+
+	for (uint8_t b = 0; b < _buses; b++)
+	{
+		_batch_frame[b] = 0;
+	}
+	_free_running = (tick_hz == 0);
+	_running = true;
+
+	if (_free_running)
+	{
+		trigger();
+	}
+
+	return HAL_OK;
+}
+
+/**
+ * Starts the next frame on all buses, call it from a timer interrupt with the tick_hz of start.
+ * A frame that is not finished on all buses by then is dropped and counted in get_missed_count,
+ * the late results of its buses are discarded and never published in a later frame.
+ */
+void ADS7828_MultiBus::tick()
+{
+	if (!_running || _free_running)
+	{
+		return;
+	}
+
+	trigger();
+}
+
+/**
+ * Stops the scan on all buses, the running reads are finished but their results are discarded
+ */
+void ADS7828_MultiBus::stop()
+{
+	_running = false;
+
+	for (uint8_t b = 0; b < _buses; b++)
+	{
+		_scanners[b]->stop();
+	}
+}
+
+/**
+ * Check if the scan is active
+ *
+ * @return True while the buses are scanned
+ */
+bool ADS7828_MultiBus::is_running()
+{
+	return _running;
+}
+
+/**
+ * Get the last merged frame, one table per bus in the order of attach.
+ * The tables stay valid until the next frame completes, check get_frame_count for slow consumers.
+ *
+ * @return Pointer to the tables, results[bus][ADS7828_CHANNEL] is a digit
+ */
+const ADS7828_digit_t (*ADS7828_MultiBus::get_results())[ADS7828_CHANNELS]
+{
+	return _results[_front];
+}
+
+/**
+ * Get the digit of a channel from the last merged frame
+ *
+ * @param bus Index of the bus in the order of attach
+ * @param channel The ADS7828_CHANNEL configuration you want the digit from
+ * @return Digit of the channel, 0 if it is not part of the list of the bus
+ */
+ADS7828_digit_t ADS7828_MultiBus::get_digit(uint8_t bus, ADS7828_CHANNEL channel)
+{
+	return (bus < _buses) ? _results[_front][bus][channel] : 0;
+}
+
+#ifndef ADS7828_INTEGER_ONLY
+/**
+ * Get the voltage of a channel from the last merged frame, see ADS7828::read_voltage
+ *
+ * @param bus Index of the bus in the order of attach
+ * @param channel The ADS7828_CHANNEL configuration you want the voltage from
+ * @return Voltage [V] of the channel
+ */
+float ADS7828_MultiBus::get_voltage(uint8_t bus, ADS7828_CHANNEL channel)
+{
+	return (bus < _buses) ? _scanners[bus]->get_adc()->digit_to_voltage(channel, get_digit(bus, channel)) : 0;
+}
+#endif
+
+/**
+ * Get the number of merged frames, every frame contains one read of every channel of every bus
+ *
+ * @return Number of merged frames since construction
+ */
+uint32_t ADS7828_MultiBus::get_frame_count()
+{
+	return _frames;
+}
+
+/**
+ * Get the number of frames that were dropped because a bus was not finished at the next tick
+ *
+ * @return Number of dropped frames since start
+ */
+uint32_t ADS7828_MultiBus::get_missed_count()
+{
+	return _missed;
+}
+
+/**
+ * Get the time between the first and the last bus finishing the last merged frame, a measure of the alignment
+ *
+ * @return DWT cycles, requires ADS7828::enable_cycle_counter
+ */
+uint32_t ADS7828_MultiBus::get_skew_cycles()
+{
+	return _skew_cycles;
+}
+
+/**
+ * Set a function that is called for every merged frame, from the I2C interrupt of the bus that finished last.
+ * In free-running mode the next frame is already running when it is called, so keep it short.
+ *
+ * @param callback Function that receives the tables of all buses, nullptr to disable
+ * @param context User pointer that is passed to the callback
+ */
+void ADS7828_MultiBus::set_frame_callback(ADS7828_multi_callback_t callback, void *context)
+{
+	_frame_callback = callback;
+	_frame_context = context;
+}
+
+/**
+ * Starts a frame on all buses back to back, so they run in parallel.
+ * A bus that did not finish the last frame keeps the tag of its batch, so its late completion is discarded.
+ */
+void ADS7828_MultiBus::trigger()
+{
+	uint8_t all = (uint8_t)((1U << _buses) - 1);
+
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	if (_pending != 0)
+	{
+		_missed = _missed + 1;
+	}
+
+	_frame_id = _frame_id + 1;
+
+	for (uint8_t b = 0; b < _buses; b++)
+	{
+		// Buses still busy start the batch of this frame after the late completion, see on_frame
+		if (!(_pending & (1U << b)))
+		{
+			_batch_frame[b] = _frame_id;
+		}
+	}
+
+	_pending = all;
+	__set_PRIMASK(primask);
+
+	for (uint8_t b = 0; b < _buses; b++)
+	{
+		_scanners[b]->tick();
+	}
+}
+
+/**
+ * Frame callback of the scanners, copies the results of one bus and publishes the merged frame after the last bus
+ */
+void ADS7828_MultiBus::on_frame(void *context, const ADS7828_digit_t *results, const ADS7828_CHANNEL *channels, uint8_t n)
+{
+	link_t *link = static_cast<link_t *>(context);
+	ADS7828_MultiBus *multi = link->owner;
+
+	if (!multi->_running)
+	{
+		return;
+	}
+
+	// Every bus writes its own row, so the buses do not have to wait for each other
+	ADS7828_digit_t *row = multi->_results[multi->_front ^ 1][link->bus];
+
+	for (uint8_t i = 0; i < n; i++)
+	{
+		row[channels[i]] = results[channels[i]];
+	}
+
+	uint8_t bit = (uint8_t)(1U << link->bus);
+	uint8_t all = (uint8_t)((1U << multi->_buses) - 1);
+	bool completed = false;
+
+	// The buses finish in their own interrupts, which may preempt each other
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	// A batch of a dropped frame, its row is rewritten by the batch of the running frame the scanner starts next
+	if (multi->_batch_frame[link->bus] != multi->_frame_id)
+	{
+		multi->_batch_frame[link->bus] = multi->_frame_id;
+	}
+	else if (multi->_pending & bit)
+	{
+		if (multi->_pending == all)
+		{
+			multi->_first_cycles = ADS7828::get_cycles();
+		}
+
+		multi->_pending = multi->_pending & ~bit;
+
+		if (multi->_pending == 0)
+		{
+			multi->_skew_cycles = ADS7828::get_cycles() - multi->_first_cycles;
+			multi->_front = multi->_front ^ 1;
+			multi->_frames = multi->_frames + 1;
+			completed = true;
+		}
+	}
+
+	__set_PRIMASK(primask);
+
+	if (!completed)
+	{
+		return;
+	}
+
+	if (multi->_free_running)
+	{
+		multi->trigger();
+	}
+
+	if (multi->_frame_callback != nullptr)
+	{
+		multi->_frame_callback(multi->_frame_context, multi->_results[multi->_front], multi->_buses);
+	}
+}
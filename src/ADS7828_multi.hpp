@@ -0,0 +1,68 @@
+// Parallel scanning of ADS7828 on separate I2C peripherals with merged, time-aligned frames
+#ifndef ADS7828_MULTI_HPP
+#define ADS7828_MULTI_HPP
+
+#include "ADS7828_scan.hpp"
+
+// Maximum number of I2C buses, e.g. I2C1 - I2C4
+constexpr uint8_t ADS7828_MULTI_BUSES = 4;
+
+// Called from the I2C interrupt of the bus that finished last, results[bus] is indexed by ADS7828_CHANNEL
+typedef void (*ADS7828_multi_callback_t)(void *context, const ADS7828_digit_t (*results)[ADS7828_CHANNELS], uint8_t buses);
+
+class ADS7828_MultiBus
+{
+public:
+	ADS7828_MultiBus();
+
+	HAL_StatusTypeDef attach(ADS7828_Scanner *scanner, const ADS7828_CHANNEL *channels, uint8_t n);
+	HAL_StatusTypeDef start(uint32_t tick_hz = 0);
+	void tick();
+	void stop();
+	bool is_running();
+
+	const ADS7828_digit_t (*get_results())[ADS7828_CHANNELS];
+	ADS7828_digit_t get_digit(uint8_t bus, ADS7828_CHANNEL channel);
+#ifndef ADS7828_INTEGER_ONLY
+	float get_voltage(uint8_t bus, ADS7828_CHANNEL channel);
+#endif
+	uint32_t get_frame_count();
+	uint32_t get_missed_count();
+	uint32_t get_skew_cycles();
+
+	void set_frame_callback(ADS7828_multi_callback_t callback, void *context = nullptr);
+
+private:
+	// Identifies the bus in the frame callback of its scanner
+	struct link_t
+	{
+		ADS7828_MultiBus *owner;
+		uint8_t bus;
+	};
+
+	static void on_frame(void *context, const ADS7828_digit_t *results, const ADS7828_CHANNEL *channels, uint8_t n);
+	void trigger();
+
+	ADS7828_Scanner *_scanners[ADS7828_MULTI_BUSES] = {}; // Scanner of every bus
+	ADS7828_CHANNEL _channels[ADS7828_MULTI_BUSES][ADS7828_CHANNELS]; // Channel list of every bus
+	uint8_t _n[ADS7828_MULTI_BUSES] = {0};				  // Number of channels of every bus
+	link_t _links[ADS7828_MULTI_BUSES];					  // Callback contexts of the scanners
+	uint8_t _buses = 0;									  // Number of attached buses
+
+	ADS7828_digit_t _results[2][ADS7828_MULTI_BUSES][ADS7828_CHANNELS] = {}; // Double-buffered merged frames
+	volatile uint8_t _front = 0;						  // Table holding the last merged frame
+	volatile uint8_t _pending = 0;						  // Buses that did not finish the running frame, bit per bus
+	volatile uint32_t _frame_id = 0;					  // Number of the running frame, counted by trigger
+	uint32_t _batch_frame[ADS7828_MULTI_BUSES] = {0};	  // Frame of the batch in flight on every bus
+	volatile uint32_t _frames = 0;						  // Number of merged frames
+	volatile uint32_t _missed = 0;						  // Frames dropped because a bus was not finished in time
+	uint32_t _first_cycles = 0;							  // DWT cycle count when the first bus finished
+	volatile uint32_t _skew_cycles = 0;					  // Cycles between the first and the last bus of the last frame
+	bool _free_running = false;							  // The next frame is triggered by the last bus
+	volatile bool _running = false;						  // Scanning is active
+
+	ADS7828_multi_callback_t _frame_callback = nullptr; // Called for every merged frame
+	void *_frame_context = nullptr;						// User context passed to the frame callback
+};
+
+#endif // ADS7828_MULTI_HPP
@@ -0,0 +1,190 @@
+#include "ADS7828_rtos.hpp"
+
+#ifdef ADS7828_RTOS
+
+/**
+ * Constructor for the FreeRTOS backend of an ADS7828
+ *
+ * @param adc Pointer to the ADS7828, only the driver task may access it after start
+ */
+ADS7828_Rtos::ADS7828_Rtos(ADS7828 *adc) : _adc(adc)
+{
+}
+
+/**
+ * Creates the request queue and the driver task
+ *
+ * @param priority FreeRTOS priority of the driver task
+ * @param stack_depth Stack size of the driver task in words
+ * @return HAL_OK if the task is running, HAL_ERROR if the FreeRTOS heap is exhausted
+ */
+HAL_StatusTypeDef ADS7828_Rtos::start(UBaseType_t priority, configSTACK_DEPTH_TYPE stack_depth)
+{
+	if (_task != nullptr)
+	{
+		return HAL_BUSY;
+	}
+
+	_queue = xQueueCreate(ADS7828_RTOS_QUEUE, sizeof(ADS7828_rtos_request_t));
+
+	if (_queue == nullptr)
+	{
+		return HAL_ERROR;
+	}
+
+	if (xTaskCreate(task, "ADS7828", stack_depth, this, priority, &_task) != pdPASS)
+	{
+		vQueueDelete(_queue);
+		_queue = nullptr;
+		return HAL_ERROR;
+	}
+
+	return HAL_OK;
+}
+
+/**
+ * Set the maximum time the driver task waits for a transfer before it is aborted
+ *
+ * @param timeout Timeout in ticks
+ */
+void ADS7828_Rtos::set_timeout(TickType_t timeout)
+{
+	_timeout = timeout;
+}
+
+/**
+ * Reads the digit of a channel configuration, see ADS7828::read_digit.
+ * The calling task is blocked until the driver task has finished the transfer, other tasks keep running.
+ * Uses the task notification of the calling task!
+ *
+ * @param channel The ADS7828_CHANNEL configuration you want the digit from
+ * @param digit Receives the digit
+ * @param queue_timeout Maximum time to wait for a free slot in the request queue
+ * @return HAL_OK on success, HAL_BUSY if the queue stayed full, HAL_TIMEOUT or HAL_ERROR from the transfer
+ */
+HAL_StatusTypeDef ADS7828_Rtos::read_digit(ADS7828_CHANNEL channel, ADS7828_digit_t &digit, TickType_t queue_timeout)
+{
+	HAL_StatusTypeDef status = HAL_ERROR;
+	ADS7828_rtos_request_t request = {channel, xTaskGetCurrentTaskHandle(), &digit, &status};
+
+	if (xQueueSend(_queue, &request, queue_timeout) != pdPASS)
+	{
+		return HAL_BUSY;
+	}
+
+	// The driver task always answers, its own timeout bounds the waiting time
+	ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+	return status;
+}
+
+#ifndef ADS7828_INTEGER_ONLY
+/**
+ * Reads the voltage of a channel configuration, see ADS7828::read_voltage and read_digit
+ *
+ * @param channel The ADS7828_CHANNEL configuration you want the voltage from
+ * @param voltage Receives the voltage [V]
+ * @param queue_timeout Maximum time to wait for a free slot in the request queue
+ * @return HAL_OK on success, HAL_BUSY if the queue stayed full, HAL_TIMEOUT or HAL_ERROR from the transfer
+ */
+HAL_StatusTypeDef ADS7828_Rtos::read_voltage(ADS7828_CHANNEL channel, float &voltage, TickType_t queue_timeout)
+{
+	ADS7828_digit_t digit = 0;
+	HAL_StatusTypeDef status = read_digit(channel, digit, queue_timeout);
+
+	voltage = _adc->digit_to_voltage(channel, digit);
+	return status;
+}
+#endif
+
+/**
+ * Has to be called from HAL_I2C_MasterTxCpltCallback
+ *
+ * @param hi2c The I2C handle passed to the HAL callback
+ */
+void ADS7828_Rtos::tx_complete_callback(I2C_HandleTypeDef *hi2c)
+{
+	_adc->tx_complete_callback(hi2c);
+}
+
+/**
+ * Has to be called from HAL_I2C_MasterRxCpltCallback
+ *
+ * @param hi2c The I2C handle passed to the HAL callback
+ */
+void ADS7828_Rtos::rx_complete_callback(I2C_HandleTypeDef *hi2c)
+{
+	_adc->rx_complete_callback(hi2c);
+}
+
+/**
+ * Has to be called from HAL_I2C_ErrorCallback
+ *
+ * @param hi2c The I2C handle passed to the HAL callback
+ */
+void ADS7828_Rtos::error_callback(I2C_HandleTypeDef *hi2c)
+{
+	_adc->error_callback(hi2c);
+}
+
+/**
+ * Driver task, serves the queued requests one after another
+ */
+void ADS7828_Rtos::task(void *argument)
+{
+	ADS7828_Rtos *rtos = static_cast<ADS7828_Rtos *>(argument);
+	ADS7828_rtos_request_t request;
+
+	while (1)
+	{
+		if (xQueueReceive(rtos->_queue, &request, portMAX_DELAY) == pdPASS)
+		{
+			rtos->serve(request);
+		}
+	}
+}
+
+/**
+ * Runs one request with a DMA read and sleeps until the I2C interrupt signals the result
+ */
+void ADS7828_Rtos::serve(ADS7828_rtos_request_t &request)
+{
+	// Discard a notification of an aborted transfer
+	ulTaskNotifyTake(pdTRUE, 0);
+
+	HAL_StatusTypeDef status = _adc->start_read_dma(request.channel, on_digit, this);
+
+	if (status == HAL_OK)
+	{
+		if (ulTaskNotifyTake(pdTRUE, _timeout) == 0)
+		{
+			_adc->abort();
+			status = HAL_TIMEOUT;
+		}
+		else
+		{
+			status = _status;
+			*request.digit = _digit;
+		}
+	}
+
+	*request.status = status;
+	xTaskNotifyGive(request.client);
+}
+
+/**
+ * Completion callback of the ADS7828, wakes up the driver task
+ */
+void ADS7828_Rtos::on_digit(void *context, ADS7828_CHANNEL, HAL_StatusTypeDef status, ADS7828_digit_t digit)
+{
+	ADS7828_Rtos *rtos = static_cast<ADS7828_Rtos *>(context);
+	BaseType_t woken = pdFALSE;
+
+	rtos->_status = status;
+	rtos->_digit = digit;
+
+	vTaskNotifyGiveFromISR(rtos->_task, &woken);
+	portYIELD_FROM_ISR(woken);
+}
+
+#endif // ADS7828_RTOS
@@ -0,0 +1,62 @@
+// FreeRTOS backend, a driver task owns the bus and serves read requests of other tasks
+#ifndef ADS7828_RTOS_HPP
+#define ADS7828_RTOS_HPP
+
+#include "ADS7828.hpp"
+
+// Build with -D ADS7828_RTOS to enable the FreeRTOS backend
+#ifdef ADS7828_RTOS
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+
+// Number of read requests that can wait for the driver task
+#ifndef ADS7828_RTOS_QUEUE
+#define ADS7828_RTOS_QUEUE 8
+#endif
+
+// Read request of a client task
+struct ADS7828_rtos_request_t
+{
+	ADS7828_CHANNEL channel;	// Channel configuration to read
+	TaskHandle_t client;		// Task waiting for the result
+	ADS7828_digit_t *digit;				// Result, written by the driver task
+	HAL_StatusTypeDef *status;	// Status, written by the driver task
+};
+
+class ADS7828_Rtos
+{
+public:
+	ADS7828_Rtos(ADS7828 *adc);
+
+	HAL_StatusTypeDef start(UBaseType_t priority, configSTACK_DEPTH_TYPE stack_depth);
+	void set_timeout(TickType_t timeout);
+
+	HAL_StatusTypeDef read_digit(ADS7828_CHANNEL channel, ADS7828_digit_t &digit, TickType_t queue_timeout = portMAX_DELAY);
+#ifndef ADS7828_INTEGER_ONLY
+	HAL_StatusTypeDef read_voltage(ADS7828_CHANNEL channel, float &voltage, TickType_t queue_timeout = portMAX_DELAY);
+#endif
+
+	// Forward the HAL I2C callbacks to these
+	void tx_complete_callback(I2C_HandleTypeDef *hi2c);
+	void rx_complete_callback(I2C_HandleTypeDef *hi2c);
+	void error_callback(I2C_HandleTypeDef *hi2c);
+
+private:
+	static void task(void *argument);
+	static void on_digit(void *context, ADS7828_CHANNEL channel, HAL_StatusTypeDef status, ADS7828_digit_t digit);
+	void serve(ADS7828_rtos_request_t &request);
+
+	ADS7828 *_adc;					 // Driver owned by the task
+	TaskHandle_t _task = nullptr;	 // Driver task
+	QueueHandle_t _queue = nullptr;	 // Pending requests
+	TickType_t _timeout = pdMS_TO_TICKS(10); // Maximum time for one transfer
+
+	volatile HAL_StatusTypeDef _status; // Status of the last transfer, set in the I2C interrupt
+	volatile ADS7828_digit_t _digit;				// Digit of the last transfer, set in the I2C interrupt
+};
+
+#endif // ADS7828_RTOS
+
+#endif // ADS7828_RTOS_HPP
@@ -0,0 +1,216 @@
+#include "ADS7828_sampler.hpp"
+
+#ifdef HAL_TIM_MODULE_ENABLED
+
+/**
+ * Constructor for a sampler that reads channels on every update event of a timer
+ *
+ * @param adc Pointer to the ADS7828 used for the reads, its HAL I2C callbacks have to be forwarded
+ * @param htim Pointer to an initialized timer, its update interrupt has to be enabled
+ */
+ADS7828_Sampler::ADS7828_Sampler(ADS7828 *adc, TIM_HandleTypeDef *htim) : _adc(adc), _htim(htim)
+{
+}
+
+/**
+ * Configures prescaler and period of the timer for a sampling rate.
+ * The exact rate is timer_clock_hz / (PSC + 1) / (ARR + 1), choose a rate that divides the timer clock for zero drift.
+ *
+ * @param rate_hz Number of triggers per second
+ * @param timer_clock_hz Input clock of the timer, e.g. 72 MHz for TIM2 on the STM32F103 demo
+ * @return HAL_OK if the rate is possible, HAL_ERROR otherwise
+ */
+HAL_StatusTypeDef ADS7828_Sampler::set_rate(uint32_t rate_hz, uint32_t timer_clock_hz)
+{
+	if (rate_hz == 0 || rate_hz > timer_clock_hz)
+	{
+		return HAL_ERROR;
+	}
+
+	uint32_t ticks = timer_clock_hz / rate_hz;
+	uint32_t prescaler = (ticks - 1) / 0x10000;
+
+	if (prescaler > 0xFFFF)
+	{
+		return HAL_ERROR;
+	}
+
+	__HAL_TIM_SET_PRESCALER(_htim, prescaler);
+	__HAL_TIM_SET_AUTORELOAD(_htim, ticks / (prescaler + 1) - 1);
+	_htim->Init.Prescaler = prescaler;
+	_htim->Init.Period = ticks / (prescaler + 1) - 1;
+
+	return HAL_OK;
+}
+
+/**
+ * Starts the timer, every update event reads all channels once
+ *
+ * @param channels List of ADS7828_CHANNEL configurations to read on every trigger
+ * @param n Number of channels in the list (1 - 16)
+ * @param callback Function that is called from the I2C interrupt for every sample
+ * @param context User pointer that is passed to the callback
+ * @return HAL_OK if the timer was started, HAL_BUSY if sampling is already running, HAL_ERROR for an invalid list
+ */
+HAL_StatusTypeDef ADS7828_Sampler::start(const ADS7828_CHANNEL *channels, uint8_t n, ADS7828_sample_callback_t callback, void *context)
+{
+	if (_running)
+	{
+		return HAL_BUSY;
+	}
+
+	if (n == 0 || n > ADS7828_CHANNELS)
+	{
+		return HAL_ERROR;
+	}
+
+	for (uint8_t i = 0; i < n; i++)
+	{
+		_channels[i] = channels[i];
+	}
+
+	_n = n;
+	_callback = callback;
+	_context = context;
+	_periods = 0;
+	_overruns = 0;
+	_sequence = false;
+	_running = true;
+
+	__HAL_TIM_SET_COUNTER(_htim, 0);
+	HAL_StatusTypeDef status = HAL_TIM_Base_Start_IT(_htim);
+
+	if (status != HAL_OK)
+	{
+		_running = false;
+	}
+
+	return status;
+}
+
+/**
+ * Stops the timer, a running sequence is finished
+ */
+void ADS7828_Sampler::stop()
+{
+	HAL_TIM_Base_Stop_IT(_htim);
+	_running = false;
+}
+
+/**
+ * Check if the sampling is active
+ *
+ * @return True while the timer is running
+ */
+bool ADS7828_Sampler::is_running()
+{
+	return _running;
+}
+
+/**
+ * Get the current time in timer counts since start
+ *
+ * @return Timer counts, same time base as the sample timestamps (wraps around after 2^32 counts)
+ */
+uint32_t ADS7828_Sampler::get_timestamp()
+{
+	uint32_t periods;
+	uint32_t counter;
+
+	// Read again if an update event happened in between
+	do
+	{
+		periods = _periods;
+		counter = __HAL_TIM_GET_COUNTER(_htim);
+
+		// The counter already wrapped, but the update interrupt was not handled yet
+		if (__HAL_TIM_GET_FLAG(_htim, TIM_FLAG_UPDATE))
+		{
+			periods++;
+			counter = __HAL_TIM_GET_COUNTER(_htim);
+		}
+	} while (periods != _periods && periods != _periods + 1);
+
+	return periods * (__HAL_TIM_GET_AUTORELOAD(_htim) + 1) + counter;
+}
+
+/**
+ * Get the number of skipped triggers, increase the period if this is not 0
+ *
+ * @return Number of triggers where the previous sequence was not finished yet
+ */
+uint32_t ADS7828_Sampler::get_overrun_count()
+{
+	return _overruns;
+}
+
+/**
+ * Has to be called from HAL_TIM_PeriodElapsedCallback, starts a new sequence of reads
+ *
+ * @param htim The timer handle passed to the HAL callback
+ */
+void ADS7828_Sampler::period_elapsed_callback(TIM_HandleTypeDef *htim)
+{
+	if (htim != _htim || !_running)
+	{
+		return;
+	}
+
+	_periods++;
+
+	if (_sequence)
+	{
+		_overruns++;
+		return;
+	}
+
+	_sequence = true;
+	_index = 0;
+	start_read();
+}
+
+/**
+ * Timestamps and starts the read of the current channel
+ */
+void ADS7828_Sampler::start_read()
+{
+	_timestamp = get_timestamp();
+
+	HAL_StatusTypeDef status = _adc->start_read_dma(_channels[_index], on_digit, this);
+
+	if (status != HAL_OK)
+	{
+		// Report the channel and drop the rest of this sequence
+		_sequence = false;
+
+		if (_callback != nullptr)
+		{
+			_callback(_context, _channels[_index], status, 0, _timestamp);
+		}
+	}
+}
+
+/**
+ * Completion callback of the ADS7828, passes the sample on and continues the sequence
+ */
+void ADS7828_Sampler::on_digit(void *context, ADS7828_CHANNEL channel, HAL_StatusTypeDef status, ADS7828_digit_t digit)
+{
+	ADS7828_Sampler *sampler = static_cast<ADS7828_Sampler *>(context);
+	uint32_t timestamp = sampler->_timestamp;
+
+	if (++sampler->_index < sampler->_n)
+	{
+		sampler->start_read();
+	}
+	else
+	{
+		sampler->_sequence = false;
+	}
+
+	if (sampler->_callback != nullptr)
+	{
+		sampler->_callback(sampler->_context, channel, status, digit, timestamp);
+	}
+}
+
+#endif // HAL_TIM_MODULE_ENABLED
@@ -0,0 +1,51 @@
+// Timer triggered sampling of ADS7828 channels with a fixed rate
+#ifndef ADS7828_SAMPLER_HPP
+#define ADS7828_SAMPLER_HPP
+
+#include "ADS7828.hpp"
+
+#ifdef HAL_TIM_MODULE_ENABLED
+
+// Completion callback of a sampled channel, timestamp is in timer counts since start
+typedef void (*ADS7828_sample_callback_t)(void *context, ADS7828_CHANNEL channel, HAL_StatusTypeDef status, ADS7828_digit_t digit, uint32_t timestamp);
+
+class ADS7828_Sampler
+{
+public:
+	ADS7828_Sampler(ADS7828 *adc, TIM_HandleTypeDef *htim);
+
+	HAL_StatusTypeDef set_rate(uint32_t rate_hz, uint32_t timer_clock_hz);
+	HAL_StatusTypeDef start(const ADS7828_CHANNEL *channels, uint8_t n, ADS7828_sample_callback_t callback, void *context = nullptr);
+	void stop();
+	bool is_running();
+
+	uint32_t get_timestamp();
+	uint32_t get_overrun_count();
+
+	// Forward HAL_TIM_PeriodElapsedCallback to this
+	void period_elapsed_callback(TIM_HandleTypeDef *htim);
+
+private:
+	static void on_digit(void *context, ADS7828_CHANNEL channel, HAL_StatusTypeDef status, ADS7828_digit_t digit);
+	void start_read();
+
+	ADS7828 *_adc;			  // Driver used for the reads
+	TIM_HandleTypeDef *_htim; // Timer that triggers the sampling
+
+	ADS7828_CHANNEL _channels[ADS7828_CHANNELS]; // Channels read on every trigger
+	uint8_t _n = 0;								 // Number of channels
+	uint8_t _index = 0;							 // Position of the running read
+	uint32_t _timestamp = 0;					 // Timestamp of the running read
+
+	ADS7828_sample_callback_t _callback = nullptr; // Callback for every sample
+	void *_context = nullptr;					   // User context passed to the callback
+
+	volatile uint32_t _periods = 0;	 // Timer update events since start
+	volatile uint32_t _overruns = 0; // Triggers skipped because the previous sequence was still running
+	volatile bool _sequence = false; // A triggered sequence is running
+	volatile bool _running = false;	 // Sampling is active
+};
+
+#endif // HAL_TIM_MODULE_ENABLED
+
+#endif // ADS7828_SAMPLER_HPP
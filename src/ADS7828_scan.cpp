@@ -0,0 +1,1508 @@
+#include "ADS7828_scan.hpp"
+#include "ADS7828_bus.hpp"
+
+#ifndef ADS7828_INTEGER_ONLY
+#include <math.h>
+#endif
+
+// Bit times of one read on the bus: address + command, repeated address + 2 data bytes, START / STOP
+static const uint32_t SCHEDULE_READ_BITS = 5 * 9 + 4;
+
+// Most ticks simulated at the start of a schedule to find the peak load, the schedule repeats after the lcm of the dividers
+static const uint32_t SCHEDULE_HORIZON = 4096;
+
+// Phases tried per list entry, enough to spread all 16 entries
+static const uint32_t SCHEDULE_MAX_PHASES = 64;
+
+#ifdef ADS7828_INTEGER_ONLY
+/**
+ * Integer square root, rounded down, bit by bit
+ */
+static uint32_t isqrt(uint64_t value)
+{
+	uint64_t root = 0;
+	uint64_t bit = 1ULL << 62;
+
+	while (bit > value)
+	{
+		bit >>= 2;
+	}
+
+	while (bit != 0)
+	{
+		if (value >= root + bit)
+		{
+			value -= root + bit;
+			root = (root >> 1) + bit;
+		}
+		else
+		{
+			root >>= 1;
+		}
+		bit >>= 2;
+	}
+
+	return (uint32_t)root;
+}
+#endif
+
+/**
+ * Constructor for a scanner that continuously reads a list of channels with an ADS7828
+ *
+ * @param adc Pointer to the ADS7828 used for the reads, its HAL I2C callbacks have to be forwarded
+ */
+ADS7828_Scanner::ADS7828_Scanner(ADS7828 *adc) : _adc(adc)
+{
+}
+
+/**
+ * Starts scanning the channel list round-robin.
+ * Every read is chained from the completion interrupt of the previous one, so no CPU time is spent waiting.
+ *
+ * @param channels List of ADS7828_CHANNEL configurations to scan, any combination is allowed
+ * @param n Number of channels in the list (1 - 16)
+ * @return HAL_OK if the scan was started, HAL_BUSY if it is already running, HAL_ERROR for an invalid list
+ */
+HAL_StatusTypeDef ADS7828_Scanner::start(const ADS7828_CHANNEL *channels, uint8_t n)
+{
+	if (_running || _adc->is_busy())
+	{
+		return HAL_BUSY;
+	}
+
+	if (n == 0 || n > ADS7828_CHANNELS)
+	{
+		return HAL_ERROR;
+	}
+
+	for (uint8_t i = 0; i < n; i++)
+	{
+		_channels[i] = channels[i];
+	}
+
+	_n = n;
+	_index = 0;
+	_scheduled = false;
+	_repeated = 0;
+	_reconfigure = false;
+	_running = true;
+	_adc->set_deferred_processing(_read_ahead);
+
+	HAL_StatusTypeDef status = start_read(_channels[0]);
+
+	if (status != HAL_OK)
+	{
+		_running = false;
+	}
+
+	return status;
+}
+
+/**
+ * Starts scanning the channel list with an individual rate per entry.
+ * Call tick() from a timer interrupt with tick_hz, every entry is read on every divider-th tick (divider = tick_hz / rate).
+ * The entries due on one tick are read as one chained batch, the offsets of the entries are chosen so
+ * that as few as possible fall on the same tick, which keeps bus load and jitter even.
+ * A frame is completed with every batch, the result table always holds the latest value of every entry.
+ *
+ * @param channels List of ADS7828_CHANNEL configurations to scan, any combination is allowed
+ * @param rates_hz Target read rate [Hz] of every entry, rounded to a divider of tick_hz, at most tick_hz
+ * @param n Number of channels in the list (1 - 16)
+ * @param tick_hz Rate [Hz] at which tick() is called
+ * @return HAL_OK if the schedule was started, HAL_BUSY if a scan is already running,
+ *         HAL_ERROR for an invalid list or if the reads of the busiest tick do not fit into one tick period at the current bus clock
+ */
+HAL_StatusTypeDef ADS7828_Scanner::start_scheduled(const ADS7828_CHANNEL *channels, const uint32_t *rates_hz, uint8_t n, uint32_t tick_hz)
+{
+	if (_running || _adc->is_busy())
+	{
+		return HAL_BUSY;
+	}
+
+	if (n == 0 || n > ADS7828_CHANNELS || tick_hz == 0)
+	{
+		return HAL_ERROR;
+	}
+
+	for (uint8_t i = 0; i < n; i++)
+	{
+		if (rates_hz[i] == 0)
+		{
+			return HAL_ERROR;
+		}
+
+		uint32_t divider = (uint32_t)(((uint64_t)tick_hz + rates_hz[i] / 2) / rates_hz[i]);
+		_channels[i] = channels[i];
+		_dividers[i] = (divider < 1) ? 1 : divider;
+	}
+
+	return start_dividers(n, tick_hz);
+}
+
+#ifndef ADS7828_INTEGER_ONLY
+/**
+ * Starts scanning the channel list with an individual rate per entry, see start_scheduled with integer rates.
+ * Rates below 1 Hz are possible here, e.g. 0.1 for a read every ten seconds.
+ *
+ * @param channels List of ADS7828_CHANNEL configurations to scan, any combination is allowed
+ * @param rates_hz Target read rate [Hz] of every entry, rounded to a divider of tick_hz, at most tick_hz
+ * @param n Number of channels in the list (1 - 16)
+ * @param tick_hz Rate [Hz] at which tick() is called
+ * @return HAL_OK if the schedule was started, HAL_BUSY if a scan is already running,
+ *         HAL_ERROR for an invalid list or if the reads of the busiest tick do not fit into one tick period at the current bus clock
+ */
+HAL_StatusTypeDef ADS7828_Scanner::start_scheduled(const ADS7828_CHANNEL *channels, const float *rates_hz, uint8_t n, uint32_t tick_hz)
+{
+	if (_running || _adc->is_busy())
+	{
+		return HAL_BUSY;
+	}
+
+	if (n == 0 || n > ADS7828_CHANNELS || tick_hz == 0)
+	{
+		return HAL_ERROR;
+	}
+
+	for (uint8_t i = 0; i < n; i++)
+	{
+		if (!(rates_hz[i] > 0.0f))
+		{
+			return HAL_ERROR;
+		}
+
+		float divider = (float)tick_hz / rates_hz[i] + 0.5f;
+		_channels[i] = channels[i];
+		_dividers[i] = (divider < 1.0f) ? 1 : (divider > 4294967040.0f) ? 0xFFFFFF00U : (uint32_t)divider;
+	}
+
+	return start_dividers(n, tick_hz);
+}
+#endif
+
+/**
+ * Places the entries of a schedule whose dividers are set and starts it
+ *
+ * @param n Number of channels in the list
+ * @param tick_hz Rate [Hz] at which tick() is called
+ * @return HAL_OK if the schedule was started, HAL_ERROR if the reads of the busiest tick do not fit into one tick period
+ */
+HAL_StatusTypeDef ADS7828_Scanner::start_dividers(uint8_t n, uint32_t tick_hz)
+{
+	_n = n;
+	assign_phases();
+
+	// Every batch has to be finished before the next tick
+	if ((uint64_t)_peak_load * SCHEDULE_READ_BITS * tick_hz > _adc->get_bus_clock())
+	{
+		return HAL_ERROR;
+	}
+
+	for (uint8_t i = 0; i < n; i++)
+	{
+		_countdown[i] = _phases[i];
+	}
+
+	_due = 0;
+	_batch_n = 0;
+	_overruns = 0;
+	_active = false;
+	_scheduled = true;
+	_repeated = 0;
+	_reconfigure = false;
+	_running = true;
+	_adc->set_deferred_processing(_read_ahead);
+
+	return HAL_OK;
+}
+
+/**
+ * Advances the schedule by one tick and starts the reads that are due, call it from a timer interrupt with the tick_hz of start_scheduled.
+ * If an entry is still due from an earlier tick, e.g. because the device was busy, it is read only once and counted as overrun.
+ */
+void ADS7828_Scanner::tick()
+{
+	if (!_running || !_scheduled)
+	{
+		return;
+	}
+
+	uint16_t due = 0;
+
+	for (uint8_t i = 0; i < _n; i++)
+	{
+		if (_countdown[i] == 0)
+		{
+			due |= (1U << i);
+			_countdown[i] = _dividers[i] - 1;
+		}
+		else
+		{
+			_countdown[i]--;
+		}
+	}
+
+	if (due == 0)
+	{
+		return;
+	}
+
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	if (_due & due)
+	{
+		_overruns = _overruns + 1;
+	}
+
+	_due = _due | due;
+	bool start = !_active;
+
+	if (start)
+	{
+		_active = true;
+		take_batch();
+	}
+
+	__set_PRIMASK(primask);
+
+	if (start)
+	{
+		start_batch();
+	}
+}
+
+/**
+ * Get the divider of a list entry of the schedule
+ *
+ * @param index Position in the channel list of start_scheduled
+ * @return Ticks between two reads, the actual rate is tick_hz / divider
+ */
+uint32_t ADS7828_Scanner::get_divider(uint8_t index)
+{
+	return (index < _n) ? _dividers[index] : 0;
+}
+
+/**
+ * Get the tick offset of a list entry of the schedule
+ *
+ * @param index Position in the channel list of start_scheduled
+ * @return Ticks after the start until the entry is first read (0 - divider - 1)
+ */
+uint32_t ADS7828_Scanner::get_phase(uint8_t index)
+{
+	return (index < _n) ? _phases[index] : 0;
+}
+
+/**
+ * Get the peak load of the schedule
+ *
+ * @return Most reads that fall on one tick
+ */
+uint8_t ADS7828_Scanner::get_peak_load()
+{
+	return _peak_load;
+}
+
+/**
+ * Get the number of ticks that found an entry still due, its rate was lower than configured then
+ *
+ * @return Number of overruns since start_scheduled
+ */
+uint32_t ADS7828_Scanner::get_overrun_count()
+{
+	return _overruns;
+}
+
+/**
+ * Stops the scan, the currently running read is finished but its result is discarded
+ */
+void ADS7828_Scanner::stop()
+{
+	_running = false;
+	_adc->set_deferred_processing(false);
+}
+
+/**
+ * Replaces the channel list of a running round-robin scan at the next frame boundary, without stopping the bus.
+ * The new list is copied now and swapped in from the interrupt that completes the current frame, right before the first read
+ * of the next frame is started. The frame callback of the completed frame still gets the old list.
+ * Channels dropped from the list keep their last result in the table.
+ * A second call before the swap replaces the pending list.
+ *
+ * @param channels New list of ADS7828_CHANNEL configurations to scan
+ * @param n Number of channels in the list (1 - 16)
+ * @param averaging Optional averaging depth for every list entry, applied with the swap (1 disables, see ADS7828::set_averaging)
+ * @return HAL_OK if the list is pending, HAL_ERROR for an invalid list or if no round-robin scan is running
+ */
+HAL_StatusTypeDef ADS7828_Scanner::reconfigure(const ADS7828_CHANNEL *channels, uint8_t n, const uint16_t *averaging)
+{
+	if (n == 0 || n > ADS7828_CHANNELS || !_running || _scheduled)
+	{
+		return HAL_ERROR;
+	}
+
+	// The interrupt only reads the pending list while the flag is set
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	for (uint8_t i = 0; i < n; i++)
+	{
+		_pending[i] = channels[i];
+		_pending_averaging[i] = (averaging != nullptr) ? averaging[i] : 0;
+	}
+
+	_pending_n = n;
+	_pending_has_averaging = (averaging != nullptr);
+	_reconfigure = true;
+
+	__set_PRIMASK(primask);
+
+	return HAL_OK;
+}
+
+/**
+ * Check if a list of reconfigure still waits for the frame boundary
+ *
+ * @return True until the new list is used
+ */
+bool ADS7828_Scanner::is_reconfigure_pending()
+{
+	return _reconfigure;
+}
+
+/**
+ * Swaps the pending list with the active one and applies its averaging, called at a frame boundary from the interrupt.
+ * The old list is left in _pending for the frame callback.
+ */
+void ADS7828_Scanner::apply_pending()
+{
+	uint8_t n = _n;
+
+	for (uint8_t i = 0; i < ADS7828_CHANNELS; i++)
+	{
+		ADS7828_CHANNEL channel = _channels[i];
+		_channels[i] = _pending[i];
+		_pending[i] = channel;
+	}
+
+	_n = _pending_n;
+	_pending_n = n;
+
+	// Dropped channels keep the result of the completed frame in both tables
+	uint8_t back = _front ^ 1;
+
+	for (uint8_t c = 0; c < ADS7828_CHANNELS; c++)
+	{
+		_results[back][c] = _results[_front][c];
+		_timestamps[back][c] = _timestamps[_front][c];
+		_quality[back][c] = _quality[_front][c];
+	}
+
+	_unsettled[back] = _unsettled[_front];
+
+	// The driver changes its slot map and averaging pool with interrupts disabled, so this is safe against foreground setters
+	if (_pending_has_averaging)
+	{
+		for (uint8_t i = 0; i < _n; i++)
+		{
+			if (_pending_averaging[i] > 1)
+			{
+				_adc->set_averaging(_channels[i], _pending_averaging[i]);
+			}
+			else
+			{
+				_adc->disable_averaging(_channels[i]);
+			}
+		}
+	}
+
+	_reconfigure = false;
+}
+
+/**
+ * Routes the reads of the scan through a bus manager, so other devices on the bus get their turns (see ADS7828_Bus::claim).
+ * The driver has to be attached to the bus and the HAL I2C callbacks forwarded to the bus instead of the driver.
+ * Set it before starting the scan.
+ *
+ * @param bus Bus manager of the I2C handle, nullptr to start the reads directly
+ */
+void ADS7828_Scanner::set_bus(ADS7828_Bus *bus)
+{
+	_bus = bus;
+}
+
+/**
+ * Starts the read of a channel directly or through the bus manager
+ *
+ * @param channel The ADS7828_CHANNEL configuration to read, on_digit receives the result
+ * @return HAL status of the start or the submit
+ */
+HAL_StatusTypeDef ADS7828_Scanner::start_read(ADS7828_CHANNEL channel)
+{
+	if (_bus != nullptr)
+	{
+		return _bus->submit(_adc, channel, on_digit, this);
+	}
+
+	return _adc->start_read_dma(channel, on_digit, this);
+}
+
+/**
+ * Check if the scan is active
+ *
+ * @return True while the scan is running
+ */
+bool ADS7828_Scanner::is_running()
+{
+	return _running;
+}
+
+/**
+ * Get the result table of the last completed frame (indexed by ADS7828_CHANNEL).
+ * The table stays valid until the next frame completes, check get_frame_count for slow consumers.
+ *
+ * @return Pointer to the ADS7828_CHANNELS digits of the last frame
+ */
+const ADS7828_digit_t *ADS7828_Scanner::get_results()
+{
+	return _results[_front];
+}
+
+/**
+ * Starts a zero-copy read of the last completed frame (seqlock style).
+ * Read the table directly, then check validate_results with the same sequence; if it fails,
+ * the scanner reused the table while you were reading it and you have to start again.
+ * Interrupts stay enabled and nothing is copied.
+ *
+ * @param sequence Receives the frame count the table belongs to
+ * @return Pointer to the ADS7828_CHANNELS digits of the last frame, indexed by ADS7828_CHANNEL
+ */
+const ADS7828_digit_t *ADS7828_Scanner::acquire_results(uint32_t &sequence)
+{
+	// The frame count is read before the table index: a frame completing in between fails the validation
+	sequence = _frames;
+	const ADS7828_digit_t *results = _results[_front];
+	__DMB();
+	return results;
+}
+
+/**
+ * Ends a zero-copy read started with acquire_results
+ *
+ * @param sequence The sequence returned by acquire_results
+ * @return True if the table was not written while it was read, the values form one consistent frame
+ */
+bool ADS7828_Scanner::validate_results(uint32_t sequence)
+{
+	// Keeps the compiler and CPU from moving the table reads behind the check
+	__DMB();
+	return _frames == sequence;
+}
+
+/**
+ * Get the digit of a channel from the last completed frame
+ *
+ * @param channel The ADS7828_CHANNEL configuration you want the digit from
+ * @return Digit of the channel, 0 if it is not part of the scan
+ */
+ADS7828_digit_t ADS7828_Scanner::get_digit(ADS7828_CHANNEL channel)
+{
+	return _results[_front][channel];
+}
+
+#ifndef ADS7828_INTEGER_ONLY
+/**
+ * Get the voltage of a channel from the last completed frame, see ADS7828::read_voltage
+ *
+ * @param channel The ADS7828_CHANNEL configuration you want the voltage from
+ * @return Voltage [V] of the channel
+ */
+float ADS7828_Scanner::get_voltage(ADS7828_CHANNEL channel)
+{
+	return _adc->digit_to_voltage(channel, get_digit(channel));
+}
+#endif
+
+/**
+ * Get the timestamp table of the last completed frame (indexed by ADS7828_CHANNEL), see ADS7828::get_sample_cycles
+ *
+ * @return Pointer to the ADS7828_CHANNELS DWT cycle counts of the last frame
+ */
+const uint32_t *ADS7828_Scanner::get_timestamps()
+{
+	return _timestamps[_front];
+}
+
+/**
+ * Get the timestamp of a channel from the last completed frame
+ *
+ * @param channel The ADS7828_CHANNEL configuration you want the timestamp of
+ * @return DWT cycle count when the result was received, requires ADS7828::enable_cycle_counter
+ */
+uint32_t ADS7828_Scanner::get_timestamp(ADS7828_CHANNEL channel)
+{
+	return _timestamps[_front][channel];
+}
+
+/**
+ * Get the number of completed frames, every frame contains one read of every channel in the list
+ *
+ * @return Number of completed frames since construction
+ */
+uint32_t ADS7828_Scanner::get_frame_count()
+{
+	return _frames;
+}
+
+/**
+ * Get the number of failed reads, failed channels keep their last value
+ *
+ * @return Number of failed reads since construction
+ */
+uint32_t ADS7828_Scanner::get_error_count()
+{
+	return _errors;
+}
+
+/**
+ * Get the driver the scanner reads with
+ *
+ * @return Pointer to the ADS7828 of the constructor
+ */
+ADS7828 *ADS7828_Scanner::get_adc()
+{
+	return _adc;
+}
+
+/**
+ * Set a function that is called from the I2C interrupt whenever a frame is completed, e.g. to export the results.
+ * The next read is already running when it is called, so keep it short.
+ *
+ * @param callback Function that receives the result table of the frame, nullptr to disable
+ * @param context User pointer that is passed to the callback
+ */
+void ADS7828_Scanner::set_frame_callback(ADS7828_frame_callback_t callback, void *context)
+{
+	_frame_callback = callback;
+	_frame_context = context;
+}
+
+/**
+ * Set how readings taken during reference settling are handled, see ADS7828::was_ref_settled.
+ * By default, they are stored and tagged in the unsettled mask. If deferred, the channel is read again until the reference has settled.
+ *
+ * @param defer If true, unsettled readings are discarded and repeated
+ */
+void ADS7828_Scanner::set_defer_unsettled(bool defer)
+{
+	_defer_unsettled = defer;
+}
+
+/**
+ * Starts the next read of the scan right when a result arrives and processes the result afterwards,
+ * so averaging, filters, events and statistics run while the command of the next read is on the bus.
+ * Set it while the scan is stopped. Single DMA reads of the driver pass raw digits while the scan runs
+ * (see ADS7828::set_deferred_processing).
+ *
+ * @param enable True to read ahead
+ * @return HAL_OK, HAL_BUSY while the scan is running
+ */
+HAL_StatusTypeDef ADS7828_Scanner::set_read_ahead(bool enable)
+{
+	if (_running)
+	{
+		return HAL_BUSY;
+	}
+
+	_read_ahead = enable;
+	return HAL_OK;
+}
+
+/**
+ * Get the channels of the last completed frame that were read during reference settling
+ *
+ * @return Bit mask with bit (1 << ADS7828_CHANNEL) set for unsettled readings
+ */
+uint16_t ADS7828_Scanner::get_unsettled_mask()
+{
+	return _unsettled[_front];
+}
+
+/**
+ * Get the quality bits of the last completed frame, see ADS7828::get_quality.
+ * A failed read keeps the last value of the channel and adds QUALITY_FAILED, a deferred read adds QUALITY_RETRIED.
+ * Mask the entries with the bits your application can't accept, e.g. quality[ch] & (QUALITY_CLIPPED_HIGH | QUALITY_FAILED).
+ *
+ * @return Pointer to the ADS7828_CHANNELS ADS7828_QUALITY masks of the last frame, indexed by ADS7828_CHANNEL
+ */
+const uint8_t *ADS7828_Scanner::get_qualities()
+{
+	return _quality[_front];
+}
+
+/**
+ * Get the quality bits of a channel from the last completed frame
+ *
+ * @param channel The ADS7828_CHANNEL configuration you want the quality of
+ * @return ADS7828_QUALITY bits, 0 for a clean result
+ */
+uint8_t ADS7828_Scanner::get_quality(ADS7828_CHANNEL channel)
+{
+	return _quality[_front][channel];
+}
+
+/**
+ * Sets a window for a channel. An event is raised when a result leaves the window (EVENT_ABOVE / EVENT_BELOW)
+ * and when it returns (EVENT_INSIDE), not for every result outside. The first result after this call only sets the position.
+ *
+ * @param channel The ADS7828_CHANNEL configuration to watch
+ * @param low Lower limit in digits, results below raise EVENT_BELOW
+ * @param high Upper limit in digits, results above raise EVENT_ABOVE
+ */
+void ADS7828_Scanner::set_window(ADS7828_CHANNEL channel, ADS7828_digit_t low, ADS7828_digit_t high)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	_low[channel] = low;
+	_high[channel] = high;
+	_window_mask |= (1U << channel);
+	_primed &= ~(1U << channel);
+	__set_PRIMASK(primask);
+}
+
+/**
+ * Sets a change detection for a channel. EVENT_DELTA is raised when a result differs by more than delta
+ * from the result of the last delta event, so slow drifts are reported too. The first result after this call is the reference.
+ *
+ * @param channel The ADS7828_CHANNEL configuration to watch
+ * @param delta Change in digits, e.g. 8 to ignore noise of a few LSB
+ */
+void ADS7828_Scanner::set_delta(ADS7828_CHANNEL channel, ADS7828_digit_t delta)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	_delta[channel] = delta;
+	_delta_mask |= (1U << channel);
+	_primed &= ~(1U << channel);
+	__set_PRIMASK(primask);
+}
+
+/**
+ * Removes the window and the change detection of a channel, pending events of the channel are discarded
+ *
+ * @param channel The ADS7828_CHANNEL configuration
+ */
+void ADS7828_Scanner::clear_events(ADS7828_CHANNEL channel)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	_window_mask &= ~(1U << channel);
+	_delta_mask &= ~(1U << channel);
+	_primed &= ~(1U << channel);
+	_events = _events & ~(1U << channel);
+	_reasons[channel] = 0;
+	__set_PRIMASK(primask);
+}
+
+/**
+ * Set a function that is called from the I2C interrupt for every channel event.
+ * It is called after the next read was started, so keep it short, e.g. notify a task.
+ *
+ * @param callback Function that receives the channel, the ADS7828_EVENT mask and the digit, nullptr to disable
+ * @param context User pointer that is passed to the callback
+ */
+void ADS7828_Scanner::set_event_callback(ADS7828_event_callback_t callback, void *context)
+{
+	_event_callback = callback;
+	_event_context = context;
+}
+
+/**
+ * Get the channels with pending events without clearing them
+ *
+ * @return Bit mask with bit (1 << ADS7828_CHANNEL) set for channels with events
+ */
+uint16_t ADS7828_Scanner::get_events()
+{
+	return _events;
+}
+
+/**
+ * Get and clear the channels with pending events, e.g. after the main loop woke up.
+ * Read the reasons with get_channel_events before the next take_events.
+ *
+ * @return Bit mask with bit (1 << ADS7828_CHANNEL) set for channels with events
+ */
+uint16_t ADS7828_Scanner::take_events()
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	uint16_t events = _events;
+	_events = 0;
+
+	for (uint8_t i = 0; i < ADS7828_CHANNELS; i++)
+	{
+		_taken[i] = _reasons[i];
+		_reasons[i] = 0;
+	}
+	__set_PRIMASK(primask);
+
+	return events;
+}
+
+/**
+ * Get the reasons of the events of a channel taken with the last take_events
+ *
+ * @param channel The ADS7828_CHANNEL configuration
+ * @return Mask of ADS7828_EVENT
+ */
+uint8_t ADS7828_Scanner::get_channel_events(ADS7828_CHANNEL channel)
+{
+	return _taken[channel];
+}
+
+/**
+ * Enable or disable the summary statistics of a channel, the accumulators start empty.
+ * Every result of the channel updates min, max, sum and sum of squares in the interrupt,
+ * so a reporting window needs no sample buffer.
+ *
+ * @param channel The ADS7828_CHANNEL configuration
+ * @param enable True to accumulate the results of the channel
+ */
+void ADS7828_Scanner::set_summary(ADS7828_CHANNEL channel, bool enable)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	_accumulators[channel] = {};
+
+	if (enable)
+	{
+		_summary_mask |= (1U << channel);
+	}
+	else
+	{
+		_summary_mask &= ~(1U << channel);
+	}
+	__set_PRIMASK(primask);
+}
+
+/**
+ * Ends the reporting window of a channel, the accumulators are read and cleared in one critical section
+ *
+ * @param channel The ADS7828_CHANNEL configuration
+ * @param summary Receives the statistics of the window
+ * @return True if the window contained results, false if it was empty or the summary is disabled
+ */
+bool ADS7828_Scanner::take_summary(ADS7828_CHANNEL channel, ADS7828_summary_t &summary)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	ADS7828_accumulator_t accumulator = _accumulators[channel];
+	_accumulators[channel] = {};
+	__set_PRIMASK(primask);
+
+	return summarize(accumulator, summary);
+}
+
+/**
+ * Ends the reporting window of all channels at the same result, the statistics are calculated afterwards
+ *
+ * @param summaries Array of ADS7828_CHANNELS summaries indexed by ADS7828_CHANNEL, only channels with results are written
+ * @return Bit mask with bit (1 << ADS7828_CHANNEL) set for every written summary
+ */
+uint16_t ADS7828_Scanner::take_summaries(ADS7828_summary_t *summaries)
+{
+	ADS7828_accumulator_t accumulators[ADS7828_CHANNELS];
+
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	uint16_t mask = _summary_mask;
+
+	for (uint8_t i = 0; i < ADS7828_CHANNELS; i++)
+	{
+		accumulators[i] = _accumulators[i];
+		_accumulators[i] = {};
+	}
+	__set_PRIMASK(primask);
+
+	uint16_t written = 0;
+
+	for (uint8_t i = 0; i < ADS7828_CHANNELS; i++)
+	{
+		if ((mask & (1U << i)) && summarize(accumulators[i], summaries[i]))
+		{
+			written |= (1U << i);
+		}
+	}
+
+	return written;
+}
+
+/**
+ * Calculates the statistics from the sums of a window
+ *
+ * @param accumulator Sums of the window
+ * @param summary Receives the statistics in digits
+ * @return False for an empty window
+ */
+bool ADS7828_Scanner::summarize(const ADS7828_accumulator_t &accumulator, ADS7828_summary_t &summary)
+{
+	if (accumulator.count == 0)
+	{
+		return false;
+	}
+
+#ifdef ADS7828_INTEGER_ONLY
+	uint64_t n = accumulator.count;
+	uint64_t mean = accumulator.sum / n;
+	uint64_t remainder = accumulator.sum % n;
+	uint64_t mean_sq = accumulator.sum_sq / n;
+	uint64_t remainder_sq = accumulator.sum_sq % n;
+
+	// sum_sq / n - (sum / n)^2 split into whole parts and remainders, so no product leaves 64 bits
+	int64_t fraction = (int64_t)remainder_sq - (int64_t)(2 * mean * remainder);
+	int64_t variance = (int64_t)(mean_sq - mean * mean) + fraction / (int64_t)n - (int64_t)(remainder * remainder / n / n);
+
+	summary.count = accumulator.count;
+	summary.min = accumulator.min;
+	summary.max = accumulator.max;
+	summary.mean = (uint16_t)(mean + (2 * remainder >= n));
+	summary.variance = (variance > 0) ? (uint32_t)variance : 0;
+	summary.rms = (uint16_t)isqrt(mean_sq);
+#else
+	const double scale = 1.0 / (1 << ADS7828_SUMMARY_SHIFT);
+	double n = accumulator.count;
+	double mean = (double)accumulator.sum / n;
+	double mean_sq = (double)accumulator.sum_sq / n;
+	double variance = mean_sq - mean * mean;
+
+	summary.count = accumulator.count;
+	summary.min = accumulator.min * scale;
+	summary.max = accumulator.max * scale;
+	summary.mean = mean * scale;
+	// Rounding can leave a tiny negative variance for constant inputs
+	summary.variance = (variance > 0) ? variance * scale * scale : 0;
+	summary.rms = sqrt(mean_sq) * scale;
+#endif
+
+	return true;
+}
+
+/**
+ * Stops pushing raw samples into the ring of set_raw_ring
+ */
+void ADS7828_Scanner::clear_raw_ring()
+{
+	set_raw_push(nullptr, nullptr, 0);
+}
+
+/**
+ * Averages every factor raw digits of a channel into one decimated result, next to the full rate result table.
+ * The block average runs on the raw digits, independent of the averaging and filters of the driver.
+ *
+ * @param channel The ADS7828_CHANNEL configuration
+ * @param factor Raw digits per decimated result (1 - 65535), 0 disables the decimation
+ * @return HAL_OK
+ */
+HAL_StatusTypeDef ADS7828_Scanner::set_decimation(ADS7828_CHANNEL channel, uint16_t factor)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	_dec_factor[channel] = factor;
+	_dec_fill[channel] = 0;
+	_dec_sum[channel] = 0;
+#ifndef ADS7828_INTEGER_ONLY
+	_dec_scale[channel] = (factor != 0) ? 1.0f / factor : 0.0f;
+#endif
+	_dec_count[channel] = 0;
+
+	if (factor != 0)
+	{
+		_dec_mask |= (1U << channel);
+	}
+	else
+	{
+		_dec_mask &= ~(1U << channel);
+	}
+
+	__set_PRIMASK(primask);
+	return HAL_OK;
+}
+
+/**
+ * Set a function that is called from the I2C interrupt for every decimated result, after the next read was started
+ *
+ * @param callback Function that receives the channel and its decimated result, nullptr to disable
+ * @param context User pointer that is passed to the callback
+ */
+void ADS7828_Scanner::set_decimated_callback(ADS7828_decimated_callback_t callback, void *context)
+{
+	_decimated_callback = callback;
+	_decimated_context = context;
+}
+
+/**
+ * Get the table of the last decimated results
+ *
+ * @return Pointer to the ADS7828_CHANNELS decimated digits, indexed by ADS7828_CHANNEL
+ */
+const ADS7828_digit_t *ADS7828_Scanner::get_decimated_results()
+{
+	return _decimated;
+}
+
+/**
+ * Get the last decimated result of a channel
+ *
+ * @param channel The ADS7828_CHANNEL configuration
+ * @return Mean of the last factor raw digits, 0 before the first result
+ */
+ADS7828_digit_t ADS7828_Scanner::get_decimated(ADS7828_CHANNEL channel)
+{
+	return _decimated[channel];
+}
+
+/**
+ * Get the number of decimated results of a channel, e.g. to detect a new one when polling
+ *
+ * @param channel The ADS7828_CHANNEL configuration
+ * @return Results since set_decimation
+ */
+uint32_t ADS7828_Scanner::get_decimated_count(ADS7828_CHANNEL channel)
+{
+	return _dec_count[channel];
+}
+
+/**
+ * Adds a new result to the accumulators of its channel
+ */
+void ADS7828_Scanner::accumulate(ADS7828_CHANNEL channel, ADS7828_digit_t digit)
+{
+	if ((_summary_mask & (1U << channel)) == 0)
+	{
+		return;
+	}
+
+#ifdef ADS7828_INTEGER_ONLY
+	uint32_t value = (uint32_t)digit << ADS7828_SUMMARY_SHIFT;
+	value = (value > 0xFFFF) ? 0xFFFF : value;
+#else
+	// Calibrated results can leave the range of the ADC
+	float scaled = digit * (1 << ADS7828_SUMMARY_SHIFT) + 0.5f;
+	uint32_t value = (scaled <= 0) ? 0 : (scaled >= 0xFFFF) ? 0xFFFF : (uint32_t)scaled;
+#endif
+	ADS7828_accumulator_t &accumulator = _accumulators[channel];
+
+	if (accumulator.count == 0 || value < accumulator.min)
+	{
+		accumulator.min = value;
+	}
+
+	if (accumulator.count == 0 || value > accumulator.max)
+	{
+		accumulator.max = value;
+	}
+
+	accumulator.count++;
+	accumulator.sum += value;
+	accumulator.sum_sq += value * value;
+}
+
+/**
+ * Adds a raw digit to the running block average of its channel
+ *
+ * @return True if a decimated result was completed
+ */
+bool ADS7828_Scanner::decimate(ADS7828_CHANNEL channel, uint16_t raw)
+{
+	if ((_dec_mask & (1U << channel)) == 0)
+	{
+		return false;
+	}
+
+	_dec_sum[channel] += raw;
+
+	if (++_dec_fill[channel] < _dec_factor[channel])
+	{
+		return false;
+	}
+
+#ifdef ADS7828_INTEGER_ONLY
+	_decimated[channel] = (_dec_sum[channel] + _dec_factor[channel] / 2) / _dec_factor[channel];
+#else
+	_decimated[channel] = _dec_sum[channel] * _dec_scale[channel];
+#endif
+	_dec_sum[channel] = 0;
+	_dec_fill[channel] = 0;
+	_dec_count[channel] = _dec_count[channel] + 1;
+	return true;
+}
+
+/**
+ * Sets the ring of the raw samples in one critical section, so the interrupt never sees a half changed ring
+ */
+void ADS7828_Scanner::set_raw_push(ADS7828_raw_push_t push, void *ring, uint8_t device)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	_raw_push = push;
+	_raw_ring = ring;
+	_raw_device = device;
+
+	__set_PRIMASK(primask);
+}
+
+/**
+ * Checks a new result against the window and delta of its channel and records the events
+ *
+ * @return Mask of the raised ADS7828_EVENT, 0 for none
+ */
+uint8_t ADS7828_Scanner::detect(ADS7828_CHANNEL channel, ADS7828_digit_t digit)
+{
+	uint16_t bit = (1U << channel);
+
+	if (((_window_mask | _delta_mask) & bit) == 0)
+	{
+		return 0;
+	}
+
+	uint8_t zone = 0;
+
+	if (_window_mask & bit)
+	{
+		zone = (digit > _high[channel]) ? EVENT_ABOVE : (digit < _low[channel]) ? EVENT_BELOW : 0;
+	}
+
+	// The first result after a configuration change only sets the state
+	if ((_primed & bit) == 0)
+	{
+		_primed |= bit;
+		_zone[channel] = zone;
+		_reference[channel] = digit;
+		return 0;
+	}
+
+	uint8_t events = 0;
+
+	if (zone != _zone[channel])
+	{
+		events |= (zone != 0) ? zone : (uint8_t)EVENT_INSIDE;
+		_zone[channel] = zone;
+	}
+
+	if (_delta_mask & bit)
+	{
+#ifdef ADS7828_INTEGER_ONLY
+		int32_t change = (int32_t)digit - _reference[channel];
+#else
+		float change = digit - _reference[channel];
+#endif
+
+		if (change > _delta[channel] || change < -_delta[channel])
+		{
+			events |= EVENT_DELTA;
+			_reference[channel] = digit;
+		}
+	}
+
+	if (events != 0)
+	{
+		_reasons[channel] |= events;
+		_events = _events | bit;
+	}
+
+	return events;
+}
+
+/**
+ * Completion callback of the ADS7828, stores the result in the back table and starts the next read.
+ * With read-ahead, the next read is started first and the raw digit is processed while its command is sent.
+ */
+void ADS7828_Scanner::on_digit(void *context, ADS7828_CHANNEL channel, HAL_StatusTypeDef status, ADS7828_digit_t digit)
+{
+	ADS7828_Scanner *scanner = static_cast<ADS7828_Scanner *>(context);
+
+	if (!scanner->_running)
+	{
+		return;
+	}
+
+	uint8_t back = scanner->_front ^ 1;
+	bool settled = scanner->_adc->was_ref_settled();
+
+	// Read the same channel again instead of publishing an inaccurate value, as long as the reference is actually settling
+	if (status == HAL_OK && !settled && scanner->_defer_unsettled && scanner->_adc->is_ref_powered())
+	{
+		scanner->_repeated |= (1U << channel);
+
+		if (scanner->start_read(channel) != HAL_OK)
+		{
+			scanner->_errors = scanner->_errors + 1;
+			scanner->_running = false;
+		}
+		return;
+	}
+
+	uint8_t events = 0;
+	bool decimated = false;
+	uint8_t retried = (scanner->_repeated & (1U << channel)) ? QUALITY_RETRIED : 0;
+	scanner->_repeated &= ~(1U << channel);
+
+	// Taken from the driver before the next read can change them
+	uint8_t quality = scanner->_adc->get_quality();
+	uint16_t raw = scanner->_adc->get_raw_digit();
+	uint32_t timestamp = scanner->_adc->get_sample_cycles();
+	bool started = scanner->_read_ahead && scanner->start_ahead();
+
+	if (status == HAL_OK)
+	{
+		if (scanner->_read_ahead)
+		{
+			digit = scanner->_adc->process_result(channel, raw);
+		}
+
+		scanner->_quality[back][channel] = quality | retried;
+		events = scanner->detect(channel, digit);
+		scanner->accumulate(channel, digit);
+		scanner->_results[back][channel] = digit;
+		scanner->_timestamps[back][channel] = timestamp;
+
+		// The raw and decimated outputs share the acquisition of the result table
+		decimated = scanner->decimate(channel, raw);
+
+		if (scanner->_raw_push != nullptr)
+		{
+			scanner->_raw_push(scanner->_raw_ring, {timestamp, raw, (uint8_t)channel, scanner->_raw_device});
+		}
+
+		if (settled)
+		{
+			scanner->_unsettled[back] &= ~(1U << channel);
+		}
+		else
+		{
+			scanner->_unsettled[back] |= (1U << channel);
+		}
+	}
+	else
+	{
+		// Keep the last value of the channel
+		scanner->_results[back][channel] = scanner->_results[scanner->_front][channel];
+		scanner->_timestamps[back][channel] = scanner->_timestamps[scanner->_front][channel];
+		scanner->_quality[back][channel] = scanner->_quality[scanner->_front][channel] | QUALITY_FAILED | retried;
+		scanner->_unsettled[back] = (scanner->_unsettled[back] & ~(1U << channel)) | (scanner->_unsettled[scanner->_front] & (1U << channel));
+		scanner->_errors = scanner->_errors + 1;
+	}
+
+	scanner->next(started);
+
+	// Reported after the next read was started, so the bus is not idle while the application reacts
+	if (events != 0 && scanner->_event_callback != nullptr)
+	{
+		scanner->_event_callback(scanner->_event_context, channel, events, digit);
+	}
+
+	if (decimated && scanner->_decimated_callback != nullptr)
+	{
+		scanner->_decimated_callback(scanner->_decimated_context, channel, scanner->_decimated[channel]);
+	}
+}
+
+/**
+ * Starts the read of the next list entry before the result of the running one is processed.
+ * At the end of a batch and at a frame boundary with a pending list, next starts the read as usual.
+ *
+ * @return True if the read was started or failed, false if next has to start it
+ */
+bool ADS7828_Scanner::start_ahead()
+{
+	ADS7828_CHANNEL channel;
+
+	if (_scheduled)
+	{
+		if (_index + 1 >= _batch_n)
+		{
+			return false;
+		}
+
+		channel = _channels[_batch[_index + 1]];
+	}
+	else
+	{
+		bool wrap = (_index + 1 >= _n);
+
+		if (wrap && _reconfigure)
+		{
+			return false;
+		}
+
+		channel = _channels[wrap ? 0 : _index + 1];
+	}
+
+	if (start_read(channel) != HAL_OK)
+	{
+		_errors = _errors + 1;
+		_running = false;
+	}
+
+	return true;
+}
+
+/**
+ * Advances to the next channel, publishes the back table when the frame is complete
+ *
+ * @param started The read of the next channel was already started by start_ahead
+ */
+void ADS7828_Scanner::next(bool started)
+{
+	if (_scheduled)
+	{
+		next_scheduled(started);
+		return;
+	}
+
+	bool completed = false;
+	bool swapped = false;
+
+	if (++_index >= _n)
+	{
+		_index = 0;
+		_front = _front ^ 1;
+		_frames = _frames + 1;
+		completed = true;
+
+		// A list passed after the read-ahead started the old first entry waits for the next boundary
+		if (_reconfigure && !started)
+		{
+			apply_pending();
+			swapped = true;
+		}
+	}
+
+	if (!started && start_read(_channels[_index]) != HAL_OK)
+	{
+		_errors = _errors + 1;
+		_running = false;
+	}
+
+	// The bus is kept busy while the frame is handed over
+	if (completed && _frame_callback != nullptr)
+	{
+		_frame_callback(_frame_context, _results[_front], swapped ? _pending : _channels, swapped ? _pending_n : _n);
+	}
+}
+
+/**
+ * Advances to the next entry of the batch, publishes the back table when the batch is complete
+ * and continues with the entries that became due in the meantime
+ *
+ * @param started The read of the next entry was already started by start_ahead
+ */
+void ADS7828_Scanner::next_scheduled(bool started)
+{
+	if (++_index < _batch_n)
+	{
+		if (!started && start_read(_channels[_batch[_index]]) != HAL_OK)
+		{
+			_errors = _errors + 1;
+			_running = false;
+		}
+		return;
+	}
+
+	_front = _front ^ 1;
+	_frames = _frames + 1;
+
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	bool more = (_due != 0);
+
+	if (more)
+	{
+		take_batch();
+	}
+	else
+	{
+		_active = false;
+	}
+
+	__set_PRIMASK(primask);
+
+	if (more)
+	{
+		start_batch();
+	}
+
+	if (_frame_callback != nullptr)
+	{
+		_frame_callback(_frame_context, _results[_front], _channels, _n);
+	}
+}
+
+/**
+ * Moves the due entries into the batch, called with interrupts disabled.
+ * The back table is refreshed with the last frame, so entries that are not read keep their latest value.
+ */
+void ADS7828_Scanner::take_batch()
+{
+	uint8_t back = _front ^ 1;
+	_batch_n = 0;
+	_batch_mask = _due;
+	_due = 0;
+	_index = 0;
+
+	for (uint8_t i = 0; i < _n; i++)
+	{
+		ADS7828_CHANNEL channel = _channels[i];
+		_results[back][channel] = _results[_front][channel];
+		_timestamps[back][channel] = _timestamps[_front][channel];
+		_quality[back][channel] = _quality[_front][channel];
+
+		if (_batch_mask & (1U << i))
+		{
+			_batch[_batch_n++] = i;
+		}
+	}
+
+	_unsettled[back] = _unsettled[_front];
+}
+
+/**
+ * Starts the first read of the batch. If the device is busy, the entries stay due for the next tick.
+ */
+void ADS7828_Scanner::start_batch()
+{
+	HAL_StatusTypeDef status = start_read(_channels[_batch[0]]);
+
+	if (status == HAL_OK)
+	{
+		return;
+	}
+
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	_active = false;
+
+	if (status == HAL_BUSY)
+	{
+		_due = _due | _batch_mask;
+		_overruns = _overruns + 1;
+	}
+	else
+	{
+		_errors = _errors + 1;
+		_running = false;
+	}
+
+	__set_PRIMASK(primask);
+}
+
+/**
+ * Greatest common divisor of two dividers
+ */
+static uint32_t gcd(uint32_t a, uint32_t b)
+{
+	while (b != 0)
+	{
+		uint32_t r = a % b;
+		a = b;
+		b = r;
+	}
+
+	return a;
+}
+
+/**
+ * Chooses the tick offset of every entry, fastest entries first.
+ * Two entries collide on a share of gcd(d1, d2) / (d1 * d2) of all ticks if their offsets are equal modulo gcd(d1, d2),
+ * every entry takes the offset with the lowest collision rate against the entries placed before it.
+ * The peak load is then found by running the schedule over one period (lcm of the dividers), at most SCHEDULE_HORIZON ticks.
+ * Overruns at runtime are counted by tick(), see get_overrun_count.
+ */
+void ADS7828_Scanner::assign_phases()
+{
+	uint8_t order[ADS7828_CHANNELS];
+	uint32_t horizon = 1;
+
+	// Insertion sort by divider, the order of the list is kept for equal dividers
+	for (uint8_t i = 0; i < _n; i++)
+	{
+		uint8_t j = i;
+
+		while (j > 0 && _dividers[order[j - 1]] > _dividers[i])
+		{
+			order[j] = order[j - 1];
+			j--;
+		}
+
+		order[j] = i;
+	}
+
+	for (uint8_t k = 0; k < _n; k++)
+	{
+		uint32_t divider = _dividers[order[k]];
+		uint32_t candidates = (divider < SCHEDULE_MAX_PHASES) ? divider : SCHEDULE_MAX_PHASES;
+		uint32_t best_phase = 0;
+		uint64_t best_cost = 0;
+
+		for (uint32_t phase = 0; phase < candidates; phase++)
+		{
+			// Collision rate with 32 fractional bits, the sum of at most 15 rates of 1 fits easily
+			uint64_t cost = 0;
+
+			for (uint8_t m = 0; m < k; m++)
+			{
+				uint32_t other = _dividers[order[m]];
+				uint32_t a = gcd(divider, other);
+
+				// a is the gcd, the offset difference decides if the two ever meet
+				uint32_t p = phase % a;
+				uint32_t q = _phases[order[m]] % a;
+
+				if (p == q)
+				{
+					cost += ((uint64_t)a << 32) / other;
+				}
+			}
+
+			if (phase == 0 || cost < best_cost)
+			{
+				best_cost = cost;
+				best_phase = phase;
+			}
+		}
+
+		_phases[order[k]] = best_phase;
+
+		// Offsets are below the divider, so one period after the largest offset covers every combination
+		uint64_t lcm = (uint64_t)(horizon / gcd(horizon, divider)) * divider;
+		horizon = (lcm > SCHEDULE_HORIZON) ? SCHEDULE_HORIZON : (uint32_t)lcm;
+	}
+
+	uint32_t max_phase = 0;
+
+	for (uint8_t i = 0; i < _n; i++)
+	{
+		max_phase = (_phases[i] > max_phase) ? _phases[i] : max_phase;
+	}
+
+	horizon = (horizon + max_phase > SCHEDULE_HORIZON) ? SCHEDULE_HORIZON : horizon + max_phase;
+	_peak_load = 0;
+
+	for (uint32_t t = 0; t < horizon; t++)
+	{
+		uint8_t load = 0;
+
+		for (uint8_t i = 0; i < _n; i++)
+		{
+			if (t >= _phases[i] && (t - _phases[i]) % _dividers[i] == 0)
+			{
+				load++;
+			}
+		}
+
+		_peak_load = (load > _peak_load) ? load : _peak_load;
+	}
+}
@@ -0,0 +1,241 @@
+// Continuous interrupt driven scanning of multiple ADS7828 channel configurations
+#ifndef ADS7828_SCAN_HPP
+#define ADS7828_SCAN_HPP
+
+#include "ADS7828.hpp"
+
+class ADS7828_Bus;
+
+// Called from the I2C interrupt for every completed frame, results are indexed by ADS7828_CHANNEL
+typedef void (*ADS7828_frame_callback_t)(void *context, const ADS7828_digit_t *results, const ADS7828_CHANNEL *channels, uint8_t n);
+
+// Reasons of a channel event, combined as bit mask
+enum ADS7828_EVENT
+{
+	EVENT_ABOVE = 0b0001,  // Left the window upwards
+	EVENT_BELOW = 0b0010,  // Left the window downwards
+	EVENT_INSIDE = 0b0100, // Returned into the window
+	EVENT_DELTA = 0b1000,  // Changed by more than the delta since the last delta event
+};
+
+// Called from the I2C interrupt for every channel event, events is a mask of ADS7828_EVENT
+typedef void (*ADS7828_event_callback_t)(void *context, ADS7828_CHANNEL channel, uint8_t events, ADS7828_digit_t digit);
+
+// Called from the I2C interrupt for every decimated result, the mean of the last factor raw digits of the channel
+typedef void (*ADS7828_decimated_callback_t)(void *context, ADS7828_CHANNEL channel, ADS7828_digit_t digit);
+
+// Pushes a raw sample into a ring of any size, see ADS7828_Scanner::set_raw_ring
+typedef bool (*ADS7828_raw_push_t)(void *ring, const ADS7828_sample_t &sample);
+
+// Fractional bits of the digits in the summary accumulators, keeps the fraction of averaged and filtered results
+#define ADS7828_SUMMARY_SHIFT 4
+
+#ifdef ADS7828_INTEGER_ONLY
+// Statistics of the results of a channel over one reporting window, in digits with ADS7828_SUMMARY_SHIFT fractional bits
+struct ADS7828_summary_t
+{
+	uint32_t count;	   // Results in the window
+	uint16_t min;	   // Smallest result
+	uint16_t max;	   // Largest result
+	uint16_t mean;	   // Arithmetic mean
+	uint32_t variance; // Population variance [digit^2] with 2 * ADS7828_SUMMARY_SHIFT fractional bits
+	uint16_t rms;	   // Root mean square
+};
+#else
+// Statistics of the results of a channel over one reporting window, in digits
+struct ADS7828_summary_t
+{
+	uint32_t count; // Results in the window
+	float min;		// Smallest result
+	float max;		// Largest result
+	float mean;		// Arithmetic mean
+	float variance; // Population variance [digit^2]
+	float rms;		// Root mean square
+};
+#endif
+
+// Running sums of a channel, the digits are stored with ADS7828_SUMMARY_SHIFT fractional bits
+struct ADS7828_accumulator_t
+{
+	uint32_t count;
+	uint16_t min;
+	uint16_t max;
+	uint64_t sum;
+	uint64_t sum_sq;
+};
+
+class ADS7828_Scanner
+{
+public:
+	ADS7828_Scanner(ADS7828 *adc);
+
+	HAL_StatusTypeDef start(const ADS7828_CHANNEL *channels, uint8_t n);
+	HAL_StatusTypeDef start_scheduled(const ADS7828_CHANNEL *channels, const uint32_t *rates_hz, uint8_t n, uint32_t tick_hz);
+#ifndef ADS7828_INTEGER_ONLY
+	HAL_StatusTypeDef start_scheduled(const ADS7828_CHANNEL *channels, const float *rates_hz, uint8_t n, uint32_t tick_hz);
+#endif
+	void tick();
+	void stop();
+	bool is_running();
+	HAL_StatusTypeDef reconfigure(const ADS7828_CHANNEL *channels, uint8_t n, const uint16_t *averaging = nullptr);
+	bool is_reconfigure_pending();
+	void set_bus(ADS7828_Bus *bus);
+	uint32_t get_divider(uint8_t index);
+	uint32_t get_phase(uint8_t index);
+	uint8_t get_peak_load();
+	uint32_t get_overrun_count();
+
+	const ADS7828_digit_t *get_results();
+	const ADS7828_digit_t *acquire_results(uint32_t &sequence);
+	bool validate_results(uint32_t sequence);
+	ADS7828_digit_t get_digit(ADS7828_CHANNEL channel);
+#ifndef ADS7828_INTEGER_ONLY
+	float get_voltage(ADS7828_CHANNEL channel);
+#endif
+	const uint32_t *get_timestamps();
+	uint32_t get_timestamp(ADS7828_CHANNEL channel);
+	uint32_t get_frame_count();
+	uint32_t get_error_count();
+	ADS7828 *get_adc();
+
+	void set_frame_callback(ADS7828_frame_callback_t callback, void *context = nullptr);
+	void set_defer_unsettled(bool defer);
+	HAL_StatusTypeDef set_read_ahead(bool enable);
+	uint16_t get_unsettled_mask();
+	const uint8_t *get_qualities();
+	uint8_t get_quality(ADS7828_CHANNEL channel);
+
+	void set_window(ADS7828_CHANNEL channel, ADS7828_digit_t low, ADS7828_digit_t high);
+	void set_delta(ADS7828_CHANNEL channel, ADS7828_digit_t delta);
+	void clear_events(ADS7828_CHANNEL channel);
+	void set_event_callback(ADS7828_event_callback_t callback, void *context = nullptr);
+	uint16_t get_events();
+	uint16_t take_events();
+	uint8_t get_channel_events(ADS7828_CHANNEL channel);
+
+	void set_summary(ADS7828_CHANNEL channel, bool enable);
+	bool take_summary(ADS7828_CHANNEL channel, ADS7828_summary_t &summary);
+	uint16_t take_summaries(ADS7828_summary_t *summaries);
+	static bool summarize(const ADS7828_accumulator_t &accumulator, ADS7828_summary_t &summary);
+
+	template <uint16_t N>
+	void set_raw_ring(ADS7828_sample_ring_t<N> *ring, uint8_t device = 0);
+	void clear_raw_ring();
+	HAL_StatusTypeDef set_decimation(ADS7828_CHANNEL channel, uint16_t factor);
+	void set_decimated_callback(ADS7828_decimated_callback_t callback, void *context = nullptr);
+	const ADS7828_digit_t *get_decimated_results();
+	ADS7828_digit_t get_decimated(ADS7828_CHANNEL channel);
+	uint32_t get_decimated_count(ADS7828_CHANNEL channel);
+
+private:
+	static void on_digit(void *context, ADS7828_CHANNEL channel, HAL_StatusTypeDef status, ADS7828_digit_t digit);
+	HAL_StatusTypeDef start_read(ADS7828_CHANNEL channel);
+	bool start_ahead();
+	void next(bool started = false);
+	void next_scheduled(bool started);
+	void take_batch();
+	void start_batch();
+	void assign_phases();
+	void apply_pending();
+	HAL_StatusTypeDef start_dividers(uint8_t n, uint32_t tick_hz);
+	uint8_t detect(ADS7828_CHANNEL channel, ADS7828_digit_t digit);
+	void accumulate(ADS7828_CHANNEL channel, ADS7828_digit_t digit);
+	bool decimate(ADS7828_CHANNEL channel, uint16_t raw);
+	void set_raw_push(ADS7828_raw_push_t push, void *ring, uint8_t device);
+
+	template <uint16_t N>
+	static bool push_raw(void *ring, const ADS7828_sample_t &sample)
+	{
+		return static_cast<ADS7828_sample_ring_t<N> *>(ring)->push(sample);
+	}
+
+	ADS7828 *_adc;								 // Driver used for the reads
+	ADS7828_Bus *_bus = nullptr;				 // Bus manager the reads are submitted to, nullptr to start them directly
+	ADS7828_CHANNEL _channels[ADS7828_CHANNELS]; // Channel list, scanned round-robin
+	uint8_t _n = 0;								 // Number of channels in the list
+	uint8_t _index = 0;							 // Position of the running read in the list
+
+	ADS7828_CHANNEL _pending[ADS7828_CHANNELS];	 // Channel list of reconfigure, swapped with _channels at the next frame boundary
+	uint8_t _pending_n = 0;						 // Number of channels in the pending list
+	uint16_t _pending_averaging[ADS7828_CHANNELS] = {0}; // Averaging depths of the pending list, indexed by list position
+	bool _pending_has_averaging = false;		 // The pending list changes the averaging
+	volatile bool _reconfigure = false;			 // A pending list waits for the frame boundary
+
+	ADS7828_digit_t _results[2][ADS7828_CHANNELS] = {{0}}; // Double-buffered result tables, indexed by channel
+	uint32_t _timestamps[2][ADS7828_CHANNELS] = {{0}}; // DWT cycle counts of the results
+	volatile uint8_t _front = 0;				 // Table holding the last completed frame
+	volatile uint32_t _frames = 0;				 // Number of completed frames
+	volatile uint32_t _errors = 0;				 // Number of failed reads
+	volatile bool _running = false;				 // Scan is active
+
+	bool _scheduled = false;						  // Channels are read on timer ticks instead of round-robin
+	uint32_t _dividers[ADS7828_CHANNELS] = {0};		  // Ticks between two reads of a list entry
+	uint32_t _phases[ADS7828_CHANNELS] = {0};		  // Tick offset of a list entry inside its divider
+	uint32_t _countdown[ADS7828_CHANNELS] = {0};	  // Ticks until a list entry is due
+	uint8_t _batch[ADS7828_CHANNELS] = {0};			  // List entries read in the running batch
+	uint8_t _batch_n = 0;							  // Number of entries in the running batch
+	uint16_t _batch_mask = 0;						  // Running batch, bit per list entry
+	volatile uint16_t _due = 0;						  // Entries that are due but not started yet, bit per list entry
+	volatile bool _active = false;					  // A batch is being read
+	uint8_t _peak_load = 0;							  // Most reads that fall on one tick
+	volatile uint32_t _overruns = 0;				  // Ticks that found an entry still due
+
+	ADS7828_frame_callback_t _frame_callback = nullptr; // Called for every completed frame
+	void *_frame_context = nullptr;						// User context passed to the frame callback
+
+	bool _defer_unsettled = false;	 // Repeat reads taken during reference settling
+	bool _read_ahead = false;		 // Start the next read before the result is processed
+	uint16_t _unsettled[2] = {0};	 // Channels read during reference settling, bit per ADS7828_CHANNEL
+	uint16_t _repeated = 0;			 // Channels whose running read repeats a deferred one
+	uint8_t _quality[2][ADS7828_CHANNELS] = {{0}}; // ADS7828_QUALITY bits of the results, double-buffered like them
+
+	ADS7828_digit_t _low[ADS7828_CHANNELS] = {0};		  // Lower window limits in digits
+	ADS7828_digit_t _high[ADS7828_CHANNELS] = {0};	  // Upper window limits in digits
+	ADS7828_digit_t _delta[ADS7828_CHANNELS] = {0};	  // Change in digits that triggers a delta event
+	ADS7828_digit_t _reference[ADS7828_CHANNELS] = {0}; // Value of the last delta event
+	uint8_t _zone[ADS7828_CHANNELS] = {0};	  // Window position of the last result, 0 inside or EVENT_ABOVE / EVENT_BELOW
+	uint8_t _reasons[ADS7828_CHANNELS] = {0}; // ADS7828_EVENT bits collected since the last take_events
+	uint8_t _taken[ADS7828_CHANNELS] = {0};	  // ADS7828_EVENT bits returned by the last take_events
+	uint16_t _window_mask = 0;				  // Channels with a window, bit per ADS7828_CHANNEL
+	uint16_t _delta_mask = 0;				  // Channels with a delta
+	uint16_t _primed = 0;					  // Channels with a valid zone and reference
+	volatile uint16_t _events = 0;			  // Channels with pending events
+
+	ADS7828_event_callback_t _event_callback = nullptr; // Called for every channel event
+	void *_event_context = nullptr;						// User context passed to the event callback
+
+	ADS7828_accumulator_t _accumulators[ADS7828_CHANNELS] = {}; // Sums of the current reporting window, indexed by channel
+	uint16_t _summary_mask = 0;									// Channels with accumulators, bit per ADS7828_CHANNEL
+
+	ADS7828_raw_push_t _raw_push = nullptr; // Pushes every raw digit into the ring, nullptr without ring
+	void *_raw_ring = nullptr;				// Ring of set_raw_ring
+	uint8_t _raw_device = 0;				// Device index of the raw samples
+
+	uint16_t _dec_factor[ADS7828_CHANNELS] = {0}; // Raw digits per decimated result, 0 if disabled
+	uint16_t _dec_fill[ADS7828_CHANNELS] = {0};	  // Raw digits in the running sum
+	uint32_t _dec_sum[ADS7828_CHANNELS] = {0};	  // Sum of the raw digits of the running result
+#ifndef ADS7828_INTEGER_ONLY
+	float _dec_scale[ADS7828_CHANNELS] = {0};	  // 1 / factor, so a result costs one multiplication
+#endif
+	ADS7828_digit_t _decimated[ADS7828_CHANNELS] = {0};	  // Last decimated result of every channel
+	volatile uint32_t _dec_count[ADS7828_CHANNELS] = {0}; // Decimated results since set_decimation
+	uint16_t _dec_mask = 0;						  // Channels with decimation, bit per ADS7828_CHANNEL
+
+	ADS7828_decimated_callback_t _decimated_callback = nullptr; // Called for every decimated result
+	void *_decimated_context = nullptr;							// User context passed to the decimated callback
+};
+
+/**
+ * Pushes the raw digit of every read into a sample ring at the full scan rate, next to the result tables.
+ * The ring is independent of averaging and filters, it gets every raw digit while the tables get the processed results.
+ *
+ * @param ring Ring of the samples, the timestamps are DWT cycles
+ * @param device Device index stored in the samples
+ */
+template <uint16_t N>
+inline void ADS7828_Scanner::set_raw_ring(ADS7828_sample_ring_t<N> *ring, uint8_t device)
+{
+	set_raw_push(push_raw<N>, ring, device);
+}
+
+#endif // ADS7828_SCAN_HPP
@@ -0,0 +1,281 @@
+#include "ADS7828_soak.hpp"
+
+// Single-ended channels read by default, all 8 inputs of every device
+static const ADS7828_CHANNEL soak_channels[] = {CHANNEL_0_COM, CHANNEL_1_COM, CHANNEL_2_COM, CHANNEL_3_COM,
+												CHANNEL_4_COM, CHANNEL_5_COM, CHANNEL_6_COM, CHANNEL_7_COM};
+
+/**
+ * Constructor for a soak run that keeps several scanners at their maximum rate
+ */
+ADS7828_Soak::ADS7828_Soak()
+{
+}
+
+/**
+ * Adds a scanner to the run. Its frame callback is used by the soak run.
+ * Scanners of devices on one bus have to share an ADS7828_Bus, see ADS7828_Scanner::set_bus.
+ *
+ * @param scanner Scanner of an ADS7828 whose HAL I2C callbacks are forwarded
+ * @return HAL_OK if the scanner was added, HAL_BUSY while running, HAL_ERROR for too many scanners
+ */
+HAL_StatusTypeDef ADS7828_Soak::attach(ADS7828_Scanner *scanner)
+{
+	if (_running)
+	{
+		return HAL_BUSY;
+	}
+
+	if (_count >= ADS7828_SOAK_SCANNERS)
+	{
+		return HAL_ERROR;
+	}
+
+	_scanners[_count] = scanner;
+	_links[_count] = {this, _count, 0, 0, {0}, {0}};
+	_count++;
+
+	return HAL_OK;
+}
+
+/**
+ * Resets the report and starts round-robin scans of the channel list on all scanners.
+ * Call poll() from the main loop, it restarts scans that stopped and keeps the run going for hours.
+ *
+ * @param channels List of ADS7828_CHANNEL configurations, nullptr for the 8 single-ended channels
+ * @param n Number of channels in the list (1 - 16)
+ * @return HAL_OK if all scanners were started, HAL_BUSY if already running, HAL_ERROR if no scanner is attached
+ *         or for an invalid list, other status of the first scanner that did not start
+ */
+HAL_StatusTypeDef ADS7828_Soak::start(const ADS7828_CHANNEL *channels, uint8_t n)
+{
+	if (_running)
+	{
+		return HAL_BUSY;
+	}
+
+	if (channels == nullptr)
+	{
+		channels = soak_channels;
+		n = sizeof(soak_channels) / sizeof(soak_channels[0]);
+	}
+
+	if (_count == 0 || n == 0 || n > ADS7828_CHANNELS)
+	{
+		return HAL_ERROR;
+	}
+
+	for (uint8_t i = 0; i < n; i++)
+	{
+		_channels[i] = channels[i];
+	}
+
+	_n = n;
+
+	// Bucket limits in cycles, so the interrupt only compares
+	ADS7828::enable_cycle_counter();
+	uint32_t cycles_per_us = SystemCoreClock / 1000000;
+
+	for (uint8_t i = 0; i < ADS7828_SOAK_BUCKETS - 1; i++)
+	{
+		_bounds[i] = cycles_per_us << i;
+	}
+
+	reset();
+	_running = true;
+
+	for (uint8_t s = 0; s < _count; s++)
+	{
+		_scanners[s]->set_frame_callback(on_frame, &_links[s]);
+		HAL_StatusTypeDef status = _scanners[s]->start(_channels, _n);
+
+		if (status != HAL_OK)
+		{
+			stop();
+			return status;
+		}
+	}
+
+	return HAL_OK;
+}
+
+/**
+ * Stops the scans of all scanners, the report keeps its values
+ */
+void ADS7828_Soak::stop()
+{
+	_running = false;
+
+	for (uint8_t s = 0; s < _count; s++)
+	{
+		_scanners[s]->stop();
+		_scanners[s]->set_frame_callback(nullptr);
+	}
+}
+
+/**
+ * Check if the soak run is active
+ *
+ * @return True between start and stop
+ */
+bool ADS7828_Soak::is_running()
+{
+	return _running;
+}
+
+/**
+ * Restarts scans that stopped, e.g. because a read could not be started after an error.
+ * Call it from the main loop, a scan whose driver is still busy is restarted by a later call.
+ */
+void ADS7828_Soak::poll()
+{
+	if (!_running)
+	{
+		return;
+	}
+
+	for (uint8_t s = 0; s < _count; s++)
+	{
+		if (!_scanners[s]->is_running() && _scanners[s]->start(_channels, _n) == HAL_OK)
+		{
+			_report.restarts++;
+		}
+	}
+}
+
+/**
+ * Clears the report and the start time, e.g. to exclude the warm-up from a run
+ */
+void ADS7828_Soak::reset()
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	_report = {};
+	_recovery_sum = 0;
+	_start_tick = HAL_GetTick();
+
+	for (uint8_t s = 0; s < _count; s++)
+	{
+		_links[s].valid = 0;
+		_links[s].failing = 0;
+	}
+
+	__set_PRIMASK(primask);
+}
+
+/**
+ * Get the results since start or reset, can be called while the run is active
+ *
+ * @param report Receives a consistent copy of the counters with the times in [us]
+ */
+void ADS7828_Soak::get_report(ADS7828_soak_report_t &report)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	report = _report;
+	uint64_t recovery_sum = _recovery_sum;
+
+	__set_PRIMASK(primask);
+
+	report.elapsed_ms = HAL_GetTick() - _start_tick;
+	report.recovery_max_us = to_us(report.recovery_max_us);
+	report.interval_max_us = to_us(report.interval_max_us);
+	report.recovery_mean_us = (report.recoveries != 0) ? to_us(recovery_sum / report.recoveries) : 0;
+}
+
+/**
+ * Frame callback of a scanner, called from the I2C interrupt with the tables of the completed frame
+ */
+void ADS7828_Soak::on_frame(void *context, const ADS7828_digit_t *results, const ADS7828_CHANNEL *channels, uint8_t n)
+{
+	(void)results;
+
+	link_t &link = *static_cast<link_t *>(context);
+	ADS7828_Soak *self = link.owner;
+	ADS7828_Scanner *scanner = self->_scanners[link.index];
+	const uint8_t *qualities = scanner->get_qualities();
+	const uint32_t *timestamps = scanner->get_timestamps();
+	uint32_t now = ADS7828::get_cycles();
+
+	// Scanners of different buses may interrupt each other
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	self->_report.frames++;
+
+	for (uint8_t i = 0; i < n; i++)
+	{
+		self->record(link, channels[i], qualities[channels[i]], timestamps[channels[i]], now);
+	}
+
+	__set_PRIMASK(primask);
+}
+
+/**
+ * Counts one result of a channel and updates its interval and outage times
+ *
+ * @param link State of the scanner
+ * @param channel The ADS7828_CHANNEL configuration of the result
+ * @param quality ADS7828_QUALITY bits of the result
+ * @param timestamp DWT cycle count of the result
+ * @param now DWT cycle count of the frame completion
+ */
+void ADS7828_Soak::record(link_t &link, ADS7828_CHANNEL channel, uint8_t quality, uint32_t timestamp, uint32_t now)
+{
+	uint16_t bit = 1U << channel;
+
+	_report.samples++;
+
+	if (quality & QUALITY_RETRIED)
+	{
+		_report.retried++;
+	}
+
+	if (quality & QUALITY_FAILED)
+	{
+		_report.dropped++;
+
+		if (!(link.failing & bit))
+		{
+			link.failing |= bit;
+			link.fail_start[channel] = now;
+		}
+		return;
+	}
+
+	if (link.failing & bit)
+	{
+		link.failing &= ~bit;
+		uint32_t outage = timestamp - link.fail_start[channel];
+
+		_report.recoveries++;
+		_recovery_sum += outage;
+		_report.recovery_max_us = (outage > _report.recovery_max_us) ? outage : _report.recovery_max_us;
+	}
+
+	if (link.valid & bit)
+	{
+		uint32_t interval = timestamp - link.last[channel];
+		uint8_t bucket = 0;
+
+		while (bucket < ADS7828_SOAK_BUCKETS - 1 && interval >= _bounds[bucket])
+		{
+			bucket++;
+		}
+
+		_report.histogram[bucket]++;
+		_report.interval_max_us = (interval > _report.interval_max_us) ? interval : _report.interval_max_us;
+	}
+
+	link.valid |= bit;
+	link.last[channel] = timestamp;
+}
+
+/**
+ * Converts DWT cycles to microseconds
+ */
+uint32_t ADS7828_Soak::to_us(uint64_t cycles)
+{
+	return (uint32_t)(cycles / (SystemCoreClock / 1000000));
+}
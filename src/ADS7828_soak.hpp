@@ -0,0 +1,72 @@
+// Load generator for soak runs of the scan engine, reports dropped samples, sample intervals and recovery times
+#ifndef ADS7828_SOAK_HPP
+#define ADS7828_SOAK_HPP
+
+#include "ADS7828_scan.hpp"
+
+// Maximum number of scanners driven at once, e.g. four devices on one bus
+constexpr uint8_t ADS7828_SOAK_SCANNERS = 4;
+
+// Buckets of the interval histogram, bucket i counts intervals below 2^i us, the last one all longer intervals
+constexpr uint8_t ADS7828_SOAK_BUCKETS = 16;
+
+// Results of a soak run, times are converted from DWT cycles (intervals and outages up to one counter period)
+struct ADS7828_soak_report_t
+{
+	uint32_t elapsed_ms;						 // Time since start
+	uint32_t frames;							 // Completed frames of all scanners
+	uint32_t samples;							 // Published results of all channels
+	uint32_t dropped;							 // Results that kept the previous value because the read failed
+	uint32_t retried;							 // Results that were read again during reference settling
+	uint32_t restarts;							 // Scans that stopped and were restarted by poll
+	uint32_t recoveries;						 // Channels that delivered a valid result again after failed reads
+	uint32_t recovery_max_us;					 // Longest time from the first failed read to the next valid result
+	uint32_t recovery_mean_us;					 // Mean of these times
+	uint32_t interval_max_us;					 // Longest time between two valid results of a channel
+	uint32_t histogram[ADS7828_SOAK_BUCKETS];	 // Times between two valid results of a channel
+};
+
+class ADS7828_Soak
+{
+public:
+	ADS7828_Soak();
+
+	HAL_StatusTypeDef attach(ADS7828_Scanner *scanner);
+	HAL_StatusTypeDef start(const ADS7828_CHANNEL *channels = nullptr, uint8_t n = 0);
+	void stop();
+	bool is_running();
+	void poll();
+	void reset();
+	void get_report(ADS7828_soak_report_t &report);
+
+private:
+	// Identifies the scanner in its frame callback and holds its per channel state
+	struct link_t
+	{
+		ADS7828_Soak *owner;
+		uint8_t index;
+		uint16_t valid;							 // Channels with a valid result, bit per ADS7828_CHANNEL
+		uint16_t failing;						 // Channels whose last read failed
+		uint32_t last[ADS7828_CHANNELS];		 // Timestamp of the last valid result
+		uint32_t fail_start[ADS7828_CHANNELS];	 // DWT cycle count of the first failed read of an outage
+	};
+
+	static void on_frame(void *context, const ADS7828_digit_t *results, const ADS7828_CHANNEL *channels, uint8_t n);
+	void record(link_t &link, ADS7828_CHANNEL channel, uint8_t quality, uint32_t timestamp, uint32_t now);
+	uint32_t to_us(uint64_t cycles);
+
+	ADS7828_Scanner *_scanners[ADS7828_SOAK_SCANNERS] = {}; // Driven scanners
+	link_t _links[ADS7828_SOAK_SCANNERS];					// Callback contexts of the scanners
+	uint8_t _count = 0;										// Number of attached scanners
+
+	ADS7828_CHANNEL _channels[ADS7828_CHANNELS]; // Channel list of every scanner
+	uint8_t _n = 0;								 // Number of channels in the list
+	volatile bool _running = false;				 // Soak run is active
+	uint32_t _start_tick = 0;					 // HAL tick of the start
+
+	uint32_t _bounds[ADS7828_SOAK_BUCKETS - 1] = {0}; // Upper limits of the histogram buckets in DWT cycles
+	ADS7828_soak_report_t _report = {};				  // Counters, the times are kept in cycles until get_report
+	uint64_t _recovery_sum = 0;						  // Sum of the recovery times in cycles
+};
+
+#endif // ADS7828_SOAK_HPP
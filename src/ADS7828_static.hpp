@@ -0,0 +1,234 @@
+// Compile-time configured ADS7828 with statically allocated averaging buffers
+#ifndef ADS7828_STATIC_HPP
+#define ADS7828_STATIC_HPP
+
+#include "ADS7828.hpp"
+
+#ifdef ADS7828_ASYNC_ONLY
+#error "ADS7828T reads with the blocking transfers, which ADS7828_ASYNC_ONLY compiles out"
+#endif
+
+// List of the channel configurations used by an ADS7828T
+template <ADS7828_CHANNEL... Channels>
+struct ADS7828_channel_set
+{
+	static constexpr uint8_t size = sizeof...(Channels);
+
+	// Position of a channel in the list, size if it is not part of it
+	static constexpr uint8_t index_of(ADS7828_CHANNEL channel)
+	{
+		const ADS7828_CHANNEL channels[] = {Channels...};
+
+		for (uint8_t i = 0; i < size; i++)
+		{
+			if (channels[i] == channel)
+			{
+				return i;
+			}
+		}
+
+		return size;
+	}
+};
+
+// Circular buffer with a depth fixed at compile time, see ADS7828_circ_buf_t
+template <uint16_t N>
+struct ADS7828_static_buf_t
+{
+	uint16_t w_index = 0;   // Write index
+	uint16_t fill = 0;	   // Number of valid elements, grows up to N after a clear
+	uint32_t sum = 0;	   // Running sum of all valid elements
+	uint16_t data[N] = {0}; // Buffer data
+
+	// Replace the oldest value and return the new average
+	uint16_t append(uint16_t value)
+	{
+		sum -= data[w_index];
+		sum += value;
+		data[w_index++] = value;
+
+		// Circ buffer rollover
+		if (w_index >= N)
+		{
+			w_index = 0;
+		}
+
+		// Warm-up, divide by the valid elements only
+		if (fill < N)
+		{
+			fill++;
+			return (uint16_t)((sum + fill / 2) / fill);
+		}
+
+		// Filled, N is a compile time constant here, so a power of two becomes a shift
+#ifdef ADS7828_SOFT_MATH
+		if ((N & (N - 1)) != 0)
+		{
+			// Thumb-1 has no long multiply, the compiler would call the division routine even for a constant
+			return (uint16_t)ADS7828_divide(sum + N / 2, N, 0xFFFFFFFFu / N);
+		}
+#endif
+		return (uint16_t)((sum + N / 2) / N);
+	}
+
+#ifndef ADS7828_INTEGER_ONLY
+	float average()
+	{
+#ifdef ADS7828_SOFT_MATH
+		if (fill == N && (N & (N - 1)) != 0)
+		{
+			uint32_t fixed = ADS7828_divide((sum << ADS7828_AVG_FRAC_BITS) + N / 2, N, 0xFFFFFFFFu / N);
+			return (float)fixed * (1.0f / (1 << ADS7828_AVG_FRAC_BITS));
+		}
+#endif
+		return fill == 0 ? 0.0f : (float)sum / fill;
+	}
+#endif
+
+	void clear()
+	{
+		for (uint16_t i = 0; i < N; i++)
+		{
+			data[i] = 0;
+		}
+
+		w_index = 0;
+		fill = 0;
+		sum = 0;
+	}
+};
+
+// Depth 1 disables averaging and takes no memory
+template <>
+struct ADS7828_static_buf_t<1>
+{
+	uint16_t last = 0; // Last value, only kept for average()
+
+	uint16_t append(uint16_t value)
+	{
+		last = value;
+		return value;
+	}
+
+#ifndef ADS7828_INTEGER_ONLY
+	float average()
+	{
+		return last;
+	}
+#endif
+
+	void clear()
+	{
+		last = 0;
+	}
+};
+
+// Depth 0 is treated like depth 1
+template <>
+struct ADS7828_static_buf_t<0> : ADS7828_static_buf_t<1>
+{
+};
+
+// One buffer for every averaging depth, laid out back to back
+template <uint16_t... Depths>
+struct ADS7828_buf_pack
+{
+};
+
+template <uint16_t Depth, uint16_t... Rest>
+struct ADS7828_buf_pack<Depth, Rest...>
+{
+	ADS7828_static_buf_t<Depth> head;
+	ADS7828_buf_pack<Rest...> tail;
+};
+
+// Compile-time access to the buffer at position I of a pack
+template <uint8_t I>
+struct ADS7828_buf_get
+{
+	template <typename Pack>
+	static auto &get(Pack &pack)
+	{
+		return ADS7828_buf_get<I - 1>::get(pack.tail);
+	}
+};
+
+template <>
+struct ADS7828_buf_get<0>
+{
+	template <typename Pack>
+	static auto &get(Pack &pack)
+	{
+		return pack.head;
+	}
+};
+
+/**
+ * ADS7828 where the used channels and their averaging depths are template parameters, e.g.
+ * ADS7828T<ADS7828_channel_set<CHANNEL_0_COM, CHANNEL_2_3>, 16, 1> for 16 values on CH0 and no averaging on CH2-CH3.
+ * Only the buffers of the listed channels are allocated (in .bss for global objects) and the channel lookup is done at compile time.
+ * The underlying driver has no averaging pool, the buffers of this class replace it.
+ */
+template <typename ChannelSet, uint16_t... AvgDepths>
+class ADS7828T;
+
+template <ADS7828_CHANNEL... Channels, uint16_t... AvgDepths>
+class ADS7828T<ADS7828_channel_set<Channels...>, AvgDepths...>
+{
+	using channel_set = ADS7828_channel_set<Channels...>;
+	static_assert(sizeof...(Channels) == sizeof...(AvgDepths), "Every channel needs an averaging depth");
+
+public:
+	ADS7828T(I2C_HandleTypeDef *hi2c, uint8_t address) : _adc(hi2c, address) {}
+#ifndef ADS7828_INTEGER_ONLY
+	ADS7828T(I2C_HandleTypeDef *hi2c, uint8_t address, float external_ref_voltage) : _adc(hi2c, address, external_ref_voltage) {}
+#endif
+
+	// Underlying driver for reference, power mode and scaling settings
+	ADS7828 &driver() { return _adc; }
+
+#ifndef ADS7828_INTEGER_ONLY
+	// Reads the (averaged) digit of a channel, see ADS7828::read_digit
+	template <ADS7828_CHANNEL Channel>
+	float read_digit()
+	{
+		auto &buffer = get_buffer<Channel>();
+		buffer.append(_adc.read_raw(Channel));
+		return buffer.average();
+	}
+
+	// Reads the (averaged) voltage of a channel, see ADS7828::read_voltage
+	template <ADS7828_CHANNEL Channel>
+	float read_voltage()
+	{
+		return _adc.digit_to_voltage(Channel, read_digit<Channel>());
+	}
+#endif
+
+	// Reads the (averaged) voltage of a channel in millivolts, see ADS7828::read_millivolts
+	template <ADS7828_CHANNEL Channel>
+	int32_t read_millivolts()
+	{
+		return _adc.digit_to_millivolts(Channel, get_buffer<Channel>().append(_adc.read_raw(Channel)));
+	}
+
+	// Clears all stored values of a channel, see ADS7828::clear_averaging
+	template <ADS7828_CHANNEL Channel>
+	void clear_averaging()
+	{
+		get_buffer<Channel>().clear();
+	}
+
+private:
+	template <ADS7828_CHANNEL Channel>
+	auto &get_buffer()
+	{
+		static_assert(channel_set::index_of(Channel) < channel_set::size, "Channel is not part of the channel set");
+		return ADS7828_buf_get<channel_set::index_of(Channel)>::get(_buffers);
+	}
+
+	ADS7828 _adc;					   // Driver used for the transfers, without an averaging pool
+	ADS7828_buf_pack<AvgDepths...> _buffers; // Averaging buffers of the listed channels
+};
+
+#endif // ADS7828_STATIC_HPP
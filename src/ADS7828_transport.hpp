@@ -0,0 +1,145 @@
+// Blocking I2C transports of the ADS7828 driver, included by ADS7828.hpp after the HAL
+#ifndef ADS7828_TRANSPORT_HPP
+#define ADS7828_TRANSPORT_HPP
+
+// Define to use the register level transport for the blocking reads, the HAL is used otherwise
+// #define ADS7828_LL
+
+// Define to bit-bang the blocking reads on two GPIOs, e.g. if no I2C peripheral is free
+// #define ADS7828_BITBANG
+
+// Define as a header (e.g. -D ADS7828_TRANSPORT_HEADER='"my_transport.hpp"') that typedefs ADS7828_transport_t
+// to use your own transport for the blocking transfers
+// #define ADS7828_TRANSPORT_HEADER "my_transport.hpp"
+
+/**
+ * Base of the blocking transports (CRTP).
+ * The driver calls write, read and write_read of ADS7828_transport_t directly, the type is fixed at compile time,
+ * so there are no virtual calls. A transport is constructed from the I2C handle and implements
+ *
+ *   HAL_StatusTypeDef write(uint8_t address, uint8_t *data, uint16_t size, uint32_t timeout_ms);
+ *   HAL_StatusTypeDef read(uint8_t address, uint8_t *data, uint16_t size, uint32_t timeout_ms);
+ *
+ * write ends with a STOP, read starts with a START and ends with a STOP. Transports that can do repeated starts
+ * also implement write_read, otherwise the one of this base sends a STOP between command and result.
+ * Transports that wait for a busy bus longer than the timeout implement is_bus_busy, so a latency budget can skip the transfer.
+ */
+template <typename Derived>
+class ADS7828_Transport
+{
+public:
+	/**
+	 * Writes one byte and reads the answer, with a STOP in between
+	 *
+	 * @param address 7 Bit I2C address
+	 * @param command Byte to send, e.g. the command byte
+	 * @param data Receives the bytes
+	 * @param size Number of bytes
+	 * @param timeout_ms Timeout of each transfer in [ms]
+	 * @return HAL status of the first failed or the last transfer
+	 */
+	HAL_StatusTypeDef write_read(uint8_t address, uint8_t command, uint8_t *data, uint16_t size, uint32_t timeout_ms)
+	{
+		HAL_StatusTypeDef status = self().write(address, &command, 1, timeout_ms);
+		return (status == HAL_OK) ? self().read(address, data, size, timeout_ms) : status;
+	}
+
+	/**
+	 * Check if another master or a stuck slave occupies the bus
+	 *
+	 * @return False, the transfers of this transport keep to their timeout on a busy bus
+	 */
+	bool is_bus_busy()
+	{
+		return false;
+	}
+
+protected:
+	Derived &self()
+	{
+		return static_cast<Derived &>(*this);
+	}
+};
+
+// Blocking transfers through the HAL I2C functions
+class ADS7828_HalTransport : public ADS7828_Transport<ADS7828_HalTransport>
+{
+public:
+	ADS7828_HalTransport(I2C_HandleTypeDef *hi2c) : _hi2c(hi2c) {}
+
+	/**
+	 * Writes bytes to a device and ends with a STOP
+	 *
+	 * @param address 7 Bit I2C address
+	 * @param data Bytes to send
+	 * @param size Number of bytes
+	 * @param timeout_ms Timeout of the transfer in [ms]
+	 * @return HAL status of the transfer
+	 */
+	HAL_StatusTypeDef write(uint8_t address, uint8_t *data, uint16_t size, uint32_t timeout_ms)
+	{
+		return HAL_I2C_Master_Transmit(_hi2c, (address << 1), data, size, timeout_ms);
+	}
+
+	/**
+	 * Reads bytes from a device and ends with a STOP
+	 *
+	 * @param address 7 Bit I2C address
+	 * @param data Receives the bytes
+	 * @param size Number of bytes
+	 * @param timeout_ms Timeout of the transfer in [ms]
+	 * @return HAL status of the transfer
+	 */
+	HAL_StatusTypeDef read(uint8_t address, uint8_t *data, uint16_t size, uint32_t timeout_ms)
+	{
+		return HAL_I2C_Master_Receive(_hi2c, (address << 1), data, size, timeout_ms);
+	}
+
+	/**
+	 * Writes one byte and reads the answer after a repeated start
+	 *
+	 * @param address 7 Bit I2C address
+	 * @param command Byte to send, e.g. the command byte
+	 * @param data Receives the bytes
+	 * @param size Number of bytes
+	 * @param timeout_ms Timeout of the transfer in [ms]
+	 * @return HAL status of the transfer
+	 */
+	HAL_StatusTypeDef write_read(uint8_t address, uint8_t command, uint8_t *data, uint16_t size, uint32_t timeout_ms)
+	{
+		// The command byte is sent like an 8 bit register address
+		return HAL_I2C_Mem_Read(_hi2c, (address << 1), command, I2C_MEMADD_SIZE_8BIT, data, size, timeout_ms);
+	}
+
+	/**
+	 * Check if the BUSY flag of the peripheral is set.
+	 * The HAL waits up to 25ms for a busy bus before every transfer, independent of the timeout.
+	 *
+	 * @return True if a transfer would have to wait for the bus
+	 */
+	bool is_bus_busy()
+	{
+#ifdef ADS7828_HOST
+		return false;
+#else
+		return __HAL_I2C_GET_FLAG(_hi2c, I2C_FLAG_BUSY) != RESET;
+#endif
+	}
+
+private:
+	I2C_HandleTypeDef *_hi2c; // I2C Handle
+};
+
+#if defined(ADS7828_TRANSPORT_HEADER)
+#include ADS7828_TRANSPORT_HEADER
+#elif defined(ADS7828_LL)
+#include "ADS7828_ll.hpp"
+typedef ADS7828_LlTransport ADS7828_transport_t;
+#elif defined(ADS7828_BITBANG)
+#include "ADS7828_bitbang.hpp"
+typedef ADS7828_BitBangTransport ADS7828_transport_t;
+#else
+typedef ADS7828_HalTransport ADS7828_transport_t;
+#endif
+
+#endif // ADS7828_TRANSPORT_HPP
@@ -0,0 +1,196 @@
+#include "ADS7828_uart.hpp"
+
+#ifdef HAL_UART_MODULE_ENABLED
+
+/**
+ * Constructor for a binary sample stream over UART
+ *
+ * @param huart Pointer to an initialized UART with a TX DMA channel
+ */
+ADS7828_Uart::ADS7828_Uart(UART_HandleTypeDef *huart) : _huart(huart)
+{
+}
+
+/**
+ * Adds a raw sample to the current frame, full frames are sent with DMA right away.
+ * Can be called from interrupts, e.g. from the completion callback of a scan or stream.
+ *
+ * @param channel The ADS7828_CHANNEL configuration of the sample, stored as 4 Bit tag
+ * @param digit The raw digit (0 - 4095)
+ * @return False if the sample was dropped because both frames are in use
+ */
+bool ADS7828_Uart::push(ADS7828_CHANNEL channel, uint16_t digit)
+{
+	// The UART interrupt switches the frames as well
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	bool added = add(channel, digit);
+
+	__set_PRIMASK(primask);
+	return added;
+}
+
+/**
+ * Adds a block of raw samples of one channel, e.g. the buffer of stream_channel
+ *
+ * @param channel The ADS7828_CHANNEL configuration of the samples
+ * @param digits The raw digits (0 - 4095)
+ * @param count Number of digits
+ * @return Number of samples added, the rest was dropped
+ */
+size_t ADS7828_Uart::push(ADS7828_CHANNEL channel, const uint16_t *digits, size_t count)
+{
+	size_t added = 0;
+
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	for (size_t i = 0; i < count; i++)
+	{
+		added += add(channel, digits[i]);
+	}
+
+	__set_PRIMASK(primask);
+	return added;
+}
+
+/**
+ * Sends the current frame even if it isn't full, e.g. at the end of a capture
+ *
+ * @return HAL_OK if the frame was sent or queued (or is empty), HAL_BUSY if a full frame is still waiting
+ */
+HAL_StatusTypeDef ADS7828_Uart::flush()
+{
+	HAL_StatusTypeDef status = HAL_OK;
+
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	if (_pending)
+	{
+		status = HAL_BUSY;
+	}
+	else if (_frames[_fill].count != 0)
+	{
+		if (_sending)
+		{
+			_pending = true;
+		}
+		else
+		{
+			send(_fill);
+		}
+	}
+
+	__set_PRIMASK(primask);
+	return status;
+}
+
+/**
+ * Check if all frames are sent
+ *
+ * @return True if no transfer is running or waiting
+ */
+bool ADS7828_Uart::is_idle()
+{
+	return !_sending && !_pending;
+}
+
+/**
+ * Get the number of frames sent since construction
+ *
+ * @return Number of frames handed to the DMA
+ */
+uint32_t ADS7828_Uart::get_frame_count()
+{
+	return _frames_sent;
+}
+
+/**
+ * Get the number of samples that couldn't be stored, the UART is too slow for the sample rate then
+ *
+ * @return Number of dropped samples
+ */
+uint32_t ADS7828_Uart::get_dropped_count()
+{
+	return _dropped;
+}
+
+/**
+ * Has to be called from HAL_UART_TxCpltCallback.
+ * Sends the waiting frame, if there is one.
+ *
+ * @param huart The UART handle passed to the HAL callback
+ */
+void ADS7828_Uart::tx_complete_callback(UART_HandleTypeDef *huart)
+{
+	if (huart != _huart)
+	{
+		return;
+	}
+
+	_sending = false;
+
+	if (_pending)
+	{
+		_pending = false;
+		send(_fill);
+	}
+}
+
+/**
+ * Adds a sample to the frame being filled, interrupts have to be disabled
+ *
+ * @param tag 4 Bit tag of the sample
+ * @param digit The raw digit
+ * @return False if the sample was dropped
+ */
+bool ADS7828_Uart::add(uint8_t tag, uint16_t digit)
+{
+	// The filled frame still waits for the running transfer
+	if (_pending)
+	{
+		_dropped++;
+		return false;
+	}
+
+	if (_frames[_fill].add(tag, digit))
+	{
+		if (_sending)
+		{
+			_pending = true;
+		}
+		else
+		{
+			send(_fill);
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Starts the DMA transfer of a frame and switches to the other frame for new samples
+ *
+ * @param index The frame to send
+ */
+void ADS7828_Uart::send(uint8_t index)
+{
+	size_t length = _frames[index].finish(_sequence++);
+
+	_fill = index ^ 1;
+	_frames[_fill].clear();
+
+	if (HAL_UART_Transmit_DMA(_huart, _frames[index].data, (uint16_t)length) == HAL_OK)
+	{
+		_sending = true;
+		_frames_sent++;
+	}
+	else
+	{
+		_dropped += _frames[index].count;
+	}
+}
+
+#endif // HAL_UART_MODULE_ENABLED
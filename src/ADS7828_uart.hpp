@@ -0,0 +1,44 @@
+// Binary streaming of raw samples over UART with DMA
+#ifndef ADS7828_UART_HPP
+#define ADS7828_UART_HPP
+
+#include "ADS7828.hpp"
+#include "ADS7828_frame.hpp"
+
+#ifdef HAL_UART_MODULE_ENABLED
+
+class ADS7828_Uart
+{
+public:
+	ADS7828_Uart(UART_HandleTypeDef *huart);
+
+	bool push(ADS7828_CHANNEL channel, uint16_t digit);
+	size_t push(ADS7828_CHANNEL channel, const uint16_t *digits, size_t count);
+	HAL_StatusTypeDef flush();
+	bool is_idle();
+
+	uint32_t get_frame_count();
+	uint32_t get_dropped_count();
+
+	// Forward HAL_UART_TxCpltCallback to this
+	void tx_complete_callback(UART_HandleTypeDef *huart);
+
+private:
+	bool add(uint8_t tag, uint16_t digit);
+	void send(uint8_t index);
+
+	UART_HandleTypeDef *_huart; // UART the frames are sent with
+
+	ADS7828_frame_t _frames[2];		// One frame is filled while the other one is sent
+	uint8_t _fill = 0;				// Index of the frame being filled
+	volatile bool _sending = false; // DMA transfer running
+	bool _pending = false;			// Filled frame waits for the running transfer
+	uint8_t _sequence = 0;			// Sequence number of the next frame
+
+	volatile uint32_t _frames_sent = 0; // Frames handed to the DMA
+	volatile uint32_t _dropped = 0;		// Samples lost because both frames were in use
+};
+
+#endif // HAL_UART_MODULE_ENABLED
+
+#endif // ADS7828_UART_HPP
@@ -0,0 +1,231 @@
+#include "ADS7828_usb.hpp"
+
+#ifdef ADS7828_USB_CDC
+
+#include "usbd_cdc_if.h"
+
+/**
+ * Constructor for the USB CDC export, the USB device has to be initialized by MX_USB_DEVICE_Init
+ */
+ADS7828_Usb::ADS7828_Usb()
+{
+}
+
+/**
+ * Adds a raw sample to the frame of a device, full frames are queued and sent as one 64 byte packet.
+ * Can be called from interrupts.
+ *
+ * @param device Index of the ADC (0 - ADS7828_USB_DEVICES - 1)
+ * @param channel The ADS7828_CHANNEL configuration of the sample
+ * @param digit The raw digit (0 - 4095)
+ * @return False if the sample was dropped because the queue is full
+ */
+bool ADS7828_Usb::push(uint8_t device, ADS7828_CHANNEL channel, uint16_t digit)
+{
+	if (device >= ADS7828_USB_DEVICES)
+	{
+		return false;
+	}
+
+	// The USB interrupt and the main loop use the queue as well
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	bool added = add(device, channel, digit);
+
+	__set_PRIMASK(primask);
+	return added;
+}
+
+/**
+ * Adds all channels of a completed scan frame, digits are rounded to integers
+ *
+ * @param device Index of the ADC (0 - ADS7828_USB_DEVICES - 1)
+ * @param results Result table indexed by ADS7828_CHANNEL
+ * @param channels Scanned channel list
+ * @param n Number of channels in the list
+ * @return False if samples were dropped
+ */
+bool ADS7828_Usb::push_frame(uint8_t device, const ADS7828_digit_t *results, const ADS7828_CHANNEL *channels, uint8_t n)
+{
+	if (device >= ADS7828_USB_DEVICES)
+	{
+		return false;
+	}
+
+	bool added = true;
+
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	for (uint8_t i = 0; i < n; i++)
+	{
+		added &= add(device, channels[i], ADS7828_round_digit(results[channels[i]]));
+	}
+
+	__set_PRIMASK(primask);
+	return added;
+}
+
+/**
+ * Queues the partly filled frames of all devices, e.g. at the end of a capture
+ */
+void ADS7828_Usb::flush()
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	for (uint8_t d = 0; d < ADS7828_USB_DEVICES; d++)
+	{
+		if (_filling[d].count != 0)
+		{
+			finish(d);
+		}
+	}
+
+	send_next();
+	__set_PRIMASK(primask);
+}
+
+/**
+ * Has to be called periodically from the main loop, hands waiting frames to the USB stack.
+ * Without tx_complete_callback, a sent frame is released once the next one is accepted.
+ */
+void ADS7828_Usb::poll()
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	send_next();
+
+	__set_PRIMASK(primask);
+}
+
+/**
+ * Get the number of frames sent since construction
+ *
+ * @return Number of frames handed to the USB stack
+ */
+uint32_t ADS7828_Usb::get_frame_count()
+{
+	return _frames_sent;
+}
+
+/**
+ * Get the number of samples that couldn't be queued, the host doesn't read fast enough then
+ *
+ * @return Number of dropped samples
+ */
+uint32_t ADS7828_Usb::get_dropped_count()
+{
+	return _dropped;
+}
+
+/**
+ * Frame callback for ADS7828_Scanner::set_frame_callback
+ *
+ * @param context Pointer to an ADS7828_usb_source_t
+ */
+void ADS7828_Usb::on_scan_frame(void *context, const ADS7828_digit_t *results, const ADS7828_CHANNEL *channels, uint8_t n)
+{
+	ADS7828_usb_source_t *source = static_cast<ADS7828_usb_source_t *>(context);
+	source->usb->push_frame(source->device, results, channels, n);
+}
+
+/**
+ * Releases the sent frame and sends the next one right away
+ */
+void ADS7828_Usb::tx_complete_callback()
+{
+	if (_in_flight)
+	{
+		_in_flight = false;
+		_head++;
+	}
+
+	send_next();
+}
+
+/**
+ * Adds a sample to the frame of a device, interrupts have to be disabled
+ *
+ * @return False if the sample was dropped
+ */
+bool ADS7828_Usb::add(uint8_t device, uint8_t tag, uint16_t digit)
+{
+	// A full frame is only kept if there was no free slot
+	if (_filling[device].is_full())
+	{
+		finish(device);
+
+		if (_filling[device].is_full())
+		{
+			_dropped++;
+			return false;
+		}
+	}
+
+	if (_filling[device].add(tag, digit))
+	{
+		finish(device);
+		send_next();
+	}
+
+	return true;
+}
+
+/**
+ * Moves the frame of a device into the queue, if there is a free slot
+ *
+ * @param device Index of the ADC
+ */
+void ADS7828_Usb::finish(uint8_t device)
+{
+	if ((uint8_t)(_tail - _head) >= ADS7828_USB_QUEUE)
+	{
+		return;
+	}
+
+	uint8_t slot = _tail & (ADS7828_USB_QUEUE - 1);
+	size_t length = _filling[device].finish(_sequence++, device);
+
+	for (size_t i = 0; i < length; i++)
+	{
+		_queue[slot][i] = _filling[device].data[i];
+	}
+
+	_lengths[slot] = (uint8_t)length;
+	_tail++;
+	_filling[device].clear();
+}
+
+/**
+ * Hands the oldest queued frame to the USB stack, interrupts have to be disabled.
+ * A busy endpoint means the previous frame is still on its way.
+ */
+void ADS7828_Usb::send_next()
+{
+	uint8_t next = _head;
+
+	// Without completion callback, the accepted transfer proves that the one in flight is done
+	if (_in_flight)
+	{
+		next = _head + 1;
+	}
+
+	if (next == _tail)
+	{
+		return;
+	}
+
+	uint8_t slot = next & (ADS7828_USB_QUEUE - 1);
+
+	if (CDC_Transmit_FS(_queue[slot], _lengths[slot]) == USBD_OK)
+	{
+		_head = _in_flight ? next : _head;
+		_in_flight = true;
+		_frames_sent++;
+	}
+}
+
+#endif // ADS7828_USB_CDC
@@ -0,0 +1,64 @@
+// Export of sample frames over USB CDC (virtual COM port)
+#ifndef ADS7828_USB_HPP
+#define ADS7828_USB_HPP
+
+#include "ADS7828.hpp"
+#include "ADS7828_frame.hpp"
+
+// Define to build the USB CDC export, requires the USB_DEVICE CDC middleware generated by CubeMX
+#ifdef ADS7828_USB_CDC
+
+// Number of devices with their own frame, the index is stored in the frame header
+constexpr uint8_t ADS7828_USB_DEVICES = 4;
+// Number of finished frames waiting for the host, has to be a power of two
+constexpr uint8_t ADS7828_USB_QUEUE = 8;
+
+static_assert(ADS7828_FRAME_SIZE <= 64, "A frame has to fit into one full-speed packet");
+
+class ADS7828_Usb
+{
+public:
+	ADS7828_Usb();
+
+	bool push(uint8_t device, ADS7828_CHANNEL channel, uint16_t digit);
+	bool push_frame(uint8_t device, const ADS7828_digit_t *results, const ADS7828_CHANNEL *channels, uint8_t n);
+	void flush();
+	void poll();
+
+	uint32_t get_frame_count();
+	uint32_t get_dropped_count();
+
+	// Frame callback for ADS7828_Scanner, the context has to point to an ADS7828_usb_source_t
+	static void on_scan_frame(void *context, const ADS7828_digit_t *results, const ADS7828_CHANNEL *channels, uint8_t n);
+
+	// Call from CDC_TransmitCplt_FS in usbd_cdc_if.c, or rely on poll() for older CubeMX versions without it
+	void tx_complete_callback();
+
+private:
+	bool add(uint8_t device, uint8_t tag, uint16_t digit);
+	void finish(uint8_t device);
+	void send_next();
+
+	ADS7828_frame_t _filling[ADS7828_USB_DEVICES]; // Frame being filled for every device
+
+	uint8_t _queue[ADS7828_USB_QUEUE][ADS7828_FRAME_SIZE]; // Finished frames, the head is sent or being sent
+	uint8_t _lengths[ADS7828_USB_QUEUE];				   // Number of bytes of every queued frame
+	volatile uint8_t _head = 0;							   // Oldest queued frame
+	volatile uint8_t _tail = 0;							   // Next free slot
+	volatile bool _in_flight = false;					   // Head was handed to the USB stack
+	uint8_t _sequence = 0;								   // Sequence number of the next frame
+
+	volatile uint32_t _frames_sent = 0; // Frames handed to the USB stack
+	volatile uint32_t _dropped = 0;		// Samples lost because the queue was full
+};
+
+// Connects an ADS7828_Scanner to the export, pass a pointer to it as frame callback context
+struct ADS7828_usb_source_t
+{
+	ADS7828_Usb *usb; // Export the frames are pushed to
+	uint8_t device;	  // Device index stored in the frame header
+};
+
+#endif // ADS7828_USB_CDC
+
+#endif // ADS7828_USB_HPP